@@ -1351,6 +1351,9 @@ app.definitions.Socket = L.Class.extend({
 					this.ReconnectCount = 0;
 					clearTimeout(this.timer);
 				}
+			} else if (info.id == 'download') {
+				// The document is being fetched from storage, value is a percentage.
+				this._map.showBusy(_('Downloading...') + (info.value !== undefined ? ' ' + info.value + '%' : ''), true);
 			} else if (info.id == 'start' || info.id == 'setvalue')
 				this._map.fire('statusindicator', info);
 
@@ -61,9 +61,15 @@ static const std::unordered_map<std::string, std::string> DefAppConfig = {
     { "cache_files.expiry_min", "3000" },
     { "certificates.database_path", "" },
     { "child_root_path", "jails" },
+    { "convert_cache.limit_dir_size_mb", "256" },
+    { "convert_cache.path", "" },
+    { "convert_cache[@enable]", "false" },
     { "deepl.api_url", "" },
     { "deepl.auth_key", "" },
     { "deepl.enabled", "false" },
+    { "document_cache.limit_dir_size_mb", "1024" },
+    { "document_cache.path", "" },
+    { "document_cache[@enable]", "false" },
     { "document_signing.enable", "true" },
     { "enable_websocket_urp", "false" },
     { "experimental_features", "false" },
@@ -112,6 +118,7 @@ static const std::unordered_map<std::string, std::string> DefAppConfig = {
 #if !MOBILEAPP
     // { "logging.anonymize.anonymize_user_data", "false" }, // Do not set to fallback on filename/username.
     { "logging.anonymize.anonymization_salt", "82589933" },
+    { "logging.async", "false" },
     { "logging.color", "true" },
     { "logging.disable_server_audit", "false" },
     { "logging.disabled_areas", "Socket,WebSocket,Admin,Pixel" },
@@ -152,6 +159,7 @@ static const std::unordered_map<std::string, std::string> DefAppConfig = {
     { "logging_ui_cmd.merge", "true" },
     { "logging_ui_cmd.merge_display_end_time", "false" },
 #endif
+    { "max_encoder_threads", "0" },
     { "mount_jail_tree", "true" },
     { "net.connection_timeout_secs", "30" },
     { "net.content_security_policy", "" },
@@ -203,6 +211,12 @@ static const std::unordered_map<std::string, std::string> DefAppConfig = {
     { "per_document.cleanup.limit_dirty_mem_mb", "3072" },
     { "per_document.cleanup.lost_kit_grace_period_secs", "120" },
     { "per_document.cleanup[@enable]", "true" },
+    { "per_document.convert_batch.max_documents", "1000" },
+    { "per_document.convert_batch.parallelism", "4" },
+    { "per_document.convert_kit_reuse.max_documents", "100" },
+    { "per_document.convert_kit_reuse.max_idle", "4" },
+    { "per_document.convert_kit_reuse.max_rss_mb", "1024" },
+    { "per_document.convert_kit_reuse[@enable]", "false" },
     { "per_document.idle_timeout_secs", "3600" },
     { "per_document.idlesave_duration_secs", "30" },
     { "per_document.limit_convert_secs", "100" },
@@ -216,7 +230,13 @@ static const std::unordered_map<std::string, std::string> DefAppConfig = {
     { "per_document.min_time_between_saves_ms", "500" },
     { "per_document.min_time_between_uploads_ms", "5000" },
     { "per_document.pdf_resolution_dpi", "96" },
+    { "per_document.poll_pool_threads", "0" },
     { "per_document.redlining_as_comments", "false" },
+    { "per_document.tile_coalesce_ms", "0" },
+    { "per_document.tile_compaction.max_delta_percent", "100" },
+    { "per_document.tile_compaction.max_deltas", "32" },
+    { "per_document.tile_compaction[@enable]", "false" },
+    { "per_document.tile_stream_batch", "0" },
     { "per_view.custom_os_info", "" },
     { "per_view.idle_timeout_secs", "900" },
     { "per_view.min_saved_message_timeout_secs", "6" },
@@ -374,6 +394,9 @@ std::map<std::string, std::string> extractAll(const Poco::Util::AbstractConfigur
     map.erase("net.lok_allow");
     map.erase("net.post_allow");
     map.erase("per_document.cleanup");
+    map.erase("per_document.convert_batch");
+    map.erase("per_document.convert_kit_reuse");
+    map.erase("per_document.tile_compaction");
     map.erase("ssl.hpkp");
     map.erase("ssl.hpkp.pins");
     map.erase("ssl.sts");
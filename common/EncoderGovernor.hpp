@@ -0,0 +1,257 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <common/Log.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <ostream>
+#include <thread>
+
+#if !MOBILEAPP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/// Caps the number of threads encoding tiles at once across all the Kit
+/// processes of the machine. Each Kit has its own ThreadPool, sized by
+/// MAX_CONCURRENCY, so without this many busy documents oversubscribe the
+/// cores during a burst, and everybody's tiles arrive late.
+///
+/// The budget lives in an anonymous shared mapping, created by ForKit before
+/// forking, and so inherited by all the Kits. The thread asking for tiles
+/// always encodes, so rendering never blocks on the budget; the pool gets
+/// extra threads only while the machine-wide total is under the limit.
+/// Renders of visible tiles get extra threads first: the others get none
+/// while any visible render is in progress.
+///
+/// Every Kit records what it holds in its own slot, so ForKit can return
+/// the tokens of a Kit that dies mid-render when it reaps it.
+class EncoderGovernor
+{
+    friend class EncoderGovernorTests;
+
+    /// The tokens held by one process.
+    struct Slot
+    {
+        std::atomic<pid_t> _pid;
+        std::atomic<int> _busy;
+        std::atomic<int> _urgent;
+    };
+
+    /// A Kit that finds no free slot is ungoverned.
+    static constexpr std::size_t MaxSlots = 4096;
+
+    struct State
+    {
+        explicit State(int limit)
+            : _limit(limit)
+            , _busy(0)
+            , _urgent(0)
+            , _granted(0)
+            , _denied(0)
+        {
+            for (Slot& slot : _slots)
+            {
+                slot._pid = 0;
+                slot._busy = 0;
+                slot._urgent = 0;
+            }
+        }
+
+        const int _limit; ///< The maximum number of threads encoding at once.
+        std::atomic<int> _busy; ///< The threads encoding now, machine-wide.
+        std::atomic<int> _urgent; ///< The renders of visible tiles in progress.
+        std::atomic<uint64_t> _granted; ///< Extra threads granted.
+        std::atomic<uint64_t> _denied; ///< Extra threads wanted, but not granted.
+        Slot _slots[MaxSlots];
+    };
+
+    // Shared between processes, so must not need a lock.
+    static_assert(std::atomic<int>::is_always_lock_free, "atomic<int> must be lock-free");
+    static_assert(std::atomic<pid_t>::is_always_lock_free, "atomic<pid_t> must be lock-free");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "atomic<uint64_t> must be lock-free");
+
+    static inline State* Shared = nullptr;
+    static inline std::atomic<Slot*> OwnSlot = nullptr; ///< Our slot, if we have one.
+    static inline std::atomic<pid_t> OwnPid = 0; ///< The process that OwnSlot belongs to.
+
+public:
+    /// Creates the budget of @maxThreads, to be shared with all the processes
+    /// forked hereafter. Zero, or less, for the number of CPU threads.
+    static void initialize(int maxThreads)
+    {
+#if !MOBILEAPP
+        if (Shared)
+            return;
+
+        if (maxThreads <= 0)
+            maxThreads = std::max<int>(std::thread::hardware_concurrency(), 1);
+
+        void* mem = mmap(nullptr, sizeof(State), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+        {
+            LOG_SYS("Failed to map the tile encoder budget, encoding is ungoverned");
+            return;
+        }
+
+        Shared = new (mem) State(maxThreads);
+        LOG_INF("Tile encoding is limited to " << maxThreads
+                                                << " threads across all documents");
+#else
+        (void)maxThreads;
+#endif
+    }
+
+    static bool isEnabled() { return Shared != nullptr; }
+
+    /// Called on the thread about to encode, which always counts towards the
+    /// budget, wanting @wanted more threads to help. Returns the number of extra
+    /// threads it may use. Must be paired with release() of what it returns.
+    static int acquire(int wanted, bool urgent)
+    {
+        Slot* slot = getSlot();
+        if (!slot)
+            return wanted;
+
+        // Our slot is updated first, so if we die midway ForKit returns too
+        // much rather than leaking, which would shrink the budget for good.
+        ++slot->_busy;
+        ++Shared->_busy;
+        if (urgent)
+        {
+            ++slot->_urgent;
+            ++Shared->_urgent;
+        }
+
+        int granted = 0;
+        if (urgent || Shared->_urgent == 0)
+        {
+            int busy = Shared->_busy;
+            while (granted < wanted && busy < Shared->_limit)
+            {
+                ++slot->_busy;
+                if (Shared->_busy.compare_exchange_weak(busy, busy + 1))
+                {
+                    ++granted;
+                    ++busy;
+                }
+                else
+                    --slot->_busy;
+            }
+        }
+
+        Shared->_granted += granted;
+        Shared->_denied += wanted - granted;
+        if (granted < wanted)
+            LOG_TRC("Tile encoding granted " << granted << " of " << wanted
+                                             << " extra threads, " << Shared->_busy << " of "
+                                             << Shared->_limit << " busy");
+        return granted;
+    }
+
+    /// Returns the tokens of the calling thread, and the @granted extra threads.
+    static void release(int granted, bool urgent)
+    {
+        Slot* slot = getSlot();
+        if (!slot)
+            return;
+
+        // The reverse of acquire(), for the same reason.
+        Shared->_busy -= granted + 1;
+        slot->_busy -= granted + 1;
+        if (urgent)
+        {
+            --Shared->_urgent;
+            --slot->_urgent;
+        }
+    }
+
+    /// Called when the process @pid is reaped, to return whatever its slots held.
+    static void releaseProcess(pid_t pid)
+    {
+        if (!Shared || pid <= 0)
+            return;
+
+        for (Slot& slot : Shared->_slots)
+        {
+            if (slot._pid != pid)
+                continue;
+
+            const int busy = slot._busy.exchange(0);
+            const int urgent = slot._urgent.exchange(0);
+            if (busy || urgent)
+            {
+                LOG_WRN("Process " << pid << " exited holding " << busy
+                                   << " tile encoding threads, returning them");
+                Shared->_busy -= busy;
+                Shared->_urgent -= urgent;
+            }
+
+            slot._pid = 0;
+        }
+    }
+
+    static void dumpState(std::ostream& oss)
+    {
+        if (!Shared)
+            return;
+
+        oss << "\tencoderGovernor:"
+            << "\n\t\tlimit: " << Shared->_limit << "\n\t\tbusy: " << Shared->_busy
+            << "\n\t\turgent: " << Shared->_urgent << "\n\t\tgranted: " << Shared->_granted
+            << "\n\t\tdenied: " << Shared->_denied << '\n';
+    }
+
+private:
+    /// Returns the slot of this process, claiming one the first time.
+    static Slot* getSlot()
+    {
+#if !MOBILEAPP
+        if (!Shared)
+            return nullptr;
+
+        // A forked child doesn't inherit the slot of its parent.
+        const pid_t pid = getpid();
+        if (OwnPid == pid)
+            return OwnSlot;
+
+        Slot* own = nullptr;
+        for (Slot& slot : Shared->_slots)
+        {
+            pid_t expected = 0;
+            if (slot._pid.compare_exchange_strong(expected, pid))
+            {
+                own = &slot;
+                break;
+            }
+        }
+
+        if (!own)
+            LOG_WRN("No free tile encoder budget slot, encoding is ungoverned");
+
+        // Racing threads may each claim a slot; all are returned when we're reaped.
+        OwnSlot = own;
+        OwnPid = pid;
+        return own;
+#else
+        return nullptr;
+#endif
+    }
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
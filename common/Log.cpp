@@ -19,20 +19,28 @@
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include <Poco/AutoPtr.h>
 #include <Poco/FileChannel.h>
 #include <Poco/Logger.h>
 
 #include "Log.hpp"
+#include "LogRing.hpp"
 #include "Util.hpp"
 
 namespace
@@ -184,13 +192,6 @@ namespace Log
         }
     };
 
-    void postFork()
-    {
-        /// after forking we can end up with threads that
-        /// logged in the parent confusing our counting.
-        ThreadLocalBufferCount = 0;
-    }
-
     class BufferedConsoleChannel : public ConsoleChannel
     {
         class ThreadLocalBuffer
@@ -372,6 +373,278 @@ namespace Log
         std::unordered_map<Poco::Message::Priority, std::string> _colorByPriority;
     };
 
+    /// Console channel that never writes from the logging threads.
+    /// Each thread appends its entries to its own lock-free ring, with
+    /// a single producer and a single consumer, which a dedicated writer
+    /// thread drains in batches. When a ring is full, the entry is dropped
+    /// and counted, unless it's a warning or more important, which is
+    /// written directly instead, so memory is bounded by the ring size
+    /// per thread and the logging threads are never blocked on the writer.
+    class AsyncConsoleChannel : public ConsoleChannel
+    {
+        /// Owns the ring of the current thread, and closes it on thread exit.
+        struct ThreadLocalRing
+        {
+            ~ThreadLocalRing()
+            {
+                if (_ring)
+                    _ring->close();
+            }
+
+            std::shared_ptr<Ring> _ring;
+        };
+
+        /// The state shared with the writer thread. It's never destroyed,
+        /// so the writer can outlive the channel and static destruction.
+        struct Shared
+        {
+            std::thread _writer;
+            std::mutex _mutex; ///< Protects the writer state.
+            std::condition_variable _cv;
+            bool _stop = false;
+            int _openCount = 0; ///< The open channels, which share the writer.
+            std::atomic<bool> _wakeup{ false };
+            /// Serializes the writing out of the rings, which have one consumer.
+            std::mutex _drainMutex;
+            std::vector<std::shared_ptr<Ring>> _rings;
+            std::atomic<std::uint64_t> _dropped{ 0 }; ///< Since the last report.
+            std::atomic<std::uint64_t> _droppedTotal{ 0 };
+            bool _forked = false;
+        };
+
+        static Shared& shared()
+        {
+            static Shared* const state = new Shared();
+            return *state;
+        }
+
+        /// Don't let a single large entry hog the ring of its thread.
+        static constexpr std::size_t MaxEntrySize = Ring::Size / 8;
+        /// How often the writer drains the rings, unless woken up earlier.
+        static constexpr std::chrono::milliseconds DrainInterval = std::chrono::milliseconds(20);
+
+    public:
+        AsyncConsoleChannel()
+            : _open(false)
+        {
+        }
+
+        ~AsyncConsoleChannel() { close(); }
+
+        /// Start the writer thread, unless another channel has already.
+        void open() override
+        {
+            Shared& state = shared();
+            std::lock_guard<std::mutex> lock(state._mutex);
+            if (state._forked || _open)
+                return;
+
+            _open = true;
+            if (state._openCount++ > 0)
+                return;
+
+            state._stop = false;
+            state._writer = std::thread(
+                []
+                {
+                    Util::setThreadName("log_writer");
+                    writerLoop();
+                });
+
+            // Don't lose the last entries when exiting without shutting down.
+            static std::once_flag once;
+            std::call_once(once, [] { std::atexit(flush); });
+        }
+
+        /// Stop the writer thread, when no other channel is open, writing
+        /// out all the pending entries.
+        void close() override
+        {
+            Shared& state = shared();
+            if (state._forked)
+                return;
+
+            std::thread writer;
+            {
+                std::lock_guard<std::mutex> lock(state._mutex);
+                if (!_open)
+                    return;
+
+                _open = false;
+                if (--state._openCount > 0)
+                    return;
+
+                writer = std::move(state._writer);
+                state._stop = true;
+            }
+
+            state._cv.notify_all();
+            if (writer.joinable())
+                writer.join();
+
+            flush();
+        }
+
+        /// Write out the pending entries of all threads, from the calling thread.
+        static void flush()
+        {
+            Shared& state = shared();
+            if (state._forked)
+                return;
+
+            std::lock_guard<std::mutex> lock(state._drainMutex);
+            drainAll(state);
+            ConsoleChannel::flush();
+        }
+
+        /// The number of entries dropped because the writer fell behind.
+        static std::uint64_t droppedCount() { return shared()._droppedTotal; }
+
+        /// Have the writer thread write out the pending entries soon.
+        static void wakeup() { wakeWriter(shared()); }
+
+        /// After forking, the writer thread doesn't exist in the child, the
+        /// locks might be held by it, and the rings of the other threads will
+        /// never be appended to. Write directly from now on.
+        static void postFork()
+        {
+            Shared& state = shared();
+            if (!state._forked && state._writer.joinable())
+            {
+                // There is no thread to join; leak its handle instead.
+                new (&state._writer) std::thread();
+            }
+
+            state._forked = true;
+            _threadRing._ring.reset();
+        }
+
+        void log(const Poco::Message& msg) override
+        {
+            Shared& state = shared();
+            const std::string& s = msg.getText();
+            if (state._forked)
+            {
+                ConsoleChannel::log(s.data(), s.size());
+                return;
+            }
+
+            const bool important = msg.getPriority() <= Message::PRIO_WARNING;
+            if (s.size() > MaxEntrySize)
+            {
+                // Can't buffer it, but preserve the order of the entries of this thread.
+                std::lock_guard<std::mutex> lock(state._drainMutex);
+                if (_threadRing._ring)
+                    drain(*_threadRing._ring);
+                ConsoleChannel::log(s.data(), s.size());
+                return;
+            }
+
+            Ring& ring = threadRing(state);
+            if (!ring.push(s.data(), s.size()))
+            {
+                if (!important)
+                {
+                    ++state._dropped;
+                    ++state._droppedTotal;
+                    wakeWriter(state);
+                    return;
+                }
+
+                // Never lose important entries, even if it means blocking.
+                std::lock_guard<std::mutex> lock(state._drainMutex);
+                drain(ring);
+                ConsoleChannel::log(s.data(), s.size());
+                return;
+            }
+
+            // Don't wait to write out important entries and filling rings.
+            if (important || ring.pending() >= Ring::Size / 2)
+                wakeWriter(state);
+        }
+
+    private:
+        /// Writes out the complete entries of @ring. Must be called with _drainMutex held.
+        static void drain(Ring& ring)
+        {
+            ring.drain([](const char* data, std::size_t size) { writeRaw(data, size); });
+        }
+
+        /// Returns the ring of the calling thread, registering it on first use.
+        static Ring& threadRing(Shared& state)
+        {
+            if (!_threadRing._ring)
+            {
+                _threadRing._ring = std::make_shared<Ring>();
+                std::lock_guard<std::mutex> lock(state._drainMutex);
+                state._rings.push_back(_threadRing._ring);
+            }
+
+            return *_threadRing._ring;
+        }
+
+        static void wakeWriter(Shared& state)
+        {
+            state._wakeup = true;
+            state._cv.notify_one();
+        }
+
+        static void writerLoop()
+        {
+            Shared& state = shared();
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(state._mutex);
+                    state._cv.wait_for(lock, DrainInterval,
+                                       [&state] { return state._wakeup || state._stop; });
+                    state._wakeup = false;
+                    if (state._stop)
+                        break;
+                }
+
+                std::lock_guard<std::mutex> lock(state._drainMutex);
+                drainAll(state);
+            }
+        }
+
+        /// Writes out, and frees the closed, rings. Must be called with _drainMutex held.
+        static void drainAll(Shared& state)
+        {
+            for (auto it = state._rings.begin(); it != state._rings.end();)
+            {
+                // Check before draining, so we don't miss the last entries.
+                const bool closed = (*it)->isClosed();
+                drain(**it);
+                it = closed ? state._rings.erase(it) : std::next(it);
+            }
+
+            const std::uint64_t dropped = state._dropped.exchange(0);
+            if (dropped)
+            {
+                char buffer[1024];
+                std::string text = Log::prefix<sizeof(buffer) - 1>(buffer, "WRN");
+                text += "Dropped " + std::to_string(dropped) +
+                        " log entries, the log writer is falling behind\n";
+                writeRaw(text.data(), text.size());
+            }
+        }
+
+        bool _open; ///< Whether this channel holds a reference to the writer.
+        static thread_local ThreadLocalRing _threadRing;
+    };
+
+    thread_local AsyncConsoleChannel::ThreadLocalRing AsyncConsoleChannel::_threadRing;
+
+    void postFork()
+    {
+        /// after forking we can end up with threads that
+        /// logged in the parent confusing our counting.
+        ThreadLocalBufferCount = 0;
+
+        AsyncConsoleChannel::postFork();
+    }
+
     /// Helper to avoid destruction ordering issues.
     static struct StaticHelper
     {
@@ -642,6 +915,11 @@ namespace Log
         {
             channel = static_cast<Poco::Channel*>(new Log::ColorConsoleChannel());
         }
+        else if (config.count("async") && Util::toLower(config.at("async")) == "true")
+        {
+            // Asynchronous logging, the entries are written by a dedicated thread.
+            channel = static_cast<Poco::Channel*>(new Log::AsyncConsoleChannel());
+        }
         else
         {
             const auto it = config.find("flush");
@@ -801,11 +1079,17 @@ namespace Log
     void flush()
     {
         BufferedConsoleChannel::flush();
+        AsyncConsoleChannel::wakeup();
 
         fflush(stdout);
         fflush(stderr);
     }
 
+    std::uint64_t droppedCount()
+    {
+        return AsyncConsoleChannel::droppedCount();
+    }
+
     void setThreadLocalLogLevel(const std::string& logLevel)
     {
         if (!Static.getLogger())
@@ -17,6 +17,7 @@
 
 #include <cerrno>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <thread>
@@ -78,6 +79,9 @@ namespace Log
 
     void flush();
 
+    /// The number of entries dropped by the asynchronous console logging.
+    std::uint64_t droppedCount();
+
     /// Cleanup state after forking
     void postFork();
 
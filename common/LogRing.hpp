@@ -0,0 +1,95 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Log
+{
+/// A ring of complete, new-line terminated, log entries, with a single
+/// producer, the thread that logs, and a single consumer, the writer.
+class Ring
+{
+public:
+    static constexpr std::size_t Size = 128 * 1024; // Must be a power of 2.
+    static constexpr std::size_t Mask = Size - 1;
+    static_assert((Size & Mask) == 0, "Ring size must be a power of 2");
+
+    Ring()
+        : _head(0)
+        , _tail(0)
+        , _closed(false)
+    {
+    }
+
+    /// Called by the owner thread only. Returns false when full.
+    bool push(const char* data, std::size_t size)
+    {
+        const std::uint64_t head = _head.load(std::memory_order_relaxed);
+        const std::uint64_t tail = _tail.load(std::memory_order_acquire);
+        if (Size - (head - tail) < size + 1)
+            return false;
+
+        const std::size_t begin = head & Mask;
+        const std::size_t first = std::min(size, Size - begin);
+        std::memcpy(_buffer + begin, data, first);
+        std::memcpy(_buffer, data + first, size - first);
+        _buffer[(head + size) & Mask] = '\n';
+
+        // Publish the complete entry.
+        _head.store(head + size + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// The bytes pending, which can be a stale under-estimate.
+    std::size_t pending() const
+    {
+        return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_relaxed);
+    }
+
+    /// Called by the consumer only. Passes all the complete entries to @write,
+    /// as one or, when they wrap around the end of the buffer, two pieces.
+    template <typename WriteFn> void drain(WriteFn write)
+    {
+        const std::uint64_t tail = _tail.load(std::memory_order_relaxed);
+        const std::uint64_t head = _head.load(std::memory_order_acquire);
+        if (head == tail)
+            return;
+
+        const std::size_t begin = tail & Mask;
+        const std::size_t size = head - tail;
+        const std::size_t first = std::min(size, Size - begin);
+        write(_buffer + begin, first);
+        if (size > first)
+            write(_buffer, size - first);
+
+        _tail.store(head, std::memory_order_release);
+    }
+
+    /// Set when the owner thread exits, to free the ring once drained.
+    void close() { _closed = true; }
+    bool isClosed() const { return _closed; }
+
+private:
+    std::atomic<std::uint64_t> _head; ///< Written up to here by the owner thread.
+    std::atomic<std::uint64_t> _tail; ///< Written out up to here by the consumer.
+    std::atomic<bool> _closed;
+    char _buffer[Size];
+};
+
+} // namespace Log
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -53,12 +53,18 @@
 #include <png.h>
 #include <zlib.h>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iomanip>
 #include <fstream>
+#include <vector>
 
 #include "Log.hpp"
+#include "ThreadPool.hpp"
 #include "TraceEvent.hpp"
 
 namespace Png
@@ -86,7 +92,7 @@ extern "C"
 
 
 /* Unpremultiplies data and converts native endian BGRA => RGBA bytes */
-static void
+inline void
 unpremultiply_bgra_data (png_structp /*png*/, png_row_infop row_info, png_bytep data)
 {
     unsigned int i;
@@ -122,7 +128,7 @@ unpremultiply_bgra_data (png_structp /*png*/, png_row_infop row_info, png_bytep
 }
 
 /* Unpremultiplies data already in RGBA order*/
-static void
+inline void
 unpremultiply_rgba_data (png_structp /*png*/, png_row_infop row_info, png_bytep data)
 {
     unsigned int i;
@@ -154,6 +160,70 @@ unpremultiply_rgba_data (png_structp /*png*/, png_row_infop row_info, png_bytep
     }
 }
 
+/// Table of (value * 255 + alpha / 2) / alpha for every alpha and value,
+/// so that unpremultiplying costs a load instead of a divide per channel.
+inline const uint8_t* getUnpremultiplyTable()
+{
+    static const std::array<uint8_t, 256 * 256> table = []()
+    {
+        std::array<uint8_t, 256 * 256> t{};
+        for (unsigned alpha = 1; alpha < 256; ++alpha)
+            for (unsigned value = 0; value < 256; ++value)
+                t[alpha * 256 + value] = (value * 255 + alpha / 2) / alpha;
+        return t;
+    }();
+    return table.data();
+}
+
+/// Unpremultiplies a sub-buffer of the pixmap into RGBA bytes in a single
+/// pass, with the same results as the unpremultiply_*_data callbacks above.
+/// The result is stored in a per-thread scratch buffer with a stride of
+/// width * 4, which is valid until the next call on the same thread.
+inline const unsigned char* unpremultiplySubBuffer(const unsigned char* pixmap, size_t startX,
+                                                   size_t startY, int width, int height,
+                                                   int bufferWidth, LibreOfficeKitTileMode mode)
+{
+    thread_local std::vector<unsigned char> scratch;
+    const size_t rowBytes = static_cast<size_t>(width) * 4;
+    if (scratch.size() < rowBytes * height)
+        scratch.resize(rowBytes * height);
+
+    const uint8_t* table = getUnpremultiplyTable();
+    const bool bgra = (mode == LOK_TILEMODE_BGRA);
+    for (int y = 0; y < height; ++y)
+    {
+        const unsigned char* src = pixmap + ((startY + y) * bufferWidth + startX) * 4;
+        unsigned char* dest = scratch.data() + y * rowBytes;
+        for (int x = 0; x < width; ++x, src += 4, dest += 4)
+        {
+            uint32_t pix;
+            std::memcpy(&pix, src, sizeof(uint32_t));
+
+            const uint32_t alpha = pix >> 24;
+            const uint32_t first = bgra ? (pix >> 16) & 0xff : pix & 0xff;
+            const uint32_t second = (pix >> 8) & 0xff;
+            const uint32_t third = bgra ? pix & 0xff : (pix >> 16) & 0xff;
+            if (alpha == 255)
+            {
+                dest[0] = first;
+                dest[1] = second;
+                dest[2] = third;
+                dest[3] = 255;
+            }
+            else
+            {
+                // The alpha == 0 row of the table is all zeros.
+                const uint8_t* row = table + alpha * 256;
+                dest[0] = row[first];
+                dest[1] = row[second];
+                dest[2] = row[third];
+                dest[3] = alpha;
+            }
+        }
+    }
+
+    return scratch.data();
+}
 
 /// This function uses setjmp which may clobbers non-trivial objects.
 /// So we can't use logging or create complex C++ objects in this frame.
@@ -172,6 +242,15 @@ inline bool impl_encodeSubBufferToPNG(unsigned char* pixmap, size_t startX, size
         return false;
     }
 
+    // Convert up-front rather than in a per-row libpng transform, and
+    // reserve the worst case output so that writing never reallocates.
+    const unsigned char* rgba =
+        unpremultiplySubBuffer(pixmap, startX, startY, width, height, bufferWidth, mode);
+    const size_t rowBytes = static_cast<size_t>(width) * 4;
+    const uLong rawSize = (rowBytes + 1) * height;
+    output.reserve(output.size() + compressBound(rawSize) + 12 * (rawSize / PNG_ZBUF_SIZE + 1) +
+                   64);
+
     png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
 
     png_infop info_ptr = png_create_info_struct(png_ptr);
@@ -201,21 +280,8 @@ inline bool impl_encodeSubBufferToPNG(unsigned char* pixmap, size_t startX, size
 
     png_write_info(png_ptr, info_ptr);
 
-    switch (mode)
-    {
-        case LOK_TILEMODE_BGRA:
-            png_set_write_user_transform_fn (png_ptr, unpremultiply_bgra_data);
-            break;
-        case LOK_TILEMODE_RGBA:
-            png_set_write_user_transform_fn (png_ptr, unpremultiply_rgba_data);
-            break;
-    }
-
     for (int y = 0; y < height; ++y)
-    {
-        size_t position = ((startY + y) * bufferWidth * 4) + (startX * 4);
-        png_write_row(png_ptr, pixmap + position);
-    }
+        png_write_row(png_ptr, const_cast<unsigned char*>(rgba) + y * rowBytes);
 
     png_write_end(png_ptr, info_ptr);
 
@@ -272,6 +338,220 @@ bool encodeBufferToPNG(unsigned char* pixmap, int width, int height,
     return encodeSubBufferToPNG(pixmap, 0, 0, width, height, width, height, output, mode);
 }
 
+/// Writes the PNG filter type byte, followed by the filtered row, to @out,
+/// using whichever of the None, Sub, Up and Paeth filters minimizes the
+/// sum of absolute differences, as libpng's adaptive filtering does.
+/// @prev is the previous row, or nullptr for the first row of the image.
+inline void filterRow(const unsigned char* row, const unsigned char* prev, size_t rowBytes,
+                      unsigned char* out)
+{
+    constexpr size_t bpp = 4;
+    thread_local std::vector<unsigned char> scratch;
+    if (scratch.size() < rowBytes * 3)
+        scratch.resize(rowBytes * 3);
+
+    unsigned char* sub = scratch.data();
+    unsigned char* up = sub + rowBytes;
+    unsigned char* paeth = up + rowBytes;
+    size_t sums[4] = { 0, 0, 0, 0 };
+    for (size_t i = 0; i < rowBytes; ++i)
+    {
+        const int a = i >= bpp ? row[i - bpp] : 0;
+        const int b = prev ? prev[i] : 0;
+        const int c = prev && i >= bpp ? prev[i - bpp] : 0;
+
+        const int p = a + b - c;
+        const int pa = std::abs(p - a);
+        const int pb = std::abs(p - b);
+        const int pc = std::abs(p - c);
+        const int predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+
+        sub[i] = row[i] - a;
+        up[i] = row[i] - b;
+        paeth[i] = row[i] - predictor;
+
+        // The filtered bytes are signed for the heuristic.
+        sums[0] += std::abs(static_cast<signed char>(row[i]));
+        sums[1] += std::abs(static_cast<signed char>(sub[i]));
+        sums[2] += std::abs(static_cast<signed char>(up[i]));
+        sums[3] += std::abs(static_cast<signed char>(paeth[i]));
+    }
+
+    static constexpr unsigned char types[4] = { 0, 1, 2, 4 }; // None, Sub, Up, Paeth.
+    const size_t best = std::min_element(std::begin(sums), std::end(sums)) - std::begin(sums);
+    const unsigned char* filtered[4] = { row, sub, up, paeth };
+    out[0] = types[best];
+    std::memcpy(out + 1, filtered[best], rowBytes);
+}
+
+/// A horizontal strip of an image, filtered and compressed independently.
+struct DeflatedStrip
+{
+    int _startRow;
+    int _rows;
+    std::vector<char> _data; ///< Raw deflate data, without a zlib header.
+    uLong _adler; ///< The Adler-32 checksum of the filtered rows.
+    uLong _size; ///< The size of the filtered rows.
+    bool _ok;
+};
+
+/// Unpremultiplies, filters and deflates a strip of the image. All but
+/// the last strip end with a sync flush, so they can be concatenated.
+inline void deflateStrip(const unsigned char* pixmap, size_t startX, size_t startY, int width,
+                         int bufferWidth, LibreOfficeKitTileMode mode, int level, bool last,
+                         DeflatedStrip& strip)
+{
+    strip._ok = false;
+
+    // The row before the strip is needed to filter its first row.
+    const int context = strip._startRow > 0 ? 1 : 0;
+    const unsigned char* rgba =
+        unpremultiplySubBuffer(pixmap, startX, startY + strip._startRow - context, width,
+                               strip._rows + context, bufferWidth, mode);
+    const size_t rowBytes = static_cast<size_t>(width) * 4;
+
+    std::vector<unsigned char> filtered((rowBytes + 1) * strip._rows);
+    for (int y = 0; y < strip._rows; ++y)
+    {
+        const unsigned char* row = rgba + (y + context) * rowBytes;
+        filterRow(row, y + context > 0 ? row - rowBytes : nullptr, rowBytes,
+                  filtered.data() + y * (rowBytes + 1));
+    }
+
+    strip._size = filtered.size();
+    strip._adler = adler32(adler32(0L, Z_NULL, 0), filtered.data(), filtered.size());
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return;
+
+    // The bound is for a complete stream; leave room for the flush marker.
+    strip._data.resize(deflateBound(&stream, filtered.size()) + 16);
+    stream.next_in = filtered.data();
+    stream.avail_in = filtered.size();
+    stream.next_out = reinterpret_cast<Bytef*>(strip._data.data());
+    stream.avail_out = strip._data.size();
+
+    const int rc = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    strip._ok = stream.avail_in == 0 && stream.avail_out > 0 &&
+                (last ? rc == Z_STREAM_END : rc == Z_OK);
+    strip._data.resize(stream.total_out);
+    deflateEnd(&stream);
+}
+
+inline void appendBigEndian32(std::vector<char>& output, uint32_t value)
+{
+    const char bytes[4] = { static_cast<char>(value >> 24), static_cast<char>(value >> 16),
+                            static_cast<char>(value >> 8), static_cast<char>(value) };
+    output.insert(output.end(), bytes, bytes + 4);
+}
+
+/// Completes the chunk started at @chunkStart, with all the data
+/// appended since, by setting its length and appending its CRC.
+inline void finishChunk(std::vector<char>& output, size_t chunkStart)
+{
+    // The chunk starts with a placeholder length, followed by the type.
+    const size_t length = output.size() - chunkStart - 8;
+    output[chunkStart] = static_cast<char>(length >> 24);
+    output[chunkStart + 1] = static_cast<char>(length >> 16);
+    output[chunkStart + 2] = static_cast<char>(length >> 8);
+    output[chunkStart + 3] = static_cast<char>(length);
+
+    const uLong crc = crc32(crc32(0L, Z_NULL, 0),
+                            reinterpret_cast<const Bytef*>(output.data() + chunkStart + 4),
+                            length + 4);
+    appendBigEndian32(output, crc);
+}
+
+inline void startChunk(std::vector<char>& output, const char type[4])
+{
+    appendBigEndian32(output, 0); // Set by finishChunk.
+    output.insert(output.end(), type, type + 4);
+}
+
+/// Encodes a large image, such as a slide layer, to PNG by filtering and
+/// compressing horizontal strips of it in parallel on the given pool, and
+/// concatenating them into a single IDAT, as pigz does. The strips don't
+/// share the compression dictionary, which costs little in size for
+/// strips of this height. Small images are encoded with libpng instead.
+inline bool encodeSubBufferToPNGInStrips(unsigned char* pixmap, size_t startX, size_t startY,
+                                         int width, int height, int bufferWidth,
+                                         int bufferHeight, std::vector<char>& output,
+                                         LibreOfficeKitTileMode mode, ThreadPool& pool)
+{
+    constexpr int StripRows = 64;
+    if (height < StripRows * 2 || bufferWidth < width || bufferHeight < height)
+        return encodeSubBufferToPNG(pixmap, startX, startY, width, height, bufferWidth,
+                                    bufferHeight, output, mode);
+
+    ProfileZone pz("encodeSubBufferToPNGInStrips");
+
+    // Same as in impl_encodeSubBufferToPNG.
+    const int level = Util::isMobileApp() ? Z_BEST_SPEED : 4;
+
+    std::vector<DeflatedStrip> strips((height + StripRows - 1) / StripRows);
+    for (size_t i = 0; i < strips.size(); ++i)
+    {
+        DeflatedStrip& strip = strips[i];
+        strip._startRow = i * StripRows;
+        strip._rows = std::min(StripRows, height - strip._startRow);
+        const bool last = (i == strips.size() - 1);
+        pool.pushWork(
+            [pixmap, startX, startY, width, bufferWidth, mode, level, last, &strip]()
+            { deflateStrip(pixmap, startX, startY, width, bufferWidth, mode, level, last, strip); });
+    }
+
+    pool.run();
+
+    size_t size = 0;
+    for (const DeflatedStrip& strip : strips)
+    {
+        if (!strip._ok)
+        {
+            LOG_WRN("Failed to compress a PNG strip, encoding the whole image instead");
+            return encodeSubBufferToPNG(pixmap, startX, startY, width, height, bufferWidth,
+                                        bufferHeight, output, mode);
+        }
+
+        size += strip._data.size();
+    }
+
+    output.reserve(output.size() + size + 128);
+
+    static constexpr unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    output.insert(output.end(), signature, signature + sizeof(signature));
+
+    size_t chunkStart = output.size();
+    startChunk(output, "IHDR");
+    appendBigEndian32(output, width);
+    appendBigEndian32(output, height);
+    // 8 bits per channel, RGBA, deflate, adaptive filtering, no interlacing.
+    static constexpr char header[5] = { 8, 6, 0, 0, 0 };
+    output.insert(output.end(), header, header + sizeof(header));
+    finishChunk(output, chunkStart);
+
+    chunkStart = output.size();
+    startChunk(output, "IDAT");
+    // The zlib header: deflate with a 32K window, at the default level.
+    output.push_back(0x78);
+    output.push_back(static_cast<char>(0x9c));
+    uLong adler = adler32(0L, Z_NULL, 0);
+    for (const DeflatedStrip& strip : strips)
+    {
+        output.insert(output.end(), strip._data.begin(), strip._data.end());
+        adler = adler32_combine(adler, strip._adler, strip._size);
+    }
+    appendBigEndian32(output, adler);
+    finishChunk(output, chunkStart);
+
+    chunkStart = output.size();
+    startChunk(output, "IEND");
+    finishChunk(output, chunkStart);
+
+    return true;
+}
+
 static
 void readTileData(png_structp png_ptr, png_bytep data, png_size_t length)
 {
@@ -11,7 +11,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <memory>
 #include <queue>
 #include <thread>
@@ -64,6 +66,62 @@ namespace RenderTiles
         return nextId;
     }
 
+    /// Latency distribution, in power-of-two millisecond buckets, from the start of
+    /// a render to the moment its tiles are handed over to be sent.
+    class LatencyHistogram
+    {
+        static constexpr size_t Buckets = 12;
+        std::atomic<size_t> _buckets[Buckets] = {};
+
+    public:
+        void add(std::chrono::steady_clock::duration duration)
+        {
+            const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+            size_t bucket = 0;
+            while (bucket < Buckets - 1 && ms >= (1 << bucket))
+                ++bucket;
+            _buckets[bucket]++;
+        }
+
+        void dumpState(std::ostream& oss, const char* legend) const
+        {
+            oss << "\t" << legend << ':';
+            for (size_t i = 0; i < Buckets; ++i)
+            {
+                if (i < Buckets - 1)
+                    oss << " <" << (1 << i) << "ms: " << _buckets[i];
+                else
+                    oss << " >=" << (1 << (i - 1)) << "ms: " << _buckets[i];
+            }
+            oss << '\n';
+        }
+    };
+
+    /// Time until the first tile of a render is sent.
+    static LatencyHistogram& getFirstTileLatency()
+    {
+        static LatencyHistogram histogram;
+        return histogram;
+    }
+
+    /// Time until the last tile of a render is sent.
+    static LatencyHistogram& getLastTileLatency()
+    {
+        static LatencyHistogram histogram;
+        return histogram;
+    }
+
+    static void dumpState(std::ostream& oss)
+    {
+        oss << "\trenderTiles:\n";
+        getFirstTileLatency().dumpState(oss, "\tfirstTileLatency");
+        getLastTileLatency().dumpState(oss, "\tlastTileLatency");
+    }
+
+    /// Renders and encodes the tiles of @tileCombined. When @streamBatchSize
+    /// is non-zero, encoded tiles are sent in batches of at least that many as
+    /// they complete, otherwise all tiles are sent in one message at the end.
+    /// @visible tiles, that a client is waiting for, get encoding threads first.
     bool doRender(
         const std::shared_ptr<lok::Document>& document, DeltaGenerator& deltaGen,
         TileCombined& tileCombined, ThreadPool& pngPool,
@@ -71,7 +129,8 @@ namespace RenderTiles
                                  size_t pixmapHeight, int pixelWidth, int pixelHeight,
                                  LibreOfficeKitTileMode mode)>& blendWatermark,
         const std::function<void(const char* buffer, size_t length)>& outputMessage,
-        [[maybe_unused]] unsigned mobileAppDocId, CanonicalViewId canonicalViewId, bool dumpTiles)
+        [[maybe_unused]] unsigned mobileAppDocId, CanonicalViewId canonicalViewId, bool dumpTiles,
+        size_t streamBatchSize = 0, bool visible = false)
     {
         const auto& tiles = tileCombined.getTiles();
 
@@ -137,13 +196,68 @@ namespace RenderTiles
 
         const auto mode = static_cast<LibreOfficeKitTileMode>(document->getTileMode());
 
-        const size_t pixmapSize = 4 * pixmapWidth * pixmapHeight;
-        std::vector<char> output;
-        output.reserve(pixmapSize);
-
         // Compress the area as tiles
-        TileCombinedBuilder renderedTiles;
-        std::vector<TileWireId> renderingIds;
+        struct EncodedTile
+        {
+            size_t _index;
+            TileWireId _wireId;
+            std::vector<char> _data;
+        };
+
+        // Tiles encoded by the pool, but not yet sent.
+        std::vector<EncodedTile> encodedTiles;
+        encodedTiles.reserve(tiles.size());
+        size_t tilesSent = 0;
+
+        // Frames and sends the given encoded tiles, either as one tilecombine:
+        // message or as individual tile: messages.
+        const auto sendTiles = [&](const std::vector<EncodedTile>& encoded)
+        {
+            if (encoded.empty())
+                return;
+
+            if (tilesSent == 0)
+                getFirstTileLatency().add(std::chrono::steady_clock::now() - start);
+            tilesSent += encoded.size();
+
+            if (tileCombined.getCombined())
+            {
+                TileCombinedBuilder renderedTiles;
+                size_t outputSize = 0;
+                for (const EncodedTile& tile : encoded)
+                {
+                    renderedTiles.pushRendered(tiles[tile._index], tile._wireId, tile._data.size());
+                    outputSize += tile._data.size();
+                }
+
+                const std::string tileMsg = renderedTiles.serialize("tilecombine:", "\n");
+
+                LOG_TRC("Sending back painted tiles for " << tileMsg << " of size " << outputSize
+                                                          << " bytes) for: " << tileMsg);
+
+                const size_t responseSize = tileMsg.size() + outputSize;
+                std::unique_ptr<char[]> response(std::make_unique<char[]>(responseSize));
+                char* pos = std::copy(tileMsg.begin(), tileMsg.end(), response.get());
+                for (const EncodedTile& tile : encoded)
+                    pos = std::copy(tile._data.begin(), tile._data.end(), pos);
+                outputMessage(response.get(), responseSize);
+            }
+            else
+            {
+                for (const EncodedTile& tile : encoded)
+                {
+                    TileDesc desc = tiles[tile._index];
+                    desc.setWireId(tile._wireId);
+                    desc.setImgSize(tile._data.size());
+                    const std::string tileMsg = desc.serialize("tile:", "\n");
+                    const size_t responseSize = tileMsg.size() + tile._data.size();
+                    std::unique_ptr<char[]> response(std::make_unique<char[]>(responseSize));
+                    std::copy(tileMsg.begin(), tileMsg.end(), response.get());
+                    std::copy(tile._data.begin(), tile._data.end(), response.get() + tileMsg.size());
+                    outputMessage(response.get(), responseSize);
+                }
+            }
+        };
 
         size_t tileIndex = 0;
 
@@ -172,13 +286,11 @@ namespace RenderTiles
             bool skipCompress = false;
             if (!skipCompress)
             {
-                renderingIds.push_back(wireId);
-
                 LOG_TRC("Queued encoding of tile #" << tileIndex << " at (" << positionX << ',' << positionY << ") with " <<
                         (forceKeyframe?"force keyframe" : "allow delta") << ", wireId: " << wireId);
 
                 // Queue to be executed later in parallel inside 'run'
-                pngPool.pushWork([=,&output,&pixmap,&tiles,&renderedTiles,
+                pngPool.pushWork([=,&encodedTiles,&pixmap,&tiles,
                                   &pngMutex,&deltaGen]()
                     {
                         std::vector< char > data;
@@ -219,14 +331,34 @@ namespace RenderTiles
 
                         LOG_TRC("Tile " << tileIndex << " is " << data.size() << " bytes.");
                         std::unique_lock<std::mutex> pngLock(pngMutex);
-                        output.insert(output.end(), data.begin(), data.end());
-                        renderedTiles.pushRendered(tiles[tileIndex], wireId, data.size());
+                        encodedTiles.push_back(EncodedTile{ tileIndex, wireId, std::move(data) });
                     });
             }
             tileIndex++;
         }
 
-        pngPool.run();
+        if (streamBatchSize > 0)
+        {
+            // Send tiles on the rendering thread as soon as enough of them
+            // are encoded, rather than waiting for the slowest one.
+            std::vector<EncodedTile> batch;
+            pngPool.run(
+                [&]()
+                {
+                    {
+                        std::unique_lock<std::mutex> pngLock(pngMutex);
+                        if (encodedTiles.size() < streamBatchSize)
+                            return;
+                        std::swap(batch, encodedTiles);
+                    }
+
+                    sendTiles(batch);
+                    batch.clear();
+                },
+                visible);
+        }
+        else
+            pngPool.run(nullptr, visible);
 
         duration = std::chrono::steady_clock::now() - start;
         const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(duration);
@@ -239,33 +371,10 @@ namespace RenderTiles
         if (tileIndex == 0)
             return false;
 
-        std::string tileMsg;
-        if (tileCombined.getCombined())
-        {
-            tileMsg = renderedTiles.serialize("tilecombine:", "\n");
-
-            LOG_TRC("Sending back painted tiles for " << tileMsg << " of size " << output.size() << " bytes) for: " << tileMsg);
-
-            const size_t responseSize = tileMsg.size() + output.size();
-            std::unique_ptr<char[]> response(std::make_unique<char[]>(responseSize));
-            std::copy(tileMsg.begin(), tileMsg.end(), response.get());
-            std::copy(output.begin(), output.end(), response.get() + tileMsg.size());
-            outputMessage(response.get(), responseSize);
-        }
-        else
-        {
-            size_t outputOffset = 0;
-            for (const auto &i : renderedTiles.getTiles())
-            {
-                tileMsg = i.serialize("tile:", "\n");
-                const size_t responseSize = tileMsg.size() + i.getImgSize();
-                std::unique_ptr<char[]> response(std::make_unique<char[]>(responseSize));
-                std::copy(tileMsg.begin(), tileMsg.end(), response.get());
-                std::copy(output.begin() + outputOffset, output.begin() + outputOffset + i.getImgSize(), response.get() + tileMsg.size());
-                outputMessage(response.get(), responseSize);
-                outputOffset += i.getImgSize();
-            }
-        }
+        // Send whatever remains, or everything when not streaming.
+        sendTiles(encodedTiles);
+        if (tilesSent > 0)
+            getLastTileLatency().add(std::chrono::steady_clock::now() - start);
 
         // Should we do this more frequently? and/or should we defer it?
         deltaGen.rebalanceDeltas();
@@ -80,6 +80,20 @@ bool Session::sendBinaryFrame(const char *buffer, int length)
     return _protocol->sendBinaryMessage(buffer, length) >= length;
 }
 
+bool Session::sendSharedBinaryFrame(const std::shared_ptr<const void>& owner, const char* buffer,
+                                    int length)
+{
+    if (!_protocol)
+    {
+        LOG_TRC("ERR - missing protocol " << getName() << ": Send: " << std::to_string(length)
+                                          << " shared binary bytes");
+        return false;
+    }
+
+    LOG_TRC("Send: " << std::to_string(length) << " shared binary bytes");
+    return _protocol->sendSharedBinaryMessage(owner, buffer, length) >= length;
+}
+
 void Session::parseDocOptions(const StringVector& tokens, int& part, std::string& timestamp)
 {
     // First token is the "load" command itself.
@@ -301,29 +315,34 @@ void Session::shutdown(bool goingAway, const std::string& statusMessage)
 }
 
 void Session::handleMessage(const std::vector<char> &data)
+{
+    handleMessageInPlace(data.data(), data.size());
+}
+
+void Session::handleMessageInPlace(const char* data, std::size_t size)
 {
     try
     {
         std::unique_ptr< std::vector<char> > replace;
-        if (UnitBase::isUnitTesting() && !Util::isFuzzing() && UnitBase::get().filterSessionInput(this, data.data(), data.size(), replace))
+        if (UnitBase::isUnitTesting() && !Util::isFuzzing() && UnitBase::get().filterSessionInput(this, data, size, replace))
         {
             if (replace && !replace->empty())
                 _handleInput(replace->data(), replace->size());
             return;
         }
 
-        if (!data.empty())
-            _handleInput(data.data(), data.size());
+        if (size > 0)
+            _handleInput(data, size);
     }
     catch (const Exception& exc)
     {
         LOG_ERR("Exception while handling ["
-                << getAbbreviatedMessage(data) << "] in " << getName() << ": " << exc.displayText()
+                << getAbbreviatedMessage(data, size) << "] in " << getName() << ": " << exc.displayText()
                 << (exc.nested() ? " (" + exc.nested()->displayText() + ')' : ""));
     }
     catch (const std::exception& exc)
     {
-        LOG_ERR("Exception while handling [" << getAbbreviatedMessage(data) << "]: " << exc.what());
+        LOG_ERR("Exception while handling [" << getAbbreviatedMessage(data, size) << "]: " << exc.what());
     }
 }
 
@@ -129,6 +129,11 @@ public:
     virtual bool sendBinaryFrame(const char* buffer, int length);
     virtual bool sendTextFrame(const char* buffer, int length);
 
+    /// Send binary data kept alive, and unchanged, by @owner until written,
+    /// so that large payloads are not copied into the socket buffer.
+    bool sendSharedBinaryFrame(const std::shared_ptr<const void>& owner, const char* buffer,
+                               int length);
+
     /// Get notified that the underlying transports disconnected
     void onDisconnect() override { /* ignore */ }
 
@@ -183,6 +188,7 @@ public:
     }
 
     virtual void handleMessage(const std::vector<char> &data) override;
+    virtual void handleMessageInPlace(const char* data, std::size_t size) override;
 
     /// Invoked when we want to disconnect a session.
     virtual void disconnect();
@@ -11,6 +11,8 @@
 
 #pragma once
 
+#include <common/EncoderGovernor.hpp>
+
 #include <cassert>
 #include <memory>
 #include <queue>
@@ -31,15 +33,28 @@ class ThreadPool
     std::queue<ThreadFn> _work;
     std::vector<std::thread> _threads;
     size_t _working;
+    /// Number of work items completed since construction, used to wake
+    /// run() for progress reporting.
+    size_t _completed;
     int _maxConcurrency;
+    /// The number of threads the EncoderGovernor lets help the current run().
+    int _helpers;
+    /// The number of threads helping the current run().
+    int _helping;
     bool _shutdown;
+    /// True while run() wants to be woken after every completed item.
+    bool _progress;
     std::atomic<bool> _running;
 
 public:
     ThreadPool()
         : _working(0)
+        , _completed(0)
         , _maxConcurrency(2)
+        , _helpers(0)
+        , _helping(0)
         , _shutdown(false)
+        , _progress(false)
         , _running(false)
     {
 #if WASMAPP
@@ -115,29 +130,77 @@ public:
 
         lock.lock();
         _working--;
-        if (_work.empty() && _working == 0)
+        _completed++;
+        // Only the thread inside run() waits on _complete.
+        if ((_work.empty() && _working == 0) || _progress)
             _complete.notify_all();
     }
 
-    void run()
+    /// Executes all queued work, using the calling thread as one of the workers.
+    /// If onProgress is given, it is invoked on the calling thread (without the
+    /// lock held) each time one or more work items have completed, so results
+    /// can be consumed before the whole batch is done.
+    /// The other threads only help as far as the EncoderGovernor allows, which
+    /// favours @urgent work, e.g. tiles visible to a waiting client, when the
+    /// run starts. The helpers are kept until the run ends: a non-urgent run
+    /// doesn't give them up to an urgent one that starts in the meantime.
+    void run(const ThreadFn& onProgress = nullptr, bool urgent = false)
     {
         std::unique_lock<std::mutex> lock(_mutex);
         assert(!_running);
         assert(_working == 0);
 
         _running = true;
+        _progress = onProgress != nullptr;
+
+        int wanted = 0;
+        if (_threads.size() > 1 && _work.size() > 1)
+            wanted = std::min<int>(_threads.size(), _work.size() - 1);
+        _helpers = EncoderGovernor::acquire(wanted, urgent);
+
+        size_t reported = _completed;
+        const auto reportProgress = [&]()
+        {
+            if (onProgress && _completed != reported)
+            {
+                reported = _completed;
+                lock.unlock();
+                onProgress();
+                lock.lock();
+            }
+        };
 
         // Avoid notifying threads if we don't need to.
-        bool useThreads = _threads.size() > 1 && _work.size() > 1;
+        bool useThreads = _helpers > 0;
         if (useThreads)
             _cond.notify_all();
 
         while (!_work.empty())
+        {
             runOne(lock);
+            reportProgress();
+        }
 
-        if (useThreads && (_working > 0 || !_work.empty()))
-            _complete.wait(lock, [this]() { return _working == 0 && _work.empty(); });
+        if (useThreads)
+        {
+            while (_working > 0 || !_work.empty())
+            {
+                _complete.wait(lock,
+                               [this, &reported]()
+                               {
+                                   return (_working == 0 && _work.empty()) ||
+                                          (_progress && _completed != reported);
+                               });
+                reportProgress();
+            }
+        }
 
+        // Catch any items completed by other threads since the last report.
+        reportProgress();
+
+        EncoderGovernor::release(_helpers, urgent);
+        _helpers = 0;
+        _progress = false;
         _running = false;
 
         assert(_working == 0);
@@ -150,8 +213,13 @@ public:
         while (!_shutdown)
         {
             _cond.wait(lock);
+            if (_helping >= _helpers)
+                continue;
+
+            ++_helping;
             while (!_shutdown && !_work.empty() && _running)
                 runOne(lock);
+            --_helping;
         }
     }
 
@@ -161,6 +229,7 @@ public:
         oss << "\tthreadPool:"
             << "\n\t\tshutdown: " << _shutdown << "\n\t\tworking: " << _working
             << "\n\t\twork count: " << count() << "\n\t\tthread count " << _threads.size() << "\n";
+        EncoderGovernor::dumpState(oss);
         THREAD_UNSAFE_DUMP_END
     }
 };
@@ -611,6 +611,9 @@ public:
                                       int /*width*/, int /*height*/,
                                       int /*tilePosX*/, int /*tilePosY*/,
                                       int /*tileWidth*/, int /*tileHeight*/) {}
+    /// Called when the tiles needing rendering for @requests requests,
+    /// from any of the views, are sent to be rendered in @combines tilecombines.
+    virtual void onTileCombinesScheduled(std::size_t /*requests*/, std::size_t /*combines*/) {}
 private:
     /// The actual test implementation.
     virtual void invokeWSDTest() {}
@@ -2421,7 +2421,10 @@ bool ChildSession::renderNextSlideLayer(const unsigned width, const unsigned hei
         }
     }
 
-    uint64_t pixmapHash = hashSubBuffer(pixmap.data(), 0, 0, width, height, width, height) + getViewId();
+    // Views with the same canonical id render identical layers, which wsd
+    // shares between them, so don't make the checksum specific to the view.
+    uint64_t pixmapHash = hashSubBuffer(pixmap.data(), 0, 0, width, height, width, height) +
+                          to_underlying(getCanonicalViewId());
     if (size_t start = jsonMsg.find("%IMAGETYPE%"); start != std::string::npos)
         jsonMsg.replace(start, 11, "png");
     if (size_t start = jsonMsg.find("%IMAGECHECKSUM%"); start != std::string::npos)
@@ -2436,7 +2439,8 @@ bool ChildSession::renderNextSlideLayer(const unsigned width, const unsigned hei
     output.resize(response.size());
     std::memcpy(output.data(), response.data(), response.size());
 
-    if (!Png::encodeSubBufferToPNG(pixmap.data(), 0, 0, width, height, width, height, output, tileMode))
+    if (!Png::encodeSubBufferToPNGInStrips(pixmap.data(), 0, 0, width, height, width, height,
+                                           output, tileMode, _docManager->getEncodingPool()))
     {
         LOG_ERR("Failed to encode into PNG.");
         return false;
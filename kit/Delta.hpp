@@ -11,8 +11,13 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <sstream>
 #include <unordered_set>
 #include <fstream>
 #include <assert.h>
@@ -79,9 +84,10 @@ class DeltaGenerator {
 
     static constexpr size_t _rleMaskUnits = 256 / 64;
 
-    /// Bitmap row with a CRC for quick vertical shift detection
+    /// Bitmap row with a hash for quick vertical shift detection
     class DeltaBitmapRow final {
         size_t _rleSize;
+        uint64_t _rleHash;
         uint64_t _rleMask[_rleMaskUnits];
         uint32_t *_rleData;
     public:
@@ -138,6 +144,7 @@ class DeltaGenerator {
 
         DeltaBitmapRow()
             : _rleSize(0)
+            , _rleHash(0)
             , _rleData(nullptr)
         {
             memset(_rleMask, 0, sizeof(_rleMask));
@@ -188,6 +195,19 @@ class DeltaGenerator {
         }
 
     private:
+        /// Cheap multiplicative hash of the packed row, used to find
+        /// candidate identical rows and to reject different ones early.
+        static uint64_t hashRow(const uint64_t *rleMask, const uint32_t *data, size_t len)
+        {
+            uint64_t hash = len;
+            for (size_t i = 0; i < _rleMaskUnits; ++i)
+                hash = (hash ^ rleMask[i]) * 0x9E3779B97F4A7C15ULL;
+            for (size_t i = 0; i < len; ++i)
+                hash = (hash ^ data[i]) * 0x9E3779B97F4A7C15ULL;
+            // fold the well mixed high bits down for bucketing.
+            return hash ^ (hash >> 31);
+        }
+
         void initPixRowCpu(const uint32_t *from, uint32_t *scratch,
                            size_t *scratchLen, uint64_t *rleMaskBlock,
                            unsigned int width)
@@ -281,6 +301,8 @@ class DeltaGenerator {
             if (!done)
                 initPixRowCpu(from, scratch, &_rleSize, _rleMask, width);
 
+            _rleHash = hashRow(_rleMask, scratch, _rleSize);
+
             if (_rleSize > 0)
             {
                 _rleData = (uint32_t *)malloc((size_t)_rleSize * 4);
@@ -290,8 +312,12 @@ class DeltaGenerator {
                 _rleData = nullptr;
         }
 
+        uint64_t getHash() const { return _rleHash; }
+
         bool identical(const DeltaBitmapRow &other) const
         {
+            if (_rleHash != other._rleHash)
+                return false;
             if (_rleSize != other._rleSize)
                 return false;
             if (memcmp(_rleMask, other._rleMask, sizeof(_rleMask)))
@@ -303,11 +329,119 @@ class DeltaGenerator {
             return !std::memcmp(_rleData, other._rleData, _rleSize * 4);
         }
 
+        /// Expand the RLE data back into @width (at most 256) @pixels.
+        void expandRow(uint32_t *pixels, unsigned int width) const
+        {
+            assert(width <= 256);
+            const uint32_t *rlePtr = _rleData;
+            uint32_t lastPix = 0x00000000; // transparency
+            for (unsigned int x = 0; x < width; ++x)
+            {
+                if (!(_rleMask[x >> 6] & (uint64_t(1) << (x & 63))))
+                    lastPix = *(rlePtr++);
+                pixels[x] = lastPix;
+            }
+        }
+
+        /// Set a bit in @sameMask for each of the 256 pixels identical in both rows.
+        static void diffRowMaskCpu(const uint32_t *prev, const uint32_t *cur, uint64_t *sameMask)
+        {
+            for (unsigned int i = 0; i < _rleMaskUnits; ++i)
+            {
+                uint64_t mask = 0;
+                for (unsigned int bit = 0; bit < 64; ++bit)
+                {
+                    if (prev[i * 64 + bit] == cur[i * 64 + bit])
+                        mask |= uint64_t(1) << bit;
+                }
+                sameMask[i] = mask;
+            }
+        }
+
         // Create a diff from our state to new state in curRow
         void diffRowTo(const DeltaBitmapRow &curRow,
                        const int width, const int curY,
                        std::vector<uint8_t> &output,
                        LibreOfficeKitTileMode mode) const
+        {
+            if (simd::HasAVX2 && width == 256)
+            {
+                uint32_t oldPixels[256];
+                uint32_t curPixels[256];
+                uint64_t sameMask[_rleMaskUnits];
+                expandRow(oldPixels, width);
+                curRow.expandRow(curPixels, width);
+                if (simd_diffRowMask(oldPixels, curPixels, sameMask))
+                {
+                    diffRowFromMask(curPixels, sameMask, width, curY, output, mode);
+                    return;
+                }
+            }
+
+            // else CPU implementation
+            diffRowToCpu(curRow, width, curY, output, mode);
+        }
+
+        /// Emit the diff for the expanded @curPixels, given which pixels are unchanged
+        /// in @sameMask. This produces the same runs as diffRowToCpu.
+        static void diffRowFromMask(const uint32_t *curPixels, const uint64_t *sameMask,
+                                    const int width, const int curY,
+                                    std::vector<uint8_t> &output,
+                                    LibreOfficeKitTileMode mode)
+        {
+            assert(width <= 256);
+            const auto isSame = [sameMask](int x)
+            {
+                return (sameMask[x >> 6] >> (x & 63)) & 1;
+            };
+
+            for (int x = 0; x < width;)
+            {
+                // skip identical pixels up to 64 at a time
+                int pos = x;
+                while (pos < width)
+                {
+                    const uint64_t differ = ~sameMask[pos >> 6] >> (pos & 63);
+                    if (differ)
+                    {
+                        pos += __builtin_ctzll(differ);
+                        break;
+                    }
+                    pos += 64 - (pos & 63);
+                }
+                x = std::min(pos, width);
+
+                int diff;
+                for (diff = 0; diff + x < width &&
+                         (!isSame(x + diff) || diff < 3)
+                         && diff < 254;)
+                    ++diff;
+
+                if (diff > 0)
+                {
+                    output.push_back('d');
+                    output.push_back(curY);
+                    output.push_back(x);
+                    output.push_back(diff);
+
+                    size_t dest = output.size();
+                    output.resize(dest + diff * 4);
+
+                    copy_row(reinterpret_cast<unsigned char *>(&output[dest]),
+                              reinterpret_cast<const unsigned char *>(curPixels + x),
+                              diff, mode);
+
+                    LOGA_TRC(Pixel, "row " << curY << " different " << diff << "pixels");
+                    x += diff;
+                }
+            }
+        }
+
+        // Create a diff from our state to new state in curRow, one pixel at a time
+        void diffRowToCpu(const DeltaBitmapRow &curRow,
+                          const int width, const int curY,
+                          std::vector<uint8_t> &output,
+                          LibreOfficeKitTileMode mode) const
         {
             PixIterator oldPixels(*this);
             PixIterator curPixels(curRow);
@@ -369,6 +503,7 @@ class DeltaGenerator {
                   [[maybe_unused]] int bufferHeight)
             : _loc(loc)
             , _inUse(false)
+            , _referenced(false)
             , _wid(wid)
             ,
             // in Pixels
@@ -456,6 +591,12 @@ class DeltaGenerator {
             repl.reset();
         }
 
+        /// Marks the entry as recently used, to survive the next eviction sweep.
+        void reference() { _referenced.store(true, std::memory_order_relaxed); }
+
+        /// Clears the recently used mark, returning its previous state.
+        bool unreference() { return _referenced.exchange(false, std::memory_order_relaxed); }
+
         inline void use()
         {
             const bool wasInUse = _inUse.exchange(true); (void)wasInUse;
@@ -471,6 +612,7 @@ class DeltaGenerator {
         TileLocation _loc;
     private:
         std::atomic<bool> _inUse; // thread debugging check.
+        std::atomic<bool> _referenced; // for CLOCK eviction.
         TileWireId _wid;
         int _width;
         int _height;
@@ -492,30 +634,64 @@ class DeltaGenerator {
         }
     };
 
-    std::mutex _deltaGuard;
+    static constexpr size_t _shardCount = 16;
+
+    /// A slice of the delta cache with its own lock, selected by tile location,
+    /// so encoder threads working on different tiles rarely contend.
+    struct DeltaShard final {
+        std::mutex _guard;
+        std::unordered_set<std::shared_ptr<DeltaData>, DeltaHasher, DeltaCompare> _entries;
+        /// The same entries, in the order the eviction hand sweeps them.
+        std::deque<std::shared_ptr<DeltaData>> _clock;
+    };
+
     /// The last several bitmap entries as a cache
-    std::unordered_set<std::shared_ptr<DeltaData>, DeltaHasher, DeltaCompare> _deltaEntries;
-    size_t _maxEntries;
+    DeltaShard _shards[_shardCount];
+    std::atomic<size_t> _maxEntries;
+
+    DeltaShard& getShard(const TileLocation& loc)
+    {
+        // Tile positions are multiples of the tile size, so mix the bits first.
+        const uint64_t hash = static_cast<uint64_t>(loc.hash()) * 0x9E3779B97F4A7C15ULL;
+        return _shards[(hash >> 32) % _shardCount];
+    }
+
+    /// Evicts entries from @shard down to @limit with the CLOCK algorithm:
+    /// entries used since the last sweep get a second chance, so eviction
+    /// is amortized O(1) per entry instead of a sort of the whole cache.
+    static void evictShardT(DeltaShard& shard, size_t limit)
+    {
+        assert(!shard._guard.try_lock() && "Expected to have shard _guard lock taken");
+
+        if (limit == 0)
+        {
+            shard._entries.clear();
+            shard._clock.clear();
+            return;
+        }
+
+        while (shard._entries.size() > limit)
+        {
+            assert(!shard._clock.empty());
+            std::shared_ptr<DeltaData> entry = std::move(shard._clock.front());
+            shard._clock.pop_front();
+
+            if (entry->unreference())
+                shard._clock.push_back(std::move(entry));
+            else
+                shard._entries.erase(entry);
+        }
+    }
 
     void rebalanceDeltasT(bool bDropAll = false)
     {
-        assert(!_deltaGuard.try_lock() && "Expected to have _deltaGuard lock taken");
-
-        if (_deltaEntries.size() > _maxEntries || bDropAll)
-        {
-            size_t toRemove = _deltaEntries.size();
-            if (!bDropAll)
-                toRemove -= (_maxEntries * 3 / 4);
-            std::vector<std::shared_ptr<DeltaData>> entries;
-            entries.insert(entries.end(), _deltaEntries.begin(), _deltaEntries.end());
-            std::sort(entries.begin(), entries.end(),
-                      [](const std::shared_ptr<DeltaData> &a,
-                         const std::shared_ptr<DeltaData> &b)
-                          {
-                              return a->getWid() < b->getWid();
-                          });
-            for (size_t i = 0; i < toRemove; ++i)
-                _deltaEntries.erase(entries[i]);
+        const size_t maxEntries = _maxEntries;
+        // Round up, so small caches still keep something in each shard.
+        const size_t limit = bDropAll ? 0 : (maxEntries + _shardCount - 1) / _shardCount;
+        for (DeltaShard& shard : _shards)
+        {
+            std::unique_lock<std::mutex> guard(shard._guard);
+            evictShardT(shard, limit);
         }
     }
 
@@ -562,51 +738,72 @@ class DeltaGenerator {
         // column position is a byte.
         assert (prev.getWidth() <= 256);
 
+        // Index the previous rows by hash, so hunting for a moved row is
+        // a short chain walk rather than a scan of every row.
+        const int height = prev.getHeight();
+        constexpr size_t hashBuckets = 512;
+        int16_t bucketHead[hashBuckets];
+        int16_t nextInChain[256];
+        std::fill_n(bucketHead, hashBuckets, -1);
+        for (int y = height - 1; y >= 0; --y)
+        {
+            const size_t bucket = prev.getRow(y).getHash() % hashBuckets;
+            nextInChain[y] = bucketHead[bucket];
+            bucketHead[bucket] = y;
+        }
+
         // How do the rows look against each other ?
         size_t lastMatchOffset = 0;
         size_t lastCopy = 0;
-        for (int y = 0; y < prev.getHeight(); ++y)
+        for (int y = 0; y < height; ++y)
         {
+            const DeltaBitmapRow& curRow = cur.getRow(y);
+
             // Life is good where rows match:
-            if (prev.getRow(y).identical(cur.getRow(y)))
+            if (prev.getRow(y).identical(curRow))
                 continue;
 
-            // Hunt for other rows
-            bool matched = false;
-            for (int yn = 0; yn < prev.getHeight() && !matched; ++yn)
+            // Hunt for other rows, preferring the first one at or after the
+            // row that would continue the last copy.
+            const size_t start = (y + lastMatchOffset) % height;
+            int match = -1;
+            size_t bestDistance = height;
+            for (int candidate = bucketHead[curRow.getHash() % hashBuckets];
+                 candidate >= 0 && bestDistance > 0; candidate = nextInChain[candidate])
             {
-                size_t match = (y + lastMatchOffset + yn) % prev.getHeight();
-                if (prev.getRow(match).identical(cur.getRow(y)))
+                const size_t distance = (candidate + height - start) % height;
+                if (distance < bestDistance && prev.getRow(candidate).identical(curRow))
                 {
-                    // TODO: if offsets are >256 - use 16bits?
-                    if (lastCopy > 0)
+                    match = candidate;
+                    bestDistance = distance;
+                }
+            }
+
+            if (match >= 0)
+            {
+                // TODO: if offsets are >256 - use 16bits?
+                if (lastCopy > 0)
+                {
+                    // check if we can extend the last copy
+                    uint8_t cnt = output[lastCopy];
+                    if (output[lastCopy + 1] + cnt == match &&
+                        output[lastCopy + 2] + cnt == y &&
+                        // make sure we're not copying from out of bounds of the previous tile
+                        output[lastCopy + 1] + cnt + 1 < height)
                     {
-                        // check if we can extend the last copy
-                        uint8_t cnt = output[lastCopy];
-                        if (output[lastCopy + 1] + cnt == match &&
-                            output[lastCopy + 2] + cnt == y &&
-                            // make sure we're not copying from out of bounds of the previous tile
-                            output[lastCopy + 1] + cnt + 1 < prev.getHeight())
-                        {
-                            output[lastCopy]++;
-                            matched = true;
-                            continue;
-                        }
+                        output[lastCopy]++;
+                        continue;
                     }
-
-                    lastMatchOffset = match - y;
-                    output.push_back('c');   // copy-row
-                    lastCopy = output.size();
-                    output.push_back(1);     // count - updated later.
-                    output.push_back(match); // src
-                    output.push_back(y);     // dest
-
-                    matched = true;
-                    continue;
                 }
-            }
-            if (matched)
+
+                lastMatchOffset = match - y;
+                output.push_back('c');   // copy-row
+                lastCopy = output.size();
+                output.push_back(1);     // count - updated later.
+                output.push_back(match); // src
+                output.push_back(y);     // dest
                 continue;
+            }
 
             // Our row is just that different:
             prev.getRow(y).diffRowTo(cur.getRow(y), prev.getWidth(), y, output, mode);
@@ -659,7 +856,6 @@ class DeltaGenerator {
     /// Re-balances the cache size to fit the number of sessions
     void rebalanceDeltas(ssize_t limit = -1)
     {
-        std::unique_lock<std::mutex> guard(_deltaGuard);
         if (limit > 0)
             _maxEntries = limit;
         rebalanceDeltasT();
@@ -673,23 +869,30 @@ class DeltaGenerator {
 
     void dropCache()
     {
-        std::unique_lock<std::mutex> guard(_deltaGuard);
         rebalanceDeltasT(true);
     }
 
     void dumpState(std::ostream& oss)
     {
-        oss << "\tdelta generator with " << _deltaEntries.size() << " entries vs. max "
-            << _maxEntries << '\n';
+        size_t count = 0;
         size_t totalSize = 0;
-        for (const auto& it : _deltaEntries)
+        std::ostringstream entries;
+        for (DeltaShard& shard : _shards)
         {
-            size_t size = it->sizeBytes();
-            oss << "\t\t" << it->_loc._size << ',' << it->_loc._part << ',' << it->_loc._left << ','
-                << it->_loc._top << " wid: " << it->getWid() << " size: " << size << '\n';
-            totalSize += size;
+            std::unique_lock<std::mutex> guard(shard._guard);
+            count += shard._entries.size();
+            for (const auto& it : shard._entries)
+            {
+                size_t size = it->sizeBytes();
+                entries << "\t\t" << it->_loc._size << ',' << it->_loc._part << ','
+                        << it->_loc._left << ',' << it->_loc._top << " wid: " << it->getWid()
+                        << " size: " << size << '\n';
+                totalSize += size;
+            }
         }
-        oss << "\tdelta generator consumes " << totalSize << " bytes\n";
+        oss << "\tdelta generator with " << count << " entries in " << _shardCount
+            << " shards vs. max " << _maxEntries << '\n'
+            << entries.str() << "\tdelta generator consumes " << totalSize << " bytes\n";
     }
 
     /**
@@ -730,17 +933,20 @@ class DeltaGenerator {
         std::shared_ptr<DeltaData> cacheEntry;
 
         {
-            // protect _deltaEntries
-            std::unique_lock<std::mutex> guard(_deltaGuard);
+            // protect the shard holding this location
+            DeltaShard& shard = getShard(loc);
+            std::unique_lock<std::mutex> guard(shard._guard);
 
-            auto it = _deltaEntries.find(update);
-            if (it == _deltaEntries.end())
+            auto it = shard._entries.find(update);
+            if (it == shard._entries.end())
             {
-                _deltaEntries.insert(update);
+                shard._entries.insert(update);
+                shard._clock.push_back(update);
                 rleData = std::move(update);
                 return false;
             }
             cacheEntry = *it;
+            cacheEntry->reference();
             cacheEntry->use();
         }
 
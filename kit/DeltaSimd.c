@@ -181,4 +181,88 @@ int simd_initPixRowSimd(const uint32_t *from, uint32_t *scratch, size_t *scratch
 #endif // ENABLE_SIMD
 }
 
+// accelerated comparison of two expanded 256 pixel rows
+int simd_diffRowMask(const uint32_t *prev, const uint32_t *curr, uint64_t *sameMask)
+{
+#if !ENABLE_SIMD
+    // no fun.
+    (void)prev; (void)curr; (void)sameMask;
+    return 0;
+
+#else // ENABLE_SIMD
+
+    for (unsigned int x = 0; x < 256/64; ++x)
+        sameMask[x] = 0;
+
+    for (unsigned int x = 0; x < 256; x += 8) // 8 pixels per cycle
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i_u*)(prev + x));
+        __m256i b = _mm256_loadu_si256((const __m256i_u*)(curr + x));
+
+        sameMask[x >> 6] |= diffMask(a, b) << (x & 63);
+    }
+
+    return 1;
+#endif // ENABLE_SIMD
+}
+
+// fixed-point blend of pre-multiplied pixels, returns the number of pixels done.
+int simd_alphaBlendRow(uint8_t *to, const uint8_t *from, int count,
+                       int blendAll, int isSlideShowLayer)
+{
+#if !ENABLE_SIMD
+    // no fun.
+    (void)to; (void)from; (void)count; (void)blendAll; (void)isSlideShowLayer;
+    return 0;
+
+#else // ENABLE_SIMD
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one16 = _mm256_set1_epi16(1);
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m256i opaque = _mm256_set1_epi32(255);
+    const __m256i colorMask = _mm256_set1_epi32(0x00ffffff);
+    // broadcast the alpha of each pixel to all of its bytes
+    const __m256i alphaShuffle = _mm256_set_epi8(
+        15, 15, 15, 15,  11, 11, 11, 11,  7, 7, 7, 7,  3, 3, 3, 3,
+        15, 15, 15, 15,  11, 11, 11, 11,  7, 7, 7, 7,  3, 3, 3, 3);
+
+    int x;
+    for (x = 0; x + 8 <= count; x += 8) // 8 pixels per cycle
+    {
+        __m256i dst = _mm256_loadu_si256((const __m256i_u*)(to + 4 * x));
+        __m256i src = _mm256_loadu_si256((const __m256i_u*)(from + 4 * x));
+
+        // dst * (255 - alpha) / 255 in 16 bits, as (p + 1 + (p >> 8)) >> 8
+        __m256i inverse = _mm256_sub_epi8(_mm256_set1_epi8(-1),
+                                          _mm256_shuffle_epi8(src, alphaShuffle));
+        __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(dst, zero),
+                                        _mm256_unpacklo_epi8(inverse, zero));
+        __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(dst, zero),
+                                        _mm256_unpackhi_epi8(inverse, zero));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(lo, one16),
+                                                _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(hi, one16),
+                                                _mm256_srli_epi16(hi, 8)), 8);
+        __m256i out = _mm256_adds_epu8(src, _mm256_packus_epi16(lo, hi));
+
+        __m256i dstAlpha = _mm256_srli_epi32(dst, 24);
+        __m256i transparent = isSlideShowLayer ? _mm256_cmpeq_epi32(dstAlpha, zero) : zero;
+
+        // over a transparent slideshow background only an eighth of the alpha
+        __m256i eighth = _mm256_or_si256(_mm256_and_si256(out, colorMask),
+                                         _mm256_slli_epi32(_mm256_srli_epi32(out, 27), 24));
+        out = _mm256_blendv_epi8(out, eighth, transparent);
+
+        __m256i apply = blendAll ? ones :
+            _mm256_or_si256(_mm256_cmpeq_epi32(dstAlpha, opaque), transparent);
+        out = _mm256_blendv_epi8(dst, out, apply);
+
+        _mm256_storeu_si256((__m256i_u*)(to + 4 * x), out);
+    }
+
+    return x;
+#endif // ENABLE_SIMD
+}
+
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -22,6 +22,11 @@ void simd_deltaInit(void);
 
 int simd_initPixRowSimd(const uint32_t *from, uint32_t *scratch, size_t *scratchLen, uint64_t *rleMask);
 
+int simd_diffRowMask(const uint32_t *prev, const uint32_t *curr, uint64_t *sameMask);
+
+int simd_alphaBlendRow(uint8_t *to, const uint8_t *from, int count,
+                       int blendAll, int isSlideShowLayer);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -49,6 +49,7 @@
 #include <common/SigUtil.hpp>
 #include <common/security.h>
 #include <common/ConfigUtil.hpp>
+#include <common/EncoderGovernor.hpp>
 #include <common/Uri.hpp>
 #include <common/Watchdog.hpp>
 #include <kit/DeltaSimd.h>
@@ -357,6 +358,7 @@ static void cleanupChildren(const std::string& childRoot)
             }
 
             LOG_INF("Child " << exitedChildPid << " has exited, will remove its jail [" << it->second << "].");
+            EncoderGovernor::releaseProcess(exitedChildPid);
             cleanupJailPaths.emplace_back(it->second);
             childJails.erase(it);
             if (childJails.empty() && !SigUtil::getTerminationFlag())
@@ -1026,6 +1028,10 @@ int forkit_main(int argc, char** argv)
 
     Util::setThreadName("forkit");
 
+    // Shared by all the Kits we fork, to cap their tile encoding threads machine-wide.
+    const char* maxEncoderThreads = std::getenv("MAX_ENCODER_THREADS");
+    EncoderGovernor::initialize(maxEncoderThreads ? std::atoi(maxEncoderThreads) : 0);
+
     LOG_INF("Preinit stage OK.");
 
     // We must have at least one child, more are created dynamically.
@@ -48,9 +48,12 @@
 #include <condition_variable>
 #include <cstdlib>
 #include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -769,11 +772,13 @@ Document::Document(const std::shared_ptr<lok::Office>& loKit, const std::string&
     , _modified(ModifiedState::UnModified)
     , _isBgSaveProcess(false)
     , _isBgSaveDisabled(false)
+    , _recyclable(false)
     , _haveDocPassword(false)
     , _isDocPasswordProtected(false)
     , _docPasswordType(DocumentPasswordType::ToView)
     , _stop(false)
     , _deltaGen(new DeltaGenerator())
+    , _tileStreamBatch(0)
     , _editorId(-1)
     , _editorChangeWarning(false)
     , _lastMemTrimTime(std::chrono::steady_clock::now())
@@ -784,6 +789,9 @@ Document::Document(const std::shared_ptr<lok::Office>& loKit, const std::string&
             "] url [" << anonymizeUrl(_url) << "] on child [" << _jailId <<
             "] and id [" << _docId << "].");
     assert(_loKit);
+    // coverity[tainted_data_return] - we trust the contents of this variable
+    if (const char* streamBatch = std::getenv("TILE_STREAM_BATCH"))
+        _tileStreamBatch = std::max(0, std::atoi(streamBatch));
 #if !MOBILEAPP
     assert(singletonDocument == nullptr);
     singletonDocument = this;
@@ -814,6 +822,10 @@ Document::~Document()
     DocumentData::deallocate(_mobileAppDocId);
 #endif
 
+#if !MOBILEAPP
+    if (singletonDocument == this)
+        singletonDocument = nullptr;
+#endif
 }
 
 /// Post the message - in the unipoll world we're in the right thread anyway
@@ -919,7 +931,7 @@ std::size_t Document::purgeSessions()
         }
 
         num_sessions = _sessions.size();
-        if (!Util::isMobileApp() && num_sessions == 0)
+        if (!Util::isMobileApp() && num_sessions == 0 && !isRecyclable())
         {
             LOG_FTL("Document [" << anonymizeUrl(_url) << "] has no more views, exiting bluntly.");
             flushAndExit(EX_OK);
@@ -969,7 +981,7 @@ void Document::setDocumentPassword(int passwordType)
     LOG_INF("setDocumentPassword returned.");
 }
 
-void Document::renderTiles(TileCombined &tileCombined)
+void Document::renderTiles(TileCombined &tileCombined, bool visible)
 {
     // Find a session matching our view / render settings.
     const auto session = _sessions.findByCanonicalId(tileCombined.getCanonicalViewId());
@@ -1009,7 +1021,8 @@ void Document::renderTiles(TileCombined &tileCombined)
 
     if (!RenderTiles::doRender(_loKitDocument, *_deltaGen, tileCombined, _deltaPool,
                                blenderFunc, postMessageFunc, _mobileAppDocId,
-                               session->getCanonicalViewId(), session->getDumpTiles()))
+                               session->getCanonicalViewId(), session->getDumpTiles(),
+                               _tileStreamBatch, visible))
     {
         LOG_DBG("All tiles skipped, not producing empty tilecombine: message");
         return;
@@ -1279,6 +1292,17 @@ void Document::onUnload(const ChildSession& session)
         return;
     }
 
+    // Keep the document, and its last view, until the poll drops it; it's unloaded then.
+    if (!Util::isMobileApp() && _sessions.empty() && isRecyclable())
+    {
+        LOG_INF("Document [" << anonymizeUrl(_url)
+                             << "] has no more sessions; unloading it to load another");
+        _loKitDocument->setView(session.getViewId());
+        _loKitDocument->registerCallback(nullptr, nullptr);
+        _loKit->registerCallback(nullptr, nullptr);
+        return;
+    }
+
     // If we have no more sessions, we have nothing more to do.
     if (!Util::isMobileApp() && _sessions.empty())
     {
@@ -2512,7 +2536,7 @@ void Document::drainQueue()
                 TileCombined tileCombined = _queue->popTileQueue(prio);
                 LOG_TRC("Tile priority is " << static_cast<int>(prio) << " for " << tileCombined.serialize());
 
-                renderTiles(tileCombined);
+                renderTiles(tileCombined, prio >= TilePrioritizer::Priority::VERYHIGH);
             }
             // if priority is low - do one render, then process more events.
         }
@@ -2696,6 +2720,8 @@ void Document::dumpState(std::ostream& oss)
     oss << '\n';
 
     _deltaPool.dumpState(oss);
+    oss << "\ttileStreamBatch: " << _tileStreamBatch << '\n';
+    RenderTiles::dumpState(oss);
     _sessions.dumpState(oss);
 
     _deltaGen->dumpState(oss);
@@ -3001,9 +3027,28 @@ int KitSocketPoll::kitPoll(int timeoutMicroS)
 
         if (_document && _document->purgeSessions() == 0)
         {
-            LOG_INF("Last session discarded. Setting TerminationFlag");
-            SigUtil::setTerminationFlag();
-            return -1;
+            if (!_document->isRecyclable())
+            {
+                LOG_INF("Last session discarded. Setting TerminationFlag");
+                SigUtil::setTerminationFlag();
+                return -1;
+            }
+
+            LOG_INF("Last session discarded. Unloading the document to load another");
+            const std::shared_ptr<WebSocketHandler> websocketHandler =
+                _document->getWebSocketHandler();
+            std::static_pointer_cast<KitWebSocketHandler>(websocketHandler)->dropDocument();
+            _document.reset();
+
+            // Leave nothing of it to the next document, or don't take one.
+            if (!cleanupJailTmp())
+            {
+                LOG_INF("Cannot clean up after the last document. Setting TerminationFlag");
+                SigUtil::setTerminationFlag();
+                return -1;
+            }
+
+            websocketHandler->sendMessage("recycled:");
         }
     }
     // Report the number of events we processed.
@@ -3962,6 +4007,117 @@ void consistencyCheckJail()
     }
 }
 
+namespace
+{
+/// A regular file in the jail's TMPDIR, as it was before loading any document.
+struct JailTmpFile
+{
+    std::uintmax_t _size;
+    std::filesystem::file_time_type _modified;
+};
+
+/// The jail's TMPDIR before loading any document: its regular files, and
+/// its other entries, e.g. directories, with no JailTmpFile.
+std::map<std::string, std::optional<JailTmpFile>> JailTmpSnapshot;
+bool HaveJailTmpSnapshot = false;
+
+std::string getJailTmpDir()
+{
+    const char* tmpDir = ::getenv("TMPDIR");
+    return tmpDir ? tmpDir : JailUtil::CHILDROOT_TMP_PATH;
+}
+
+std::optional<JailTmpFile> getJailTmpFile(const std::filesystem::directory_entry& entry)
+{
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(entry.symlink_status(ec)))
+        return std::nullopt;
+
+    return JailTmpFile{ entry.file_size(ec), entry.last_write_time(ec) };
+}
+} // namespace
+
+void snapshotJailTmp()
+{
+    if (HaveJailTmpSnapshot)
+        return;
+
+    // Symbolic links are never followed.
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(getJailTmpDir(), ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+    {
+        JailTmpSnapshot.emplace(it->path().string(), getJailTmpFile(*it));
+    }
+
+    if (ec)
+    {
+        LOG_ERR("Failed to list the jail's temporary directory [" << getJailTmpDir()
+                                                                  << "]: " << ec.message());
+        JailTmpSnapshot.clear();
+        return;
+    }
+
+    HaveJailTmpSnapshot = true;
+    LOG_DBG("Have " << JailTmpSnapshot.size() << " entries in the jail's temporary directory ["
+                    << getJailTmpDir() << ']');
+}
+
+bool cleanupJailTmp()
+{
+    if (!HaveJailTmpSnapshot)
+    {
+        LOG_WRN("Cannot clean up the jail's temporary directory, it wasn't recorded before");
+        return false;
+    }
+
+    bool clean = true;
+    std::vector<std::filesystem::path> added;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(getJailTmpDir(), ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+    {
+        const auto found = JailTmpSnapshot.find(it->path().string());
+        if (found == JailTmpSnapshot.end())
+        {
+            // Removed with all it has.
+            added.push_back(it->path());
+            it.disable_recursion_pending();
+            continue;
+        }
+
+        const std::optional<JailTmpFile> file = getJailTmpFile(*it);
+        if (found->second.has_value() != file.has_value() ||
+            (file && (file->_size != found->second->_size ||
+                      file->_modified != found->second->_modified)))
+        {
+            // E.g. the user profile, which we can't restore, not least as it's in memory too.
+            LOG_INF("Jailed file [" << it->path().string() << "] was modified since loading");
+            clean = false;
+        }
+    }
+
+    if (ec)
+    {
+        LOG_ERR("Failed to list the jail's temporary directory [" << getJailTmpDir()
+                                                                  << "]: " << ec.message());
+        clean = false;
+    }
+
+    for (const std::filesystem::path& path : added)
+    {
+        LOG_TRC("Removing [" << path.string() << "] from the jail");
+        std::filesystem::remove_all(path, ec);
+        if (ec)
+        {
+            LOG_ERR("Failed to remove [" << path.string() << "] from the jail: " << ec.message());
+            clean = false;
+        }
+    }
+
+    return clean;
+}
+
 /// Fetch the latest monotonically incrementing wire-id
 TileWireId getCurrentWireId(bool increment)
 {
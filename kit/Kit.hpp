@@ -219,7 +219,8 @@ public:
 
     void setDocumentPassword(int passwordType);
 
-    void renderTiles(TileCombined& tileCombined);
+    /// Renders the tiles, @visible to a client waiting for them, or not.
+    void renderTiles(TileCombined& tileCombined, bool visible);
 
 
     bool sendTextFrame(const std::string& message)
@@ -408,10 +409,19 @@ public:
     /// Return access to the lok::Document instance.
     std::shared_ptr<lok::Document> getLOKitDocument();
 
+    /// Return access to the thread pool used for encoding.
+    ThreadPool& getEncodingPool() { return _deltaPool; }
+
     std::string getObfuscatedFileId() { return _obfuscatedFileId; }
 
     bool isBackgroundSaveProcess() const { return _isBgSaveProcess; }
 
+    /// Unload, rather than exit, when the last session goes, to load another document.
+    void setRecyclable(bool recyclable) { _recyclable = recyclable; }
+    bool isRecyclable() const { return _recyclable && !_isBgSaveProcess; }
+
+    std::shared_ptr<WebSocketHandler> getWebSocketHandler() const { return _websocketHandler; }
+
     static void shutdownBackgroundWatchdog();
 
     /// Save is async, so we need to set 'unmodified' while we are saving
@@ -472,6 +482,7 @@ private:
     ModifiedState _modified;
     bool _isBgSaveProcess;
     bool _isBgSaveDisabled;
+    bool _recyclable;
 
     // Document password provided
     std::string _docPassword;
@@ -486,6 +497,9 @@ private:
 
     ThreadPool _deltaPool;
     std::unique_ptr<DeltaGenerator> _deltaGen;
+    /// Minimum number of encoded tiles to send at once while rendering; 0 to send
+    /// whole tilecombines only.
+    std::size_t _tileStreamBatch;
 
     int _editorId;
     bool _editorChangeWarning;
@@ -521,6 +535,14 @@ std::string anonymizeUsername(const std::string& username);
 /// Ensure there is no fatal system setup problem
 void consistencyCheckJail();
 
+/// Records what the jail's TMPDIR has, including the user profile,
+/// before loading any document, to tell what documents leave behind.
+void snapshotJailTmp();
+
+/// Removes what was added to the jail's TMPDIR since snapshotJailTmp().
+/// Returns false if anything else changed, which we can't undo.
+bool cleanupJailTmp();
+
 /// check how many theads we have currently
 int getCurrentThreadCount();
 
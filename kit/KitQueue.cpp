@@ -167,64 +167,212 @@ bool extractRectangle(const StringVector& tokens, int& x, int& y, int& w, int& h
 
 }
 
+namespace
+{
+/// Returns true iff callbacks of the given type are elided by later ones.
+bool isElidableCallback(int type)
+{
+    switch (static_cast<LibreOfficeKitCallbackType>(type))
+    {
+        case LOK_CALLBACK_INVALIDATE_TILES:
+        case LOK_CALLBACK_STATE_CHANGED:
+        case LOK_CALLBACK_INVALIDATE_VISIBLE_CURSOR:
+        case LOK_CALLBACK_CURSOR_VISIBLE:
+        case LOK_CALLBACK_STATUS_INDICATOR_SET_VALUE:
+        case LOK_CALLBACK_DOCUMENT_SIZE_CHANGED:
+        case LOK_CALLBACK_CELL_CURSOR:
+        case LOK_CALLBACK_INVALIDATE_VIEW_CURSOR:
+        case LOK_CALLBACK_CELL_VIEW_CURSOR:
+        case LOK_CALLBACK_VIEW_CURSOR_VISIBLE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool isViewCallback(int type)
+{
+    return type == LOK_CALLBACK_INVALIDATE_VIEW_CURSOR || type == LOK_CALLBACK_CELL_VIEW_CURSOR ||
+           type == LOK_CALLBACK_VIEW_CURSOR_VISIBLE;
+}
+
+uint64_t callbackIndexKey(int view, int type)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(view)) << 32) |
+           static_cast<uint32_t>(type);
+}
+
+} // namespace
+
+KitQueue::QueuedCallback::QueuedCallback(int view, int type, std::string payload)
+    : _callback(view, type, std::move(payload))
+    , _x(0)
+    , _y(0)
+    , _w(0)
+    , _h(0)
+    , _part(0)
+    , _mode(0)
+    , _hasRectangle(false)
+    , _removed(false)
+{
+    const std::string& data = _callback._payload;
+    if (type == LOK_CALLBACK_INVALIDATE_TILES)
+    {
+        _hasRectangle =
+            extractRectangle(StringVector::tokenize(data), _x, _y, _w, _h, _part, _mode);
+    }
+    else if (type == LOK_CALLBACK_STATE_CHANGED)
+    {
+        _key = extractUnoCommand(data);
+    }
+    else if (isViewCallback(type))
+    {
+        _key = extractViewId(data);
+    }
+}
+
 void KitQueue::putCallback(int view, int type, const std::string &payload)
 {
-    if (!elideDuplicateCallback(view, type, payload))
-        _callbacks.emplace_back(view, type, payload);
+    QueuedCallback callback(view, type, payload);
+    if (!elideDuplicateCallback(callback))
+        pushCallback(std::move(callback));
+}
+
+bool KitQueue::getCallback(Callback &callback)
+{
+    if (_callbacks.empty())
+        return false;
+
+    assert(!_callbacks.front()._removed && "Removed callbacks are never at the front");
+    callback = std::move(_callbacks.front()._callback);
+    _callbacks.pop_front();
+    ++_callbacksFrontSeq;
+    --_callbacksCount;
+
+    // Keep a live callback at the front.
+    while (!_callbacks.empty() && _callbacks.front()._removed)
+    {
+        _callbacks.pop_front();
+        ++_callbacksFrontSeq;
+    }
+
+    // Drained, so all that is indexed is stale.
+    if (_callbacks.empty())
+        _callbacksIndex.clear();
+
+    return true;
+}
+
+void KitQueue::pushCallback(QueuedCallback&& callback)
+{
+    const uint64_t seq = _callbacksFrontSeq + _callbacks.size();
+    if (isElidableCallback(callback._callback._type))
+    {
+        _callbacksIndex[callbackIndexKey(callback._callback._view, callback._callback._type)]
+            .push_back(seq);
+    }
+
+    _callbacks.push_back(std::move(callback));
+    ++_callbacksCount;
+}
+
+void KitQueue::removeCallback(QueuedCallback& callback)
+{
+    assert(!callback._removed && "Callback is already removed");
+    callback._removed = true;
+    std::string().swap(callback._callback._payload); // Free it now.
+    --_callbacksCount;
+
+    while (!_callbacks.empty() && _callbacks.front()._removed)
+    {
+        _callbacks.pop_front();
+        ++_callbacksFrontSeq;
+    }
+
+    // Don't clear the drained index here, our callers may be iterating it.
+}
+
+std::vector<uint64_t>* KitQueue::getCallbackIndex(int view, int type)
+{
+    const auto it = _callbacksIndex.find(callbackIndexKey(view, type));
+    if (it == _callbacksIndex.end())
+        return nullptr;
+
+    // Prune what was popped or removed since.
+    std::vector<uint64_t>& index = it->second;
+    const uint64_t endSeq = _callbacksFrontSeq + _callbacks.size();
+    index.erase(std::remove_if(index.begin(), index.end(),
+                               [&](uint64_t seq)
+                               {
+                                   return seq < _callbacksFrontSeq || seq >= endSeq ||
+                                          getQueuedCallback(seq)._removed;
+                               }),
+                index.end());
+
+    if (index.empty())
+    {
+        _callbacksIndex.erase(it);
+        return nullptr;
+    }
+
+    return &index;
 }
 
 bool KitQueue::elideDuplicateCallback(int view, int type, const std::string &payload)
 {
+    return elideDuplicateCallback(QueuedCallback(view, type, payload));
+}
+
+bool KitQueue::elideDuplicateCallback(const QueuedCallback& callback)
+{
+    const int view = callback._callback._view;
+    const int type = callback._callback._type;
+    const std::string& payload = callback._callback._payload;
     const auto callbackType = static_cast<LibreOfficeKitCallbackType>(type);
 
     // Nothing to combine in this case:
-    if (_callbacks.size() == 0)
+    if (_callbacksCount == 0)
+        return false;
+
+    // Only the callbacks of the same view and type are candidates.
+    std::vector<uint64_t>* index = getCallbackIndex(view, type);
+    if (index == nullptr)
         return false;
 
     switch (callbackType)
     {
         case LOK_CALLBACK_INVALIDATE_TILES: // invalidation
         {
-            StringVector tokens = StringVector::tokenize(payload);
-
-            int msgX, msgY, msgW, msgH, msgPart, msgMode;
-            if (!extractRectangle(tokens, msgX, msgY, msgW, msgH, msgPart, msgMode))
+            if (!callback._hasRectangle)
                 return false;
 
+            int msgX = callback._x;
+            int msgY = callback._y;
+            int msgW = callback._w;
+            int msgH = callback._h;
+            const int msgPart = callback._part;
+            const int msgMode = callback._mode;
+
             bool performedMerge = false;
 
-            // we always travel the entire queue
-            std::size_t i = 0;
-            while (i < _callbacks.size())
+            // we always travel all the invalidations of this view, which
+            // are kept few, as they are merged into their union when close.
+            for (const uint64_t seq : *index)
             {
-                auto& it = _callbacks[i];
+                if (seq < _callbacksFrontSeq)
+                    continue; // Removed, and popped, as we went.
 
-                if (it._type != type || it._view != view)
-                {
-                    ++i;
-                    continue;
-                }
-                StringVector queuedTokens = StringVector::tokenize(it._payload);
-
-                int queuedX, queuedY, queuedW, queuedH, queuedPart, queuedMode;
-
-                if (!extractRectangle(queuedTokens, queuedX, queuedY, queuedW, queuedH, queuedPart, queuedMode))
-                {
-                    ++i;
+                QueuedCallback& it = getQueuedCallback(seq);
+                if (it._removed || !it._hasRectangle)
                     continue;
-                }
 
-                if (msgPart != queuedPart)
-                {
-                    ++i;
+                if (msgPart != it._part || msgMode != it._mode)
                     continue;
-                }
 
-                if (msgMode != queuedMode)
-                {
-                    ++i;
-                    continue;
-                }
+                const int queuedX = it._x;
+                const int queuedY = it._y;
+                const int queuedW = it._w;
+                const int queuedH = it._h;
 
                 // the invalidation in the queue is fully covered by the payload,
                 // just remove it
@@ -232,11 +380,11 @@ bool KitQueue::elideDuplicateCallback(int view, int type, const std::string &pay
                     && queuedY + queuedH <= msgY + msgH)
                 {
                     LOG_TRC("Removing smaller invalidation: "
-                            << it._payload << " -> " << ' ' << msgX << ' ' << msgY << ' '
-                            << msgW << ' ' << msgH << ' ' << msgPart << ' ' << msgMode);
+                            << it._callback._payload << " -> " << ' ' << msgX << ' ' << msgY
+                            << ' ' << msgW << ' ' << msgH << ' ' << msgPart << ' ' << msgMode);
 
                     // remove from the queue
-                    _callbacks.erase(_callbacks.begin() + i);
+                    removeCallback(it);
                     continue;
                 }
 
@@ -253,17 +401,11 @@ bool KitQueue::elideDuplicateCallback(int view, int type, const std::string &pay
                     const int reasonableSizeX = 4 * 3840; // 4x tile at 100% zoom
                     const int reasonableSizeY = 2 * 3840; // 2x tile at 100% zoom
                     if (joinW > reasonableSizeX || joinH > reasonableSizeY)
-                    {
-                        ++i;
                         continue;
-                    }
 
                     LOG_TRC("Merging invalidations: "
                             << Callback::toString(view, type, payload) << " and "
-                            << tokens[0] << ' ' << tokens[1] << ' ' << tokens[2] << ' '
-                            << msgX << ' ' << msgY << ' ' << msgW << ' ' << msgH << ' '
-                            << msgPart << ' ' << msgMode << " -> "
-                            << tokens[0] << ' ' << tokens[1] << ' ' << tokens[2] << ' '
+                            << it._callback._payload << " -> "
                             << joinX << ' ' << joinY << ' ' << joinW << ' ' << joinH << ' '
                             << msgPart << ' ' << msgMode);
 
@@ -274,15 +416,14 @@ bool KitQueue::elideDuplicateCallback(int view, int type, const std::string &pay
                     performedMerge = true;
 
                     // remove from the queue
-                    _callbacks.erase(_callbacks.begin() + i);
+                    removeCallback(it);
                     continue;
                 }
-
-                ++i;
             }
 
             if (performedMerge)
             {
+                const StringVector tokens = StringVector::tokenize(payload);
                 std::string newPayload =
                     std::to_string(msgX) + ", " + std::to_string(msgY) + ", " +
                     std::to_string(msgW) + ", " + std::to_string(msgH) + ", " +
@@ -290,7 +431,11 @@ bool KitQueue::elideDuplicateCallback(int view, int type, const std::string &pay
 
                 LOG_TRC("Merge result: " << newPayload);
 
-                _callbacks.emplace_back(view, type, newPayload);
+                // Done with the index, so drop it if merging drained the queue.
+                if (_callbacks.empty())
+                    _callbacksIndex.clear();
+
+                pushCallback(QueuedCallback(view, type, std::move(newPayload)));
                 return true; // elide the original - use this instead
             }
         }
@@ -298,7 +443,7 @@ bool KitQueue::elideDuplicateCallback(int view, int type, const std::string &pay
 
         case LOK_CALLBACK_STATE_CHANGED: // state changed
         {
-            std::string unoCommand = extractUnoCommand(payload);
+            const std::string& unoCommand = callback._key;
             if (unoCommand.empty())
                 return false;
 
@@ -308,22 +453,21 @@ bool KitQueue::elideDuplicateCallback(int view, int type, const std::string &pay
                 return false;
 
             // remove obsolete states of the same .uno: command
-            size_t unoCommandLen = unoCommand.size();
-            for (size_t i = 0; i < _callbacks.size(); ++i)
+            const std::size_t unoCommandLen = unoCommand.size();
+            for (const uint64_t seq : *index)
             {
-                Callback& it = _callbacks[i];
-                if (it._type != type || it._view != view)
-                    continue;
+                if (seq < _callbacksFrontSeq)
+                    continue; // Removed, and popped, as we went.
 
-                size_t payloadLen = it._payload.size();
-                if (payloadLen < unoCommandLen + 1 ||
-                    unoCommand.compare(0, unoCommandLen, it._payload) != 0 ||
-                    it._payload[unoCommandLen] != '=')
+                QueuedCallback& it = getQueuedCallback(seq);
+                if (it._removed || it._key != unoCommand ||
+                    it._callback._payload.size() < unoCommandLen + 1 ||
+                    it._callback._payload[unoCommandLen] != '=')
                     continue;
 
-                LOG_TRC("Remove obsolete uno command: " << it << " -> "
+                LOG_TRC("Remove obsolete uno command: " << it._callback << " -> "
                         << Callback::toString(view, type, payload));
-                _callbacks.erase(_callbacks.begin() + i);
+                removeCallback(it);
                 break;
             }
         }
@@ -338,41 +482,25 @@ bool KitQueue::elideDuplicateCallback(int view, int type, const std::string &pay
         case LOK_CALLBACK_CELL_VIEW_CURSOR: // the view cell cursor has moved
         case LOK_CALLBACK_VIEW_CURSOR_VISIBLE: // the view cursor visibility has changed
         {
-            const bool isViewCallback = (callbackType == LOK_CALLBACK_INVALIDATE_VIEW_CURSOR ||
-                                         callbackType == LOK_CALLBACK_CELL_VIEW_CURSOR ||
-                                         callbackType == LOK_CALLBACK_VIEW_CURSOR_VISIBLE);
-
-            const std::string viewId
-                = (isViewCallback ? extractViewId(payload) : std::string());
-
-            for (std::size_t i = 0; i < _callbacks.size(); ++i)
+            for (const uint64_t seq : *index)
             {
-                const auto& it = _callbacks[i];
+                if (seq < _callbacksFrontSeq)
+                    continue; // Removed, and popped, as we went.
 
-                if (it._type != type || it._view != view)
+                QueuedCallback& it = getQueuedCallback(seq);
+                if (it._removed)
                     continue;
 
-                if (!isViewCallback)
-                {
-                    LOG_TRC("Remove obsolete callback: " << it <<  " -> "
-                            << Callback::toString(view, type, payload));
-                    _callbacks.erase(_callbacks.begin() + i);
-                    break;
-                }
-                else if (isViewCallback)
-                {
-                    // we additionally need to ensure that the payload is about
-                    // the same viewid (otherwise we'd merge them all views into
-                    // one)
-                    const std::string queuedViewId = extractViewId(it._payload);
-                    if (viewId == queuedViewId)
-                    {
-                        LOG_TRC("Remove obsolete view callback: " << it << " -> "
-                                << Callback::toString(view, type, payload));
-                        _callbacks.erase(_callbacks.begin() + i);
-                        break;
-                    }
-                }
+                // For view callbacks, we additionally need to ensure that the
+                // payload is about the same viewid (otherwise we'd merge them
+                // all views into one)
+                if (isViewCallback(type) && it._key != callback._key)
+                    continue;
+
+                LOG_TRC("Remove obsolete " << (isViewCallback(type) ? "view " : "") << "callback: "
+                        << it._callback << " -> " << Callback::toString(view, type, payload));
+                removeCallback(it);
+                break;
             }
         }
         break;
@@ -382,6 +510,10 @@ bool KitQueue::elideDuplicateCallback(int view, int type, const std::string &pay
 
     } // switch
 
+    // Done with the index, so drop it if removals drained the queue.
+    if (_callbacks.empty())
+        _callbacksIndex.clear();
+
     // Append the new command to the callbacks list
     return false;
 }
@@ -865,10 +997,14 @@ void KitQueue::dumpState(std::ostream& oss)
             oss << "\t\t\t" << i++ << ": " << it.serialize() << "\n";
     }
 
-    oss << "\tCallbacks size: " << _callbacks.size() << "\n";
+    oss << "\tCallbacks size: " << _callbacksCount << " (" << _callbacks.size()
+        << " queued, indexed by " << _callbacksIndex.size() << " view-types)\n";
     i = 0;
-    for (auto &it : _callbacks)
-        oss << "\t\t" << i++ << ": " << it << "\n";
+    for (const QueuedCallback& it : _callbacks)
+    {
+        if (!it._removed)
+            oss << "\t\t" << i++ << ": " << it._callback << "\n";
+    }
 }
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
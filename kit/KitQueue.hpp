@@ -13,9 +13,12 @@
 
 #include <stdexcept>
 #include <algorithm>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "Log.hpp"
@@ -109,20 +112,13 @@ public:
     /// Obtain the next callback
     Callback getCallback()
     {
-        assert(_callbacks.size() > 0);
-        Callback front = _callbacks.front();
-        _callbacks.erase(_callbacks.begin());
+        assert(callbackSize() > 0);
+        Callback front;
+        getCallback(front);
         return front;
     }
 
-    bool getCallback(Callback &callback)
-    {
-        if (_callbacks.size() == 0)
-            return false;
-        callback = std::move(_callbacks.front());
-        _callbacks.erase(_callbacks.begin());
-        return true;
-    }
+    bool getCallback(Callback &callback);
 
     /// Anything in the queue ?
     bool isEmpty()
@@ -137,7 +133,7 @@ public:
 
     size_t callbackSize() const
     {
-        return _callbacks.size();
+        return _callbacksCount;
     }
 
     /// Removal of all the pending messages.
@@ -145,6 +141,9 @@ public:
     {
         _queue.clear();
         _callbacks.clear();
+        _callbacksIndex.clear();
+        _callbacksFrontSeq = 0;
+        _callbacksCount = 0;
     }
 
     void dumpState(std::ostream& oss);
@@ -167,6 +166,45 @@ protected:
     std::string combineRemoveText(const StringVector& tokens);
 
 private:
+    /// A queued callback, with what we need to elide it parsed once.
+    struct QueuedCallback
+    {
+        QueuedCallback(int view, int type, std::string payload);
+
+        Callback _callback;
+        /// The .uno: command of state changes, or the viewId of view-cursor callbacks.
+        std::string _key;
+        /// The rectangle of invalidations; all of the document for EMPTY.
+        int _x;
+        int _y;
+        int _w;
+        int _h;
+        int _part;
+        int _mode;
+        bool _hasRectangle; ///< False when the invalidation is not understood.
+        bool _removed; ///< Elided, but left in place until popped.
+    };
+
+    /// Work back over the queue to simplify & return false if we should not queue.
+    bool elideDuplicateCallback(const QueuedCallback& callback);
+
+    /// Append to the callbacks, and index it if it could be elided later.
+    void pushCallback(QueuedCallback&& callback);
+
+    /// Mark the given callback as removed, and pop removed ones at the front.
+    void removeCallback(QueuedCallback& callback);
+
+    /// Returns the queued callbacks of the given view and type, oldest first,
+    /// pruning the ones no longer queued. Null when there are none.
+    std::vector<uint64_t>* getCallbackIndex(int view, int type);
+
+    /// Returns the queued callback with the given sequence number.
+    QueuedCallback& getQueuedCallback(uint64_t seq)
+    {
+        assert(seq >= _callbacksFrontSeq && seq - _callbacksFrontSeq < _callbacks.size());
+        return _callbacks[seq - _callbacksFrontSeq];
+    }
+
     /// Search the queue for a duplicate callback and remove it (if present).
     ///
     /// This removes also callbacks that are made invalid by the current
@@ -187,8 +225,20 @@ private:
     typedef std::pair<CanonicalViewId, std::vector<TileDesc>> viewTileQueue;
     std::vector<viewTileQueue> _tileQueues;
 
-    /// Queue of callbacks from Kit to send out to coolwsd
-    std::vector<Callback> _callbacks;
+    /// Queue of callbacks from Kit to send out to coolwsd.
+    /// Elided callbacks are marked removed, rather than erased, until they reach the front.
+    std::deque<QueuedCallback> _callbacks;
+
+    /// The sequence number of the front of _callbacks; they are numbered in order.
+    uint64_t _callbacksFrontSeq = 0;
+
+    /// The number of callbacks in _callbacks that are not removed.
+    std::size_t _callbacksCount = 0;
+
+    /// Sequence numbers of the callbacks we might elide, by view and type.
+    /// May include ones already popped or removed, which are pruned on access,
+    /// and all are dropped whenever the queue drains.
+    std::unordered_map<uint64_t, std::vector<uint64_t>> _callbacksIndex;
 };
 
 inline std::ostream& operator<<(std::ostream& os, const KitQueue::Callback &c)
@@ -36,11 +36,16 @@
 using Poco::Exception;
 
 void KitWebSocketHandler::handleMessage(const std::vector<char>& data)
+{
+    handleMessageInPlace(data.data(), data.size());
+}
+
+void KitWebSocketHandler::handleMessageInPlace(const char* data, std::size_t size)
 {
     // To get A LOT of Trace Events, to exercise their handling, uncomment this:
     // ProfileZone profileZone("KitWebSocketHandler::handleMessage");
 
-    std::string message(data.data(), data.size());
+    std::string message(data, size);
 
     if (!Util::isMobileApp() && UnitKit::get().filterKitMessage(this, message))
         return;
@@ -82,6 +87,7 @@ void KitWebSocketHandler::handleMessage(const std::vector<char>& data)
             _document = std::make_shared<Document>(
                 _loKit, _jailId, _docKey, docId, url,
                 std::static_pointer_cast<WebSocketHandler>(shared_from_this()), _mobileAppDocId);
+            _document->setRecyclable(_recycleDocuments);
             _ksPoll->setDocument(_document);
 
             // We need to send the process name information to WSD if Trace Event recording is enabled (but
@@ -99,6 +105,15 @@ void KitWebSocketHandler::handleMessage(const std::vector<char>& data)
             LOG_DBG("CreateSession failed.");
         }
     }
+    else if (tokens.equals(0, "recycle"))
+    {
+        LOG_INF("Will unload documents when done, to load others, rather than exit");
+        if (!_recycleDocuments && !_document)
+            snapshotJailTmp();
+        _recycleDocuments = true;
+        if (_document)
+            _document->setRecyclable(true);
+    }
     else if (!Util::isFuzzing() && tokens.equals(0, "exit"))
     {
         if constexpr (!Util::isMobileApp())
@@ -29,6 +29,7 @@ class KitWebSocketHandler final : public WebSocketHandler
     std::shared_ptr<KitSocketPoll> _ksPoll;
     const unsigned _mobileAppDocId;
     bool _backgroundSaver;
+    bool _recycleDocuments; ///< Unload documents when done, rather than exit, to load others.
 
 public:
     KitWebSocketHandler(const std::string& socketName, const std::shared_ptr<lok::Office>& loKit,
@@ -41,6 +42,7 @@ public:
         , _ksPoll(std::move(ksPoll))
         , _mobileAppDocId(mobileAppDocId)
         , _backgroundSaver(false)
+        , _recycleDocuments(false)
     {
     }
 
@@ -51,10 +53,14 @@ public:
 
     void shutdownForBackgroundSave();
 
+    /// Forgets the document, done and unloading, to create the next one on 'session'.
+    void dropDocument() { _document.reset(); }
+
     int getKitId() const { return _mobileAppDocId; }
 
 protected:
     virtual void handleMessage(const std::vector<char>& data) override;
+    virtual void handleMessageInPlace(const char* data, std::size_t size) override;
     virtual void enableProcessInput(bool enable = true) override;
     virtual void onDisconnect() override;
 };
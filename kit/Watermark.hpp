@@ -17,13 +17,27 @@
 #include <LibreOfficeKit/LibreOfficeKitEnums.h>
 #include <vector>
 #include <Log.hpp>
+#include <Simd.hpp>
 #include <cstdlib>
 #include <string>
 #include <cmath>
 #include <unordered_map>
+#include <utility>
+
+#include "DeltaSimd.h"
 
 class Watermark final
 {
+    friend class WatermarkTests;
+
+    /// A pre-multiplied watermark pixmap, and for each of its rows the
+    /// [start, end) runs of pixels that are not fully transparent.
+    struct Bitmap
+    {
+        std::vector<unsigned char> _pixels;
+        std::vector<std::vector<std::pair<int, int>>> _spans;
+    };
+
 public:
     Watermark(const std::shared_ptr<lok::Document>& loKitDoc, const std::string& text,
               double opacity)
@@ -43,81 +57,131 @@ public:
                    int offsetX, int offsetY,
                    int tilesPixmapWidth, int tilesPixmapHeight,
                    int tileWidth, int tileHeight,
-                   LibreOfficeKitTileMode /*mode*/,
+                   LibreOfficeKitTileMode mode,
                    bool isSlideShowLayer = false)
     {
         // set requested watermark size a little bit smaller than tile size
         const int width = tileWidth * 0.8;
         const int height = tileHeight * 0.8;
 
-        const std::vector<unsigned char>* pixmap = getPixmap(width, height);
+        const Bitmap* bitmap = getBitmap(width, height, mode);
 
-        if (pixmap && tilePixmap)
+        if (bitmap && tilePixmap)
         {
             // center watermark
             const int maxX = std::min(tileWidth, width);
             const int maxY = std::min(tileHeight, height);
             offsetX += (tileWidth - maxX) / 2;
             offsetY += (tileHeight - maxY) / 2;
-            alphaBlend(*pixmap, width, height, offsetX, offsetY,
+            const bool isCalc = (_loKitDoc->getDocumentType() == LOK_DOCTYPE_SPREADSHEET);
+            alphaBlend(*bitmap, width, height, offsetX, offsetY,
                        tilePixmap, tilesPixmapWidth, tilesPixmapHeight,
-                       /*isFontBlending*/ false,  isSlideShowLayer);
+                       /*blendAll*/ isCalc, isSlideShowLayer);
         }
     }
 
 private:
-    /// Alpha blend pixels from 'from' over the 'to'.
-    void alphaBlend(const std::vector<unsigned char>& from, int from_width, int from_height, int from_offset_x, int from_offset_y,
-            unsigned char* to, int to_width, int to_height, const bool isFontBlending, bool isSlideShowLayer = false)
+    /// Blend count pre-multiplied pixels from 'from' over 'to' in fixed-point.
+    /// Unless blendAll, only opaque destination pixels are blended, or with
+    /// isSlideShowLayer also fully transparent ones, which end up with an
+    /// eighth of the watermark's alpha.
+    static void blendRow(unsigned char* to, const unsigned char* from, int count,
+                         bool blendAll, bool isSlideShowLayer)
+    {
+        if (simd::HasAVX2)
+        {
+            const int done = simd_alphaBlendRow(to, from, count, blendAll, isSlideShowLayer);
+            to += 4 * done;
+            from += 4 * done;
+            count -= done;
+        }
+
+        for (; count > 0; --count, to += 4, from += 4)
+        {
+            const bool isTransparentBackground = isSlideShowLayer && to[3] == 0;
+            if (!blendAll && to[3] != 255 && !isTransparentBackground)
+                continue;
+
+            // out = src + dst * (255 - src_alpha) / 255, the same for all channels.
+            const unsigned int inverseAlpha = 255 - from[3];
+            for (int i = 0; i < 4; ++i)
+            {
+                const unsigned int product = to[i] * inverseAlpha;
+                const unsigned int value = from[i] + ((product + 1 + (product >> 8)) >> 8);
+                to[i] = std::min(value, 255U);
+            }
+
+            if (isTransparentBackground)
+                to[3] /= 8;
+        }
+    }
+
+    /// Alpha blend pixels from 'from' over the 'to', skipping the
+    /// transparent parts of 'from' if it has spans.
+    static void alphaBlend(const Bitmap& from, int from_width, int from_height, int from_offset_x, int from_offset_y,
+            unsigned char* to, int to_width, int to_height, const bool blendAll, bool isSlideShowLayer = false)
     {
-        bool isCalc = (_loKitDoc->getDocumentType() == LOK_DOCTYPE_SPREADSHEET);
+        const int maxX = std::min(from_width, to_width - from_offset_x);
         for (int to_y = from_offset_y, from_y = 0; (to_y < to_height) && (from_y < from_height) ; ++to_y, ++from_y)
-            for (int to_x = from_offset_x, from_x = 0; (to_x < to_width) && (from_x < from_width); ++to_x, ++from_x)
+        {
+            unsigned char* t = to + 4 * (to_y * to_width + from_offset_x);
+            const unsigned char* f = from._pixels.data() + 4 * (from_y * from_width);
+            if (from._spans.empty())
+            {
+                blendRow(t, f, maxX, blendAll, isSlideShowLayer);
+                continue;
+            }
+
+            for (const auto& span : from._spans[from_y])
             {
-                unsigned char* t = to + 4 * (to_y * to_width + to_x);
+                const int end = std::min(span.second, maxX);
+                if (span.first < end)
+                    blendRow(t + 4 * span.first, f + 4 * span.first, end - span.first,
+                             blendAll, isSlideShowLayer);
+            }
+        }
+    }
+
+    /// Find the runs of non-transparent pixels in each row, merging those
+    /// separated by short gaps to keep the runs long enough to vectorize.
+    static void computeSpans(Bitmap& bitmap, int width, int height)
+    {
+        constexpr int minGap = 16;
 
-                const bool isTransparentBackground = isSlideShowLayer && t[3] == 0;
-                if (!isFontBlending && !isCalc && t[3] != 255 && !isTransparentBackground)
+        bitmap._spans.assign(height, {});
+        for (int y = 0; y < height; ++y)
+        {
+            const uint32_t* row = reinterpret_cast<const uint32_t*>(bitmap._pixels.data()) + y * width;
+            std::vector<std::pair<int, int>>& spans = bitmap._spans[y];
+            for (int x = 0; x < width; ++x)
+            {
+                if (!row[x])
                     continue;
 
-                double dst_r = t[0];
-                double dst_g = t[1];
-                double dst_b = t[2];
-                double dst_a = t[3] / 255.0;
-
-                const unsigned char* f = from.data() + 4 * (from_y * from_width + from_x);
-                double src_r = f[0];
-                double src_g = f[1];
-                double src_b = f[2];
-                double src_a = f[3] / 255.0;
-
-                double out_a = src_a + dst_a * (1.0 - src_a);
-                if (isTransparentBackground)
-                    out_a /= 8;
-                unsigned char out_r = src_r + dst_r * (1.0 - src_a);
-                unsigned char out_g = src_g + dst_g * (1.0 - src_a);
-                unsigned char out_b = src_b + dst_b * (1.0 - src_a);
-
-                t[0] = out_r;
-                t[1] = out_g;
-                t[2] = out_b;
-                t[3] = static_cast<unsigned char>(out_a * 255.0);
+                if (!spans.empty() && x - spans.back().second < minGap)
+                    spans.back().second = x + 1;
+                else
+                    spans.emplace_back(x, x + 1);
             }
+        }
     }
 
     /// Create bitmap that we later use as the watermark for every tile.
-    const std::vector<unsigned char>* getPixmap(int width, int height)
+    const Bitmap* getBitmap(int width, int height, LibreOfficeKitTileMode mode)
     {
         if (_loKitDoc == nullptr)
         {
             return nullptr;
         }
 
-        const size_t key = width + height * 10000;
+        // The watermark is grey, so the mode doesn't change the pixels,
+        // but keep them apart should that ever change.
+        const size_t key = (width + height * 10000) * 2 + (mode == LOK_TILEMODE_BGRA ? 1 : 0);
 
-        if (_pixmaps.find(key) != _pixmaps.end())
+        const auto it = _bitmaps.find(key);
+        if (it != _bitmaps.end())
         {
-            return &_pixmaps[key];
+            return &it->second;
         }
 
         // renderFont returns a buffer based on RGBA mode, where r, g, b
@@ -138,8 +202,9 @@ private:
         // No longer needed.
         std::free(textPixels);
 
-        _pixmaps.emplace(key, std::vector<unsigned char>(pixel_count));
-        std::vector<unsigned char>& _pixmap = _pixmaps[key];
+        Bitmap& bitmap = _bitmaps[key];
+        bitmap._pixels.resize(pixel_count);
+        std::vector<unsigned char>& _pixmap = bitmap._pixels;
 
         /*
             apply 2d rotation transformation (counter-clockwise):
@@ -212,7 +277,9 @@ private:
         }
 
         // Now copy the (black) text over the (white) blur
-        alphaBlend(_rotatedText, width, height, 0, 0, _pixmap.data(), width, height, true);
+        Bitmap rotatedText;
+        rotatedText._pixels = std::move(_rotatedText);
+        alphaBlend(rotatedText, width, height, 0, 0, _pixmap.data(), width, height, true);
 
         // Make the resulting pixmap semi-transparent
         for (unsigned char* p = _pixmap.data(); p < _pixmap.data() + pixel_count; p++)
@@ -220,7 +287,9 @@ private:
             *p = static_cast<unsigned char>(*p * _alphaLevel);
         }
 
-        return &_pixmap;
+        computeSpans(bitmap, width, height);
+
+        return &bitmap;
     }
 
 private:
@@ -228,7 +297,7 @@ private:
     const std::string _text;
     const std::string _font;
     const double _alphaLevel;
-    std::unordered_map<size_t, std::vector<unsigned char>> _pixmaps;
+    std::unordered_map<size_t, Bitmap> _bitmaps;
 };
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
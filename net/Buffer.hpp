@@ -14,19 +14,86 @@
 #include <common/Util.hpp>
 
 #include <assert.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <deque>
+#include <memory>
 #include <ostream>
 #include <vector>
 
-// Blocks -> we can share from client -> server ... etc.
-// headers / and a 'writeV' etc. =)
-
 /**
  * Encapsulate data we need to write.
+ *
+ * Data is appended to a contiguous buffer, unless shared segments are
+ * queued: large payloads owned elsewhere (eg. a tile message sent to
+ * many viewers) are referenced, not copied, and written with writev.
+ * Anything appended after a segment goes into an owned tail segment to
+ * preserve ordering. data(), begin(), end() and operator[] only cover
+ * the contiguous head of the buffer.
  */
 class Buffer
 {
+    /// A span of data kept alive by its owner.
+    struct Segment
+    {
+        std::shared_ptr<const void> _owner;
+        const char* _data;
+        std::size_t _size;
+    };
+
     std::size_t _offset;  /// offset into _buffer of data
     std::vector<char> _buffer;
+    std::deque<Segment> _segments; /// queued after _buffer
+    std::size_t _segmentsSize; /// total bytes in _segments
+    std::shared_ptr<std::vector<char>> _tail; /// owned storage for appends after segments
+
+    /// Minimum capacity of an owned tail segment.
+    static constexpr std::size_t TailCapacity = 4096;
+
+    std::size_t headSize() const { return _buffer.size() - _offset; }
+
+    void appendTail(const char* data, const std::size_t len)
+    {
+        if (_tail && _segments.back()._owner == _tail &&
+            _tail->capacity() - _tail->size() >= len)
+        {
+            // Fits without reallocating, so the segment pointer stays valid.
+            _tail->insert(_tail->end(), data, data + len);
+            _segments.back()._size += len;
+        }
+        else
+        {
+            _tail = std::make_shared<std::vector<char>>();
+            _tail->reserve(std::max(len, TailCapacity));
+            _tail->insert(_tail->end(), data, data + len);
+            _segments.push_back(Segment{ _tail, _tail->data(), len });
+        }
+
+        _segmentsSize += len;
+    }
+
+    void eraseSegments(std::size_t len)
+    {
+        while (len > 0 && !_segments.empty())
+        {
+            Segment& segment = _segments.front();
+            if (len < segment._size)
+            {
+                segment._data += len;
+                segment._size -= len;
+                _segmentsSize -= len;
+                return;
+            }
+
+            len -= segment._size;
+            _segmentsSize -= segment._size;
+            _segments.pop_front();
+        }
+
+        if (_segments.empty())
+            _tail.reset();
+    }
 
     void resetOffset()
     {
@@ -37,27 +104,69 @@ class Buffer
     }
 
 public:
-    Buffer() : _offset(0)
+    Buffer()
+        : _offset(0)
+        , _segmentsSize(0)
     {
     }
 
+    /// Maximum number of blocks gathered for a single vectored write.
+    static constexpr int MaxBlocks = 64;
+
     typedef std::vector<char>::iterator iterator;
     typedef std::vector<char>::const_iterator const_iterator;
 
-    std::size_t size() const { return _buffer.size() - _offset; }
+    std::size_t size() const { return headSize() + _segmentsSize; }
     std::size_t capacity() const { return _buffer.capacity(); }
-    bool empty() const { return _offset == _buffer.size(); }
+    bool empty() const { return size() == 0; }
+
+    /// True when shared segments are queued, and writing should gather blocks.
+    bool hasSegments() const { return !_segments.empty(); }
 
     const char *getBlock() const
     {
-        if (!empty())
+        if (headSize() > 0)
             return &_buffer[_offset];
+        if (!_segments.empty())
+            return _segments.front()._data;
         return nullptr;
     }
 
     std::size_t getBlockSize() const
     {
-        return size();
+        if (headSize() > 0 || _segments.empty())
+            return headSize();
+        return _segments.front()._size;
+    }
+
+    /// Fill @iov with up to @maxCount blocks, in order, covering at most
+    /// @maxBytes of data. Returns the number of blocks filled.
+    int getBlocks(iovec* iov, const int maxCount, std::size_t maxBytes) const
+    {
+        int count = 0;
+        const auto add = [&](const char* data, std::size_t len)
+        {
+            len = std::min(len, maxBytes);
+            if (len == 0 || count >= maxCount)
+                return false;
+
+            iov[count].iov_base = const_cast<char*>(data);
+            iov[count].iov_len = len;
+            ++count;
+            maxBytes -= len;
+            return true;
+        };
+
+        if (headSize() > 0 && !add(&_buffer[_offset], headSize()))
+            return count;
+
+        for (const Segment& segment : _segments)
+        {
+            if (!add(segment._data, segment._size))
+                break;
+        }
+
+        return count;
     }
 
     void eraseFirst(std::size_t len)
@@ -65,16 +174,25 @@ public:
         if (len <= 0)
             return;
 
+        if (!_segments.empty() && len >= headSize())
+        {
+            assert(len <= size());
+            eraseSegments(len - headSize());
+            _buffer.clear();
+            resetOffset();
+            return;
+        }
+
         assert(_offset + len <= _buffer.size());
-        assert(_offset + size() == _buffer.size());
+        assert(_offset + headSize() == _buffer.size());
 
-        len = std::min(len, size()); // Avoid accidental damage.
+        len = std::min(len, headSize()); // Avoid accidental damage.
 
         // avoid regular shuffling down larger chunks of data
         if (_buffer.size() > 16384 && // lots of queued data
-            len < size() &&           // not a complete erase
+            len < headSize() &&       // not a complete erase
             _offset < 16384 * 64 &&   // do cleanup a Mb at a time or so:
-            size() > 512)             // early cleanup if what remains is small.
+            headSize() > 512)         // early cleanup if what remains is small.
         {
             _offset += len;
             return;
@@ -86,7 +204,21 @@ public:
 
     void append(const char *data, const int len)
     {
-        _buffer.insert(_buffer.end(), data, data + len);
+        if (!_segments.empty())
+            appendTail(data, len);
+        else
+            _buffer.insert(_buffer.end(), data, data + len);
+    }
+
+    /// Queue @len bytes at @data without copying them.
+    /// @owner keeps the data alive, and unchanged, until written.
+    void appendShared(std::shared_ptr<const void> owner, const char* data, const std::size_t len)
+    {
+        if (len == 0)
+            return;
+
+        _segments.push_back(Segment{ std::move(owner), data, len });
+        _segmentsSize += len;
     }
 
     void append(const std::string& s) { append(s.c_str(), s.size()); }
@@ -101,17 +233,23 @@ public:
     void dumpHex(std::ostream &os, const char *legend, const char *prefix) const
     {
         if (size() > 0 || _offset > 0)
-            os << prefix << "Buffer size: " << size() << " offset: " << _offset << '\n';
+            os << prefix << "Buffer size: " << size() << " offset: " << _offset
+               << " segments: " << _segments.size() << '\n';
         if (_buffer.size() > 0)
             Util::dumpHex(os, _buffer, legend, prefix);
     }
 
     // various std::vector API compatibility functions
 
+    /// Note: keeps the storage, since a message may still be
+    /// handled in place when the owner stops reading input.
     void clear()
     {
         _buffer.clear();
-        resetOffset();
+        _offset = 0;
+        _segments.clear();
+        _segmentsSize = 0;
+        _tail.reset();
     }
 
     iterator begin() { return _buffer.begin() + _offset; }
@@ -15,8 +15,14 @@
 #include "HttpRequest.hpp"
 
 #include <algorithm>
+#include <cerrno>
+#include <memory>
 #include <string>
-#include <zlib.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <Poco/Net/HTTPResponse.h>
 
@@ -27,53 +33,94 @@
 
 namespace HttpHelper
 {
-void sendUncompressedFileContent(const std::shared_ptr<StreamSocket>& socket,
-                                 const std::string& path, const int bufferSize)
+/// Sends the file's content straight from a read-only mapping. Only for files that
+/// we own: a mapped file truncated under us raises SIGBUS on access.
+static void sendMappedFileContent(const std::shared_ptr<StreamSocket>& socket,
+                                  const std::string& path, const std::size_t size)
 {
-    std::ifstream file(path, std::ios::binary);
-    std::unique_ptr<char[]> buf = std::make_unique<char[]>(bufferSize);
-    do
+    if (size == 0)
+        return; // Nothing to map.
+
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
     {
-        file.read(&buf[0], bufferSize);
-        const int size = file.gcount();
-        if (size > 0)
-            socket->send(&buf[0], size, true);
-        else
-            break;
-    } while (file);
+        LOG_SYS('#' << socket->getFD() << ": Failed to open [" << path << "] to send");
+        return;
+    }
+
+    // Never map past the end, in case the file shrank since we stat'ed it.
+    struct stat st;
+    const std::size_t mapSize =
+        (::fstat(fd, &st) == 0 ? std::min<std::size_t>(size, st.st_size) : 0);
+    void* data =
+        (mapSize > 0 ? ::mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        LOG_SYS('#' << socket->getFD() << ": Failed to map [" << path << "] to send");
+        return;
+    }
+
+    // We are going to read it all, sequentially.
+    ::madvise(data, mapSize, MADV_SEQUENTIAL);
+
+    // send() takes an int length.
+    constexpr std::size_t MaxChunkSize = 64 * 1024 * 1024;
+    const char* begin = static_cast<const char*>(data);
+    for (std::size_t offset = 0; offset < mapSize; offset += MaxChunkSize)
+        socket->send(begin + offset, std::min(mapSize - offset, MaxChunkSize), true);
+
+    ::munmap(data, mapSize);
 }
 
-void sendDeflatedFileContent(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
-                             const int fileSize)
+/// Sends the file's content by reading it in chunks of @bufferSize. Safe for files
+/// that others, e.g. a Kit in its jail, may change while we send them.
+static void sendUncompressedFileContent(const std::shared_ptr<StreamSocket>& socket,
+                                        const std::string& path, const std::size_t size,
+                                        const int bufferSize)
 {
-    // FIXME: Should compress once ahead of time
-    // compression of bundle.js takes significant time:
-    //   200's ms for level 9 (468k), 72ms for level 1(587k)
-    //   down from 2Mb.
-    if (fileSize > 0)
+    if (size == 0)
+        return;
+
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
     {
-        std::ifstream file(path, std::ios::binary);
-        std::unique_ptr<char[]> buf = std::make_unique<char[]>(fileSize);
-        file.read(&buf[0], fileSize);
-
-        static const unsigned int Level = 1;
-        const long unsigned int size = file.gcount();
-        long unsigned int compSize = compressBound(size);
-        std::unique_ptr<char[]> cbuf = std::make_unique<char[]>(compSize);
-        int result = compress2((Bytef*)&cbuf[0], &compSize, (Bytef*)&buf[0], size, Level);
-        if (result != Z_OK)
-        {
-             LOG_ERR("failed compress of: " << path << " result: " << result);
-             return;
-        }
-        if (size > 0)
-            socket->send(&cbuf[0], compSize, true);
+        LOG_SYS('#' << socket->getFD() << ": Failed to open [" << path << "] to send");
+        socket->shutdown();
+        return;
+    }
+
+    std::unique_ptr<char[]> buf = std::make_unique<char[]>(bufferSize);
+    std::size_t sent = 0;
+    while (sent < size)
+    {
+        // Never send more than the Content-Length, in case the file grew.
+        const ssize_t len =
+            ::read(fd, buf.get(), std::min<std::size_t>(bufferSize, size - sent));
+        if (len < 0 && errno == EINTR)
+            continue;
+
+        if (len <= 0)
+            break;
+
+        socket->send(buf.get(), len, true);
+        sent += len;
+    }
+
+    ::close(fd);
+
+    if (sent < size)
+    {
+        // The file shrank, or failed; the client can't get a valid response now.
+        LOG_ERR('#' << socket->getFD() << ": Sent only " << sent << " of " << size
+                     << " bytes of [" << path << "], closing");
+        socket->shutdown();
     }
 }
 
 static void sendFileImpl(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
-                         http::Response& response, const bool noCache,
-                         const bool deflate, const bool headerOnly, const bool closeSocket)
+                         http::Response& response, const bool noCache, const bool headerOnly,
+                         const bool closeSocket, const bool mapFile)
 {
     FileUtil::Stat st(path);
     if (st.bad())
@@ -107,46 +154,42 @@ static void sendFileImpl(const std::shared_ptr<StreamSocket>& socket, const std:
         bufferSize = socket->getSendBufferSize();
     }
 
-    // Disable deflate for now - until we can cache deflated data.
-    // FIXME: IE/Edge doesn't work well with deflate, so check with
-    // IE/Edge before enabling the deflate again
-    if (!deflate || true)
-    {
-        response.setContentLength(st.size());
-        LOG_TRC('#' << socket->getFD() << ": Sending " << (headerOnly ? "header for " : "")
-                    << " file [" << path << "].");
-        socket->send(response);
+    // Static assets are served pre-compressed by FileServerRequestHandler;
+    // these are one-off files, which aren't worth compressing per request.
+    response.setContentLength(st.size());
+    LOG_TRC('#' << socket->getFD() << ": Sending " << (headerOnly ? "header for " : "")
+                << " file [" << path << "].");
+    socket->send(response);
 
-        if (!headerOnly)
-            sendUncompressedFileContent(socket, path, bufferSize);
-    }
-    else
+    if (!headerOnly)
     {
-        response.set("Content-Encoding", "deflate");
-        LOG_TRC('#' << socket->getFD() << ": Sending " << (headerOnly ? "header for " : "")
-                    << " file [" << path << "].");
-        socket->send(response);
-
-        if (!headerOnly)
-            sendDeflatedFileContent(socket, path, st.size());
+        if (mapFile)
+            sendMappedFileContent(socket, path, st.size());
+        else
+            sendUncompressedFileContent(socket, path, st.size(), bufferSize);
     }
+
     if(closeSocket) {
         socket->shutdown();
     }
 }
 
 void sendFile(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
-              http::Response& response, const bool noCache,
-              const bool deflate, const bool headerOnly)
+              http::Response& response, const bool noCache, const bool headerOnly)
+{
+    sendFileImpl(socket, path, response, noCache, headerOnly, false, false);
+}
+
+void sendStaticFile(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
+                    http::Response& response, const bool noCache)
 {
-    sendFileImpl(socket, path, response, noCache, deflate, headerOnly, false);
+    sendFileImpl(socket, path, response, noCache, false, false, true);
 }
 
 void sendFileAndShutdown(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
-                         http::Response& response, const bool noCache,
-                         const bool deflate, const bool headerOnly)
+                         http::Response& response, const bool noCache, const bool headerOnly)
 {
-    sendFileImpl(socket, path, response, noCache, deflate, headerOnly, true);
+    sendFileImpl(socket, path, response, noCache, headerOnly, true, false);
 }
 
 } // namespace HttpHelper
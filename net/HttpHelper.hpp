@@ -48,13 +48,46 @@ inline void sendErrorAndShutdown(http::StatusCode errorCode,
 
 /// Sends file as HTTP response and shutdown the socket.
 void sendFileAndShutdown(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
-                         http::Response& response,
-                         const bool noCache = false, const bool deflate = false, const bool headerOnly = false);
+                         http::Response& response, const bool noCache = false,
+                         const bool headerOnly = false);
 
 /// Sends file as HTTP response.
 void sendFile(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
-              http::Response& response,
-              const bool noCache = false, const bool deflate = false, const bool headerOnly = false);
+              http::Response& response, const bool noCache = false,
+              const bool headerOnly = false);
+
+/// Sends a file that coolwsd owns, and nobody truncates, as HTTP response,
+/// straight from a mapping. Never for files in a jail, or the caches.
+void sendStaticFile(const std::shared_ptr<StreamSocket>& socket, const std::string& path,
+                    http::Response& response, const bool noCache = false);
+
+/// True iff the If-None-Match header value matches the given (strong) etag.
+/// Handles the wildcard, lists, and the weak W/ prefix, which we compare weakly.
+inline bool matchesETag(std::string_view ifNoneMatch, std::string_view etag)
+{
+    constexpr std::string_view Space = " \t";
+    while (!ifNoneMatch.empty())
+    {
+        const std::size_t comma = ifNoneMatch.find(',');
+        std::string_view tag = ifNoneMatch.substr(0, comma);
+        ifNoneMatch = (comma == std::string_view::npos ? std::string_view()
+                                                       : ifNoneMatch.substr(comma + 1));
+
+        const std::size_t first = tag.find_first_not_of(Space);
+        if (first == std::string_view::npos)
+            continue;
+        tag = tag.substr(first, tag.find_last_not_of(Space) - first + 1);
+
+        if (tag == "*")
+            return true;
+        if (tag.starts_with("W/"))
+            tag.remove_prefix(2);
+        if (tag == etag)
+            return true;
+    }
+
+    return false;
+}
 
 /// Verifies that the given WOPISrc is properly URI-encoded.
 /// Warns if it isn't and, in debug builds, closes the socket (if given) and returns false.
@@ -19,12 +19,15 @@
 #include <Poco/MemoryStream.h>
 #include <Poco/Net/HTTPResponse.h>
 
+#include <cerrno>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <netdb.h>
 #include <stdexcept>
 #include <string>
 #include <sys/types.h>
+#include <unistd.h>
 #include <utility>
 
 namespace http
@@ -416,6 +419,94 @@ int64_t Request::readData(const char* p, const int64_t len)
     return len - available;
 }
 
+void Response::saveBodyToFile(const std::string& path, ProgressCallback onProgress)
+{
+    closeBodyFile();
+
+    _bodyFileFailed = false;
+    _bodyFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (_bodyFd < 0)
+    {
+        LOG_SYS("Unable to open [" << path << "] for saveBodyToFile");
+        _bodyFileFailed = true;
+    }
+
+    if (!_bodyFileBlock)
+        _bodyFileBlock = std::make_unique<BodyFileBlock>();
+    _bodyFileBlockSize = 0;
+
+    _onBodyWriteCb = [this, onProgress = std::move(onProgress)](const char* p, int64_t len)
+    {
+        LOG_TRC("Writing " << len << " bytes");
+        if (_bodyFd < 0)
+            return static_cast<int64_t>(-1);
+
+        for (int64_t left = len; left > 0;)
+        {
+            const std::size_t size =
+                std::min<std::size_t>(left, BodyFileBlockSize - _bodyFileBlockSize);
+            std::memcpy(_bodyFileBlock->_data + _bodyFileBlockSize, p, size);
+            _bodyFileBlockSize += size;
+            p += size;
+            left -= size;
+
+            if (_bodyFileBlockSize == BodyFileBlockSize && !flushBodyFile())
+                return static_cast<int64_t>(-1);
+        }
+
+        if (onProgress)
+            onProgress(_recvBodySize + len,
+                       _header.hasContentLength() ? _header.getContentLength() : -1);
+
+        return len;
+    };
+}
+
+bool Response::flushBodyFile()
+{
+    std::size_t offset = 0;
+    while (offset < _bodyFileBlockSize)
+    {
+        const ssize_t wrote =
+            ::write(_bodyFd, _bodyFileBlock->_data + offset, _bodyFileBlockSize - offset);
+        if (wrote < 0 && errno == EINTR)
+            continue;
+
+        if (wrote <= 0)
+        {
+            LOG_SYS("Failed to write " << _bodyFileBlockSize - offset
+                                       << " bytes of the response body to file");
+            ::close(_bodyFd);
+            _bodyFd = -1;
+            _bodyFileBlockSize = 0;
+            _bodyFileFailed = true;
+            return false;
+        }
+
+        offset += wrote;
+    }
+
+    _bodyFileBlockSize = 0;
+    return true;
+}
+
+bool Response::closeBodyFile()
+{
+    if (_bodyFd >= 0 && flushBodyFile())
+    {
+        // Delayed write errors, e.g. on NFS, are only reported here.
+        if (::close(_bodyFd) != 0)
+        {
+            LOG_SYS("Failed to close the response body file");
+            _bodyFileFailed = true;
+        }
+
+        _bodyFd = -1;
+    }
+
+    return !_bodyFileFailed;
+}
+
 /// Handles incoming data.
 /// Returns the number of bytes consumed, or -1 for error
 /// and/or to interrupt transmission.
@@ -486,7 +577,9 @@ int64_t Response::readData(const char* p, int64_t len)
                 // We can possibly have a body.
                 if (_statusLine.statusCategory() != StatusLine::StatusCodeClass::Successful)
                 {
-                    // Failed: Store the body (if any) in memory.
+                    // Failed: Store the body (if any) in memory, not in the file.
+                    closeBodyFile();
+                    _bodyFileFailed = false;
                     saveBodyToMemory();
                 }
 
@@ -873,6 +873,14 @@ class Response final
 public:
     using FinishedCallback = std::function<void()>;
 
+    /// The callback signature for reporting the progress of a body saved to file:
+    /// the bytes received so far, and the expected total, or -1 when unknown.
+    using ProgressCallback = std::function<void(int64_t received, int64_t total)>;
+
+    /// The body is written to file in blocks of this size, from an aligned
+    /// buffer, so that writes are large and suitable for direct I/O.
+    static constexpr std::size_t BodyFileBlockSize = 256 * 1024;
+
     /// A response received from a server.
     /// Used for parsing an incoming response.
     explicit Response(FinishedCallback finishedCallback, int fd = -1)
@@ -880,6 +888,9 @@ public:
         , _parserStage(ParserStage::StatusLine)
         , _recvBodySize(0)
         , _finishedCallback(std::move(finishedCallback))
+        , _bodyFd(-1)
+        , _bodyFileBlockSize(0)
+        , _bodyFileFailed(false)
         , _fd(fd)
     {
         // By default we store the body in memory.
@@ -900,6 +911,9 @@ public:
         , _state(State::New)
         , _parserStage(ParserStage::StatusLine)
         , _recvBodySize(0)
+        , _bodyFd(-1)
+        , _bodyFileBlockSize(0)
+        , _bodyFileFailed(false)
         , _fd(fd)
     {
         _header.add("Date", Util::getHttpTimeNow());
@@ -913,6 +927,8 @@ public:
     {
     }
 
+    ~Response() { closeBodyFile(); }
+
     /// The state of an incoming response, when parsing.
     STATE_ENUM(State,
                New, ///< Valid but meaningless.
@@ -959,19 +975,9 @@ public:
     /// If the server responds with a non-success status code (i.e. not 2xx)
     /// the body is redirected to memory to be read via getBody().
     /// Check the statusLine().statusCategory() for the status code.
-    void saveBodyToFile(const std::string& path)
-    {
-        _bodyFile.open(path, std::ios_base::out | std::ios_base::binary);
-        if (!_bodyFile.good())
-            LOG_ERR("Unable to open [" << path << "] for saveBodyToFile");
-        _onBodyWriteCb = [this](const char* p, int64_t len)
-        {
-            LOG_TRC("Writing " << len << " bytes");
-            if (_bodyFile.good())
-                _bodyFile.write(p, len);
-            return _bodyFile.good() ? len : -1;
-        };
-    }
+    /// The body is streamed to the file as it arrives, in fixed-size blocks,
+    /// and @onProgress, if given, is invoked after each received chunk.
+    void saveBodyToFile(const std::string& path, ProgressCallback onProgress = nullptr);
 
     /// Generic handler for the body payload.
     /// See IoWriteFunc documentation for the contract.
@@ -992,6 +998,9 @@ public:
     /// Returns the body, assuming it wasn't redirected to file or callback.
     const std::string& getBody() const { return _body; }
 
+    /// The number of body bytes received so far.
+    int64_t recvBodySize() const { return _recvBodySize; }
+
     /// Set the body to be sent to the client.
     /// Also sets Content-Length and Content-Type.
     void setBody(std::string body, std::string contentType = "text/html;charset=utf-8")
@@ -1081,23 +1090,46 @@ private:
         if (!done())
         {
             LOG_TRC("Finishing: " << name(newState));
-            _bodyFile.close();
+            if (!closeBodyFile() && newState == State::Complete)
+            {
+                // The file misses some of the body, it must not be mistaken for the whole.
+                LOG_ERR("Failed to save the response body to file, finishing with error");
+                newState = State::Error;
+            }
+
             _state = newState;
             if (_finishedCallback)
                 _finishedCallback();
         }
     }
 
+    /// Write out the buffered block of the body file.
+    /// Returns false, and closes the file, on error.
+    bool flushBodyFile();
+
+    /// Flush the remaining body data and close the body file, if open.
+    /// Returns false if the body file, if any, misses some of the body.
+    bool closeBodyFile();
+
     /// The stage we're at in consuming the received data.
     STATE_ENUM(ParserStage, StatusLine, Header, Body, Finished);
 
+    /// The aligned buffer through which the body is written to file.
+    struct alignas(4096) BodyFileBlock
+    {
+        char _data[BodyFileBlockSize];
+    };
+
     StatusLine _statusLine;
     Header _header;
     std::atomic<State> _state; ///< The state of the Response.
     ParserStage _parserStage; ///< The parser's state.
     int64_t _recvBodySize; ///< The amount of data we received (compared to the Content-Length).
     std::string _body; ///< Used when _bodyHandling is InMemory.
-    std::ofstream _bodyFile; ///< Used when _bodyHandling is OnDisk.
+    int _bodyFd; ///< The file the body is saved to, if any.
+    std::unique_ptr<BodyFileBlock> _bodyFileBlock; ///< Buffered body data not yet written to file.
+    std::size_t _bodyFileBlockSize; ///< The bytes used in _bodyFileBlock.
+    bool _bodyFileFailed; ///< Failed to open, or to write, the body file.
     IoWriteFunc _onBodyWriteCb; ///< Used to handling body receipt in all cases.
     FinishedCallback _finishedCallback; ///< Called when response is finished.
     int _fd; ///< The socket file-descriptor.
@@ -1324,22 +1356,25 @@ public:
                                      << req.getUrl());
 
         newRequest(req);
+        asyncRequestImpl(poll);
+    }
 
-        if (!isConnected())
-        {
-            asyncConnect(poll);
-        }
-        else
-        {
-            // Technically, there is a race here. The socket can
-            // get disconnected and removed right after isConnected.
-            // In that case, we will timeout and no request will be sent.
-            poll->wakeup();
-        }
-
-        LOG_DBG("starting asyncRequest: " << req.getVerb() << ' ' << host() << ':' << port() << ' '
-                                          << req.getUrl());
+    /// Start an asynchronous request to download a file to the given path.
+    /// The body is streamed to the file on the given SocketPoll as it arrives,
+    /// invoking @onProgress, if given, as it does. Completion is signalled via
+    /// the onFinished handler, as with asyncRequest.
+    /// Note: when the server returns an error, the response body,
+    /// if any, will be stored in memory and can be read via getBody().
+    void asyncDownload(const Request& req, const std::string& saveToFilePath,
+                       const std::shared_ptr<SocketPoll>& poll,
+                       Response::ProgressCallback onProgress = nullptr)
+    {
+        LOG_TRC("new asyncDownload: " << req.getVerb() << ' ' << host() << ':' << port() << ' '
+                                      << req.getUrl());
 
+        newRequest(req);
+        _response->saveBodyToFile(saveToFilePath, std::move(onProgress));
+        asyncRequestImpl(poll);
     }
 
     void asyncShutdown()
@@ -1495,6 +1530,25 @@ private:
         }
     }
 
+    /// Dispatch the new request on the given SocketPoll, connecting if necessary.
+    void asyncRequestImpl(const std::shared_ptr<SocketPoll>& poll)
+    {
+        if (!isConnected())
+        {
+            asyncConnect(poll);
+        }
+        else
+        {
+            // Technically, there is a race here. The socket can
+            // get disconnected and removed right after isConnected.
+            // In that case, we will timeout and no request will be sent.
+            poll->wakeup();
+        }
+
+        LOG_DBG("starting asyncRequest: " << _request.getVerb() << ' ' << host() << ':' << port()
+                                          << ' ' << _request.getUrl());
+    }
+
     /// Set up a new request and response.
     void newRequest(const Request& req)
     {
@@ -293,8 +293,14 @@ namespace {
 }
 
 
-SocketPoll::SocketPoll(std::string threadName)
+SocketPoll::SocketPoll(std::string threadName, [[maybe_unused]] Backend backend)
     : _name(std::move(threadName))
+#ifdef HAVE_EPOLL
+    , _backend(Util::isMobileApp() ? Backend::Poll : backend)
+#else
+    , _backend(Backend::Poll)
+#endif
+    , _epollFd(-1)
     , _pollStartIndex(0)
     , _owner(std::this_thread::get_id())
     , _threadStarted(0)
@@ -303,6 +309,7 @@ SocketPoll::SocketPoll(std::string threadName)
     , _stop(false)
     , _threadFinished(false)
     , _runOnClientThread(false)
+    , _runOnPool(false)
 {
     ProfileZone profileZone("SocketPoll::SocketPoll");
 
@@ -330,6 +337,8 @@ SocketPoll::~SocketPoll()
 
     joinThread();
 
+    closeEpoll();
+
     removeFromWakeupArray();
 }
 
@@ -342,11 +351,18 @@ void SocketPoll::checkAndReThread()
         return; // all well
     LOG_DBG("Unusual - SocketPoll used from a new thread");
 
-    _owner = us;
+    setThreadOwner(us);
+}
+
+void SocketPoll::setThreadOwner(const std::thread::id& id)
+{
+    _owner = id;
     _ownerThreadId = Util::getThreadId();
     for (const auto& it : _pollSockets)
-        SocketThreadOwnerChange::setThreadOwner(*it, us);
+        SocketThreadOwnerChange::setThreadOwner(*it, id);
     // _newSockets are adapted as they are inserted.
+
+    threadOwnerChanged();
 }
 
 void SocketPoll::removeFromWakeupArray()
@@ -432,6 +448,17 @@ void SocketPoll::joinThread()
             _threadStarted = 0;
         }
     }
+    else if (_threadStarted && _runOnPool)
+    {
+        if (_owner == std::this_thread::get_id() && !_threadFinished)
+            LOG_ERR("DEADLOCK PREVENTED: joining own pool thread!");
+        else
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _poolFinishedCV.wait(lock, [this]() { return _threadFinished.load(); });
+            _threadStarted = 0;
+        }
+    }
 
     if (_runOnClientThread)
     {
@@ -499,28 +526,33 @@ int SocketPoll::poll(int64_t timeoutMaxMicroS, bool justPoll)
     disableWatchdog();
 
     int rc;
-    do
+    if (_backend == Backend::Epoll && updateEpoll(size))
+        rc = epollWait(size, timeoutMaxMicroS);
+    else
     {
+        do
+        {
 #if !MOBILEAPP
 #  if HAVE_PPOLL
-        LOGA_TRC(Socket, "ppoll start, timeoutMicroS: " << timeoutMaxMicroS << " size " << size);
-        timeoutMaxMicroS = std::max(timeoutMaxMicroS, (int64_t)0);
-        struct timespec timeout;
-        timeout.tv_sec = timeoutMaxMicroS / (1000 * 1000);
-        timeout.tv_nsec = (timeoutMaxMicroS % (1000 * 1000)) * 1000;
-        rc = ::ppoll(&_pollFds[0], size + 1, &timeout, nullptr);
+            LOGA_TRC(Socket, "ppoll start, timeoutMicroS: " << timeoutMaxMicroS << " size " << size);
+            timeoutMaxMicroS = std::max(timeoutMaxMicroS, (int64_t)0);
+            struct timespec timeout;
+            timeout.tv_sec = timeoutMaxMicroS / (1000 * 1000);
+            timeout.tv_nsec = (timeoutMaxMicroS % (1000 * 1000)) * 1000;
+            rc = ::ppoll(&_pollFds[0], size + 1, &timeout, nullptr);
 #  else
-        int timeoutMaxMs = (timeoutMaxMicroS + 999) / 1000;
-        LOG_TRC("Legacy Poll start, timeoutMs: " << timeoutMaxMs);
-        rc = ::poll(&_pollFds[0], size + 1, std::max(timeoutMaxMs,0));
+            int timeoutMaxMs = (timeoutMaxMicroS + 999) / 1000;
+            LOG_TRC("Legacy Poll start, timeoutMs: " << timeoutMaxMs);
+            rc = ::poll(&_pollFds[0], size + 1, std::max(timeoutMaxMs,0));
 #  endif
 #else
-        LOG_TRC("SocketPoll Poll");
-        int timeoutMaxMs = (timeoutMaxMicroS + 999) / 1000;
-        rc = fakeSocketPoll(&_pollFds[0], size + 1, std::max(timeoutMaxMs,0));
+            LOG_TRC("SocketPoll Poll");
+            int timeoutMaxMs = (timeoutMaxMicroS + 999) / 1000;
+            rc = fakeSocketPoll(&_pollFds[0], size + 1, std::max(timeoutMaxMs,0));
 #endif
+        }
+        while (rc < 0 && errno == EINTR);
     }
-    while (rc < 0 && errno == EINTR);
     LOGA_TRC(Socket, "Poll completed with " << rc << " live polls max (" <<
              timeoutMaxMicroS << "us)" << ((rc==0) ? "(timedout)" : ""));
 
@@ -673,6 +705,7 @@ int SocketPoll::poll(int64_t timeoutMaxMicroS, bool justPoll)
                     ++itemsErased;
                     LOGA_TRC(Socket, '#' << _pollFds[i].fd << ": Removing socket (at " << i
                              << " of " << _pollSockets.size() << ") from " << _name);
+                    epollRemove(*_pollSockets[i]);
                     _pollSockets[i] = nullptr;
                 }
 
@@ -709,6 +742,166 @@ int SocketPoll::poll(int64_t timeoutMaxMicroS, bool justPoll)
     return rc;
 }
 
+int SocketPoll::prepareWait(int64_t& timeoutMaxMicroS)
+{
+    setupPollFds(std::chrono::steady_clock::now(), timeoutMaxMicroS);
+    if (_backend == Backend::Epoll && updateEpoll(_pollSockets.size()))
+        return _epollFd;
+
+    return -1;
+}
+
+bool SocketPoll::updateEpoll([[maybe_unused]] std::size_t size)
+{
+#ifdef HAVE_EPOLL
+    if (_epollFd < 0)
+    {
+        _epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = _wakeup[0];
+        if (_epollFd < 0 || ::epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wakeup[0], &ev) < 0)
+        {
+            LOG_SYS("Failed to create epoll set for " << _name << ", falling back to poll");
+            closeEpoll();
+            _backend = Backend::Poll;
+            return false;
+        }
+
+        LOG_DBG("Created epoll set #" << _epollFd << " for " << _name);
+    }
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        const int fd = _pollFds[i].fd;
+        if (fd < 0)
+            continue; // Closed; poll(2) would ignore it too.
+
+        if (static_cast<std::size_t>(fd) >= _epollEntries.size())
+            _epollEntries.resize(fd + 1);
+
+        EpollEntry& entry = _epollEntries[fd];
+        entry._index = i;
+
+        const Socket* socket = _pollSockets[i].get();
+        const int events = _pollFds[i].events;
+        if (entry._socket == socket && entry._events == events)
+            continue; // The common case: nothing changed.
+
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+
+        // A new socket may reuse the fd of one we never saw leave.
+        int op = (entry._socket == socket ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+        int rc = ::epoll_ctl(_epollFd, op, fd, &ev);
+        if (rc < 0 && (errno == EEXIST || errno == ENOENT))
+        {
+            op = (errno == EEXIST ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+            rc = ::epoll_ctl(_epollFd, op, fd, &ev);
+        }
+
+        if (rc < 0)
+        {
+            LOG_SYS('#' << fd << ": Failed to register with epoll set of " << _name
+                        << ", falling back to poll");
+            closeEpoll();
+            _backend = Backend::Poll;
+            return false;
+        }
+
+        LOGA_TRC(Socket, '#' << fd << ": " << (op == EPOLL_CTL_ADD ? "Added to" : "Modified in")
+                             << " epoll set of " << _name << " with events: 0x" << std::hex
+                             << events << std::dec);
+        entry._socket = socket;
+        entry._events = events;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+int SocketPoll::epollWait([[maybe_unused]] std::size_t size,
+                          [[maybe_unused]] int64_t timeoutMaxMicroS)
+{
+#ifdef HAVE_EPOLL
+    static_assert(EPOLLIN == POLLIN && EPOLLPRI == POLLPRI && EPOLLOUT == POLLOUT &&
+                      EPOLLERR == POLLERR && EPOLLHUP == POLLHUP,
+                  "epoll events are expected to match their poll counterparts");
+
+    _epollEvents.resize(size + 1); // + wakeup pipe
+
+    // epoll_wait has only millisecond resolution; round up so we never spin.
+    const int timeoutMaxMs = (std::max<int64_t>(timeoutMaxMicroS, 0) + 999) / 1000;
+    LOGA_TRC(Socket, "epoll_wait start, timeoutMs: " << timeoutMaxMs << " size " << size);
+
+    int rc;
+    do
+    {
+        rc = ::epoll_wait(_epollFd, _epollEvents.data(), _epollEvents.size(), timeoutMaxMs);
+    } while (rc < 0 && errno == EINTR);
+
+    for (int k = 0; k < rc; ++k)
+    {
+        const int fd = _epollEvents[k].data.fd;
+        const int revents = _epollEvents[k].events & (POLLIN | POLLPRI | POLLOUT | POLLERR | POLLHUP);
+        if (fd == _wakeup[0])
+        {
+            _pollFds[size].revents = revents;
+            continue;
+        }
+
+        if (static_cast<std::size_t>(fd) < _epollEntries.size())
+        {
+            const EpollEntry& entry = _epollEntries[fd];
+            if (entry._index < size && _pollFds[entry._index].fd == fd &&
+                _pollSockets[entry._index].get() == entry._socket)
+            {
+                _pollFds[entry._index].revents = revents;
+                continue;
+            }
+
+            _epollEntries[fd] = EpollEntry();
+        }
+
+        // Left this poll without us noticing, e.g. moved to another poll, drop it.
+        LOGA_TRC(Socket, '#' << fd << ": Dropping stale registration from epoll set of " << _name);
+        ::epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    return rc;
+#else
+    return -1;
+#endif
+}
+
+void SocketPoll::epollRemove([[maybe_unused]] const Socket& socket)
+{
+#ifdef HAVE_EPOLL
+    const int fd = socket.getFD();
+    if (_epollFd < 0 || fd < 0 || static_cast<std::size_t>(fd) >= _epollEntries.size() ||
+        _epollEntries[fd]._socket != &socket)
+        return;
+
+    // The fd may have been closed already, which removes it implicitly.
+    ::epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    _epollEntries[fd] = EpollEntry();
+#endif
+}
+
+void SocketPoll::closeEpoll()
+{
+    if (_epollFd >= 0)
+    {
+        ::close(_epollFd);
+        _epollFd = -1;
+    }
+
+    _epollEntries.clear();
+}
+
 void SocketPoll::wakeupWorld()
 {
     std::lock_guard<std::mutex> lock(getPollWakeupsMutex());
@@ -724,6 +917,10 @@ void SocketPoll::closeAllSockets()
     // We just forked so we need to shift thread ids to this thread.
     checkAndReThread();
 
+    // The epoll set is shared with the parent; unregistering
+    // would affect it, so just drop our reference.
+    closeEpoll();
+
     removeFromWakeupArray();
     for (std::shared_ptr<Socket> &it : _pollSockets)
     {
@@ -759,6 +956,8 @@ void SocketPoll::takeSocket(const std::shared_ptr<SocketPoll> &fromPoll,
                             fromPoll->_pollSockets.end(), socket);
         if (it != fromPoll->_pollSockets.end())
         {
+            fromPoll->epollRemove(*socket);
+
             // Erasing messes up the tracking of poll results in 'poll'
             // leave to be added to toErase and cleaned later.
             *it = nullptr;
@@ -789,6 +988,38 @@ void SocketPoll::takeSocket(const std::shared_ptr<SocketPoll> &fromPoll,
             " from: " << fromPoll->name() << " to new poll: " << name() << " complete");
 }
 
+bool SocketPoll::releaseSocket(const std::shared_ptr<Socket>& socket)
+{
+    ASSERT_CORRECT_THREAD();
+
+    const auto it = std::find(_pollSockets.begin(), _pollSockets.end(), socket);
+    if (it != _pollSockets.end())
+    {
+        epollRemove(*socket);
+
+        // Not polling, so the poll results can't get out of step.
+        _pollSockets.erase(it);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto newIt = std::find(_newSockets.begin(), _newSockets.end(), socket);
+        if (newIt == _newSockets.end())
+        {
+            LOG_WRN("Trying to release socket #" << socket->getFD() << " not in " << _name);
+            return false;
+        }
+
+        _newSockets.erase(newIt);
+    }
+
+    // sockets in transit are un-owned
+    SocketThreadOwnerChange::resetThreadOwner(*socket);
+
+    LOG_TRC("Socket #" << socket->getFD() << " released from " << _name);
+    return true;
+}
+
 void SocketPoll::createWakeups()
 {
     assert(_wakeup[0] == -1 && _wakeup[1] == -1);
@@ -815,6 +1046,9 @@ void SocketPoll::removeSockets()
                             << " sockets from SocketPoll thread " << _name);
     ASSERT_CORRECT_SOCKET_THREAD(this);
 
+    // Dropping the whole set is cheaper than unregistering one by one.
+    closeEpoll();
+
     while (!_pollSockets.empty())
     {
         const std::shared_ptr<Socket>& socket = _pollSockets.back();
@@ -1098,6 +1332,11 @@ void SocketPoll::dumpState(std::ostream& os) const
        << (pollSockets.size() == 1 ? "" : "s") << " - wakeup rfd: " << _wakeup[0]
        << " wfd: " << _wakeup[1] << '\n';
 
+    os << "\tbackend: " << (_backend == Backend::Epoll ? "epoll" : "poll");
+    if (_epollFd >= 0)
+        os << " fd: " << _epollFd;
+    os << '\n';
+
     os << "\tcallbacks: " << _newCallbacks.size() << '\n';
 
     os << "\t\tfd\tevents\tstatus\trbuffered\trcapacity\twbuffered\twcapacity\trtotal\twtotal\tclie"
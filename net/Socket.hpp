@@ -23,6 +23,7 @@
 #include <cerrno>
 #include <chrono>
 #include <climits>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
 #include <functional>
@@ -42,6 +43,8 @@
 
 #ifdef __linux__
 #define HAVE_ABSTRACT_UNIX_SOCKETS
+#define HAVE_EPOLL
+#include <sys/epoll.h>
 #endif
 
 // Enable to dump socket traffic as hex in logs.
@@ -71,6 +74,7 @@ std::ostream& operator<<(std::ostream& os, const Socket &s);
 
 class Watchdog;
 class SocketPoll;
+class SocketPollPool;
 
 /// Helper to allow us to easily defer the movement of a socket
 /// between polls to clarify thread ownership.
@@ -627,6 +631,14 @@ public:
     /// 0 for closed/invalid socket, and -1 for other errors.
     virtual int sendBinaryMessage(const char* data, size_t len, bool flush = false) const = 0;
 
+    /// Sends a binary message whose data is kept alive, and unchanged, by @owner.
+    /// Protocols that can queue the data without copying it override this.
+    virtual int sendSharedBinaryMessage(const std::shared_ptr<const void>& /* owner */,
+                                        const char* data, size_t len, bool flush = false) const
+    {
+        return sendBinaryMessage(data, len, flush);
+    }
+
     /// Shutdown the socket and specify if the endpoint is going away or not (useful for WS).
     /// Optionally provide a message sent in the close frame (useful for WS).
     virtual void shutdown(bool goingAway = false,
@@ -704,6 +716,12 @@ public:
     virtual void writeQueuedMessages(std::size_t capacity) = 0;
     /// We just got a message - here it is
     virtual void handleMessage(const std::vector<char> &data) = 0;
+    /// We just got a message, which is only valid during the call,
+    /// as it's typically still in the socket's input buffer.
+    virtual void handleMessageInPlace(const char* data, std::size_t size)
+    {
+        handleMessage(std::vector<char>(data, data + size));
+    }
     /// Get notified that the underlying transports disconnected
     virtual void onDisconnect() = 0;
     /// Append pretty printed internal state to a line
@@ -740,18 +758,31 @@ private:
 /// Handles non-blocking socket event polling.
 /// Only polls on N-Sockets and invokes callback and
 /// doesn't manage buffers or client data.
-/// Note: uses poll(2) since it has very good performance
-/// compared to epoll up to a few hundred sockets and
-/// doesn't suffer select(2)'s poor API. Since this will
+/// Note: uses poll(2) by default since it has very good
+/// performance compared to epoll up to a few hundred sockets
+/// and doesn't suffer select(2)'s poor API. Since this will
 /// be used per-document we don't expect to have several
 /// hundred users on same document to suffer poll(2)'s
-/// scalability limit. Meanwhile, epoll(2)'s high
-/// overhead to adding/removing sockets is not helpful.
+/// scalability limit. Polls with a high fan-in (e.g. the
+/// web-server and prisoner polls) can select the epoll(7)
+/// backend instead, which keeps the kernel interest-list in
+/// sync incrementally: sockets are only re-registered when
+/// inserted, removed, or when their getPollEvents changes.
 class SocketPoll
 {
+    /// Runs the polling hooks of pooled polls.
+    friend class SocketPollPool;
+
 public:
+    /// The kernel interface used to wait for events.
+    enum class Backend : uint8_t
+    {
+        Poll, ///< poll(2), rebuilding the fd array every iteration.
+        Epoll ///< epoll(7), level-triggered; falls back to Poll where unavailable.
+    };
+
     /// Create a socket poll, called rather infrequently.
-    explicit SocketPoll(std::string threadName);
+    explicit SocketPoll(std::string threadName, Backend backend = Backend::Poll);
     virtual ~SocketPoll();
 
     static std::unique_ptr<Watchdog> PollWatchdog;
@@ -888,6 +919,11 @@ public:
     void takeSocket(const std::shared_ptr<SocketPoll> &fromPoll,
                     const std::shared_ptr<Socket> &socket);
 
+    /// Stops polling @socket, without closing it, to hand it over to
+    /// another poll. Called from our thread, between polls, rather
+    /// than from a handler. Returns false if we don't have it.
+    bool releaseSocket(const std::shared_ptr<Socket>& socket);
+
 #if !MOBILEAPP
     /// Inserts a new remote websocket to be polled.
     /// NOTE: The DNS lookup is synchronous.
@@ -928,7 +964,7 @@ public:
     const std::string& name() const { return _name; }
 
     /// Start the polling thread (if desired)
-    /// Mutually exclusive with runOnClientThread().
+    /// Mutually exclusive with runOnClientThread() and SocketPollPool::startPoll().
     bool startThread();
 
     /// Stop and join the polling thread before returning (if active)
@@ -956,6 +992,9 @@ public:
         return _runOnClientThread;
     }
 
+    /// True iff this poll waits on epoll(7) rather than poll(2).
+    bool isEpoll() const { return _backend == Backend::Epoll; }
+
     void disableWatchdog();
     void enableWatchdog();
 
@@ -981,19 +1020,68 @@ protected:
         return false;
     }
 
+    /// Called on the new owner thread, when the poll moves to another
+    /// thread, after its sockets, e.g. on a SocketPollPool.
+    virtual void threadOwnerChanged() {}
+
 private:
-    /// The default implementation of our polling thread
+    /// The default implementation of our polling thread,
+    /// driving the polling hooks below.
     virtual void pollingThread()
     {
+        if (!pollingStart())
+            return;
+
         while (continuePolling())
         {
-            poll(DefaultPollTimeoutMicroS);
+            poll(pollingTimeout());
+            if (!pollingStep())
+                break;
         }
+
+        pollingFinish();
     }
 
+    /// The polling loop, one iteration at a time, so that it can
+    /// run either on its own thread or on a SocketPollPool.
+    /// Called once before polling. Returns false to finish without polling.
+    virtual bool pollingStart() { return true; }
+
+    /// The maximum time to wait for events in the next poll.
+    virtual std::chrono::microseconds pollingTimeout() { return DefaultPollTimeoutMicroS; }
+
+    /// Called after each poll. Returns false to stop polling.
+    virtual bool pollingStep() { return true; }
+
+    /// Called once after polling, unless pollingStart() failed.
+    virtual void pollingFinish() {}
+
+    /// Moves this poll, and its sockets, to the given thread.
+    void setThreadOwner(const std::thread::id& id);
+
+    /// Does what poll() does before waiting: reduces @timeoutMaxMicroS as
+    /// the sockets need and registers their events with the epoll set.
+    /// Returns the epoll set, to wait on elsewhere, or -1 on the poll(2) backend.
+    int prepareWait(int64_t& timeoutMaxMicroS);
+
     /// Actual poll implementation
     int poll(int64_t timeoutMaxMicroS, bool justPoll = false);
 
+    /// Register new and changed sockets with the epoll set,
+    /// creating it on first use. Returns false, having
+    /// switched this poll back to poll(2), on failure.
+    bool updateEpoll(std::size_t size);
+
+    /// Wait on the epoll set and scatter the ready events
+    /// into _pollFds, as poll(2) would have returned them.
+    int epollWait(std::size_t size, int64_t timeoutMaxMicroS);
+
+    /// Drop the socket from the epoll set, if it's registered.
+    void epollRemove(const Socket& socket);
+
+    /// Close the epoll set, dropping all registrations.
+    void closeEpoll();
+
     /// Initialize the poll fds array with the right events
     void setupPollFds(std::chrono::steady_clock::time_point now,
                       int64_t &timeoutMaxMicroS)
@@ -1050,6 +1138,22 @@ private:
     /// The fds to poll.
     std::vector<pollfd> _pollFds;
 
+    /// The epoll registration of a socket, indexed by fd.
+    struct EpollEntry
+    {
+        const Socket* _socket = nullptr; ///< The registered socket, to detect fd reuse.
+        int _events = 0; ///< The events registered with the kernel.
+        std::size_t _index = 0; ///< The socket's index in _pollFds in this iteration.
+    };
+
+    Backend _backend;
+    /// The epoll set, when using Backend::Epoll, created lazily.
+    int _epollFd;
+    std::vector<EpollEntry> _epollEntries;
+#ifdef HAVE_EPOLL
+    std::vector<epoll_event> _epollEvents;
+#endif
+
     /// main-loop wakeup pipe
     int _wakeup[2];
     /// We start handling the poll results of the above sockets at a different index each time, to
@@ -1068,6 +1172,10 @@ private:
     std::atomic<bool> _stop;
     std::atomic<bool> _threadFinished;
     std::atomic<bool> _runOnClientThread;
+    /// Run by a SocketPollPool, instead of _thread.
+    bool _runOnPool;
+    /// Signalled, with _mutex, when the pool finished running this poll.
+    std::condition_variable _poolFinishedCV;
 };
 
 /// A SocketPoll that will stop polling and
@@ -1075,8 +1183,10 @@ private:
 class TerminatingPoll : public SocketPoll
 {
 public:
-    TerminatingPoll(const std::string &threadName) :
-        SocketPoll(threadName) {}
+    TerminatingPoll(const std::string& threadName, Backend backend = Backend::Poll)
+        : SocketPoll(threadName, backend)
+    {
+    }
 
     bool continuePolling() override
     {
@@ -1651,12 +1761,27 @@ public:
         {
             do
             {
-                // Writing much more than we can absorb in the kernel causes wastage.
-                const int size = std::min((int)_outBuffer.getBlockSize(), getSendBufferSize());
-                if (size == 0)
-                    break;
+                if (_outBuffer.hasSegments())
+                {
+                    // Gather the shared segments, rather than copying them.
+                    iovec iov[Buffer::MaxBlocks];
+                    const int count =
+                        _outBuffer.getBlocks(iov, Buffer::MaxBlocks, getSendBufferSize());
+                    if (count == 0)
+                        break;
+
+                    len = writeDataV(iov, count);
+                }
+                else
+                {
+                    // Writing much more than we can absorb in the kernel causes wastage.
+                    const int size =
+                        std::min((int)_outBuffer.getBlockSize(), getSendBufferSize());
+                    if (size == 0)
+                        break;
 
-                len = writeData(_outBuffer.getBlock(), size);
+                    len = writeData(_outBuffer.getBlock(), size);
+                }
                 if (len < 0)
                     last_errno = errno; // Save only on error.
 
@@ -1670,7 +1795,8 @@ public:
                 else // Success.
                     LOGA_TRC(Socket, "Wrote " << len << " bytes of " << _outBuffer.size() << " buffered data"
 #ifdef LOG_SOCKET_DATA
-                            << (len ? Util::dumpHex(std::string(_outBuffer.getBlock(), len), ":\n")
+                            << (len ? Util::dumpHex(std::string(_outBuffer.getBlock(),
+                                                                std::min<std::size_t>(len, _outBuffer.getBlockSize())), ":\n")
                                     : std::string())
 #endif
                     );
@@ -1797,6 +1923,26 @@ protected:
 #endif
     }
 
+    /// Override to handle vectored writes differently.
+    /// Writes the blocks in order, returning the total bytes written.
+    virtual int writeDataV(const iovec* iov, const int count)
+    {
+        ASSERT_CORRECT_SOCKET_THREAD(this);
+        assert((getFD() >= 0 || isShutdown()) && "Socket is closed but not marked correctly");
+        assert(count > 0);
+
+#if !MOBILEAPP
+#if ENABLE_DEBUG
+        if (simulateSocketError(false))
+            return -1;
+#endif
+        return ::writev(getFD(), iov, count);
+#else
+        return fakeSocketWrite(getFD(), static_cast<const char*>(iov[0].iov_base),
+                               iov[0].iov_len);
+#endif
+    }
+
     void setShutdownSignalled()
     {
         _shutdownSignalled = true;
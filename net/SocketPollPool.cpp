@@ -0,0 +1,555 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include "SocketPollPool.hpp"
+
+#include <common/Log.hpp>
+#include <common/Util.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <ostream>
+#include <stdexcept>
+#include <system_error>
+
+namespace
+{
+/// The most events the waiting worker takes at once.
+constexpr std::size_t MaxEvents = 256;
+
+/// The ID of the wakeup pipe in our epoll set; the polls' start at 1.
+constexpr uint64_t WakeupId = 0;
+
+} // namespace
+
+SocketPollPool::SocketPollPool(std::string name, std::size_t threadCount)
+    : _name(std::move(name))
+    , _nextId(WakeupId + 1)
+    , _waiting(false)
+    , _blockingCount(0)
+    , _queuedCount(0)
+    , _stop(false)
+    , _runCount(0)
+    , _stealCount(0)
+    , _epollFd(-1)
+{
+    _wakeup[0] = -1;
+    _wakeup[1] = -1;
+
+#ifdef HAVE_EPOLL
+    _epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFd >= 0 && ::pipe2(_wakeup, O_CLOEXEC | O_NONBLOCK) == 0)
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = WakeupId;
+        if (::epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wakeup[0], &ev) == 0)
+        {
+            _events.resize(MaxEvents);
+
+            threadCount = std::max<std::size_t>(threadCount, 1);
+            for (std::size_t i = 0; i < threadCount; ++i)
+                _workers.emplace_back(std::make_unique<Worker>());
+            for (std::size_t i = 0; i < threadCount; ++i)
+                _workers[i]->_thread = std::thread(&SocketPollPool::workerThread, this, i);
+
+            LOG_INF("Started SocketPollPool [" << _name << "] with " << threadCount
+                                               << " threads");
+            return;
+        }
+    }
+
+    LOG_SYS("Failed to create the epoll set of SocketPollPool [" << _name << ']');
+#endif
+
+    if (_epollFd >= 0)
+        ::close(_epollFd);
+    if (_wakeup[0] >= 0)
+        ::close(_wakeup[0]);
+    if (_wakeup[1] >= 0)
+        ::close(_wakeup[1]);
+
+    throw std::runtime_error("Failed to create SocketPollPool [" + _name + ']');
+}
+
+SocketPollPool::~SocketPollPool()
+{
+    stop();
+
+    ::close(_epollFd);
+    ::close(_wakeup[0]);
+    ::close(_wakeup[1]);
+}
+
+bool SocketPollPool::startPoll(const std::shared_ptr<SocketPoll>& poll)
+{
+    assert(!poll->_runOnClientThread);
+
+    // In a race, only the first gets in, as with SocketPoll::startThread().
+    if (poll->_threadStarted++ != 0)
+    {
+        if (poll->isAlive())
+            LOG_DBG("SocketPoll [" << poll->name() << "] is already running");
+        else
+            LOG_ASSERT_MSG(!"Expired poll", "SocketPoll [" << poll->name()
+                                                           << "] has ran and finished. Will not "
+                                                              "start it again");
+        return false;
+    }
+
+    if (!poll->isEpoll())
+        LOG_WRN("SocketPoll [" << poll->name() << "] isn't on the epoll backend, pool ["
+                               << _name << "] will poll it every " << PollBackendFallbackTimeout);
+
+    poll->_threadFinished = false;
+    poll->_stop = false;
+    poll->_runOnPool = true;
+
+    bool wakeup = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stop)
+        {
+            LOG_ERR("SocketPollPool [" << _name << "] is stopped, cannot start ["
+                                       << poll->name() << ']');
+            poll->_threadFinished = true;
+            return false;
+        }
+
+        const uint64_t id = _nextId++;
+        auto task = std::make_unique<Task>(poll, id, id % _workers.size());
+        enqueue(*task);
+        _tasks.emplace(id, std::move(task));
+        wakeup = _waiting;
+    }
+
+    _cv.notify_all();
+    if (wakeup)
+        SocketPoll::wakeup(_wakeup[1]);
+
+    return true;
+}
+
+void SocketPollPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stop)
+            return;
+
+        _stop = true;
+    }
+
+    LOG_INF("Stopping SocketPollPool [" << _name << ']');
+    _cv.notify_all();
+    SocketPoll::wakeup(_wakeup[1]);
+
+    for (const auto& worker : _workers)
+    {
+        if (!worker->_thread.joinable())
+            continue;
+
+        if (worker->_thread.get_id() == std::this_thread::get_id())
+            LOG_ERR("DEADLOCK PREVENTED: stopping SocketPollPool [" << _name
+                                                                   << "] from its own thread!");
+        else
+            worker->_thread.join();
+    }
+
+    // Finish any polls left, once none is starting or finishing, so they can be joined.
+    std::unordered_map<uint64_t, std::unique_ptr<Task>> tasks;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this]() { return _blockingCount == 0; });
+        tasks.swap(_tasks);
+        _timers.clear();
+    }
+
+    if (!tasks.empty())
+        LOG_WRN("SocketPollPool [" << _name << "] stopped with " << tasks.size()
+                                   << " polls still running");
+
+    for (const auto& it : tasks)
+    {
+        SocketPoll& poll = *it.second->_poll;
+        poll.setThreadOwner(std::this_thread::get_id());
+        poll.removeSockets();
+
+        {
+            std::lock_guard<std::mutex> lock(poll._mutex);
+            poll._threadFinished = true;
+        }
+
+        poll._poolFinishedCV.notify_all();
+    }
+}
+
+std::size_t SocketPollPool::getPollCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _tasks.size();
+}
+
+void SocketPollPool::workerThread(std::size_t index)
+{
+    Util::setThreadName(_name + '_' + std::to_string(index));
+
+    while (!_stop)
+    {
+        Task* task = dequeue(index);
+        if (task)
+        {
+            run(*task, index);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_stop || _queuedCount > 0)
+            continue;
+
+        if (!_waiting)
+        {
+            // Wait for the events of all the polls, on behalf of all the idle workers.
+            _waiting = true;
+            waitForEvents(lock);
+            _waiting = false;
+            lock.unlock();
+            _cv.notify_all();
+        }
+        else
+            _cv.wait(lock, [this]() { return _stop || _queuedCount > 0 || !_waiting; });
+    }
+
+    LOG_INF("Finished SocketPollPool [" << _name << "] thread #" << index);
+}
+
+SocketPollPool::Task* SocketPollPool::dequeue(std::size_t index)
+{
+    if (_queuedCount == 0)
+        return nullptr;
+
+    // Our own polls first, oldest first.
+    {
+        Worker& worker = *_workers[index];
+        std::lock_guard<std::mutex> lock(worker._mutex);
+        if (!worker._queue.empty())
+        {
+            Task* task = worker._queue.front();
+            worker._queue.pop_front();
+            --_queuedCount;
+            return task;
+        }
+    }
+
+    // Then steal the newest of a busy worker, whose cache is the least warm.
+    for (std::size_t i = 1; i < _workers.size(); ++i)
+    {
+        Worker& worker = *_workers[(index + i) % _workers.size()];
+        std::lock_guard<std::mutex> lock(worker._mutex);
+        if (!worker._queue.empty())
+        {
+            Task* task = worker._queue.back();
+            worker._queue.pop_back();
+            --_queuedCount;
+            ++_stealCount;
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+void SocketPollPool::enqueue(Task& task)
+{
+    Worker& worker = *_workers[task._worker];
+    std::lock_guard<std::mutex> lock(worker._mutex);
+    worker._queue.push_back(&task);
+    ++_queuedCount;
+}
+
+void SocketPollPool::run(Task& task, std::size_t index)
+{
+    SocketPoll& poll = *task._poll;
+    ++_runCount;
+    task._worker = index;
+
+    if (!task._started)
+    {
+        task._started = true;
+        LOG_INF("Starting polling [" << poll.name() << "] on SocketPollPool [" << _name
+                                     << "] thread #" << index);
+        runBlocking(task, /*start=*/true);
+        return;
+    }
+
+    // Take the poll, and its sockets, over from the thread that ran it last.
+    if (poll._owner != std::this_thread::get_id())
+        poll.setThreadOwner(std::this_thread::get_id());
+
+    try
+    {
+        // It has events, or timed out: handle them without waiting.
+        poll.poll(std::chrono::microseconds::zero());
+        if (poll.pollingStep() && poll.continuePolling())
+        {
+            int64_t timeoutMicroS = poll.pollingTimeout().count();
+            const int fd = poll.prepareWait(timeoutMicroS);
+
+            // It's good to sleep.
+            poll.disableWatchdog();
+
+            arm(task, fd,
+                std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutMicroS));
+            return;
+        }
+    }
+    catch (const std::exception& exc)
+    {
+        LOG_ERR("Exception in polling [" << poll.name() << "] on SocketPollPool [" << _name
+                                         << "]: " << exc.what());
+        finish(task);
+        return;
+    }
+
+    runBlocking(task, /*start=*/false);
+}
+
+void SocketPollPool::runBlocking(Task& task, bool start)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_blockingCount;
+    }
+
+    const auto work = [this, &task, start]()
+    {
+        SocketPoll& poll = *task._poll;
+        poll.setThreadOwner(std::this_thread::get_id());
+
+        bool polling = false;
+        try
+        {
+            if (start)
+                polling = poll.pollingStart();
+            else
+                poll.pollingFinish();
+        }
+        catch (const std::exception& exc)
+        {
+            LOG_ERR("Exception while " << (start ? "starting" : "finishing") << " polling ["
+                                       << poll.name() << "] on SocketPollPool [" << _name
+                                       << "]: " << exc.what());
+        }
+
+        if (polling)
+        {
+            // Back to the workers, to poll it; it's good to wait for one.
+            poll.disableWatchdog();
+
+            bool wakeup = false;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                enqueue(task);
+                wakeup = _waiting;
+            }
+
+            _cv.notify_all();
+            if (wakeup)
+                SocketPoll::wakeup(_wakeup[1]);
+        }
+        else
+            finish(task);
+
+        // Notified with the lock held, as stop() may destroy us as soon as it's released.
+        std::lock_guard<std::mutex> lock(_mutex);
+        --_blockingCount;
+        _cv.notify_all();
+    };
+
+    try
+    {
+        std::thread(
+            [work, name = task._poll->name()]()
+            {
+                Util::setThreadName(name);
+                work();
+            })
+            .detach();
+    }
+    catch (const std::system_error& exc)
+    {
+        LOG_ERR("Failed to create a thread to " << (start ? "start" : "finish") << " polling ["
+                                                << task._poll->name() << "] on SocketPollPool ["
+                                                << _name << "], running it here: " << exc.what());
+        work();
+    }
+}
+
+void SocketPollPool::arm(Task& task, int fd, std::chrono::steady_clock::time_point deadline)
+{
+    // Closing its epoll set, when it's recreated or the poll falls back to
+    // poll(2), unregistered it from ours already.
+    const bool added = (fd != task._fd);
+    task._fd = fd;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // Registered while holding the lock, lest the waiting worker gets
+    // its events before it's armed, and drops them.
+    task._armed = true;
+#ifdef HAVE_EPOLL
+    if (task._fd >= 0)
+    {
+        // Level-triggered, so it fires right away when it has events already,
+        // and one-shot, so it fires once until we run it and re-arm it.
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.u64 = task._id;
+
+        int op = (added ? EPOLL_CTL_ADD : EPOLL_CTL_MOD);
+        int rc = ::epoll_ctl(_epollFd, op, task._fd, &ev);
+        if (rc < 0 && (errno == EEXIST || errno == ENOENT))
+        {
+            op = (errno == EEXIST ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+            rc = ::epoll_ctl(_epollFd, op, task._fd, &ev);
+        }
+
+        if (rc < 0)
+        {
+            LOG_SYS("Failed to register the epoll set #"
+                    << task._fd << " of [" << task._poll->name() << "] with SocketPollPool ["
+                    << _name << "], will poll it every " << PollBackendFallbackTimeout);
+            task._fd = -1;
+        }
+    }
+#endif
+
+    if (task._fd < 0)
+        deadline = std::min(deadline, std::chrono::steady_clock::now() + PollBackendFallbackTimeout);
+
+    task._deadline = deadline;
+    _timers.emplace(deadline, task._id);
+
+    if (_waiting && deadline < _waitDeadline)
+        SocketPoll::wakeup(_wakeup[1]);
+}
+
+bool SocketPollPool::claim(Task& task)
+{
+    if (!task._armed)
+        return false; // Already queued, or running.
+
+    task._armed = false;
+    _timers.erase(std::make_pair(task._deadline, task._id));
+    return true;
+}
+
+void SocketPollPool::finish(Task& task)
+{
+    SocketPoll& poll = *task._poll;
+
+#ifdef HAVE_EPOLL
+    if (task._fd >= 0)
+        ::epoll_ctl(_epollFd, EPOLL_CTL_DEL, task._fd, nullptr);
+#endif
+
+    // Release sockets.
+    poll.removeSockets();
+
+    LOG_INF("Finished polling [" << poll.name() << "] on SocketPollPool [" << _name << ']');
+
+    // Keep the poll alive until the joiners are told; it may be destroyed
+    // here, as when its own thread finishes.
+    std::shared_ptr<SocketPoll> finished;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        finished = std::move(task._poll);
+        _tasks.erase(task._id);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(finished->_mutex);
+        finished->_threadFinished = true;
+    }
+
+    finished->_poolFinishedCV.notify_all();
+}
+
+void SocketPollPool::waitForEvents([[maybe_unused]] std::unique_lock<std::mutex>& lock)
+{
+#ifdef HAVE_EPOLL
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    int timeoutMs = -1;
+    _waitDeadline = std::chrono::steady_clock::time_point::max();
+    if (!_timers.empty())
+    {
+        _waitDeadline = _timers.begin()->first;
+        const int64_t timeoutMicroS =
+            std::chrono::duration_cast<std::chrono::microseconds>(_waitDeadline - now).count();
+
+        // epoll_wait has only millisecond resolution; round up so we never spin.
+        timeoutMs = static_cast<int>(
+            std::min<int64_t>((std::max<int64_t>(timeoutMicroS, 0) + 999) / 1000, INT_MAX));
+    }
+
+    lock.unlock();
+    const int rc = ::epoll_wait(_epollFd, _events.data(), _events.size(), timeoutMs);
+    lock.lock();
+
+    for (int k = 0; k < rc; ++k)
+    {
+        const uint64_t id = _events[k].data.u64;
+        if (id == WakeupId)
+        {
+            char dump[32];
+            while (::read(_wakeup[0], dump, sizeof(dump)) > 0)
+            {
+            }
+
+            continue;
+        }
+
+        // The poll may have finished since.
+        const auto it = _tasks.find(id);
+        if (it != _tasks.end() && claim(*it->second))
+            enqueue(*it->second);
+    }
+
+    // Then the polls that timed out.
+    now = std::chrono::steady_clock::now();
+    while (!_timers.empty() && _timers.begin()->first <= now)
+    {
+        Task& task = *_tasks.at(_timers.begin()->second);
+        claim(task);
+        enqueue(task);
+    }
+#endif
+}
+
+void SocketPollPool::dumpState(std::ostream& os) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    os << "\n  SocketPollPool [" << _name << "]:"
+       << "\n    threads: " << _workers.size()
+       << "\n    polls: " << _tasks.size()
+       << "\n    queued: " << _queuedCount
+       << "\n    waiting: " << _timers.size()
+       << "\n    runs: " << _runCount
+       << "\n    steals: " << _stealCount;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
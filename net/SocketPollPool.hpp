@@ -0,0 +1,174 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <net/Socket.hpp>
+
+/// Runs many SocketPolls on a few threads, rather than a thread each.
+///
+/// A pooled poll runs its polling hooks, one iteration at a time, on one
+/// worker at a time, which owns the poll and its sockets while it runs,
+/// as its own thread would. Between iterations, its epoll set, which is
+/// itself pollable, is registered with the pool's, and its timeout with
+/// the pool's timers. When either fires, the poll is queued on the worker
+/// that ran it last, and idle workers steal from the queues of busy ones.
+/// One idle worker at a time waits for the events of all the polls, the
+/// others for polls to be queued.
+///
+/// The first and last hooks of a poll, pollingStart() and pollingFinish(),
+/// can block, e.g. to get a Kit, or to upload a document, so they run on
+/// a thread of their own, rather than holding up a worker, and so the
+/// polls queued on it.
+///
+/// Only polls on the epoll backend can wait on the pool; any other is
+/// woken up every PollBackendFallbackTimeout.
+class SocketPollPool final
+{
+    friend class NetUtilWhiteBoxTests;
+
+public:
+    static constexpr std::chrono::milliseconds PollBackendFallbackTimeout{ 10 };
+
+    SocketPollPool(std::string name, std::size_t threadCount);
+    ~SocketPollPool();
+
+    SocketPollPool(const SocketPollPool&) = delete;
+    SocketPollPool& operator=(const SocketPollPool&) = delete;
+
+    /// Starts running the given poll on this pool, until it's stopped.
+    /// Mutually exclusive with SocketPoll::startThread().
+    /// Join it with SocketPoll::joinThread(), as usual.
+    bool startPoll(const std::shared_ptr<SocketPoll>& poll);
+
+    /// Stops the workers, and waits for any polls starting or finishing.
+    /// The polls should have been stopped and joined: any left are
+    /// finished without running them further.
+    void stop();
+
+    std::size_t getThreadCount() const { return _workers.size(); }
+
+    std::size_t getPollCount() const;
+
+    /// The number of iterations run, and how many of them stolen from a busy worker.
+    uint64_t getRunCount() const { return _runCount; }
+    uint64_t getStealCount() const { return _stealCount; }
+
+    void dumpState(std::ostream& os) const;
+
+private:
+    /// A pooled poll.
+    struct Task
+    {
+        Task(std::shared_ptr<SocketPoll> poll, uint64_t id, std::size_t worker)
+            : _poll(std::move(poll))
+            , _id(id)
+            , _worker(worker)
+            , _fd(-1)
+            , _armed(false)
+            , _started(false)
+        {
+        }
+
+        std::shared_ptr<SocketPoll> _poll;
+        const uint64_t _id; ///< Identifies it in the epoll events, which can be stale.
+        std::size_t _worker; ///< The worker that ran it last, which it's queued on.
+        int _fd; ///< The epoll set of the poll, registered with ours.
+        bool _armed; ///< Waiting for events or timeout, rather than queued or running.
+        bool _started; ///< pollingStart() was called.
+        /// When it times out, while armed.
+        std::chrono::steady_clock::time_point _deadline;
+    };
+
+    struct Worker
+    {
+        std::thread _thread;
+        std::mutex _mutex; ///< Protects _queue.
+        std::deque<Task*> _queue; ///< The polls ready to run.
+    };
+
+    void workerThread(std::size_t index);
+
+    /// Takes the next poll to run, from our own queue, or stolen from another.
+    Task* dequeue(std::size_t index);
+
+    /// Queues the ready poll on the worker that ran it last.
+    void enqueue(Task& task);
+
+    /// Runs one iteration of the given poll.
+    void run(Task& task, std::size_t index);
+
+    /// Waits for the given poll to be ready, i.e. its epoll set
+    /// @fd to have events, or its @deadline to pass.
+    void arm(Task& task, int fd, std::chrono::steady_clock::time_point deadline);
+
+    /// Runs pollingStart(), when @start, or else pollingFinish(), of the
+    /// given poll on a new thread. Then either queues it, started, or
+    /// removes it.
+    void runBlocking(Task& task, bool start);
+
+    /// Removes the poll, done polling, from the pool.
+    void finish(Task& task);
+
+    /// Waits for, and queues, the polls that are ready. Called with the lock held.
+    void waitForEvents(std::unique_lock<std::mutex>& lock);
+
+    /// If armed, takes the poll to queue it. Called with the lock held.
+    bool claim(Task& task);
+
+    const std::string _name;
+    std::vector<std::unique_ptr<Worker>> _workers;
+
+    /// Protects the below.
+    mutable std::mutex _mutex;
+    /// Signalled when polls are queued, when the waiting worker
+    /// returns, when a poll is done starting or finishing, and when stopping.
+    std::condition_variable _cv;
+    std::unordered_map<uint64_t, std::unique_ptr<Task>> _tasks;
+    /// The deadlines of the armed polls, by their ID.
+    std::set<std::pair<std::chrono::steady_clock::time_point, uint64_t>> _timers;
+    uint64_t _nextId;
+    bool _waiting; ///< A worker is waiting for events.
+    std::size_t _blockingCount; ///< The polls starting or finishing, off the workers.
+    std::chrono::steady_clock::time_point _waitDeadline; ///< Until when it waits.
+
+    std::atomic<std::size_t> _queuedCount;
+    std::atomic<bool> _stop;
+    std::atomic<uint64_t> _runCount;
+    std::atomic<uint64_t> _stealCount;
+
+    /// The epoll set of the epoll sets of the polls.
+    int _epollFd;
+    /// To wake up the waiting worker, when a deadline gets earlier, or stopping.
+    int _wakeup[2];
+#ifdef HAVE_EPOLL
+    /// The events returned to the waiting worker.
+    std::vector<epoll_event> _events;
+#endif
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
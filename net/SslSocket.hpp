@@ -202,6 +202,28 @@ public:
         return handleSslState(SSL_write(_ssl, buf, len), "write");
     }
 
+    /// There is no SSL_writev, so batch the blocks into successive
+    /// SSL_write calls, stopping at the first short or failed write.
+    int writeDataV(const iovec* iov, const int count) override
+    {
+        ASSERT_CORRECT_SOCKET_THREAD(this);
+
+        int total = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            const int len = static_cast<int>(iov[i].iov_len);
+            const int rc = writeData(static_cast<const char*>(iov[i].iov_base), len);
+            if (rc <= 0)
+                return total > 0 ? total : rc;
+
+            total += rc;
+            if (rc < len)
+                break;
+        }
+
+        return total;
+    }
+
     int getPollEvents(std::chrono::steady_clock::time_point now,
                       int64_t & timeoutMaxMicroS) override
     {
@@ -23,6 +23,7 @@
 #include <Poco/Net/HTTPResponse.h>
 
 #include <chrono>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <vector>
@@ -54,6 +55,9 @@ private:
     UnitBase* const _unit;
 
 protected:
+    /// Payloads smaller than this are cheaper to copy than to reference.
+    static constexpr uint64_t MinSharedPayloadSize = 4096;
+
     struct WSFrameMask
     {
         static constexpr unsigned char Fin = 0x80;
@@ -381,15 +385,17 @@ private:
                 << len << " bytes: "
                 << Util::stringifyHexLine(socket->getInBuffer(), 0, std::min((size_t)32, len)));
 
-        unsigned char *data = p + headerLen;
+        char* const data = reinterpret_cast<char*>(p + headerLen);
+
+        // Unmask in place, there is no need to keep the masked data.
+        if (mask)
+            applyMask(data, payloadLen, mask);
 
         if (isControlFrame(code))
         {
             //Process control frames
 
-            std::vector<char> ctrlPayload;
-
-            readPayload(data, payloadLen, mask, ctrlPayload);
+            std::vector<char> ctrlPayload(data, data + payloadLen);
             socket->getInBuffer().eraseFirst(headerLen + payloadLen);
             LOGA_TRC(WebSocket, "Incoming WebSocket frame code "
                     << static_cast<unsigned>(code) << ", fin? " << fin << ", mask? " << hasMask
@@ -485,60 +491,60 @@ private:
             return true;
         }
 
-        //Process data frame
-        readPayload(data, payloadLen, mask, _wsPayload);
-#else
-        unsigned char * const p = reinterpret_cast<unsigned char*>(socket->getInBuffer().data());
-        _wsPayload.insert(_wsPayload.end(), p, p + len);
-        const size_t headerLen = 0;
-        const size_t payloadLen = len;
-#endif
-
-        socket->eraseFirstInputBytes(headerLen + payloadLen);
-
-#if !MOBILEAPP
-
         LOGA_TRC(WebSocket, "Incoming WebSocket frame code "
             << static_cast<unsigned>(code) << ", fin? " << fin << ", mask? " << hasMask
             << ", payload length: " << payloadLen
-            << ", residual socket data: " << socket->getInBuffer().size()
+            << ", residual socket data: " << socket->getInBuffer().size() - headerLen - payloadLen
             << " bytes, unmasked data: " +
-                   Util::stringifyHexLine(_wsPayload, 0, std::min((size_t)32, _wsPayload.size())));
+                   Util::stringifyHexLine(std::string_view(data, payloadLen), 0,
+                                          std::min((size_t)32, payloadLen)));
 
-        if (fin)
+        if (!fin)
         {
-            // If is final fragment then process the accumulated message.
-
-            try
-            {
-                handleMessage(_wsPayload);
-            }
-            catch (const Poco::Exception& ex)
-            {
-                LOG_ERR("Error during handleMessage: " << ex.displayText());
-            }
-            catch (const std::exception& exception)
-            {
-                LOG_ERR("Error during handleMessage: " << exception.what());
-            }
-            catch (...)
-            {
-                LOG_ERR("Error during handleMessage");
-            }
-
-            _inFragmentBlock = false;
+            // If is not final fragment then wait for next fragment.
+            _wsPayload.insert(_wsPayload.end(), data, data + payloadLen);
+            socket->eraseFirstInputBytes(headerLen + payloadLen);
+            _inFragmentBlock = true;
+            return true;
         }
-        else
+
+        if (_inFragmentBlock)
         {
-            _inFragmentBlock = true;
-            // If is not final fragment then wait for next fragment.
+            // If is final fragment then process the accumulated message.
+            _wsPayload.insert(_wsPayload.end(), data, data + payloadLen);
+            socket->eraseFirstInputBytes(headerLen + payloadLen);
+            _inFragmentBlock = false;
+
+            deliverMessage(_wsPayload.data(), _wsPayload.size());
+            _wsPayload.clear();
             return true;
         }
+
+        // Unfragmented, the common case: hand over the payload in place.
+        deliverMessage(data, payloadLen);
+        consumeInput(socket, headerLen + payloadLen);
 #else
+        deliverMessage(socket->getInBuffer().data(), len);
+        consumeInput(socket, len);
+#endif
+
+        return true;
+    }
+
+private:
+    /// Passes a complete message to handleMessageInPlace, logging any failure.
+    void deliverMessage(const char* data, std::size_t size)
+    {
         try
         {
-            handleMessage(_wsPayload);
+            handleMessageInPlace(data, size);
         }
+#if !MOBILEAPP
+        catch (const Poco::Exception& ex)
+        {
+            LOG_ERR("Error during handleMessage: " << ex.displayText());
+        }
+#endif
         catch (const std::exception& exception)
         {
             LOG_ERR("Error during handleMessage: " << exception.what());
@@ -547,11 +553,53 @@ private:
         {
             LOG_ERR("Error during handleMessage");
         }
-#endif
+    }
 
-        _wsPayload.clear();
+    /// Erases a message delivered in place, unless the
+    /// handler has already discarded our input meanwhile.
+    static void consumeInput(const std::shared_ptr<StreamSocket>& socket, std::size_t size)
+    {
+        if (socket->getInBuffer().size() >= size)
+            socket->eraseFirstInputBytes(size);
+    }
 
-        return true;
+public:
+    /// XORs len bytes of data, in place, with the 4-byte websocket mask,
+    /// which is first rotated by offset bytes, for continuing a payload.
+    /// Works 8 bytes at a time, in blocks the compiler can vectorize.
+    static void applyMask(char* data, std::size_t len, const unsigned char* mask,
+                          std::size_t offset = 0)
+    {
+        unsigned char rotated[4];
+        for (std::size_t i = 0; i < 4; ++i)
+            rotated[i] = mask[(offset + i) % 4];
+
+        uint32_t mask32;
+        std::memcpy(&mask32, rotated, sizeof(mask32));
+        const uint64_t mask64 = (static_cast<uint64_t>(mask32) << 32) | mask32;
+
+        std::size_t i = 0;
+        for (; i + 32 <= len; i += 32)
+        {
+            uint64_t words[4];
+            std::memcpy(words, data + i, sizeof(words));
+            words[0] ^= mask64;
+            words[1] ^= mask64;
+            words[2] ^= mask64;
+            words[3] ^= mask64;
+            std::memcpy(data + i, words, sizeof(words));
+        }
+
+        for (; i + 8 <= len; i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            word ^= mask64;
+            std::memcpy(data + i, &word, sizeof(word));
+        }
+
+        for (; i < len; ++i)
+            data[i] ^= rotated[i % 4];
     }
 
 protected:
@@ -709,10 +757,21 @@ public:
         return sendMessage(data, len, WSOpCode::Binary, flush);
     }
 
+    /// Implementation of the ProtocolHandlerInterface.
+    /// Large payloads are queued by reference, so the same data can be
+    /// sent to many sockets without copying it into each output buffer.
+    int sendSharedBinaryMessage(const std::shared_ptr<const void>& owner, const char* data,
+                                const size_t len, bool flush = false) const override
+    {
+        return sendMessage(data, len, WSOpCode::Binary, flush, owner);
+    }
+
     /// Sends a WebSocket message of WPOpCode type.
     /// Returns the number of bytes written (including frame overhead) on success,
     /// 0 for closed socket, and -1 for other errors.
-    int sendMessage(const char* data, const size_t len, const WSOpCode code, const bool flush) const
+    /// When given, @owner keeps the data alive until it is written.
+    int sendMessage(const char* data, const size_t len, const WSOpCode code, const bool flush,
+                    const std::shared_ptr<const void>& owner = nullptr) const
     {
         if (UnitBase::isUnitTesting() && !Util::isFuzzing())
         {
@@ -724,7 +783,8 @@ public:
         //TODO: Support fragmented messages.
 
         std::shared_ptr<StreamSocket> socket = _socket.lock();
-        return sendFrame(socket, data, len, WSFrameMask::Fin | static_cast<unsigned char>(code), flush);
+        return sendFrame(socket, data, len, WSFrameMask::Fin | static_cast<unsigned char>(code), flush,
+                         owner);
     }
 
     bool processInputEnabled() const override
@@ -747,8 +807,10 @@ protected:
 
 #if !MOBILEAPP
     /// Builds a websocket frame based on data and flags received as parameters.
-    /// The frame is output in 'out' parameter
-    void buildFrame(const char* data, const uint64_t len, unsigned char flags, Buffer &out) const
+    /// The frame is output in 'out' parameter, referencing rather than
+    /// copying large unmasked payloads when their 'owner' is given.
+    void buildFrame(const char* data, const uint64_t len, unsigned char flags, Buffer &out,
+                    const std::shared_ptr<const void>& owner = nullptr) const
     {
         int slen = 0;
         char scratch[16];
@@ -795,17 +857,19 @@ protected:
 
             // copy and mask the data
             char copy[16384];
-            ssize_t i = 0, toSend;
-            while (true)
+            for (uint64_t i = 0; i < len;)
             {
-                toSend = std::min(sizeof(copy), len - i);
-                if (toSend == 0)
-                    break;
-                for (ssize_t j = 0; j < toSend; ++j, ++i)
-                    copy[j] = data[i] ^ mask[i%4];
+                const std::size_t toSend = std::min<uint64_t>(sizeof(copy), len - i);
+                std::memcpy(copy, data + i, toSend);
+                applyMask(copy, toSend, reinterpret_cast<const unsigned char*>(mask), i);
                 out.append(copy, toSend);
+                i += toSend;
             }
         }
+        else if (owner && len >= MinSharedPayloadSize)
+        {
+            out.appendShared(owner, data, len);
+        }
         else
         {
             // Copy the data.
@@ -818,7 +882,8 @@ protected:
     /// Returns the number of bytes written (including frame overhead) on success,
     /// 0 for closed/invalid socket, and -1 for other errors.
     int sendFrame(const std::shared_ptr<StreamSocket>& socket, const char* data, const uint64_t len,
-                  [[maybe_unused]] unsigned char flags, bool flush = true) const
+                  [[maybe_unused]] unsigned char flags, bool flush = true,
+                  [[maybe_unused]] const std::shared_ptr<const void>& owner = nullptr) const
     {
         if (!socket || data == nullptr || len == 0)
         {
@@ -882,7 +947,7 @@ protected:
 #if !MOBILEAPP
         const size_t oldSize = out.size();
 
-        buildFrame(data, len, flags, out);
+        buildFrame(data, len, flags, out, owner);
 
         // Return the number of bytes we wrote to the *buffer*.
         const size_t size = out.size() - oldSize;
@@ -944,26 +1009,6 @@ protected:
 
     bool isControlFrame(WSOpCode code) const { return code >= WSOpCode::Close; }
 
-    void readPayload(unsigned char *data, size_t dataLen, unsigned char* mask, std::vector<char>& payload)
-    {
-        if (dataLen == 0)
-            return;
-
-        if (mask)
-        {
-            size_t end = payload.size();
-            payload.resize(end + dataLen);
-            if (dataLen > 0)
-            {
-                char* wsData = &payload[end];
-                for (size_t i = 0; i < dataLen; ++i)
-                    *wsData++ = data[i] ^ mask[i % 4];
-            }
-        }
-        else
-            payload.insert(payload.end(), data, data + dataLen);
-    }
-
     /// To be overridden to handle the websocket messages the way you need.
     virtual void handleMessage(const std::vector<char> &data)
     {
@@ -971,6 +1016,17 @@ protected:
             _msgHandler->handleMessage(data);
     }
 
+    /// Handles a complete message that is only valid for the duration of the call,
+    /// typically still in the socket's input buffer. Passed on as-is to the message
+    /// handler, if any; otherwise copied for handleMessage.
+    virtual void handleMessageInPlace(const char* data, std::size_t size)
+    {
+        if (_msgHandler)
+            _msgHandler->handleMessageInPlace(data, size);
+        else
+            handleMessage(std::vector<char>(data, data + size));
+    }
+
     const std::weak_ptr<StreamSocket>& getSocket() const
     {
         return _socket;
@@ -0,0 +1,202 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <test/lokassert.hpp>
+
+#include <common/FileUtil.hpp>
+#include <wsd/ConvertCache.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <fstream>
+
+#include <string>
+
+/// ConvertCache unit-tests.
+class ConvertCacheTests : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ConvertCacheTests);
+
+    CPPUNIT_TEST(testKey);
+    CPPUNIT_TEST(testCacheResult);
+    CPPUNIT_TEST(testLeastRecentlyUsed);
+    CPPUNIT_TEST(testSizeLimit);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void testKey();
+    void testCacheResult();
+    void testLeastRecentlyUsed();
+    void testSizeLimit();
+
+    std::string _dir;
+
+public:
+    void setUp() override
+    {
+        _dir = FileUtil::createRandomTmpDir();
+        // Without its thread, so everything is done before returning.
+        ConvertCache::initialize(_dir + "/cache", 3000);
+        ConvertCache::setCoreVersion("24.04.1");
+    }
+
+    void tearDown() override
+    {
+        ConvertCache::Entries.clear();
+        ConvertCache::EntriesMap.clear();
+        ConvertCache::CachePath.clear();
+        ConvertCache::SizeBytes = 0;
+        ConvertCache::CoreVersion.clear();
+        FileUtil::removeFile(_dir, /*recursive=*/true);
+    }
+
+    /// Writes a file of @size bytes of @c, returning its path.
+    std::string writeFile(const std::string& name, std::size_t size, char c = 'x')
+    {
+        const std::string path = _dir + '/' + name;
+        std::ofstream(path) << std::string(size, c);
+        return path;
+    }
+
+    std::string readFile(const std::string& path)
+    {
+        std::string content;
+        FileUtil::readFile(path, content);
+        return content;
+    }
+
+    static bool contains(const std::string& key)
+    {
+        return ConvertCache::EntriesMap.find(key) != ConvertCache::EntriesMap.end();
+    }
+};
+
+void ConvertCacheTests::testKey()
+{
+    constexpr auto testname = __func__;
+
+    const std::string path = writeFile("doc.odt", 100);
+    const std::string key = ConvertCache::getKey(path, "convert-to", "pdf", "", "en-US", "");
+    LOK_ASSERT_EQUAL(std::size_t(64), key.size());
+    LOK_ASSERT_EQUAL(key, ConvertCache::getKey(path, "convert-to", "pdf", "", "en-US", ""));
+
+    // Anything that changes the result changes the key.
+    LOK_ASSERT(key != ConvertCache::getKey(path, "get-thumbnail", "pdf", "", "en-US", ""));
+    LOK_ASSERT(key != ConvertCache::getKey(path, "convert-to", "png", "", "en-US", ""));
+    LOK_ASSERT(key != ConvertCache::getKey(path, "convert-to", "pdf", ",PDFVer=PDF-1.6PDFVEREND",
+                                           "en-US", ""));
+    LOK_ASSERT(key != ConvertCache::getKey(path, "convert-to", "pdf", "", "de-DE", ""));
+    LOK_ASSERT(key != ConvertCache::getKey(writeFile("doc.docx", 100), "convert-to", "pdf", "",
+                                           "en-US", ""));
+    LOK_ASSERT(key != ConvertCache::getKey(writeFile("doc.odt", 100, 'y'), "convert-to", "pdf",
+                                           "", "en-US", ""));
+    const std::string otherKey = ConvertCache::getKey(path, "convert-to", "pdf", "", "en-US", "");
+    ConvertCache::setCoreVersion("24.04.2");
+    LOK_ASSERT(otherKey != ConvertCache::getKey(path, "convert-to", "pdf", "", "en-US", ""));
+
+    // Nothing is cacheable before a Kit tells us the version of the core.
+    ConvertCache::setCoreVersion(std::string());
+    LOK_ASSERT(ConvertCache::getKey(path, "convert-to", "pdf", "", "en-US", "").empty());
+    ConvertCache::setCoreVersion("24.04.1");
+
+    // Unreadable uploads aren't cacheable.
+    LOK_ASSERT(
+        ConvertCache::getKey(_dir + "/missing.odt", "convert-to", "pdf", "", "", "").empty());
+    LOK_ASSERT(!ConvertCache::supplyResult(std::string(), _dir + "/supplied"));
+}
+
+void ConvertCacheTests::testCacheResult()
+{
+    constexpr auto testname = __func__;
+
+    // The result is copied, so writing to it, or removing it with its jail, is harmless.
+    const std::string path = writeFile("result.pdf", 100);
+    ConvertCache::cacheResult("a", path);
+    LOK_ASSERT(contains("a"));
+    LOK_ASSERT(FileUtil::Stat(ConvertCache::CachePath + 'a').inodeNumber() !=
+               FileUtil::Stat(path).inodeNumber());
+    writeFile("result.pdf", 100, 'y');
+    FileUtil::removeFile(path);
+
+    // Nothing but the entry is left in the cache directory.
+    LOK_ASSERT_EQUAL(std::size_t(1), FileUtil::getDirEntries(ConvertCache::CachePath).size());
+
+    const std::string destPath = _dir + "/supplied";
+    LOK_ASSERT(ConvertCache::supplyResult("a", destPath));
+    LOK_ASSERT_EQUAL(std::string(100, 'x'), readFile(destPath));
+
+    ConvertCache::cacheResultData("b", std::string(50, 'z'));
+    LOK_ASSERT(ConvertCache::supplyResult("b", _dir + "/thumbnail"));
+    LOK_ASSERT_EQUAL(std::string(50, 'z'), readFile(_dir + "/thumbnail"));
+
+    LOK_ASSERT(!ConvertCache::supplyResult("c", _dir + "/missing"));
+    LOK_ASSERT(!FileUtil::Stat(_dir + "/missing").exists());
+}
+
+void ConvertCacheTests::testLeastRecentlyUsed()
+{
+    constexpr auto testname = __func__;
+
+    for (const std::string name : { "a", "b", "c" })
+        ConvertCache::cacheResult(name, writeFile(name, 1000));
+
+    // Using the oldest makes the next one the least recently used.
+    LOK_ASSERT(ConvertCache::supplyResult("a", _dir + "/supplied"));
+
+    ConvertCache::cacheResult("d", writeFile("d", 1000));
+    LOK_ASSERT(contains("a"));
+    LOK_ASSERT(!contains("b"));
+    LOK_ASSERT(contains("c"));
+    LOK_ASSERT(contains("d"));
+    LOK_ASSERT(!FileUtil::Stat(ConvertCache::CachePath + 'b').exists());
+    LOK_ASSERT(!ConvertCache::supplyResult("b", _dir + "/evicted"));
+
+    // Caching a new result under the same key replaces it.
+    ConvertCache::cacheResult("a", writeFile("a", 500));
+    LOK_ASSERT_EQUAL(std::size_t(2500), ConvertCache::SizeBytes);
+    LOK_ASSERT_EQUAL(std::size_t(3), ConvertCache::Entries.size());
+}
+
+void ConvertCacheTests::testSizeLimit()
+{
+    constexpr auto testname = __func__;
+
+    // Too large to ever fit.
+    ConvertCache::cacheResult("huge", writeFile("huge", 3001));
+    LOK_ASSERT(!contains("huge"));
+    LOK_ASSERT_EQUAL(std::size_t(0), ConvertCache::SizeBytes);
+
+    // Makes room for a large one by evicting as many as needed.
+    for (const std::string name : { "a", "b", "c" })
+        ConvertCache::cacheResult(name, writeFile(name, 1000));
+    LOK_ASSERT_EQUAL(std::size_t(3000), ConvertCache::SizeBytes);
+
+    ConvertCache::cacheResultData("large", std::string(2500, 'x'));
+    LOK_ASSERT(contains("large"));
+    LOK_ASSERT(!contains("a"));
+    LOK_ASSERT(!contains("b"));
+    LOK_ASSERT(!contains("c"));
+    LOK_ASSERT_EQUAL(std::size_t(2500), ConvertCache::SizeBytes);
+    LOK_ASSERT_EQUAL(std::size_t(1), FileUtil::getDirEntries(ConvertCache::CachePath).size());
+
+    // What we find on restarting counts towards the limit, less what was left half-written.
+    writeFile("cache/large.tmp", 100);
+    ConvertCache::initialize(_dir + "/cache", 2000);
+    LOK_ASSERT(!contains("large"));
+    LOK_ASSERT_EQUAL(std::size_t(0), ConvertCache::SizeBytes);
+    LOK_ASSERT(FileUtil::getDirEntries(ConvertCache::CachePath).empty());
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ConvertCacheTests);
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
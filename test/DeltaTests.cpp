@@ -16,6 +16,8 @@
 #include <random>
 
 #include <Delta.hpp>
+#include <DeltaSimd.h>
+#include <Simd.hpp>
 #include <Util.hpp>
 #include <Png.hpp>
 
@@ -35,6 +37,8 @@ class DeltaTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testDeltaSequence);
     CPPUNIT_TEST(testRandomDeltas);
     CPPUNIT_TEST(testDeltaCopyOutOfBounds);
+    CPPUNIT_TEST(testDiffRowSimd);
+    CPPUNIT_TEST(testDeltaShiftedRows);
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -45,6 +49,8 @@ class DeltaTests : public CPPUNIT_NS::TestFixture
     void testDeltaSequence();
     void testRandomDeltas();
     void testDeltaCopyOutOfBounds();
+    void testDiffRowSimd();
+    void testDeltaShiftedRows();
 
     std::vector<char> applyDelta(
         const std::vector<char> &pixmap,
@@ -507,6 +513,93 @@ void DeltaTests::testDeltaCopyOutOfBounds()
     assertEqual(reText2, text2, width, height, testname);
 }
 
+void DeltaTests::testDiffRowSimd()
+{
+    constexpr auto testname = __func__;
+
+    std::mt19937 random;
+    random.seed(42);
+    std::uniform_int_distribution<uint32_t> dist(0, 3);
+
+    // As in ForKit, the SIMD row encoder needs its tables.
+    const bool hasSimd = simd::init();
+    if (hasSimd)
+        simd_deltaInit();
+
+    for (int iter = 0; iter < 64; ++iter)
+    {
+        // Mostly repeated pixels, with an increasing number of changes.
+        uint32_t prev[256], cur[256];
+        for (int x = 0; x < 256; ++x)
+        {
+            prev[x] = (x / (1 + iter % 9)) % 3 ? 0xffffffff : 0xff000000 | iter;
+            cur[x] = dist(random) * iter < 8 ? prev[x] : 0xff000000 | random();
+        }
+
+        DeltaGenerator::DeltaBitmapRow rowPrev, rowCur;
+        rowPrev.initRow(prev, 256);
+        rowCur.initRow(cur, 256);
+
+        uint32_t expanded[256];
+        rowCur.expandRow(expanded, 256);
+        LOK_ASSERT_EQUAL(0, memcmp(cur, expanded, sizeof(cur)));
+
+        uint64_t cpuMask[4];
+        DeltaGenerator::DeltaBitmapRow::diffRowMaskCpu(prev, cur, cpuMask);
+
+        // Cross-check the SIMD kernel, where it is built and supported.
+        uint64_t simdMask[4];
+        if (hasSimd && simd_diffRowMask(prev, cur, simdMask))
+            LOK_ASSERT_EQUAL(0, memcmp(cpuMask, simdMask, sizeof(cpuMask)));
+
+        // The mask based diff must be byte-identical to the per-pixel one.
+        std::vector<uint8_t> cpuDiff, maskDiff;
+        rowPrev.diffRowToCpu(rowCur, 256, iter, cpuDiff, LOK_TILEMODE_RGBA);
+        DeltaGenerator::DeltaBitmapRow::diffRowFromMask(cur, cpuMask, 256, iter, maskDiff,
+                                                        LOK_TILEMODE_RGBA);
+        LOK_ASSERT(cpuDiff == maskDiff);
+
+        std::vector<uint8_t> diff;
+        rowPrev.diffRowTo(rowCur, 256, iter, diff, LOK_TILEMODE_RGBA);
+        LOK_ASSERT(cpuDiff == diff);
+    }
+}
+
+void DeltaTests::testDeltaShiftedRows()
+{
+    constexpr auto testname = __func__;
+
+    DeltaGenerator gen;
+
+    uint32_t height, width, rowBytes;
+    std::vector<char> text =
+        Png::loadPng(TDOC "/delta-text.png", height, width, rowBytes);
+    LOK_ASSERT(height == 256 && width == 256 && rowBytes == 256*4);
+
+    // Scroll the content up by 17 rows, as when scrolling a document.
+    std::vector<char> scrolled(text.size(), 0);
+    const size_t shift = 17 * rowBytes;
+    std::copy(text.begin() + shift, text.end(), scrolled.begin());
+
+    std::vector<char> delta;
+    std::shared_ptr<DeltaGenerator::DeltaData> rleData;
+    LOK_ASSERT(gen.createDelta(
+                       reinterpret_cast<unsigned char *>(text.data()),
+                       0, 0, width, height, width, height,
+                       TileLocation(1, 2, 3, 0, CanonicalViewId(1), 0), delta,
+                       1, false, LOK_TILEMODE_RGBA, rleData) == false);
+
+    LOK_ASSERT(gen.createDelta(
+                       reinterpret_cast<unsigned char *>(scrolled.data()),
+                       0, 0, width, height, width, height,
+                       TileLocation(1, 2, 3, 0, CanonicalViewId(1), 0), delta,
+                       2, false, LOK_TILEMODE_RGBA, rleData) == true);
+    checkzDelta(delta, "scrolled rows");
+
+    std::vector<char> reScrolled = applyDelta(text, width, height, delta, testname);
+    assertEqual(reScrolled, scrolled, width, height, testname);
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(DeltaTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
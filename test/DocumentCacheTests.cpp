@@ -0,0 +1,204 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <test/lokassert.hpp>
+
+#include <common/FileUtil.hpp>
+#include <wsd/DocumentCache.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <fstream>
+#include <sys/stat.h>
+
+#include <string>
+
+/// DocumentCache unit-tests.
+class DocumentCacheTests : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(DocumentCacheTests);
+
+    CPPUNIT_TEST(testKey);
+    CPPUNIT_TEST(testPrivateCopies);
+    CPPUNIT_TEST(testTampered);
+    CPPUNIT_TEST(testLeastRecentlyUsed);
+    CPPUNIT_TEST(testSizeLimit);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void testKey();
+    void testPrivateCopies();
+    void testTampered();
+    void testLeastRecentlyUsed();
+    void testSizeLimit();
+
+    std::string _dir;
+
+public:
+    void setUp() override
+    {
+        _dir = FileUtil::createRandomTmpDir();
+        DocumentCache::initialize(_dir + "/cache", 3000);
+    }
+
+    void tearDown() override
+    {
+        DocumentCache::Entries.clear();
+        DocumentCache::EntriesMap.clear();
+        DocumentCache::CachePath.clear();
+        DocumentCache::SizeBytes = 0;
+        FileUtil::removeFile(_dir, /*recursive=*/true);
+    }
+
+    /// Writes a document of @size bytes of @c, returning its path.
+    std::string writeDocument(const std::string& name, std::size_t size, char c = 'x')
+    {
+        const std::string path = _dir + '/' + name;
+        std::ofstream(path) << std::string(size, c);
+        return path;
+    }
+
+    std::string readDocument(const std::string& path)
+    {
+        std::string content;
+        FileUtil::readFile(path, content);
+        return content;
+    }
+
+    static std::string key(const std::string& name)
+    {
+        return DocumentCache::getKey("https://wopi/files/" + name, "1", std::string());
+    }
+};
+
+void DocumentCacheTests::testKey()
+{
+    constexpr auto testname = __func__;
+
+    const std::string docKey = "https://wopi/files/1";
+    const std::string key = DocumentCache::getKey(docKey, "v1", "2024-01-01T00:00:00Z");
+    LOK_ASSERT_EQUAL(std::size_t(40), key.size());
+    LOK_ASSERT_EQUAL(key, DocumentCache::getKey(docKey, "v1", "2024-01-01T00:00:00Z"));
+
+    // The Version, when we have it, is all that matters.
+    LOK_ASSERT_EQUAL(key, DocumentCache::getKey(docKey, "v1", "2024-02-02T00:00:00Z"));
+    LOK_ASSERT(key != DocumentCache::getKey(docKey, "v2", "2024-01-01T00:00:00Z"));
+    LOK_ASSERT(key != DocumentCache::getKey("https://wopi/files/2", "v1",
+                                            "2024-01-01T00:00:00Z"));
+
+    // Otherwise the LastModifiedTime, which doesn't collide with a Version of the same value.
+    const std::string timeKey = DocumentCache::getKey(docKey, std::string(), "v1");
+    LOK_ASSERT(timeKey != key);
+    LOK_ASSERT(timeKey != DocumentCache::getKey(docKey, std::string(), "v2"));
+
+    // Unknown versions aren't cacheable.
+    LOK_ASSERT(DocumentCache::getKey(docKey, std::string(), std::string()).empty());
+    LOK_ASSERT(!DocumentCache::contains(std::string()));
+}
+
+void DocumentCacheTests::testPrivateCopies()
+{
+    constexpr auto testname = __func__;
+
+    const std::string path = writeDocument("doc", 100);
+    ::mkdir((path + ".certs").c_str(), S_IRWXU);
+    std::ofstream(path + ".certs/cert.0") << "cert";
+
+    DocumentCache::cacheDocument(key("doc"), path);
+    LOK_ASSERT(DocumentCache::contains(key("doc")));
+
+    // Neither the original, nor what we supply, shares the cached file.
+    const std::string cachedPath = DocumentCache::CachePath + key("doc");
+    const FileUtil::Stat cached(cachedPath);
+    LOK_ASSERT(cached.inodeNumber() != FileUtil::Stat(path).inodeNumber());
+    LOK_ASSERT_EQUAL(0, static_cast<int>(cached.sb().st_mode & (S_IWUSR | S_IRWXG | S_IRWXO)));
+
+    // Writing to the original, as the Kit can, doesn't change what we cached.
+    writeDocument("doc", 100, 'y');
+
+    const std::string destPath = _dir + "/supplied";
+    LOK_ASSERT(DocumentCache::supplyDocument(key("doc"), destPath));
+    LOK_ASSERT_EQUAL(std::string(100, 'x'), readDocument(destPath));
+    LOK_ASSERT(FileUtil::Stat(destPath).inodeNumber() != cached.inodeNumber());
+    LOK_ASSERT_EQUAL(std::string("cert"), readDocument(destPath + ".certs/cert.0"));
+}
+
+void DocumentCacheTests::testTampered()
+{
+    constexpr auto testname = __func__;
+
+    DocumentCache::cacheDocument(key("doc"), writeDocument("doc", 100));
+
+    // Same size, same times, different content.
+    const std::string cachedPath = DocumentCache::CachePath + key("doc");
+    const FileUtil::Stat before(cachedPath);
+    ::chmod(cachedPath.c_str(), S_IRUSR | S_IWUSR);
+    std::ofstream(cachedPath) << std::string(100, 'z');
+    FileUtil::updateTimestamps(cachedPath, before.sb().st_atim, before.sb().st_mtim);
+
+    const std::string destPath = _dir + "/supplied";
+    LOK_ASSERT(!DocumentCache::supplyDocument(key("doc"), destPath));
+    LOK_ASSERT(!FileUtil::Stat(destPath).exists());
+    LOK_ASSERT(!DocumentCache::contains(key("doc")));
+    LOK_ASSERT(!FileUtil::Stat(cachedPath).exists());
+}
+
+void DocumentCacheTests::testLeastRecentlyUsed()
+{
+    constexpr auto testname = __func__;
+
+    for (const std::string name : { "a", "b", "c" })
+        DocumentCache::cacheDocument(key(name), writeDocument(name, 1000));
+
+    // Using the oldest makes the next one the least recently used.
+    LOK_ASSERT(DocumentCache::supplyDocument(key("a"), _dir + "/supplied"));
+
+    DocumentCache::cacheDocument(key("d"), writeDocument("d", 1000));
+    LOK_ASSERT(DocumentCache::contains(key("a")));
+    LOK_ASSERT(!DocumentCache::contains(key("b")));
+    LOK_ASSERT(DocumentCache::contains(key("c")));
+    LOK_ASSERT(DocumentCache::contains(key("d")));
+    LOK_ASSERT(!FileUtil::Stat(DocumentCache::CachePath + key("b")).exists());
+
+    // Caching a new version of the same key replaces it.
+    DocumentCache::cacheDocument(key("a"), writeDocument("a", 500));
+    LOK_ASSERT_EQUAL(std::size_t(2500), DocumentCache::SizeBytes);
+    LOK_ASSERT_EQUAL(std::size_t(3), DocumentCache::Entries.size());
+}
+
+void DocumentCacheTests::testSizeLimit()
+{
+    constexpr auto testname = __func__;
+
+    // Too large to ever fit.
+    DocumentCache::cacheDocument(key("huge"), writeDocument("huge", 3001));
+    LOK_ASSERT(!DocumentCache::contains(key("huge")));
+    LOK_ASSERT_EQUAL(std::size_t(0), DocumentCache::SizeBytes);
+
+    // Makes room for a large one by evicting as many as needed.
+    for (const std::string name : { "a", "b", "c" })
+        DocumentCache::cacheDocument(key(name), writeDocument(name, 1000));
+    LOK_ASSERT_EQUAL(std::size_t(3000), DocumentCache::SizeBytes);
+
+    DocumentCache::cacheDocument(key("large"), writeDocument("large", 2500));
+    LOK_ASSERT(DocumentCache::contains(key("large")));
+    LOK_ASSERT(!DocumentCache::contains(key("a")));
+    LOK_ASSERT(!DocumentCache::contains(key("b")));
+    LOK_ASSERT(!DocumentCache::contains(key("c")));
+    LOK_ASSERT_EQUAL(std::size_t(2500), DocumentCache::SizeBytes);
+    LOK_ASSERT_EQUAL(std::size_t(1), FileUtil::getDirEntries(DocumentCache::CachePath).size());
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DocumentCacheTests);
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
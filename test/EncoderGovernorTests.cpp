@@ -0,0 +1,188 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <test/lokassert.hpp>
+
+#include <DummyLibreOfficeKit.hpp>
+#include <EncoderGovernor.hpp>
+#include <RenderTiles.hpp>
+#include <ThreadPool.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+
+/// EncoderGovernor unit-tests.
+class EncoderGovernorTests : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(EncoderGovernorTests);
+
+    CPPUNIT_TEST(testLimit);
+    CPPUNIT_TEST(testVisibleFirst);
+    CPPUNIT_TEST(testRenderWithinBudget);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void testLimit();
+    void testVisibleFirst();
+    void testRenderWithinBudget();
+
+public:
+    void tearDown() override
+    {
+        // Don't govern the other tests.
+        if (EncoderGovernor::Shared)
+            munmap(EncoderGovernor::Shared, sizeof(EncoderGovernor::State));
+        EncoderGovernor::Shared = nullptr;
+        EncoderGovernor::OwnSlot = nullptr;
+        EncoderGovernor::OwnPid = 0;
+    }
+
+    static int busy() { return EncoderGovernor::Shared->_busy; }
+
+    /// Forks a process that starts encoding, and dies doing so. Returns its pid.
+    static pid_t encodeAndDie(bool urgent)
+    {
+        const pid_t pid = fork();
+        if (pid == 0)
+        {
+            // No extra threads wanted, so nothing to log either.
+            EncoderGovernor::acquire(0, urgent);
+            _exit(0);
+        }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        return pid;
+    }
+};
+
+void EncoderGovernorTests::testLimit()
+{
+    constexpr auto testname = __func__;
+
+    EncoderGovernor::initialize(4);
+    LOK_ASSERT(EncoderGovernor::isEnabled());
+
+    // The caller counts, so only 3 of the 7 extra threads.
+    LOK_ASSERT_EQUAL(3, EncoderGovernor::acquire(7, false));
+    LOK_ASSERT_EQUAL(4, busy());
+
+    // Another process over the limit still encodes, on its own thread.
+    const pid_t pid = encodeAndDie(false);
+    LOK_ASSERT_EQUAL(5, busy());
+
+    // What a dead process held is returned when it's reaped.
+    EncoderGovernor::releaseProcess(pid);
+    LOK_ASSERT_EQUAL(4, busy());
+
+    EncoderGovernor::release(3, false);
+    LOK_ASSERT_EQUAL(0, busy());
+
+    LOK_ASSERT_EQUAL(3, EncoderGovernor::acquire(3, false));
+    EncoderGovernor::release(3, false);
+    LOK_ASSERT_EQUAL(0, busy());
+}
+
+void EncoderGovernorTests::testVisibleFirst()
+{
+    constexpr auto testname = __func__;
+
+    EncoderGovernor::initialize(8);
+
+    // Another process is rendering visible tiles.
+    const pid_t pid = encodeAndDie(true);
+
+    // So we get no help for tiles nobody is looking at.
+    LOK_ASSERT_EQUAL(0, EncoderGovernor::acquire(3, false));
+    EncoderGovernor::release(0, false);
+
+    // But do for visible ones.
+    LOK_ASSERT_EQUAL(3, EncoderGovernor::acquire(3, true));
+    EncoderGovernor::release(3, true);
+
+    EncoderGovernor::releaseProcess(pid);
+    LOK_ASSERT_EQUAL(0, busy());
+    LOK_ASSERT_EQUAL(3, EncoderGovernor::acquire(3, false));
+    EncoderGovernor::release(3, false);
+}
+
+void EncoderGovernorTests::testRenderWithinBudget()
+{
+    constexpr auto testname = __func__;
+
+    // The pool reads it on construction only, so restore it at once.
+    const char* const maxConcurrency = getenv("MAX_CONCURRENCY");
+    const std::string oldMaxConcurrency = maxConcurrency ? maxConcurrency : std::string();
+    // coverity[tainted_data_argument : FALSE] - we trust this variable in tests
+    setenv("MAX_CONCURRENCY", "4", 1);
+    ThreadPool pool;
+    if (maxConcurrency)
+        setenv("MAX_CONCURRENCY", oldMaxConcurrency.c_str(), 1);
+    else
+        unsetenv("MAX_CONCURRENCY");
+    DeltaGenerator deltaGen;
+
+    LibreOfficeKit* kit = dummy_lok_init_2(nullptr, nullptr);
+    const auto document =
+        std::make_shared<lok::Document>(kit->pClass->documentLoad(kit, "file:///dummy.odt"));
+
+    const auto render = [&](bool visible)
+    {
+        TileCombined tileCombined = TileCombined::parse(
+            "tilecombine nviewid=0 part=0 width=256 height=256 tileposx=0,3840,7680,11520 "
+            "tileposy=0,0,0,0 tilewidth=3840 tileheight=3840");
+
+        std::size_t sent = 0;
+        LOK_ASSERT(RenderTiles::doRender(
+            document, deltaGen, tileCombined, pool,
+            [](unsigned char*, int, int, std::size_t, std::size_t, int, int,
+               LibreOfficeKitTileMode) {},
+            [&](const char* buffer, std::size_t length)
+            {
+                LOK_ASSERT(std::string(buffer, length).starts_with("tilecombine:"));
+                ++sent;
+            },
+            0, CanonicalViewId::None, false, 0, visible));
+        LOK_ASSERT_EQUAL(std::size_t(1), sent);
+    };
+
+    // With a budget of one thread, the renderer encodes all by itself.
+    EncoderGovernor::initialize(1);
+    render(true);
+    LOK_ASSERT_EQUAL(uint64_t(0), EncoderGovernor::Shared->_granted.load());
+    LOK_ASSERT_EQUAL(uint64_t(3), EncoderGovernor::Shared->_denied.load());
+    LOK_ASSERT_EQUAL(0, busy());
+
+    // Other processes hogging the budget don't stop us either.
+    tearDown();
+    EncoderGovernor::initialize(2);
+    const pid_t pid = encodeAndDie(false);
+    render(false);
+    LOK_ASSERT_EQUAL(uint64_t(0), EncoderGovernor::Shared->_granted.load());
+
+    // Once they're gone, we get the help we want.
+    EncoderGovernor::releaseProcess(pid);
+    render(true);
+    LOK_ASSERT_EQUAL(uint64_t(1), EncoderGovernor::Shared->_granted.load());
+    LOK_ASSERT_EQUAL(0, busy());
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(EncoderGovernorTests);
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -13,6 +13,7 @@
 
 #include <wsd/FileServer.hpp>
 #include <common/FileUtil.hpp>
+#include <net/HttpHelper.hpp>
 #include <test/lokassert.hpp>
 
 #include <Poco/String.h>
@@ -20,10 +21,16 @@
 #include <cppunit/TestAssert.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include <chrono>
 #include <cstddef>
+#include <fstream>
 #include <memory>
+#include <random>
 #include <unordered_map>
 
+#include <zlib.h>
+#include <zstd.h>
+
 /// File-Serve White-Box unit-tests.
 class FileServeTests : public CPPUNIT_NS::TestFixture
 {
@@ -33,6 +40,9 @@ class FileServeTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testPreProcessedFile);
     CPPUNIT_TEST(testPreProcessedFileRoundtrip);
     CPPUNIT_TEST(testPreProcessedFileSubstitution);
+    CPPUNIT_TEST(testPreProcessedFileRenderTime);
+    CPPUNIT_TEST(testStaticAsset);
+    CPPUNIT_TEST(testMatchesETag);
     CPPUNIT_TEST_SUITE_END();
 
     void testUIDefaults();
@@ -40,6 +50,9 @@ class FileServeTests : public CPPUNIT_NS::TestFixture
     void testPreProcessedFile();
     void testPreProcessedFileRoundtrip();
     void testPreProcessedFileSubstitution();
+    void testPreProcessedFileRenderTime();
+    void testStaticAsset();
+    void testMatchesETag();
 
     void preProcessedFileSubstitution(const std::string& testname,
                                       std::unordered_map<std::string, std::string> variables);
@@ -441,6 +454,199 @@ void FileServeTests::testPreProcessedFileSubstitution()
                                  std::unordered_map<std::string, std::string>());
 }
 
+/// Compares rendering a cool.html-sized page from the parsed template
+/// against replacing the variables one by one, per request.
+void FileServeTests::testPreProcessedFileRenderTime()
+{
+    constexpr auto testname = __func__;
+
+    // About as many variables, and as large, as cool.html.
+    std::unordered_map<std::string, std::string> variables;
+    std::string page = "<!DOCTYPE html>\n<html %UI_RTL_SETTINGS%><head>\n<!--%BRANDING_CSS%-->\n";
+    for (int i = 0; i < 48; ++i)
+    {
+        const std::string name = "VARIABLE_" + std::string(1, 'A' + i % 26) +
+                                 std::string(1, 'A' + i / 26);
+        variables[name] = "value-of-" + name;
+        for (int j = 0; j < 40; ++j)
+            page += "<div class=\"filler\" style=\"width: 100%\">Some text " +
+                    std::to_string(j) + "</div>\n";
+        page += "window." + name + " = '%" + name + "%';\n";
+    }
+
+    page += "<script src=\"%SERVICE_ROOT%/browser/%VERSION%/bundle.js\"></script>\n</html>\n";
+    variables["UI_RTL_SETTINGS"] = " dir=\"rtl\" ";
+    variables["BRANDING_CSS"] = "<link rel=\"stylesheet\" href=\"branding.css\">";
+    variables["SERVICE_ROOT"] = "/cool";
+    variables["VERSION"] = "0123456789abcdef";
+
+    constexpr int Iterations = 200;
+
+    std::string expected;
+    const auto replaceStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; ++i)
+    {
+        expected = page;
+        for (const auto& pair : variables)
+        {
+            const std::string key = pair.first == "BRANDING_CSS" ? "<!--%" + pair.first + "%-->"
+                                                                 : '%' + pair.first + '%';
+            Poco::replaceInPlace(expected, key, pair.second);
+        }
+    }
+
+    const auto replaceTime = std::chrono::steady_clock::now() - replaceStart;
+
+    const PreProcessedFile ppf("cool.html", page);
+    std::string rendered;
+    const auto renderStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; ++i)
+        rendered = ppf.substitute(variables);
+
+    const auto renderTime = std::chrono::steady_clock::now() - renderStart;
+
+    LOK_ASSERT_EQUAL(expected, rendered);
+
+    TST_LOG("Rendering " << page.size() << " bytes with " << variables.size()
+                         << " variables: replacing takes "
+                         << std::chrono::duration_cast<std::chrono::microseconds>(replaceTime)
+                                    .count() /
+                                Iterations
+                         << "us, substituting takes "
+                         << std::chrono::duration_cast<std::chrono::microseconds>(renderTime)
+                                    .count() /
+                                Iterations
+                         << "us per request");
+}
+
+namespace
+{
+void writeFile(const std::string& path, const std::string& data)
+{
+    std::ofstream ofs(path, std::ios::binary);
+    ofs.write(data.data(), data.size());
+}
+
+std::string gunzip(std::string_view data)
+{
+    z_stream strm{};
+    inflateInit2(&strm, 31); // Expect the gzip wrapper.
+    strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    strm.avail_in = data.size();
+
+    std::string result;
+    char buffer[16 * 1024];
+    int rc;
+    do
+    {
+        strm.next_out = reinterpret_cast<Bytef*>(buffer);
+        strm.avail_out = sizeof(buffer);
+        rc = inflate(&strm, Z_NO_FLUSH);
+        result.append(buffer, sizeof(buffer) - strm.avail_out);
+    } while (rc == Z_OK);
+
+    inflateEnd(&strm);
+    return rc == Z_STREAM_END ? result : std::string();
+}
+} // namespace
+
+/// Tests the mapped, pre-compressed static assets.
+void FileServeTests::testStaticAsset()
+{
+    constexpr auto testname = __func__;
+
+    const std::string dir = FileUtil::createRandomTmpDir();
+
+    // Compressible text.
+    std::string text;
+    for (int i = 0; i < 2000; ++i)
+        text += "function f" + std::to_string(i % 50) + "() { return " + std::to_string(i) + "; }\n";
+
+    const std::string textPath = dir + "/bundle.js";
+    writeFile(textPath, text);
+    writeFile(textPath + ".br", "not really brotli");
+
+    StaticAsset asset;
+    LOK_ASSERT(asset.load(textPath));
+    asset.compress();
+    LOK_ASSERT_EQUAL(text, std::string(asset.get(StaticAsset::Encoding::Identity)));
+
+    LOK_ASSERT(!asset.get(StaticAsset::Encoding::Gzip).empty());
+    LOK_ASSERT(asset.get(StaticAsset::Encoding::Gzip).size() < text.size());
+    LOK_ASSERT_EQUAL(text, gunzip(asset.get(StaticAsset::Encoding::Gzip)));
+
+    const std::string_view zstd = asset.get(StaticAsset::Encoding::Zstd);
+    LOK_ASSERT(!zstd.empty());
+    std::string unzstd(text.size(), '\0');
+    LOK_ASSERT_EQUAL(text.size(),
+                     ZSTD_decompress(unzstd.data(), unzstd.size(), zstd.data(), zstd.size()));
+    LOK_ASSERT_EQUAL(text, unzstd);
+
+    // No brotli yet.
+    LOK_ASSERT(StaticAsset::Encoding::Zstd == asset.select(true, true, true));
+    LOK_ASSERT(StaticAsset::Encoding::Gzip == asset.select(true, false, true));
+    LOK_ASSERT(StaticAsset::Encoding::Identity == asset.select(false, false, false));
+
+    LOK_ASSERT(asset.loadBrotli(textPath + ".br"));
+    LOK_ASSERT(StaticAsset::Encoding::Brotli == asset.select(true, true, true));
+    LOK_ASSERT(StaticAsset::Encoding::Zstd == asset.select(false, true, true));
+    LOK_ASSERT_EQUAL(std::string("not really brotli"),
+                     std::string(asset.get(StaticAsset::Encoding::Brotli)));
+    LOK_ASSERT_EQUAL(std::string("br"),
+                     std::string(StaticAsset::name(StaticAsset::Encoding::Brotli)));
+
+    // Moving keeps the mappings valid.
+    const StaticAsset moved(std::move(asset));
+    LOK_ASSERT_EQUAL(text, std::string(moved.get(StaticAsset::Encoding::Identity)));
+    LOK_ASSERT_EQUAL(text.size() + 17, moved.mappedSize());
+
+    // Incompressible data isn't worth a Content-Encoding.
+    std::mt19937 rng(42);
+    std::string noise(64 * 1024, '\0');
+    for (char& c : noise)
+        c = static_cast<char>(rng());
+
+    const std::string noisePath = dir + "/image.png";
+    writeFile(noisePath, noise);
+    StaticAsset image;
+    LOK_ASSERT(image.load(noisePath));
+    image.compress();
+    LOK_ASSERT(image.get(StaticAsset::Encoding::Gzip).empty());
+    LOK_ASSERT(image.get(StaticAsset::Encoding::Zstd).empty());
+    LOK_ASSERT_EQUAL(0UL, image.heapSize());
+    LOK_ASSERT(StaticAsset::Encoding::Identity == image.select(true, true, true));
+
+    // Empty files are served too.
+    const std::string emptyPath = dir + "/empty.css";
+    writeFile(emptyPath, std::string());
+    StaticAsset empty;
+    LOK_ASSERT(empty.load(emptyPath));
+    empty.compress();
+    LOK_ASSERT(empty.get(StaticAsset::Encoding::Identity).empty());
+    LOK_ASSERT(StaticAsset::Encoding::Identity == empty.select(true, true, true));
+
+    StaticAsset missing;
+    LOK_ASSERT(!missing.load(dir + "/missing.js"));
+
+    FileUtil::removeFile(dir, true);
+}
+
+void FileServeTests::testMatchesETag()
+{
+    constexpr auto testname = __func__;
+
+    const std::string etag = "\"abc123\"";
+    LOK_ASSERT(HttpHelper::matchesETag("\"abc123\"", etag));
+    LOK_ASSERT(HttpHelper::matchesETag("W/\"abc123\"", etag));
+    LOK_ASSERT(HttpHelper::matchesETag("*", etag));
+    LOK_ASSERT(HttpHelper::matchesETag("\"old\", \"abc123\"", etag));
+    LOK_ASSERT(HttpHelper::matchesETag(" \"old\" ,W/\"abc123\"  ", etag));
+    LOK_ASSERT(!HttpHelper::matchesETag("", etag));
+    LOK_ASSERT(!HttpHelper::matchesETag("\"abc\"", etag));
+    LOK_ASSERT(!HttpHelper::matchesETag("abc123", etag));
+    LOK_ASSERT(!HttpHelper::matchesETag(" , ", etag));
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(FileServeTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -66,6 +66,7 @@ class HttpRequestTests final : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testTimeout);
     CPPUNIT_TEST(testOnFinished_Complete);
     CPPUNIT_TEST(testOnFinished_Timeout);
+    CPPUNIT_TEST(testAsyncDownload);
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -82,6 +83,7 @@ class HttpRequestTests final : public CPPUNIT_NS::TestFixture
     void testTimeout();
     void testOnFinished_Complete();
     void testOnFinished_Timeout();
+    void testAsyncDownload();
 
     static constexpr std::chrono::seconds DefTimeoutSeconds{ 5 };
 
@@ -719,6 +721,58 @@ void HttpRequestTests::testOnFinished_Timeout()
     LOK_ASSERT(httpResponse->state() == http::Response::State::Timeout);
 }
 
+void HttpRequestTests::testAsyncDownload()
+{
+    constexpr auto testname = __func__;
+
+    // As the WOPI GetFile prefetch does, stream the body to file on a poll.
+    std::shared_ptr<SocketPoll> pollThread = std::make_shared<SocketPoll>("AsyncDownloadPoll");
+    pollThread->startThread();
+
+    const std::string body = "some/data/to/download";
+    const auto download = [&](const std::string& path)
+    {
+        auto httpSession = http::Session::create(_localUri);
+        httpSession->setTimeout(DefTimeoutSeconds);
+
+        std::condition_variable cv;
+        std::mutex mutex;
+        bool finished = false;
+        httpSession->setFinishedHandler(
+            [&](const std::shared_ptr<http::Session>&)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished = true;
+                cv.notify_all();
+            });
+
+        int64_t progress = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        httpSession->asyncDownload(http::Request("/echo/" + body), path, pollThread,
+                                   [&](int64_t received, int64_t) { progress = received; });
+
+        cv.wait_for(lock, DefTimeoutSeconds, [&]() { return finished; });
+        LOK_ASSERT_EQUAL_MESSAGE("Timed out waiting for the onFinished handler", true, finished);
+        LOK_ASSERT_EQUAL(http::StatusCode::OK, httpSession->response()->statusCode());
+        LOK_ASSERT_EQUAL(static_cast<int64_t>(body.size()), progress);
+        return httpSession->response()->state();
+    };
+
+    const std::string path =
+        FileUtil::getSysTempDirectoryPath() + "/asyncDownload-" + std::to_string(getpid());
+    LOK_ASSERT(download(path) == http::Response::State::Complete);
+    std::string content;
+    FileUtil::readFile(path, content);
+    LOK_ASSERT_EQUAL(body, content);
+    FileUtil::removeFile(path);
+
+    // A body we fail to save must not pass for a whole one.
+    if (FileUtil::Stat("/dev/full").exists())
+        LOK_ASSERT(download("/dev/full") == http::Response::State::Error);
+
+    pollThread->joinThread();
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(HttpRequestTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -14,6 +14,7 @@
 #include <string>
 
 #include <common/Clipboard.hpp>
+#include <common/FileUtil.hpp>
 #include <net/HttpRequest.hpp>
 
 #include <test/lokassert.hpp>
@@ -36,6 +37,10 @@ class HttpWhiteBoxTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testRequestParserValidIncomplete);
     CPPUNIT_TEST(testClipboardIsOwnFormat);
 
+    CPPUNIT_TEST(testResponseSaveBodyToFile);
+    CPPUNIT_TEST(testResponseSaveBodyToFileChunked);
+    CPPUNIT_TEST(testResponseSaveBodyToFileFailed);
+
     CPPUNIT_TEST_SUITE_END();
 
     void testStatusLineParserValidComplete();
@@ -46,6 +51,25 @@ class HttpWhiteBoxTests : public CPPUNIT_NS::TestFixture
     void testRequestParserValidComplete();
     void testRequestParserValidIncomplete();
     void testClipboardIsOwnFormat();
+    void testResponseSaveBodyToFile();
+    void testResponseSaveBodyToFileChunked();
+    void testResponseSaveBodyToFileFailed();
+
+    /// A body spanning a few blocks of the body file, and a partial one.
+    static std::string makeBody()
+    {
+        std::string body;
+        for (std::size_t i = 0; body.size() < 2 * http::Response::BodyFileBlockSize + 1234; ++i)
+            body += std::to_string(i) + ',';
+        return body;
+    }
+
+    static std::string readBodyFile(const std::string& path)
+    {
+        std::string content;
+        FileUtil::readFile(path, content, 4 * http::Response::BodyFileBlockSize);
+        return content;
+    }
 };
 
 void HttpWhiteBoxTests::testStatusLineParserValidComplete()
@@ -249,6 +273,142 @@ PK)x";
     }
 }
 
+void HttpWhiteBoxTests::testResponseSaveBodyToFile()
+{
+    constexpr auto testname = __func__;
+
+    const std::string body = makeBody();
+    const std::string data = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size())
+                             + "\r\n\r\n" + body;
+
+    const std::string path = FileUtil::getSysTempDirectoryPath() + "/saveBodyToFile-"
+                             + std::to_string(getpid());
+    int64_t progress = 0;
+    {
+        http::Response response;
+        response.saveBodyToFile(path,
+                                [&](int64_t received, int64_t total)
+                                {
+                                    LOK_ASSERT(received > progress);
+                                    LOK_ASSERT_EQUAL(static_cast<int64_t>(body.size()), total);
+                                    progress = received;
+                                });
+
+        // Feed it in odd pieces, as they come from the socket.
+        std::size_t offset = 0;
+        for (std::size_t piece = 1; offset < data.size(); piece = piece * 7 + 3)
+        {
+            const std::size_t len = std::min(piece % 100000 + 1, data.size() - offset);
+            const int64_t read = response.readData(data.data() + offset, len);
+            LOK_ASSERT(read >= 0);
+            offset += read;
+            if (read == 0)
+            {
+                // Incomplete header, give it the rest of it at once.
+                const std::size_t header = data.find("\r\n\r\n") + 4;
+                LOK_ASSERT_EQUAL(static_cast<int64_t>(header - offset),
+                                 response.readData(data.data() + offset, header - offset));
+                offset = header;
+            }
+        }
+
+        LOK_ASSERT(response.state() == http::Response::State::Complete);
+        LOK_ASSERT(response.getBody().empty());
+    }
+
+    LOK_ASSERT_EQUAL(static_cast<int64_t>(body.size()), progress);
+    LOK_ASSERT_EQUAL(body, readBodyFile(path));
+    FileUtil::removeFile(path);
+}
+
+void HttpWhiteBoxTests::testResponseSaveBodyToFileChunked()
+{
+    constexpr auto testname = __func__;
+
+    const std::string body = makeBody();
+    http::Response chunks(http::StatusCode::OK);
+    for (std::size_t offset = 0; offset < body.size(); offset += 100003)
+        chunks.appendChunk(body.substr(offset, 100003));
+    chunks.appendChunk(std::string());
+
+    const std::string data =
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n" + chunks.getBody();
+
+    const std::string path = FileUtil::getSysTempDirectoryPath() + "/saveBodyToFileChunked-"
+                             + std::to_string(getpid());
+    {
+        http::Response response;
+        response.saveBodyToFile(path);
+
+        // Whatever isn't consumed, for want of a whole chunk, is given again.
+        std::string pending;
+        for (std::size_t offset = 0; offset < data.size(); offset += 65536)
+        {
+            pending += data.substr(offset, 65536);
+            const int64_t read = response.readData(pending.data(), pending.size());
+            LOK_ASSERT(read >= 0);
+            pending.erase(0, read);
+        }
+
+        LOK_ASSERT(response.state() == http::Response::State::Complete);
+    }
+
+    LOK_ASSERT_EQUAL(body, readBodyFile(path));
+    FileUtil::removeFile(path);
+}
+
+void HttpWhiteBoxTests::testResponseSaveBodyToFileFailed()
+{
+    constexpr auto testname = __func__;
+
+    // Every write to /dev/full fails with ENOSPC.
+    if (!FileUtil::Stat("/dev/full").exists())
+        return;
+
+    // Only the final flush, on completion, fails.
+    {
+        const std::string data = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+        http::Response response;
+        response.saveBodyToFile("/dev/full");
+        LOK_ASSERT_EQUAL(static_cast<int64_t>(data.size()),
+                         response.readData(data.data(), data.size()));
+        LOK_ASSERT(response.state() == http::Response::State::Error);
+    }
+
+    // Failing to write a full block interrupts the transfer.
+    {
+        const std::string body = makeBody();
+        const std::string data = "HTTP/1.1 200 OK\r\nContent-Length: "
+                                 + std::to_string(body.size()) + "\r\n\r\n" + body;
+        http::Response response;
+        response.saveBodyToFile("/dev/full");
+        LOK_ASSERT_EQUAL(static_cast<int64_t>(-1), response.readData(data.data(), data.size()));
+        response.finish();
+        LOK_ASSERT(response.state() == http::Response::State::Error);
+    }
+
+    // Nor can it complete when the file can't be created.
+    {
+        const std::string data = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+        http::Response response;
+        response.saveBodyToFile("/nonexistent/directory/file");
+        LOK_ASSERT_EQUAL(static_cast<int64_t>(data.size()),
+                         response.readData(data.data(), data.size()));
+        LOK_ASSERT(response.state() == http::Response::State::Error);
+    }
+
+    // But errors aren't saved to file, so they don't fail with it.
+    {
+        const std::string data = "HTTP/1.1 404 Not Found\r\nContent-Length: 4\r\n\r\nnope";
+        http::Response response;
+        response.saveBodyToFile("/dev/full");
+        LOK_ASSERT_EQUAL(static_cast<int64_t>(data.size()),
+                         response.readData(data.data(), data.size()));
+        LOK_ASSERT(response.state() == http::Response::State::Complete);
+        LOK_ASSERT_EQUAL(std::string("nope"), response.getBody());
+    }
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(HttpWhiteBoxTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
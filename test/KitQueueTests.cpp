@@ -22,6 +22,8 @@
 
 #include <cppunit/extensions/HelperMacros.h>
 
+#include <chrono>
+
 /// KitQueue unit-tests.
 class KitQueueTests : public CPPUNIT_NS::TestFixture
 {
@@ -43,6 +45,9 @@ class KitQueueTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testCallbackInvalidation);
     CPPUNIT_TEST(testCallbackIndicatorValue);
     CPPUNIT_TEST(testCallbackPageSize);
+    CPPUNIT_TEST(testCallbackUnoCommand);
+    CPPUNIT_TEST(testCallbackInvalidationManyViews);
+    CPPUNIT_TEST(testCallbackIndexDrained);
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -62,6 +67,9 @@ class KitQueueTests : public CPPUNIT_NS::TestFixture
     void testCallbackInvalidation();
     void testCallbackIndicatorValue();
     void testCallbackPageSize();
+    void testCallbackUnoCommand();
+    void testCallbackInvalidationManyViews();
+    void testCallbackIndexDrained();
 
     // Compat helper for tests
     std::string popHelper(KitQueue &queue)
@@ -722,6 +730,123 @@ void KitQueueTests::testCallbackModifiedStatusIsSkipped()
     }
 }
 
+void KitQueueTests::testCallbackUnoCommand()
+{
+    constexpr auto testname = __func__;
+
+    TilePrioritizer dummy;
+    KitQueue queue(dummy);
+    KitQueue::Callback item;
+
+    // The last state of a command per view wins.
+    queue.putCallback(0, LOK_CALLBACK_STATE_CHANGED, ".uno:Bold=true");
+    queue.putCallback(1, LOK_CALLBACK_STATE_CHANGED, ".uno:Bold=true");
+    queue.putCallback(0, LOK_CALLBACK_STATE_CHANGED, ".uno:BoldItalic=true");
+    queue.putCallback(0, LOK_CALLBACK_STATE_CHANGED, ".uno:Bold=false");
+
+    LOK_ASSERT_EQUAL(static_cast<size_t>(3), queue.callbackSize());
+
+    item = queue.getCallback();
+    LOK_ASSERT_EQUAL(1, item._view);
+    LOK_ASSERT_EQUAL_STR(".uno:Bold=true", item._payload);
+    item = queue.getCallback();
+    LOK_ASSERT_EQUAL(0, item._view);
+    LOK_ASSERT_EQUAL_STR(".uno:BoldItalic=true", item._payload);
+    item = queue.getCallback();
+    LOK_ASSERT_EQUAL(0, item._view);
+    LOK_ASSERT_EQUAL_STR(".uno:Bold=false", item._payload);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), queue.callbackSize());
+}
+
+/// Feeds 10k invalidations, interleaved with state changes, across 50
+/// views, as when many are typing, and benchmarks the coalescing.
+void KitQueueTests::testCallbackInvalidationManyViews()
+{
+    constexpr auto testname = __func__;
+
+    constexpr int Views = 50;
+    constexpr int Invalidations = 10000;
+
+    TilePrioritizer dummy;
+    KitQueue queue(dummy);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Invalidations; ++i)
+    {
+        const int view = i % Views;
+        const int x = (i * 7919) % 100000;
+        const int y = (i * 104729) % 200000;
+        queue.putCallback(view, LOK_CALLBACK_INVALIDATE_TILES,
+                          std::to_string(x) + ", " + std::to_string(y) + ", 300, 300, 0");
+        queue.putCallback(view, LOK_CALLBACK_STATE_CHANGED,
+                          ".uno:Bold=" + std::string(i % 2 ? "true" : "false"));
+    }
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    TST_LOG("Queued " << Invalidations << " invalidations across " << Views << " views in "
+                      << elapsed << ", leaving " << queue.callbackSize() << " callbacks");
+
+    // Only the last state of each view is left.
+    LOK_ASSERT_EQUAL(static_cast<size_t>(Invalidations + Views), queue.callbackSize());
+
+    // Now invalidate everything in each view, which covers all the others.
+    for (int view = 0; view < Views; ++view)
+        queue.putCallback(view, LOK_CALLBACK_INVALIDATE_TILES, "EMPTY, 0");
+
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2 * Views), queue.callbackSize());
+
+    KitQueue::Callback item;
+    for (int view = 0; view < Views; ++view)
+    {
+        item = queue.getCallback();
+        LOK_ASSERT_EQUAL(view, item._view);
+        LOK_ASSERT_EQUAL(static_cast<int>(LOK_CALLBACK_STATE_CHANGED), item._type);
+    }
+
+    for (int view = 0; view < Views; ++view)
+    {
+        item = queue.getCallback();
+        LOK_ASSERT_EQUAL(view, item._view);
+        LOK_ASSERT_EQUAL_STR("EMPTY, 0", item._payload);
+    }
+
+    LOK_ASSERT(!queue.getCallback(item));
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), queue._callbacksIndex.size());
+}
+
+void KitQueueTests::testCallbackIndexDrained()
+{
+    constexpr auto testname = __func__;
+
+    TilePrioritizer dummy;
+    KitQueue queue(dummy);
+    KitQueue::Callback item;
+
+    // The Kit flushes the callbacks often, never eliding anything in between.
+    for (int i = 0; i < 1000; ++i)
+    {
+        queue.putCallback(i % 50, LOK_CALLBACK_INVALIDATE_TILES,
+                          std::to_string(i * 1000) + ", 0, 300, 300, 0");
+        queue.putCallback(i % 50, LOK_CALLBACK_STATE_CHANGED, ".uno:Bold=true");
+        LOK_ASSERT_EQUAL(static_cast<size_t>(2), queue.callbackSize());
+
+        while (queue.getCallback(item))
+            ;
+
+        LOK_ASSERT_EQUAL(static_cast<size_t>(0), queue._callbacksIndex.size());
+    }
+
+    // Nor when some were elided before being popped.
+    queue.putCallback(0, LOK_CALLBACK_STATE_CHANGED, ".uno:Bold=true");
+    queue.putCallback(0, LOK_CALLBACK_INVALIDATE_TILES, "0, 0, 300, 300, 0");
+    LOK_ASSERT_EQUAL(static_cast<int>(LOK_CALLBACK_STATE_CHANGED), queue.getCallback()._type);
+    queue.putCallback(0, LOK_CALLBACK_INVALIDATE_TILES, "EMPTY, 0");
+    LOK_ASSERT_EQUAL_STR("EMPTY, 0", queue.getCallback()._payload);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), queue.callbackSize());
+    LOK_ASSERT_EQUAL(static_cast<size_t>(0), queue._callbacksIndex.size());
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(KitQueueTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
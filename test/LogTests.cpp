@@ -0,0 +1,119 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <test/lokassert.hpp>
+
+#include <common/LogRing.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <memory>
+#include <string>
+
+/// Log unit-tests.
+class LogTests : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(LogTests);
+
+    CPPUNIT_TEST(testRingWrapAround);
+    CPPUNIT_TEST(testRingOverflow);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void testRingWrapAround();
+    void testRingOverflow();
+
+    /// Drains @ring, returning what was written out, and how many pieces it took.
+    static std::string drain(Log::Ring& ring, int& pieces)
+    {
+        std::string out;
+        pieces = 0;
+        ring.drain(
+            [&](const char* data, std::size_t size)
+            {
+                out.append(data, size);
+                ++pieces;
+            });
+        return out;
+    }
+};
+
+void LogTests::testRingWrapAround()
+{
+    constexpr auto testname = __func__;
+
+    auto ring = std::make_unique<Log::Ring>();
+    int pieces = 0;
+    LOK_ASSERT(drain(*ring, pieces).empty());
+    LOK_ASSERT_EQUAL(0, pieces);
+
+    // Leave the head 10 bytes before the end of the buffer.
+    const std::string filler(Log::Ring::Size - 11, 'f');
+    LOK_ASSERT(ring->push(filler.data(), filler.size()));
+    LOK_ASSERT_EQUAL(Log::Ring::Size - 10, ring->pending());
+    LOK_ASSERT_EQUAL(filler + '\n', drain(*ring, pieces));
+    LOK_ASSERT_EQUAL(1, pieces);
+    LOK_ASSERT_EQUAL(std::size_t(0), ring->pending());
+
+    // An entry split across the end, whose new-line wraps around too.
+    const std::string first = "0123456789";
+    LOK_ASSERT(ring->push(first.data(), first.size()));
+    const std::string second = "second entry";
+    LOK_ASSERT(ring->push(second.data(), second.size()));
+    LOK_ASSERT_EQUAL(first.size() + second.size() + 2, ring->pending());
+
+    LOK_ASSERT_EQUAL(first + '\n' + second + '\n', drain(*ring, pieces));
+    LOK_ASSERT_EQUAL(2, pieces);
+
+    // And many more laps, with entries of all sizes.
+    for (std::size_t i = 0; i < 3 * Log::Ring::Size / 500; ++i)
+    {
+        const std::string entry(i % 997, 'a' + i % 26);
+        LOK_ASSERT(ring->push(entry.data(), entry.size()));
+        LOK_ASSERT_EQUAL(entry + '\n', drain(*ring, pieces));
+    }
+}
+
+void LogTests::testRingOverflow()
+{
+    constexpr auto testname = __func__;
+
+    auto ring = std::make_unique<Log::Ring>();
+    int pieces = 0;
+
+    // Each entry takes its new-line too, so exactly two fit.
+    const std::string half(Log::Ring::Size / 2 - 1, 'h');
+    LOK_ASSERT(ring->push(half.data(), half.size()));
+    LOK_ASSERT(ring->push(half.data(), half.size()));
+    LOK_ASSERT_EQUAL(Log::Ring::Size, ring->pending());
+
+    // Full: dropped, and nothing already pushed is overwritten.
+    LOK_ASSERT(!ring->push("x", 1));
+    LOK_ASSERT(!ring->push("", 0));
+    LOK_ASSERT_EQUAL(half + '\n' + half + '\n', drain(*ring, pieces));
+
+    // An entry that can never fit is rejected, even when empty.
+    const std::string huge(Log::Ring::Size, 'x');
+    LOK_ASSERT(!ring->push(huge.data(), huge.size()));
+    LOK_ASSERT_EQUAL(std::size_t(0), ring->pending());
+
+    // Room is made by draining.
+    LOK_ASSERT(ring->push(half.data(), half.size()));
+    LOK_ASSERT(!ring->push(half.data(), half.size() + 1));
+    LOK_ASSERT(ring->push(half.data(), half.size()));
+    LOK_ASSERT_EQUAL(half + '\n' + half + '\n', drain(*ring, pieces));
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LogTests);
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -13,26 +13,49 @@
 
 #include <net/Buffer.hpp>
 #include <net/NetUtil.hpp>
+#include <net/Socket.hpp>
+#include <net/SocketPollPool.hpp>
+#include <net/WebSocketHandler.hpp>
 
 #include <test/lokassert.hpp>
 
 #include <cppunit/TestAssert.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include <atomic>
+#include <memory>
+#include <set>
+#include <thread>
+
+#ifdef HAVE_EPOLL
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#endif
+
 /// Net-utility WhiteBox unit-tests.
 class NetUtilWhiteBoxTests : public CPPUNIT_NS::TestFixture
 {
     CPPUNIT_TEST_SUITE(NetUtilWhiteBoxTests);
     CPPUNIT_TEST(testBufferClass);
+    CPPUNIT_TEST(testBufferSegments);
     CPPUNIT_TEST(testParseUri);
     CPPUNIT_TEST(testParseUriUrl);
     CPPUNIT_TEST(testParseUrl);
+    CPPUNIT_TEST(testPollBackendScaling);
+    CPPUNIT_TEST(testPollPoolStealing);
+    CPPUNIT_TEST(testPollPoolJoin);
+    CPPUNIT_TEST(testWebSocketMask);
     CPPUNIT_TEST_SUITE_END();
 
     void testBufferClass();
+    void testBufferSegments();
     void testParseUri();
     void testParseUriUrl();
     void testParseUrl();
+    void testPollBackendScaling();
+    void testPollPoolStealing();
+    void testPollPoolJoin();
+    void testWebSocketMask();
 };
 
 void NetUtilWhiteBoxTests::testBufferClass()
@@ -120,6 +143,85 @@ void NetUtilWhiteBoxTests::testBufferClass()
     LOK_ASSERT_EQUAL(true, buf.empty());
 }
 
+void NetUtilWhiteBoxTests::testBufferSegments()
+{
+    constexpr auto testname = __func__;
+
+    // Drain by gathering at most maxBytes at a time, as writev would.
+    const auto drain = [&](Buffer& buf, std::size_t maxBytes)
+    {
+        std::string out;
+        while (!buf.empty())
+        {
+            iovec iov[Buffer::MaxBlocks];
+            const int count = buf.getBlocks(iov, Buffer::MaxBlocks, maxBytes);
+            LOK_ASSERT(count > 0);
+
+            std::size_t len = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                out.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+                len += iov[i].iov_len;
+            }
+
+            LOK_ASSERT(len <= maxBytes);
+            buf.eraseFirst(len);
+        }
+
+        return out;
+    };
+
+    for (const std::size_t maxBytes : { 1UL, 3UL, 7UL, 4096UL, 1UL << 20 })
+    {
+        auto shared = std::make_shared<std::string>(8192, 's');
+        std::weak_ptr<std::string> weak = shared;
+
+        Buffer buf;
+        buf.append("head:");
+        buf.appendShared(shared, shared->data(), shared->size());
+        buf.append("mid:"); // Must follow the shared data, not the head.
+        buf.append("dle:");
+        buf.appendShared(shared, shared->data(), 5);
+        buf.append(":tail");
+        LOK_ASSERT(buf.hasSegments());
+
+        const std::string expected =
+            "head:" + *shared + "mid:dle:" + shared->substr(0, 5) + ":tail";
+        LOK_ASSERT_EQUAL(expected.size(), buf.size());
+        LOK_ASSERT_EQUAL(std::size_t(5), buf.getBlockSize());
+
+        // The buffer keeps the shared data alive until written.
+        shared.reset();
+        LOK_ASSERT(!weak.expired());
+
+        LOK_ASSERT_EQUAL(expected, drain(buf, maxBytes));
+        LOK_ASSERT_EQUAL(true, buf.empty());
+        LOK_ASSERT_EQUAL(false, buf.hasSegments());
+        LOK_ASSERT(weak.expired());
+
+        // Back to contiguous appends.
+        buf.append("abc");
+        LOK_ASSERT_EQUAL(false, buf.hasSegments());
+        LOK_ASSERT_EQUAL(std::string("abc"), std::string(buf.getBlock(), buf.getBlockSize()));
+        buf.clear();
+    }
+
+    // Appends after a segment are kept in order across tail growth.
+    Buffer buf;
+    auto blob = std::make_shared<std::vector<char>>(100, 'b');
+    buf.appendShared(blob, blob->data(), blob->size());
+    std::string expected(blob->begin(), blob->end());
+    for (int i = 0; i < 1000; ++i)
+    {
+        const std::string chunk = std::to_string(i) + ',';
+        buf.append(chunk);
+        expected += chunk;
+    }
+
+    LOK_ASSERT_EQUAL(expected.size(), buf.size());
+    LOK_ASSERT_EQUAL(expected, drain(buf, 1000));
+}
+
 void NetUtilWhiteBoxTests::testParseUri()
 {
     constexpr auto testname = __func__;
@@ -273,6 +375,368 @@ void NetUtilWhiteBoxTests::testParseUrl()
                      net::parseUrl("https://sub.domain.com:80/some/path"));
 }
 
+#ifdef HAVE_EPOLL
+namespace
+{
+/// A socket that is always interested in input but never gets any, unless poked.
+class IdleSocket final : public Socket
+{
+public:
+    IdleSocket()
+        : Socket(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), Socket::Type::Unix)
+        , _eventCount(0)
+        , _closeOnEvent(false)
+    {
+    }
+
+    /// Make the socket readable.
+    void poke()
+    {
+        const uint64_t one = 1;
+        LOK_ASSERT_EQUAL(static_cast<ssize_t>(sizeof(one)), ::write(getFD(), &one, sizeof(one)));
+    }
+
+    int getPollEvents(std::chrono::steady_clock::time_point /* now */,
+                      int64_t& /* timeoutMaxMicroS */) override
+    {
+        return POLLIN;
+    }
+
+    void handlePoll(SocketDisposition& disposition, std::chrono::steady_clock::time_point /* now */,
+                    int events) override
+    {
+        if (events & POLLIN)
+        {
+            uint64_t count;
+            if (::read(getFD(), &count, sizeof(count)) == sizeof(count))
+                ++_eventCount;
+            if (_closeOnEvent)
+                disposition.setClosed();
+        }
+    }
+
+    int _eventCount;
+    bool _closeOnEvent;
+};
+} // namespace
+#endif
+
+void NetUtilWhiteBoxTests::testPollBackendScaling()
+{
+#ifdef HAVE_EPOLL
+    constexpr auto testname = __func__;
+
+    // Each socket needs an fd; raise the soft limit as far as we may.
+    rlimit rlim;
+    LOK_ASSERT_EQUAL(0, getrlimit(RLIMIT_NOFILE, &rlim));
+    rlim.rlim_cur = rlim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rlim);
+
+    constexpr int Iterations = 100;
+    for (const std::size_t count : { 100, 1000, 10000 })
+    {
+        if (count + 64 > rlim.rlim_cur)
+        {
+            TST_LOG("Skipping " << count << " sockets, RLIMIT_NOFILE is " << rlim.rlim_cur);
+            continue;
+        }
+
+        for (const auto backend : { SocketPoll::Backend::Poll, SocketPoll::Backend::Epoll })
+        {
+            const bool epoll = (backend == SocketPoll::Backend::Epoll);
+            SocketPoll poll(epoll ? "epoll_bench" : "poll_bench", backend);
+            poll.runOnClientThread();
+
+            std::vector<std::shared_ptr<IdleSocket>> sockets;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                sockets.emplace_back(std::make_shared<IdleSocket>());
+                LOK_ASSERT(sockets.back()->getFD() >= 0);
+                poll.insertNewSocket(sockets.back());
+            }
+
+            // Take the new sockets in, registering them with epoll.
+            poll.poll(std::chrono::microseconds(0));
+            LOK_ASSERT_EQUAL(count, poll.getSocketCount());
+            LOK_ASSERT_EQUAL(epoll, poll.isEpoll());
+
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < Iterations; ++i)
+                poll.poll(std::chrono::microseconds(0));
+            const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start);
+
+            TST_LOG((epoll ? "epoll" : "poll") << " with " << count << " idle sockets: "
+                                               << elapsed.count() / Iterations << "us per loop");
+
+            // Only the poked socket gets the event.
+            sockets[count / 2]->poke();
+            poll.poll(std::chrono::milliseconds(100));
+            LOK_ASSERT_EQUAL(1, sockets[count / 2]->_eventCount);
+            LOK_ASSERT_EQUAL(0, sockets[count / 2 + 1]->_eventCount);
+
+            // A removed socket must not be reported any more.
+            sockets[0]->_closeOnEvent = true;
+            sockets[0]->poke();
+            poll.poll(std::chrono::milliseconds(100));
+            LOK_ASSERT_EQUAL(count - 1, poll.getSocketCount());
+            sockets[0]->poke();
+            poll.poll(std::chrono::microseconds(0));
+            LOK_ASSERT_EQUAL(1, sockets[0]->_eventCount);
+
+            poll.removeSockets();
+        }
+    }
+#endif
+}
+
+namespace
+{
+/// Records where a pooled poll runs its hooks.
+class PoolTestPoll final : public SocketPoll
+{
+public:
+    PoolTestPoll(std::string name, bool startResult = true)
+        : SocketPoll(std::move(name), SocketPoll::Backend::Epoll)
+        , _startResult(startResult)
+    {
+    }
+
+    std::atomic<std::thread::id> _startThread;
+    std::atomic<std::thread::id> _finishThread;
+    std::atomic<std::thread::id> _ownerThread; ///< The last thread it moved to.
+
+private:
+    bool pollingStart() override
+    {
+        _startThread = std::this_thread::get_id();
+        return _startResult;
+    }
+
+    void pollingFinish() override { _finishThread = std::this_thread::get_id(); }
+
+    void threadOwnerChanged() override { _ownerThread = std::this_thread::get_id(); }
+
+    const bool _startResult;
+};
+
+/// Waits up to 10 seconds for @predicate to hold.
+template <typename Predicate> bool waitFor(Predicate predicate)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!predicate())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+/// Runs a callback on the given poll, returning the thread that ran it.
+std::thread::id runOn(SocketPoll& poll)
+{
+    auto ran = std::make_shared<std::atomic<std::thread::id>>();
+    poll.addCallback([ran]() { *ran = std::this_thread::get_id(); });
+    waitFor([&ran]() { return *ran != std::thread::id(); });
+    return *ran;
+}
+
+} // namespace
+
+/// Queues a poll on a busy worker: an idle one steals it, and moves it over.
+/// Then stops the pool while a worker is still running a poll.
+void NetUtilWhiteBoxTests::testPollPoolStealing()
+{
+#ifdef HAVE_EPOLL
+    constexpr auto testname = __func__;
+
+    SocketPollPool pool("pool_test", 2);
+    std::set<std::thread::id> workers;
+    for (const auto& worker : pool._workers)
+        workers.insert(worker->_thread.get_id());
+
+    auto busy = std::make_shared<PoolTestPoll>("busy_poll");
+    auto stolen = std::make_shared<PoolTestPoll>("stolen_poll");
+    LOK_ASSERT(pool.startPoll(busy));
+    LOK_ASSERT(pool.startPoll(stolen));
+    LOK_ASSERT(workers.count(runOn(*busy)));
+    LOK_ASSERT(workers.count(runOn(*stolen)));
+    LOK_ASSERT_EQUAL(std::size_t(2), pool.getPollCount());
+
+    // Started off the workers, as it can block.
+    LOK_ASSERT(busy->_startThread.load() != std::thread::id());
+    LOK_ASSERT(!workers.count(busy->_startThread));
+
+    // Keep a worker busy.
+    std::atomic<std::thread::id> busyThread;
+    std::atomic<bool> release(false);
+    busy->addCallback(
+        [&busyThread, &release]()
+        {
+            busyThread = std::this_thread::get_id();
+            while (!release)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        });
+    LOK_ASSERT(waitFor([&busyThread]() { return busyThread.load() != std::thread::id(); }));
+
+    // Queue the other on it, as if it ran there last.
+    {
+        std::lock_guard<std::mutex> lock(pool._mutex);
+        std::size_t busyWorker = 0;
+        while (pool._workers[busyWorker]->_thread.get_id() != busyThread.load())
+            ++busyWorker;
+
+        for (const auto& it : pool._tasks)
+        {
+            if (it.second->_poll == stolen)
+                it.second->_worker = busyWorker;
+        }
+    }
+
+    const uint64_t stealCount = pool.getStealCount();
+    std::atomic<std::thread::id> ownerThread;
+    const std::thread::id stolenThread = runOn(*stolen);
+    stolen->addCallback([&stolen, &ownerThread]() { ownerThread = stolen->getThreadOwner(); });
+    LOK_ASSERT(waitFor([&ownerThread]() { return ownerThread.load() != std::thread::id(); }));
+
+    LOK_ASSERT(stolenThread != busyThread.load());
+    LOK_ASSERT(workers.count(stolenThread));
+    LOK_ASSERT(pool.getStealCount() > stealCount);
+    LOK_ASSERT(ownerThread.load() == stolenThread);
+    LOK_ASSERT(stolen->_ownerThread.load() == stolenThread);
+
+    // Stopping waits for the busy worker, then finishes the polls left,
+    // without running them further.
+    std::thread stopper([&pool]() { pool.stop(); });
+    LOK_ASSERT(waitFor([&pool]() { return pool._stop.load(); }));
+    release = true;
+    stopper.join();
+
+    for (const auto& poll : { busy, stolen })
+    {
+        poll->joinThread();
+        LOK_ASSERT(!poll->isAlive());
+        LOK_ASSERT(poll->_finishThread.load() == std::thread::id());
+    }
+
+    LOK_ASSERT_EQUAL(std::size_t(0), pool.getPollCount());
+    LOK_ASSERT(!pool.startPoll(std::make_shared<PoolTestPoll>("late_poll")));
+#endif
+}
+
+/// Stops and joins pooled polls, which finish off the workers.
+void NetUtilWhiteBoxTests::testPollPoolJoin()
+{
+#ifdef HAVE_EPOLL
+    constexpr auto testname = __func__;
+
+    SocketPollPool pool("pool_test", 1);
+    const std::thread::id worker = pool._workers[0]->_thread.get_id();
+
+    auto poll = std::make_shared<PoolTestPoll>("join_poll");
+    LOK_ASSERT(pool.startPoll(poll));
+    LOK_ASSERT(!pool.startPoll(poll));
+    LOK_ASSERT(runOn(*poll) == worker);
+    LOK_ASSERT(poll->isAlive());
+
+    poll->stop();
+    poll->joinThread();
+    LOK_ASSERT(!poll->isAlive());
+    LOK_ASSERT(poll->_finishThread.load() != std::thread::id());
+    LOK_ASSERT(poll->_finishThread.load() != worker);
+    LOK_ASSERT(poll->_startThread.load() != worker);
+
+    // Failing to start finishes without polling.
+    auto failed = std::make_shared<PoolTestPoll>("failed_poll", /*startResult=*/false);
+    LOK_ASSERT(pool.startPoll(failed));
+    failed->joinThread();
+    LOK_ASSERT(!failed->isAlive());
+    LOK_ASSERT(failed->_startThread.load() != std::thread::id());
+    LOK_ASSERT(failed->_finishThread.load() == std::thread::id());
+
+    LOK_ASSERT(waitFor([&pool]() { return pool.getPollCount() == 0; }));
+    pool.stop();
+    LOK_ASSERT(pool.getRunCount() > 0);
+#endif
+}
+
+/// Checks the websocket (un)masking against the byte-wise
+/// definition, and benchmarks its throughput per frame size.
+void NetUtilWhiteBoxTests::testWebSocketMask()
+{
+    constexpr auto testname = __func__;
+
+    const unsigned char mask[4] = { 0x81, 0x76, 0x3c, 0x0f };
+
+    std::vector<char> data(1024);
+    for (std::size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<char>(i * 7);
+
+    // All alignments, lengths around the block sizes, and mask offsets.
+    for (std::size_t start = 0; start < 8; ++start)
+    {
+        for (std::size_t len = 0; len < 80; ++len)
+        {
+            for (std::size_t offset = 0; offset < 4; ++offset)
+            {
+                std::vector<char> masked(data);
+                WebSocketHandler::applyMask(masked.data() + start, len, mask, offset);
+                for (std::size_t i = 0; i < masked.size(); ++i)
+                {
+                    const bool inside = i >= start && i < start + len;
+                    const char expected = inside ? data[i] ^ mask[(offset + i - start) % 4]
+                                                 : data[i];
+                    LOK_ASSERT_EQUAL(expected, masked[i]);
+                }
+
+                // Masking is its own inverse.
+                WebSocketHandler::applyMask(masked.data() + start, len, mask, offset);
+                LOK_ASSERT(masked == data);
+            }
+        }
+    }
+
+    // Throughput, compared to the byte-wise loop.
+    for (std::size_t size = 1024; size <= 64 * 1024 * 1024; size *= 4)
+    {
+        std::vector<char> frame(size, 'x');
+        const std::size_t iterations = std::max<std::size_t>(1, 64 * 1024 * 1024 / size);
+
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t n = 0; n < iterations; ++n)
+        {
+            char* const payload = frame.data();
+            for (std::size_t i = 0; i < size; ++i)
+                payload[i] ^= mask[i % 4];
+        }
+
+        const auto byteTime = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (std::size_t n = 0; n < iterations; ++n)
+            WebSocketHandler::applyMask(frame.data(), size, mask);
+
+        const auto wordTime = std::chrono::steady_clock::now() - start;
+
+        // An even number of passes over the data in total.
+        LOK_ASSERT_EQUAL('x', frame[size / 2]);
+
+        const auto mbPerSec = [&](std::chrono::steady_clock::duration elapsed)
+        {
+            const auto us = std::max<int64_t>(
+                1, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+            return static_cast<uint64_t>(size * iterations / us);
+        };
+
+        TST_LOG("Unmasking " << size << " byte frames: " << mbPerSec(byteTime)
+                             << " MB/s byte-wise, " << mbPerSec(wordTime)
+                             << " MB/s word-wise");
+    }
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(NetUtilWhiteBoxTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,205 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <test/lokassert.hpp>
+
+#include <Png.hpp>
+#include <ThreadPool.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// Png unit-tests.
+class PngTests : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(PngTests);
+
+    CPPUNIT_TEST(testFilterRowTypes);
+    CPPUNIT_TEST(testStripsRoundTrip);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void testFilterRowTypes();
+    void testStripsRoundTrip();
+
+    /// An image, opaque but for the first band, in bands of 8 rows, each
+    /// suiting different filters.
+    static std::vector<unsigned char> makeImage(int width, int height)
+    {
+        std::vector<unsigned char> image(static_cast<size_t>(width) * height * 4);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                unsigned char value;
+                switch ((y / 8) % 4)
+                {
+                    case 0: // Transparent, for None and Up.
+                        value = 0;
+                        break;
+                    case 1: // Horizontal stripes, for Sub and Paeth.
+                        value = (y * 97 + 13) % 256;
+                        break;
+                    case 2: // Vertical stripes, for Up.
+                        value = (x * 97 + 13) % 256;
+                        break;
+                    default: // Blocks of 2x2, for Sub and Up.
+                        value = ((x / 2) * 67 + (y / 2) * 131) % 256;
+                        break;
+                }
+
+                unsigned char* pixel = image.data() + (static_cast<size_t>(y) * width + x) * 4;
+                const bool transparent = (y / 8) % 4 == 0;
+                pixel[0] = value;
+                pixel[1] = transparent ? 0 : value ^ 0x55;
+                pixel[2] = transparent ? 0 : x + y;
+                pixel[3] = transparent ? 0 : 255;
+            }
+        }
+
+        return image;
+    }
+
+    /// Returns the concatenated IDAT data of @png.
+    static std::string getImageData(const std::vector<char>& png)
+    {
+        std::string data;
+        size_t pos = 8; // Skip the signature.
+        while (pos + 12 <= png.size())
+        {
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(png.data() + pos);
+            const size_t length = (static_cast<size_t>(bytes[0]) << 24) | (bytes[1] << 16) |
+                                  (bytes[2] << 8) | bytes[3];
+            if (std::string(png.data() + pos + 4, 4) == "IDAT")
+                data.append(png.data() + pos + 8, length);
+            pos += length + 12;
+        }
+
+        return data;
+    }
+};
+
+void PngTests::testFilterRowTypes()
+{
+    constexpr auto testname = __func__;
+
+    constexpr int width = 37;
+    constexpr int height = 32;
+    const std::vector<unsigned char> image = makeImage(width, height);
+    const size_t rowBytes = width * 4;
+
+    std::set<int> types;
+    std::vector<unsigned char> filtered(rowBytes + 1);
+    std::vector<unsigned char> prev(rowBytes);
+    for (int y = 0; y < height; ++y)
+    {
+        const unsigned char* row = image.data() + y * rowBytes;
+        Png::filterRow(row, y > 0 ? row - rowBytes : nullptr, rowBytes, filtered.data());
+        types.insert(filtered[0]);
+
+        // Reverse the filter, as a decoder does.
+        std::vector<unsigned char> decoded(rowBytes);
+        for (size_t i = 0; i < rowBytes; ++i)
+        {
+            const int a = i >= 4 ? decoded[i - 4] : 0;
+            const int b = y > 0 ? prev[i] : 0;
+            const int c = y > 0 && i >= 4 ? prev[i - 4] : 0;
+            int predictor = 0;
+            switch (filtered[0])
+            {
+                case 1:
+                    predictor = a;
+                    break;
+                case 2:
+                    predictor = b;
+                    break;
+                case 4:
+                {
+                    const int p = a + b - c;
+                    const int pa = std::abs(p - a);
+                    const int pb = std::abs(p - b);
+                    const int pc = std::abs(p - c);
+                    predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                    break;
+                }
+            }
+
+            decoded[i] = filtered[i + 1] + predictor;
+        }
+
+        LOK_ASSERT_MESSAGE("Row " + std::to_string(y) + " isn't restored by its filter",
+                           std::equal(decoded.begin(), decoded.end(), row));
+        prev = decoded;
+    }
+
+    // None, Sub, Up and Paeth are all used.
+    LOK_ASSERT(types == std::set<int>({ 0, 1, 2, 4 }));
+}
+
+void PngTests::testStripsRoundTrip()
+{
+    constexpr auto testname = __func__;
+
+    ThreadPool pool;
+
+    // Odd widths, with a partial last strip, from a larger buffer.
+    for (const int width : { 1, 3, 37, 255 })
+    {
+        constexpr int height = 64 * 3 + 17;
+        const int bufferWidth = width + 5;
+        const int bufferHeight = height + 3;
+        constexpr int startX = 2;
+        constexpr int startY = 1;
+
+        std::vector<unsigned char> buffer = makeImage(bufferWidth, bufferHeight);
+        std::vector<char> png;
+        LOK_ASSERT(Png::encodeSubBufferToPNGInStrips(buffer.data(), startX, startY, width,
+                                                     height, bufferWidth, bufferHeight, png,
+                                                     LOK_TILEMODE_RGBA, pool));
+
+        // The strips concatenate to a valid zlib stream, including its Adler-32.
+        const std::string data = getImageData(png);
+        uLongf size = (width * 4 + 1) * height;
+        std::vector<Bytef> raw(size);
+        LOK_ASSERT_EQUAL(Z_OK, uncompress(raw.data(), &size,
+                                          reinterpret_cast<const Bytef*>(data.data()),
+                                          data.size()));
+        LOK_ASSERT_EQUAL(static_cast<uLongf>((width * 4 + 1) * height), size);
+
+        // And decode to the same pixels.
+        std::stringstream stream(std::string(png.data(), png.size()));
+        png_uint_32 decodedHeight, decodedWidth, rowBytes;
+        const std::vector<png_bytep> rows =
+            Png::decodePNG(stream, decodedHeight, decodedWidth, rowBytes);
+        LOK_ASSERT_EQUAL(static_cast<png_uint_32>(width), decodedWidth);
+        LOK_ASSERT_EQUAL(static_cast<png_uint_32>(height), decodedHeight);
+        for (int y = 0; y < height; ++y)
+        {
+            const unsigned char* expected =
+                buffer.data() + ((static_cast<size_t>(startY) + y) * bufferWidth + startX) * 4;
+            LOK_ASSERT_MESSAGE("Row " + std::to_string(y) + " of width " + std::to_string(width) +
+                                   " differs",
+                               std::equal(expected, expected + width * 4, rows[y]));
+        }
+    }
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(PngTests);
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -13,6 +13,7 @@
 
 #include "WebSocketSession.hpp"
 
+#include <limits>
 #include <sstream>
 #include <random>
 
@@ -26,6 +27,7 @@
 #include <Protocol.hpp>
 #include <Png.hpp>
 #include <TileCache.hpp>
+#include <TileScheduler.hpp>
 #include <kit/Delta.hpp>
 #include <Unit.hpp>
 #include <Util.hpp>
@@ -68,6 +70,12 @@ class TileCacheTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testSimpleCombine);
     CPPUNIT_TEST(testTileSubscription);
     CPPUNIT_TEST(testSize);
+    CPPUNIT_TEST(testInvalidateScaling);
+    CPPUNIT_TEST(testEvictionKeepsVisible);
+    CPPUNIT_TEST(testSlideLayers);
+    CPPUNIT_TEST(testTileScheduler);
+    CPPUNIT_TEST(testClientDeltaTracker);
+    CPPUNIT_TEST(testTileCompaction);
     CPPUNIT_TEST(testDisconnectMultiView);
     CPPUNIT_TEST(testUnresponsiveClient);
     CPPUNIT_TEST(testImpressTiles);
@@ -106,6 +114,12 @@ class TileCacheTests : public CPPUNIT_NS::TestFixture
     void testSimpleCombine();
     void testTileSubscription();
     void testSize();
+    void testInvalidateScaling();
+    void testEvictionKeepsVisible();
+    void testSlideLayers();
+    void testTileScheduler();
+    void testClientDeltaTracker();
+    void testTileCompaction();
     void testDisconnectMultiView();
     void testUnresponsiveClient();
     void testImpressTiles();
@@ -443,6 +457,376 @@ void TileCacheTests::testSize()
 }
 
 
+void TileCacheTests::testInvalidateScaling()
+{
+    constexpr auto testname = __func__;
+
+    CanonicalViewId nviewid(CanonicalViewId::None);
+    const int zooms[] = { 3840, 1920, 960, 480 };
+    std::vector<char> data = genRandomData(16);
+    data[0] = 'Z'; // compressed pixels.
+
+    // Time the invalidation of a single small area, as when typing,
+    // against caches of growing size: it should stay roughly flat.
+    for (const int columns : { 16, 32, 64, 128 })
+    {
+        const int tilesPerZoom = columns * columns;
+        TileCache tc("doc.ods", std::chrono::system_clock::time_point());
+        tc.setMaxCacheSize(std::numeric_limits<size_t>::max());
+
+        TileWireId id = 0;
+        for (const int tileSize : zooms)
+        {
+            for (int i = 0; i < tilesPerZoom; ++i)
+            {
+                TileDesc tile(nviewid, 0, 0, 256, 256, (i % columns) * tileSize,
+                              (i / columns) * tileSize, tileSize, tileSize, -1, 0, -1);
+                tile.setWireId(++id);
+                tc.saveTileAndNotify(tile, data.data(), data.size());
+            }
+        }
+
+        constexpr int iterations = 1000;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            tc.invalidateTiles(
+                "invalidatetiles: part=0 mode=0 x=5000 y=5000 width=100 height=100 wid=0", nviewid);
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start);
+
+        TST_LOG("Invalidating a small area with " << tilesPerZoom * 4 << " cached tiles took "
+                                                  << elapsed.count() / iterations << "ns");
+
+        // Only the tiles around the area are invalidated, the rest stay valid.
+        for (const int tileSize : zooms)
+        {
+            const int col = 5000 / tileSize;
+            TileDesc inside(nviewid, 0, 0, 256, 256, col * tileSize, col * tileSize, tileSize,
+                            tileSize, -1, 0, -1);
+            Tile tileData = tc.lookupTile(inside);
+            LOK_ASSERT_MESSAGE("intersecting tile still valid", tileData && !tileData->isValid());
+
+            TileDesc outside(nviewid, 0, 0, 256, 256, (col + 2) * tileSize, col * tileSize,
+                             tileSize, tileSize, -1, 0, -1);
+            tileData = tc.lookupTile(outside);
+            LOK_ASSERT_MESSAGE("distant tile invalidated", tileData && tileData->isValid());
+
+            TileDesc otherPart(nviewid, 1, 0, 256, 256, col * tileSize, col * tileSize, tileSize,
+                               tileSize, -1, 0, -1);
+            tileData = tc.lookupTile(otherPart);
+            LOK_ASSERT_MESSAGE("tile in a different part found", !tileData);
+        }
+
+        // Everything goes with an EMPTY invalidation.
+        tc.invalidateTiles("invalidatetiles: EMPTY", nviewid);
+        TileDesc last(nviewid, 0, 0, 256, 256, 0, 0, zooms[0], zooms[0], -1, 0, -1);
+        Tile tileData = tc.lookupTile(last);
+        LOK_ASSERT_MESSAGE("tile survived EMPTY invalidation", tileData && !tileData->isValid());
+    }
+}
+
+void TileCacheTests::testEvictionKeepsVisible()
+{
+    constexpr auto testname = __func__;
+
+    TileCache tc("doc.ods", std::chrono::system_clock::time_point());
+
+    CanonicalViewId nviewid(CanonicalViewId::None);
+    const int tileSize = 3840;
+    std::vector<char> data = genRandomData(1024);
+    data[0] = 'Z'; // compressed pixels.
+
+    // Room for ~100 tiles, with a client looking at the top-left 4x4 tiles.
+    tc.setMaxCacheSize((data.size() + sizeof(Tile) + sizeof(TileDesc)) * 100);
+    tc.setVisibleAreaProvider(
+        [](std::vector<TileCache::VisibleArea>& areas)
+        {
+            areas.push_back({ CanonicalViewId::None, tileSize, tileSize,
+                              Util::Rectangle(0, 0, tileSize * 4 - 1, tileSize * 4 - 1) });
+        });
+
+    const auto makeTile = [&](int col, int row)
+    {
+        return TileDesc(nviewid, 0, 0, 256, 256, col * tileSize, row * tileSize, tileSize,
+                        tileSize, -1, 0, -1);
+    };
+
+    // Scroll down through the document, while something keeps using one tile.
+    TileWireId id = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        TileDesc tile = makeTile(i % 40, i / 40);
+        tile.setWireId(++id);
+        tc.saveTileAndNotify(tile, data.data(), data.size());
+        tc.lookupTile(makeTile(5, 0));
+    }
+
+    LOK_ASSERT_MESSAGE("nothing was evicted", tc.getEvictionCount() > 0);
+    LOK_ASSERT_MESSAGE("used tile was evicted", tc.lookupTile(makeTile(5, 0)) != nullptr);
+    for (int row = 0; row < 4; ++row)
+        for (int col = 0; col < 4; ++col)
+            LOK_ASSERT_MESSAGE("visible tile was evicted",
+                               tc.lookupTile(makeTile(col, row)) != nullptr);
+    LOK_ASSERT_MESSAGE("invisible tile kept", tc.lookupTile(makeTile(10, 1)) == nullptr);
+    LOK_ASSERT_MESSAGE("lookups not counted",
+                       tc.getHitCount() > 0 && tc.getHitCount() <= tc.getLookupCount());
+}
+
+void TileCacheTests::testSlideLayers()
+{
+    constexpr auto testname = __func__;
+
+    TileCache tc("doc.odp", std::chrono::system_clock::time_point());
+
+    const std::string key = "1000 hash=123 part=0 width=1920 height=1080";
+    const auto now = std::chrono::steady_clock::now();
+    LOK_ASSERT(tc.lookupSlideLayers(key) == nullptr);
+
+    // The first view renders it, the others wait for it.
+    LOK_ASSERT(!tc.subscribeToSlideRendering(key, nullptr, now));
+    LOK_ASSERT(tc.subscribeToSlideRendering(key, nullptr, now));
+
+    TileCache::SlideLayers layers;
+    layers.push_back(std::make_shared<Message>("slidelayer: {}", Message::Dir::Out));
+    layers.push_back(std::make_shared<Message>("sliderenderingcomplete: success",
+                                               Message::Dir::Out));
+    tc.saveSlideLayersAndNotify(key, layers, true);
+
+    const TileCache::SlideLayers* cached = tc.lookupSlideLayers(key);
+    LOK_ASSERT(cached != nullptr);
+    LOK_ASSERT_EQUAL(static_cast<size_t>(2), cached->size());
+    LOK_ASSERT_EQUAL(layers[0], (*cached)[0]);
+
+    // Changes to the document invalidate the slides.
+    tc.invalidateTiles("invalidatetiles: EMPTY", CanonicalViewId::None);
+    LOK_ASSERT(tc.lookupSlideLayers(key) == nullptr);
+
+    // Failed renders are not cached.
+    LOK_ASSERT(!tc.subscribeToSlideRendering(key, nullptr, now));
+    tc.saveSlideLayersAndNotify(key, layers, false);
+    LOK_ASSERT(tc.lookupSlideLayers(key) == nullptr);
+
+    // A render that takes too long is retried.
+    LOK_ASSERT(!tc.subscribeToSlideRendering(key, nullptr, now));
+    LOK_ASSERT(!tc.subscribeToSlideRendering(
+        key, nullptr, now + std::chrono::milliseconds(COMMAND_TIMEOUT_MS + 1)));
+
+    // A render abandoned by its view, with no subscriber left, is forgotten.
+    const std::string otherKey = "1000 hash=456 part=1 width=1920 height=1080";
+    LOK_ASSERT(!tc.subscribeToSlideRendering(otherKey, nullptr, now));
+    LOK_ASSERT(tc.subscribeToSlideRendering(otherKey, nullptr, now));
+    LOK_ASSERT(tc.handOverSlideRendering(otherKey, nullptr, now) == nullptr);
+    LOK_ASSERT(tc.handOverSlideRendering(otherKey, nullptr, now) == nullptr);
+    LOK_ASSERT(!tc.subscribeToSlideRendering(otherKey, nullptr, now));
+}
+
+void TileCacheTests::testTileScheduler()
+{
+    constexpr auto testname = __func__;
+
+    const auto tileAt = [](int x, int y, int version)
+    {
+        return TileDesc(CanonicalViewId(1000), 0, 0, 256, 256, x * 3840, y * 3840, 3840, 3840,
+                        version, 0, -1);
+    };
+
+    // Two views request 4x4 viewports, one shifted by a column, in different orders.
+    std::vector<TileDesc> first;
+    std::vector<TileDesc> second;
+    for (int y = 0; y < 4; ++y)
+    {
+        for (int x = 0; x < 4; ++x)
+        {
+            first.push_back(tileAt(x, y, 1));
+            second.insert(second.begin(), tileAt(x + 1, y, 2));
+        }
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    TileScheduler scheduler(std::chrono::milliseconds(10));
+    LOK_ASSERT(!scheduler.hasPending());
+    LOK_ASSERT_EQUAL(static_cast<std::int64_t>(100),
+                     static_cast<std::int64_t>(
+                         scheduler.getTimeout(now, std::chrono::microseconds(100)).count()));
+
+    scheduler.enqueue(first, now);
+    scheduler.enqueue(second, now + std::chrono::milliseconds(5));
+    // A far away tile, and a tile at another zoom, can't be combined.
+    scheduler.enqueue({ tileAt(20, 20, 3) }, now + std::chrono::milliseconds(5));
+    scheduler.enqueue({ TileDesc(CanonicalViewId(1000), 0, 0, 256, 256, 0, 0, 1920, 1920, 3, 0,
+                                 -1) },
+                      now + std::chrono::milliseconds(5));
+
+    LOK_ASSERT(scheduler.hasPending());
+    LOK_ASSERT(!scheduler.isDue(now + std::chrono::milliseconds(9)));
+    LOK_ASSERT_EQUAL(static_cast<std::int64_t>(5000),
+                     static_cast<std::int64_t>(
+                         scheduler
+                             .getTimeout(now + std::chrono::milliseconds(5), std::chrono::seconds(64))
+                             .count()));
+    LOK_ASSERT(scheduler.isDue(now + std::chrono::milliseconds(10)));
+
+    const std::vector<TileCombined> tileCombines = scheduler.flush();
+    LOK_ASSERT(!scheduler.hasPending());
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(4), scheduler.getRequestCount());
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(3), scheduler.getCombineCount());
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(3), tileCombines.size());
+
+    // The overlapping viewports are rendered once, as a single 5x4 rectangle.
+    const TileCombined& viewports = tileCombines[0];
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(20), viewports.getTiles().size());
+    LOK_ASSERT(!viewports.hasDuplicates());
+    for (const TileDesc& tile : viewports.getTiles())
+        LOK_ASSERT_EQUAL(tile.getTilePosX() == 0 ? 1 : 2, tile.getVersion());
+
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(1), tileCombines[1].getTiles().size());
+    LOK_ASSERT_EQUAL(20 * 3840, tileCombines[1].getTiles()[0].getTilePosX());
+    LOK_ASSERT_EQUAL(1920, tileCombines[2].getTileWidth());
+
+    // Disjoint rows are split rather than rendering the gap between them.
+    const std::vector<TileCombined> split =
+        TileScheduler::combine({ tileAt(0, 0, 1), tileAt(1, 0, 1), tileAt(0, 5, 1), tileAt(1, 5, 1) });
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(2), split.size());
+
+    // As are rectangles that would paint any gap, even a single tile.
+    const std::vector<TileCombined> corner =
+        TileScheduler::combine({ tileAt(0, 0, 1), tileAt(1, 0, 1), tileAt(0, 1, 1) });
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(2), corner.size());
+
+    // Without other requests to merge with, the tiles are rendered as requested.
+    scheduler.enqueue({ tileAt(1, 0, 4), tileAt(0, 0, 4), tileAt(0, 5, 4) }, now);
+    const std::vector<TileCombined> single = scheduler.flush();
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(1), single.size());
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(3), single[0].getTiles().size());
+    LOK_ASSERT_EQUAL(3840, single[0].getTiles()[0].getTilePosX());
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(4), scheduler.getCombineCount());
+}
+
+void TileCacheTests::testClientDeltaTracker()
+{
+    constexpr auto testname = __func__;
+
+    const auto tileAt = [](int x, int y, TileWireId wid, int size = 3840)
+    {
+        TileDesc tile(CanonicalViewId(1000), 0, 0, 256, 256, x, y, size, size, -1, 0, -1);
+        tile.setWireId(wid);
+        return tile;
+    };
+
+    ClientDeltaTracker tracker;
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(0), tracker.size());
+
+    // A zoomed-out spreadsheet: 100x100 tiles, packed in pages.
+    for (int y = 0; y < 100; ++y)
+    {
+        for (int x = 0; x < 100; ++x)
+            LOK_ASSERT_EQUAL(TileWireId(0), tracker.updateTileSeq(tileAt(x * 3840, y * 3840, 1)));
+    }
+
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(10000), tracker.size());
+    LOK_ASSERT_MESSAGE("Expected less than 8 bytes per tile", tracker.getMemorySize() < 80000);
+
+    LOK_ASSERT_EQUAL(TileWireId(1), tracker.updateTileSeq(tileAt(3840, 3840, 2)));
+    LOK_ASSERT_EQUAL(TileWireId(2), tracker.updateTileSeq(tileAt(3840, 3840, 3)));
+
+    // Resetting forces a keyframe next time.
+    tracker.resetTileSeq(tileAt(3840, 3840, 0));
+    LOK_ASSERT_EQUAL(TileWireId(0), tracker.updateTileSeq(tileAt(3840, 3840, 4)));
+
+    // Tiles off the grid, and at other sizes, are tracked separately.
+    LOK_ASSERT_EQUAL(TileWireId(0), tracker.updateTileSeq(tileAt(100, 0, 5)));
+    LOK_ASSERT_EQUAL(TileWireId(5), tracker.updateTileSeq(tileAt(100, 0, 6)));
+    LOK_ASSERT_EQUAL(TileWireId(0), tracker.updateTileSeq(tileAt(0, 0, 7, 1920)));
+
+    // Only the tiles around the viewport, at its zoom, are kept.
+    tracker.updateViewPort({ Util::Rectangle(0, 0, 10 * 3840, 10 * 3840) }, 3840, 3840,
+                           CanonicalViewId(1000));
+    LOK_ASSERT(tracker.size() < 10000);
+    LOK_ASSERT_EQUAL(TileWireId(4), tracker.updateTileSeq(tileAt(3840, 3840, 8)));
+    LOK_ASSERT_EQUAL(TileWireId(6), tracker.updateTileSeq(tileAt(100, 0, 9)));
+    LOK_ASSERT_EQUAL(TileWireId(0), tracker.updateTileSeq(tileAt(0, 0, 10, 1920)));
+    LOK_ASSERT_EQUAL(TileWireId(0), tracker.updateTileSeq(tileAt(90 * 3840, 90 * 3840, 11)));
+
+    // A frozen pane, at the top-left, keeps its tiles while the rest scrolls away.
+    tracker.updateViewPort({ Util::Rectangle(0, 0, 3840, 3840),
+                             Util::Rectangle(90 * 3840, 90 * 3840, 5 * 3840, 5 * 3840) },
+                           3840, 3840, CanonicalViewId(1000));
+    LOK_ASSERT_EQUAL(TileWireId(8), tracker.updateTileSeq(tileAt(3840, 3840, 12)));
+    LOK_ASSERT_EQUAL(TileWireId(11), tracker.updateTileSeq(tileAt(90 * 3840, 90 * 3840, 13)));
+    LOK_ASSERT_EQUAL(TileWireId(0), tracker.updateTileSeq(tileAt(17 * 3840, 17 * 3840, 14)));
+
+    // Another canonical view forgets them all.
+    tracker.updateViewPort({ Util::Rectangle(0, 0, 10 * 3840, 10 * 3840) }, 3840, 3840,
+                           CanonicalViewId(1001));
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(0), tracker.size());
+}
+
+void TileCacheTests::testTileCompaction()
+{
+    constexpr auto testname = __func__;
+
+    if (isStandalone())
+    {
+        if (!UnitWSD::init(UnitWSD::UnitType::Wsd, ""))
+            throw std::runtime_error("Failed to load wsd unit test library.");
+    }
+
+    TileCache tc("doc.ods", std::chrono::system_clock::time_point());
+    tc.setCompactionLimits(4, 100);
+
+    TileDesc tile(CanonicalViewId::None, 0, 0, 256, 256, 0, 0, 3840, 3840, -1, 0, -1);
+    TileWireId wid = 1;
+    const auto save = [&](char type, std::size_t size)
+    {
+        std::vector<char> data = genRandomData(size);
+        data[0] = type;
+        tile.setWireId(wid++);
+        tc.saveTileAndNotify(tile, data.data(), data.size());
+    };
+
+    save('Z', 1024);
+    for (int i = 0; i < 4; ++i)
+        save('D', 9);
+
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(0), tc.getCompactionCount());
+    LOK_ASSERT(tc.takeTilesToCompact().empty());
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(1), tc.getChainLengthCounts()[3]);
+    LOK_ASSERT_EQUAL(std::string("4-7"), TileCache::getChainLengthBucketName(3));
+
+    // One delta too many requests a keyframe, once.
+    save('D', 9);
+    save('D', 9);
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(1), tc.getCompactionCount());
+    std::vector<TileDesc> tiles = tc.takeTilesToCompact();
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(1), tiles.size());
+    LOK_ASSERT(tiles[0].sameTileCombineParams(tile));
+    LOK_ASSERT(tc.takeTilesToCompact().empty());
+
+    // Views requesting it meanwhile wait for the keyframe.
+    const auto now = std::chrono::steady_clock::now();
+    tiles[0].setVersion(1);
+    tc.registerTileRendering(tiles[0], now);
+    LOK_ASSERT(tc.hasTileBeingRendered(tiles[0], &now));
+
+    // When it won't come, it's requested again.
+    tc.abandonTileRendering(tiles[0]);
+    LOK_ASSERT(!tc.hasTileBeingRendered(tiles[0]));
+    save('D', 9);
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(2), tc.getCompactionCount());
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(1), tc.takeTilesToCompact().size());
+
+    // The keyframe resets the chain, and large deltas trigger compaction sooner.
+    save('Z', 1024);
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(1), tc.getChainLengthCounts()[0]);
+    save('D', 1100);
+    LOK_ASSERT_EQUAL(static_cast<uint64_t>(3), tc.getCompactionCount());
+    LOK_ASSERT_EQUAL(static_cast<std::size_t>(1), tc.takeTilesToCompact().size());
+
+    LOK_ASSERT_EQUAL(std::string("0"), TileCache::getChainLengthBucketName(0));
+    LOK_ASSERT_EQUAL(std::string("32+"),
+                     TileCache::getChainLengthBucketName(TileCache::ChainLengthBuckets - 1));
+}
+
 void TileCacheTests::testDisconnectMultiView()
 {
     const char* testname = "testDisconnectMultiView";
@@ -0,0 +1,264 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <Common.hpp>
+#include <Unit.hpp>
+#include <helpers.hpp>
+
+#include <Poco/Net/HTMLForm.h>
+#include <Poco/Net/StringPartSource.h>
+#include <Poco/StreamCopier.h>
+#include <Poco/Util/LayeredConfiguration.h>
+
+/// Converts batches of documents in convert-to-batch requests, two at a time,
+/// and checks that all the results, including those of documents that fail to
+/// convert, and the closing report, come back in a single multipart response.
+/// That batches of too many documents are rejected, and that the server
+/// carries on converting when clients disconnect in the middle of a batch.
+class UnitConvertBatch : public UnitWSD
+{
+    using Documents = std::vector<std::pair<std::string, std::string>>;
+
+    bool _workerStarted;
+    std::thread _worker;
+
+public:
+    UnitConvertBatch()
+        : UnitWSD("UnitConvertBatch")
+        , _workerStarted(false)
+    {
+        setTimeout(std::chrono::minutes(3));
+    }
+
+    ~UnitConvertBatch()
+    {
+        LOG_INF("Joining test worker thread");
+        _worker.join();
+    }
+
+    void configure(Poco::Util::LayeredConfiguration& config) override
+    {
+        UnitWSD::configure(config);
+
+        config.setBool("ssl.enable", true);
+        config.setInt("per_document.limit_load_secs", 30);
+        config.setBool("storage.filesystem[@allow]", false);
+        config.setInt("per_document.convert_batch.parallelism", 2);
+        config.setInt("per_document.convert_batch.total_parallelism", 2);
+        config.setInt("per_document.convert_batch.max_documents", 4);
+    }
+
+    /// Returns text documents of the given names.
+    static Documents textDocuments(std::initializer_list<std::string> names)
+    {
+        Documents documents;
+        for (const std::string& name : names)
+            documents.emplace_back(name, "Hello World of " + name);
+        return documents;
+    }
+
+    /// Prepares the @request, and its @form, to convert @documents to PDF.
+    static void prepareBatch(const Documents& documents, Poco::Net::HTMLForm& form,
+                             Poco::Net::HTTPRequest& request)
+    {
+        form.setEncoding(Poco::Net::HTMLForm::ENCODING_MULTIPART);
+        for (const auto& document : documents)
+        {
+            form.addPart("data", new Poco::Net::StringPartSource(
+                                     document.second, "application/octet-stream", document.first));
+        }
+
+        form.prepareSubmit(request);
+    }
+
+    static std::unique_ptr<Poco::Net::HTTPClientSession> createSession()
+    {
+        std::unique_ptr<Poco::Net::HTTPClientSession> session(
+            helpers::createSession(Poco::URI(helpers::getTestServerURI())));
+        session->setTimeout(Poco::Timespan(60, 0)); // 60 seconds.
+        return session;
+    }
+
+    /// Converts @documents in one batch, returning the response status and its body.
+    std::pair<Poco::Net::HTTPResponse::HTTPStatus, std::string>
+    convertBatch(const Documents& documents)
+    {
+        std::unique_ptr<Poco::Net::HTTPClientSession> session = createSession();
+
+        Poco::Net::HTMLForm form;
+        Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST,
+                                       "/cool/convert-to-batch/pdf");
+        prepareBatch(documents, form, request);
+        form.write(session->sendRequest(request));
+
+        Poco::Net::HTTPResponse response;
+        std::ostringstream oss;
+        std::istream& responseStream = session->receiveResponse(response);
+        Poco::StreamCopier::copyStream(responseStream, oss);
+
+        if (response.getStatus() == Poco::Net::HTTPResponse::HTTPStatus::HTTP_OK &&
+            !response.getContentType().starts_with("multipart/mixed; boundary="))
+        {
+            TST_LOG("Unexpected batch response of type [" << response.getContentType() << ']');
+            return std::make_pair(Poco::Net::HTTPResponse::HTTPStatus::HTTP_NOT_ACCEPTABLE,
+                                  oss.str());
+        }
+
+        return std::make_pair(response.getStatus(), oss.str());
+    }
+
+    /// Converts three documents, and one that is password-protected, which fails.
+    bool testFailedDocument()
+    {
+        Documents documents = textDocuments({ "first.txt", "second.txt", "third.txt" });
+        const std::vector<char> protectedDocument =
+            helpers::readDataFromFile("password-protected.docx");
+        documents.emplace_back("protected.docx",
+                               std::string(protectedDocument.begin(), protectedDocument.end()));
+
+        const auto [status, body] = convertBatch(documents);
+        if (status != Poco::Net::HTTPResponse::HTTPStatus::HTTP_OK)
+        {
+            TST_LOG("Unexpected batch response " << status);
+            return false;
+        }
+
+        for (const std::string name : { "first.pdf", "second.pdf", "third.pdf", "protected.pdf" })
+        {
+            if (body.find("filename=\"" + name + '"') == std::string::npos)
+            {
+                TST_LOG("Missing the result " << name);
+                return false;
+            }
+        }
+
+        if (body.find("X-Conversion-Status: 401\r\n") == std::string::npos ||
+            body.find("X-ERROR-KIND: passwordrequired") == std::string::npos)
+        {
+            TST_LOG("Missing the failure of the password-protected document");
+            return false;
+        }
+
+        if (body.find("{\"total\":4,\"converted\":3,\"failed\":1,") == std::string::npos)
+        {
+            TST_LOG("Missing, or unexpected, report in: " << body.size() << " bytes");
+            return false;
+        }
+
+        return true;
+    }
+
+    /// Batches of more than max_documents are rejected.
+    bool testTooManyDocuments()
+    {
+        const auto [status, body] = convertBatch(
+            textDocuments({ "first.txt", "second.txt", "third.txt", "fourth.txt", "fifth.txt" }));
+        if (status != Poco::Net::HTTPResponse::HTTPStatus::HTTP_BAD_REQUEST)
+        {
+            TST_LOG("Unexpected response " << status << " to a batch of too many documents");
+            return false;
+        }
+
+        return true;
+    }
+
+    /// Disconnects while uploading a batch, and while receiving the results of another.
+    bool testDisconnect()
+    {
+        {
+            std::unique_ptr<Poco::Net::HTTPClientSession> session = createSession();
+
+            Poco::Net::HTMLForm form;
+            Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST,
+                                           "/cool/convert-to-batch/pdf");
+            prepareBatch(textDocuments({ "first.txt", "second.txt" }), form, request);
+            std::ostringstream oss;
+            form.write(oss);
+
+            const std::string upload = oss.str();
+            session->sendRequest(request) << upload.substr(0, upload.size() / 2) << std::flush;
+            session->reset();
+        }
+
+        {
+            std::unique_ptr<Poco::Net::HTTPClientSession> session = createSession();
+
+            Poco::Net::HTMLForm form;
+            Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST,
+                                           "/cool/convert-to-batch/pdf");
+            prepareBatch(textDocuments({ "first.txt", "second.txt", "third.txt", "fourth.txt" }),
+                         form, request);
+            form.write(session->sendRequest(request));
+
+            // Abandon the batch as soon as it starts.
+            Poco::Net::HTTPResponse response;
+            session->receiveResponse(response);
+            if (response.getStatus() != Poco::Net::HTTPResponse::HTTPStatus::HTTP_OK)
+            {
+                TST_LOG("Unexpected batch response " << response.getStatus());
+                return false;
+            }
+
+            session->reset();
+        }
+
+        // The abandoned conversions count against all the batches until they end, but no
+        // more are started for them, so this one gets its turn.
+        const auto [status, body] = convertBatch(textDocuments({ "first.txt", "second.txt" }));
+        if (status != Poco::Net::HTTPResponse::HTTPStatus::HTTP_OK ||
+            body.find("{\"total\":2,\"converted\":2,\"failed\":0,") == std::string::npos)
+        {
+            TST_LOG("Failed to convert a batch after disconnections: " << status);
+            return false;
+        }
+
+        return true;
+    }
+
+    void invokeWSDTest() override
+    {
+        if (_workerStarted)
+            return;
+        _workerStarted = true;
+
+        _worker = std::thread(
+            [this]
+            {
+                try
+                {
+                    if (!testFailedDocument() || !testTooManyDocuments() || !testDisconnect())
+                    {
+                        exitTest(TestResult::Failed);
+                        return;
+                    }
+                }
+                catch (const std::exception& ex)
+                {
+                    TST_LOG("Failed to convert a batch: " << ex.what());
+                    exitTest(TestResult::Failed);
+                    return;
+                }
+
+                exitTest(TestResult::Ok);
+            });
+    }
+};
+
+UnitBase* unit_create_wsd(void) { return new UnitConvertBatch(); }
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
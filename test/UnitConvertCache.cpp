@@ -0,0 +1,150 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <atomic>
+#include <sstream>
+#include <thread>
+
+#include <Common.hpp>
+#include <FileUtil.hpp>
+#include <Unit.hpp>
+#include <Util.hpp>
+#include <helpers.hpp>
+
+#include <Poco/Net/HTMLForm.h>
+#include <Poco/Net/StringPartSource.h>
+#include <Poco/StreamCopier.h>
+#include <Poco/Util/LayeredConfiguration.h>
+
+/// Converts the same document twice, with convert_cache
+/// enabled, and checks the second conversion is served
+/// from the cache, without a DocumentBroker.
+class UnitConvertCache : public UnitWSD
+{
+    bool _workerStarted;
+    std::thread _worker;
+    std::string _cachePath;
+    std::atomic<int> _docBrokerCount;
+
+public:
+    UnitConvertCache()
+        : UnitWSD("UnitConvertCache")
+        , _workerStarted(false)
+        , _docBrokerCount(0)
+    {
+        setTimeout(std::chrono::minutes(2));
+    }
+
+    ~UnitConvertCache()
+    {
+        LOG_INF("Joining test worker thread");
+        _worker.join();
+
+        if (!_cachePath.empty())
+            FileUtil::removeFile(_cachePath, /*recursive=*/true);
+    }
+
+    void configure(Poco::Util::LayeredConfiguration& config) override
+    {
+        UnitWSD::configure(config);
+
+        _cachePath = FileUtil::createRandomTmpDir();
+
+        config.setBool("ssl.enable", true);
+        config.setInt("per_document.limit_load_secs", 30);
+        config.setBool("storage.filesystem[@allow]", false);
+        config.setBool("convert_cache[@enable]", true);
+        config.setString("convert_cache.path", _cachePath);
+    }
+
+    void onDocBrokerCreate(const std::string& docKey) override
+    {
+        TST_LOG("Created [" << docKey << ']');
+        ++_docBrokerCount;
+    }
+
+    /// Converts @filename, returning the result, or an empty string on failure.
+    std::string convert(const std::string& filename)
+    {
+        std::unique_ptr<Poco::Net::HTTPClientSession> session(
+            helpers::createSession(Poco::URI(helpers::getTestServerURI())));
+        session->setTimeout(Poco::Timespan(30, 0)); // 30 seconds.
+
+        Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, "/cool/convert-to/pdf");
+        Poco::Net::HTMLForm form;
+        form.setEncoding(Poco::Net::HTMLForm::ENCODING_MULTIPART);
+        form.addPart("data", new Poco::Net::StringPartSource("Hello World Content", "text/plain",
+                                                             filename));
+        form.prepareSubmit(request);
+        form.write(session->sendRequest(request));
+
+        Poco::Net::HTTPResponse response;
+        std::ostringstream oss;
+        try
+        {
+            std::istream& responseStream = session->receiveResponse(response);
+            Poco::StreamCopier::copyStream(responseStream, oss);
+        }
+        catch (...)
+        {
+            return std::string();
+        }
+
+        if (response.getStatus() != Poco::Net::HTTPResponse::HTTPStatus::HTTP_OK)
+            return std::string();
+
+        return oss.str();
+    }
+
+    void invokeWSDTest() override
+    {
+        if (_workerStarted)
+            return;
+        _workerStarted = true;
+
+        _worker = std::thread(
+            [this]
+            {
+                const std::string first = convert("first.txt");
+                if (first.empty())
+                {
+                    TST_LOG("Failed to convert first.txt");
+                    exitTest(TestResult::Failed);
+                    return;
+                }
+
+                // Same content, different name; the name isn't part of the key.
+                const std::string second = convert("second.txt");
+                if (second != first)
+                {
+                    TST_LOG("Expected the cached result of " << first.size() << " bytes, got "
+                                                             << second.size() << " bytes");
+                    exitTest(TestResult::Failed);
+                    return;
+                }
+
+                if (_docBrokerCount != 1)
+                {
+                    TST_LOG("Expected one conversion, got " << _docBrokerCount);
+                    exitTest(TestResult::Failed);
+                    return;
+                }
+
+                exitTest(TestResult::Ok);
+            });
+    }
+};
+
+UnitBase* unit_create_wsd(void) { return new UnitConvertCache(); }
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,176 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Common.hpp>
+#include <Unit.hpp>
+#include <Util.hpp>
+#include <helpers.hpp>
+
+#include <Poco/Net/HTMLForm.h>
+#include <Poco/Net/StringPartSource.h>
+#include <Poco/Util/LayeredConfiguration.h>
+
+/// Converts documents one after the other, with
+/// per_document.convert_kit_reuse enabled, and checks
+/// they are all converted by the same Kit.
+class UnitConvertKitReuse : public UnitWSD
+{
+    static constexpr std::size_t ConversionCount = 3;
+
+    bool _workerStarted;
+    std::thread _worker;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::vector<int> _kitPids; ///< The Kit of each conversion, in turn.
+    std::size_t _destroyedCount;
+
+public:
+    UnitConvertKitReuse()
+        : UnitWSD("UnitConvertKitReuse")
+        , _workerStarted(false)
+        , _destroyedCount(0)
+    {
+        setHasKitHooks();
+        setTimeout(std::chrono::minutes(5));
+    }
+
+    ~UnitConvertKitReuse()
+    {
+        LOG_INF("Joining test worker thread");
+        _worker.join();
+    }
+
+    void configure(Poco::Util::LayeredConfiguration& config) override
+    {
+        UnitWSD::configure(config);
+
+        config.setBool("ssl.enable", true);
+        config.setInt("per_document.limit_load_secs", 30);
+        config.setBool("storage.filesystem[@allow]", false);
+        config.setBool("per_document.convert_kit_reuse[@enable]", true);
+    }
+
+    void onDocBrokerAttachKitProcess(const std::string& docKey, int pid) override
+    {
+        TST_LOG("Kit [" << pid << "] attached to [" << docKey << ']');
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _kitPids.push_back(pid);
+    }
+
+    void onDocBrokerDestroy(const std::string& docKey) override
+    {
+        TST_LOG("Destroyed [" << docKey << ']');
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_destroyedCount;
+        _cv.notify_all();
+    }
+
+    bool convert(const std::string& filename)
+    {
+        std::unique_ptr<Poco::Net::HTTPClientSession> session(
+            helpers::createSession(Poco::URI(helpers::getTestServerURI())));
+        session->setTimeout(Poco::Timespan(30, 0)); // 30 seconds.
+
+        Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, "/cool/convert-to/pdf");
+        Poco::Net::HTMLForm form;
+        form.setEncoding(Poco::Net::HTMLForm::ENCODING_MULTIPART);
+        form.addPart("data", new Poco::Net::StringPartSource("Hello World Content", "text/plain",
+                                                             filename));
+        form.prepareSubmit(request);
+        form.write(session->sendRequest(request));
+
+        Poco::Net::HTTPResponse response;
+        try
+        {
+            session->receiveResponse(response);
+        }
+        catch (...)
+        {
+            return false;
+        }
+
+        return response.getStatus() == Poco::Net::HTTPResponse::HTTPStatus::HTTP_OK;
+    }
+
+    void invokeWSDTest() override
+    {
+        if (_workerStarted)
+            return;
+        _workerStarted = true;
+
+        _worker = std::thread(
+            [this]
+            {
+                for (std::size_t i = 0; i < ConversionCount; ++i)
+                {
+                    const std::string filename = "reuse" + std::to_string(i) + ".txt";
+                    if (!convert(filename))
+                    {
+                        TST_LOG("Failed to convert " << filename);
+                        exitTest(TestResult::Failed);
+                        return;
+                    }
+
+                    // The Kit is kept once the DocBroker is done with it.
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    if (!_cv.wait_for(lock, std::chrono::seconds(30),
+                                      [this, i] { return _destroyedCount > i; }))
+                    {
+                        TST_LOG("Timed out waiting for the conversion of " << filename
+                                                                           << " to finish");
+                        exitTest(TestResult::Failed);
+                        return;
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_kitPids.size() != ConversionCount ||
+                    std::count(_kitPids.begin(), _kitPids.end(), _kitPids[0]) !=
+                        static_cast<long>(ConversionCount))
+                {
+                    TST_LOG("Expected all " << ConversionCount << " conversions on one Kit, got "
+                                            << _kitPids.size() << " attachments");
+                    exitTest(TestResult::Failed);
+                    return;
+                }
+
+                exitTest(TestResult::Ok);
+            });
+    }
+};
+
+// Inside the forkit & kit processes
+class UnitKitConvertKitReuse : public UnitKit
+{
+public:
+    UnitKitConvertKitReuse()
+        : UnitKit("UnitKitConvertKitReuse")
+    {
+        setTimeout(std::chrono::minutes(5));
+    }
+};
+
+UnitBase* unit_create_wsd(void) { return new UnitConvertKitReuse(); }
+
+UnitBase* unit_create_kit(void) { return new UnitKitConvertKitReuse(); }
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -17,7 +17,15 @@
 #include <WebSocketSession.hpp>
 #include <test/lokassert.hpp>
 
+#include <Poco/Util/LayeredConfiguration.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <sstream>
 #include <string>
+#include <thread>
 
 /// Load torture testcase.
 class UnitLoadTorture : public UnitWSD
@@ -29,10 +37,29 @@ class UnitLoadTorture : public UnitWSD
     TestResult testLoadTortureODP();
     TestResult testLoadTortureODG();
     TestResult testLoadTorture();
+    TestResult testTileCoalescing();
+
+    /// Requests and tilecombines reported by the TileScheduler.
+    std::atomic<std::size_t> _tileRequests;
+    std::atomic<std::size_t> _tileCombines;
 
 public:
     UnitLoadTorture();
     void invokeWSDTest() override;
+
+    void configure(Poco::Util::LayeredConfiguration& config) override
+    {
+        UnitWSD::configure(config);
+
+        // Long enough for all the views to request their tiles in time.
+        config.setInt("per_document.tile_coalesce_ms", 200);
+    }
+
+    void onTileCombinesScheduled(std::size_t requests, std::size_t combines) override
+    {
+        _tileRequests += requests;
+        _tileCombines += combines;
+    }
 };
 
 void UnitLoadTorture::loadTorture(const std::string& name, const std::string& docName,
@@ -196,8 +223,106 @@ UnitBase::TestResult UnitLoadTorture::testLoadTorture()
     return TestResult::Ok;
 }
 
+/// Many views of the same document, as when a class opens a handout,
+/// request overlapping viewports in their own order at the same time.
+/// Their requests should be rendered together, in fewer tilecombines.
+UnitBase::TestResult UnitLoadTorture::testTileCoalescing()
+{
+    constexpr std::size_t thread_count = 8;
+
+    std::string documentPath, documentURL;
+    helpers::getDocumentPathAndURL("hello.odt", documentPath, documentURL, testname);
+
+    std::shared_ptr<SocketPoll> poll = std::make_shared<SocketPoll>("WebSocketPoll");
+    poll->startThread();
+
+    std::vector<std::shared_ptr<http::WebSocketSession>> sessions;
+    for (std::size_t i = 0; i < thread_count; ++i)
+    {
+        auto wsSession = http::WebSocketSession::create(helpers::getTestServerURI());
+        http::Request req(documentURL);
+        wsSession->asyncRequest(req, poll);
+        wsSession->sendMessage("load url=" + documentURL);
+        sessions.push_back(std::move(wsSession));
+    }
+
+    for (const auto& wsSession : sessions)
+    {
+        const std::vector<char> message =
+            wsSession->waitForMessage("status:", std::chrono::seconds(20), testname);
+        LOK_ASSERT_MESSAGE("Failed to load the document", !message.empty());
+    }
+
+    _tileRequests = 0;
+    _tileCombines = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    // All request a 4x4 viewport, each shifted by up to 2 tiles, in a random order.
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < thread_count; ++i)
+    {
+        threads.emplace_back(
+            [&, i]
+            {
+                std::vector<std::pair<int, int>> positions;
+                for (int y = 0; y < 4; ++y)
+                {
+                    for (int x = 0; x < 4; ++x)
+                        positions.emplace_back((x + i % 3) * 3840, (y + i / 3 % 3) * 3840);
+                }
+
+                std::mt19937 rng(i);
+                std::shuffle(positions.begin(), positions.end(), rng);
+
+                std::ostringstream xs;
+                std::ostringstream ys;
+                for (const auto& position : positions)
+                {
+                    xs << position.first << ',';
+                    ys << position.second << ',';
+                }
+
+                std::string tileposx = xs.str();
+                tileposx.pop_back();
+                std::string tileposy = ys.str();
+                tileposy.pop_back();
+
+                sessions[i]->sendMessage(
+                    "tilecombine nviewid=0 part=0 width=256 height=256 tileposx=" + tileposx +
+                    " tileposy=" + tileposy + " tilewidth=3840 tileheight=3840");
+
+                const std::vector<char> tile = sessions[i]->waitForMessageAny(
+                    { "tile:", "delta:" }, std::chrono::seconds(10), testname);
+                LOK_ASSERT_MESSAGE("Expected the requested tiles", !tile.empty());
+            });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    const std::size_t requests = _tileRequests;
+    const std::size_t combines = _tileCombines;
+    TST_LOG("Rendered the tiles of " << requests << " requests from " << thread_count
+                                     << " views in " << combines << " tilecombines, saving "
+                                     << (requests - combines) * 1000 /
+                                            std::max<std::int64_t>(elapsed.count(), 1)
+                                     << " renders/second over " << elapsed);
+
+    LOK_ASSERT_MESSAGE("Expected tiles to be rendered", requests > 0);
+    LOK_ASSERT_MESSAGE("Expected the requests to be rendered together", combines < requests);
+
+    for (const auto& wsSession : sessions)
+        wsSession->asyncShutdown();
+
+    return TestResult::Ok;
+}
+
 UnitLoadTorture::UnitLoadTorture()
     : UnitWSD("UnitLoadTorture")
+    , _tileRequests(0)
+    , _tileCombines(0)
 {
     // Double of the default.
     constexpr std::chrono::minutes timeout_minutes(1);
@@ -222,6 +347,10 @@ void UnitLoadTorture::invokeWSDTest()
     if (result != TestResult::Ok)
         exitTest(result);
 
+    result = testTileCoalescing();
+    if (result != TestResult::Ok)
+        exitTest(result);
+
     result = testLoadTorture();
     exitTest(result);
 }
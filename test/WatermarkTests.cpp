@@ -0,0 +1,95 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include <test/lokassert.hpp>
+
+#include <random>
+#include <vector>
+
+#include <Simd.hpp>
+#include <Watermark.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/// Watermark unit-tests.
+class WatermarkTests : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(WatermarkTests);
+
+    CPPUNIT_TEST(testBlendRowSimd);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    void testBlendRowSimd();
+};
+
+void WatermarkTests::testBlendRowSimd()
+{
+    constexpr auto testname = __func__;
+
+    const bool hadAVX2 = simd::HasAVX2;
+    if (!simd::init())
+    {
+        simd::HasAVX2 = hadAVX2;
+        return; // Nothing to cross-check.
+    }
+
+    std::mt19937 random(42);
+    std::uniform_int_distribution<unsigned> byte(0, 255);
+    std::uniform_int_distribution<int> length(1, 99);
+
+    for (int iter = 0; iter < 2000; ++iter)
+    {
+        // Mostly odd lengths, to leave a tail for the scalar loop.
+        const int count = length(random) | (iter % 4 ? 1 : 0);
+        const bool blendAll = iter & 1;
+        const bool isSlideShowLayer = iter & 2;
+
+        // Pre-multiplied watermark pixels of any alpha, including the edges.
+        std::vector<unsigned char> from(4 * count);
+        for (int x = 0; x < count; ++x)
+        {
+            const unsigned alpha = x % 7 == 0 ? 0 : x % 7 == 1 ? 255 : byte(random);
+            for (int i = 0; i < 3; ++i)
+                from[4 * x + i] = byte(random) * alpha / 255;
+            from[4 * x + 3] = alpha;
+        }
+
+        // Opaque, transparent and translucent tile pixels.
+        std::vector<unsigned char> to(4 * count);
+        for (int x = 0; x < count; ++x)
+        {
+            const unsigned alpha = x % 3 == 0 ? 255 : x % 3 == 1 ? 0 : byte(random);
+            for (int i = 0; i < 3; ++i)
+                to[4 * x + i] = byte(random);
+            to[4 * x + 3] = alpha;
+        }
+
+        std::vector<unsigned char> scalar = to;
+        simd::HasAVX2 = false;
+        Watermark::blendRow(scalar.data(), from.data(), count, blendAll, isSlideShowLayer);
+
+        std::vector<unsigned char> avx2 = to;
+        simd::HasAVX2 = true;
+        Watermark::blendRow(avx2.data(), from.data(), count, blendAll, isSlideShowLayer);
+
+        LOK_ASSERT_MESSAGE("AVX2 blend of " + std::to_string(count) + " pixels differs",
+                           scalar == avx2);
+    }
+
+    simd::HasAVX2 = hadAVX2;
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(WatermarkTests);
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -62,6 +62,7 @@ class WhiteBoxTests : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testStateEnum);
     CPPUNIT_TEST(testFindInVector);
     CPPUNIT_TEST(testThreadPool);
+    CPPUNIT_TEST(testThreadPoolProgress);
     CPPUNIT_TEST_SUITE_END();
 
     void testCOOLProtocolFunctions();
@@ -89,6 +90,7 @@ class WhiteBoxTests : public CPPUNIT_NS::TestFixture
     void testStateEnum();
     void testFindInVector();
     void testThreadPool();
+    void testThreadPoolProgress();
 
     size_t waitForThreads(size_t count);
 };
@@ -652,6 +654,17 @@ void WhiteBoxTests::testTileData()
     LOK_ASSERT_EQUAL(data.size(), size_t(9));
     LOK_ASSERT_EQUAL(data._wids.size(), size_t(4));
     LOK_ASSERT_EQUAL(data._wids.back(), unsigned(54));
+
+    // sessions sent the same changes share a message
+    std::shared_ptr<Message> message = data.getChangesMessage("delta:\n", 43);
+    LOK_ASSERT_EQUAL(std::string("delta:\nbaabaz"),
+                     std::string(message->data().data(), message->size()));
+    LOK_ASSERT(message == data.getChangesMessage("delta:\n", 43));
+    LOK_ASSERT(message != data.getChangesMessage("tile:\n", 43));
+
+    // but it isn't kept once sent, as the cache doesn't count it
+    message.reset();
+    LOK_ASSERT(data._message.expired());
 }
 
 void WhiteBoxTests::testRectanglesIntersect()
@@ -1122,6 +1135,48 @@ void WhiteBoxTests::testThreadPool()
 //    LOK_ASSERT_EQUAL(size_t(7 + existingUnrelatedThreads), waitForThreads(8 + existingUnrelatedThreads));
 }
 
+void WhiteBoxTests::testThreadPoolProgress()
+{
+    constexpr auto testname = __func__;
+    // coverity[tainted_data_argument : FALSE] - we trust this variable in tests
+    setenv("MAX_CONCURRENCY","4",1);
+    ThreadPool pool;
+
+    constexpr size_t Items = 64;
+    std::mutex mutex;
+    std::vector<size_t> done;
+    for (size_t i = 0; i < Items; ++i)
+    {
+        pool.pushWork([i, &mutex, &done]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            done.push_back(i);
+        });
+    }
+
+    // Progress must be reported on the calling thread, while work completes.
+    const std::thread::id caller = std::this_thread::get_id();
+    size_t progressCalls = 0;
+    size_t consumed = 0;
+    bool sameThread = true;
+    pool.run([&]() {
+        sameThread &= std::this_thread::get_id() == caller;
+        ++progressCalls;
+        std::unique_lock<std::mutex> lock(mutex);
+        consumed = done.size();
+    });
+
+    LOK_ASSERT(sameThread);
+    LOK_ASSERT(progressCalls > 0);
+    LOK_ASSERT_EQUAL(Items, consumed);
+    LOK_ASSERT_EQUAL(Items, done.size());
+
+    // And the pool is reusable without a progress callback.
+    done.clear();
+    pool.pushWork([&]() { done.push_back(0); });
+    pool.run();
+    LOK_ASSERT_EQUAL(size_t(1), done.size());
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(WhiteBoxTests);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
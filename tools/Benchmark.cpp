@@ -14,10 +14,24 @@
 
 #include "config.h"
 
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <map>
+#include <memory>
+#include <thread>
 
+#include <common/Log.hpp>
 #include <common/Png.hpp>
+#include <common/Util.hpp>
 #include <kit/Delta.hpp>
+#include <kit/Watermark.hpp>
+#include <net/Socket.hpp>
+#include <net/SocketPollPool.hpp>
 
 typedef std::vector<char> Pixmap;
 
@@ -62,6 +76,375 @@ public:
         std::cout << "time/rle: " <<
             (1.0*std::chrono::duration_cast<std::chrono::microseconds>(end - start).count())/deltas << "us\n";
     }
+
+    /// Measure createDelta throughput with several threads sharing one
+    /// generator, as the Kit's encoding thread pool does.
+    static void timeCreateDelta(unsigned threadCount)
+    {
+        constexpr int tilesPerThread = 64;
+        constexpr int iterations = 50;
+
+        DeltaGenerator gen;
+        gen.setSessionCount(threadCount);
+
+        std::atomic<size_t> deltas(0);
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < threadCount; ++t)
+        {
+            threads.emplace_back([&gen, &deltas, t]() {
+                std::vector<char> output;
+                TileWireId wid = 1;
+                for (int it = 0; it < iterations; ++it)
+                {
+                    for (int tile = 0; tile < tilesPerThread; ++tile)
+                    {
+                        // Each thread owns its tiles: just like a tilecombine.
+                        Pixmap &pix = pixmaps[(it + tile) % pixmaps.size()];
+                        TileLocation loc(tile * 3840, t * 3840, 3840, 0, CanonicalViewId::None, 0);
+                        std::shared_ptr<DeltaGenerator::DeltaData> rleData;
+                        output.clear();
+                        if (gen.createDelta(reinterpret_cast<unsigned char *>(pix.data()),
+                                            0, 0, 256, 256, 256, 256, loc, output, wid++,
+                                            false, LOK_TILEMODE_RGBA, rleData))
+                            deltas++;
+                    }
+                    gen.rebalanceDeltas();
+                }
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+
+        const auto end = std::chrono::steady_clock::now();
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        const size_t total = static_cast<size_t>(threadCount) * tilesPerThread * iterations;
+
+        std::cout << "createDelta with " << threadCount << " threads took: " << us / 1000
+                  << "ms - " << deltas << " deltas, " << (total * 1000000.0) / std::max<int64_t>(us, 1)
+                  << " tiles/s\n";
+    }
+};
+
+class PngTests {
+public:
+    /// The previous encoding path, unpremultiplying in a libpng row transform.
+    static bool encodeWithTransform(unsigned char* pixmap, int width, int height,
+                                    std::vector<char>& output, LibreOfficeKitTileMode mode)
+    {
+        png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        png_infop info_ptr = png_create_info_struct(png_ptr);
+        if (setjmp(png_jmpbuf(png_ptr)))
+        {
+            png_destroy_write_struct(&png_ptr, nullptr);
+            return false;
+        }
+
+        png_set_compression_level(png_ptr, 4);
+        png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+                     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_set_write_fn(png_ptr, &output, Png::user_write_fn, Png::user_flush_fn);
+        png_write_info(png_ptr, info_ptr);
+        png_set_write_user_transform_fn(png_ptr, mode == LOK_TILEMODE_BGRA
+                                                     ? Png::unpremultiply_bgra_data
+                                                     : Png::unpremultiply_rgba_data);
+        for (int y = 0; y < height; ++y)
+            png_write_row(png_ptr, pixmap + y * width * 4);
+        png_write_end(png_ptr, info_ptr);
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return true;
+    }
+
+    static void timeEncode(const char *description, bool transform)
+    {
+        constexpr int iterations = 20;
+        size_t bytes = 0;
+        std::vector<char> output;
+        const auto start = std::chrono::steady_clock::now();
+        for (int it = 0; it < iterations; ++it)
+        {
+            for (Pixmap &pix : pixmaps)
+            {
+                output.clear();
+                auto data = reinterpret_cast<unsigned char *>(pix.data());
+                if (transform)
+                    encodeWithTransform(data, 256, 256, output, LOK_TILEMODE_BGRA);
+                else
+                    Png::encodeBufferToPNG(data, 256, 256, output, LOK_TILEMODE_BGRA);
+                bytes += output.size();
+            }
+        }
+        const auto end = std::chrono::steady_clock::now();
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        const double pixels = 256.0 * 256 * iterations * pixmaps.size();
+
+        std::cout << "PNG encode " << description << " took: " << us / 1000 << "ms - "
+                  << pixels / std::max<int64_t>(us, 1) << " MP/s, " << bytes << " bytes\n";
+    }
+
+    static void checkEncode()
+    {
+        for (Pixmap &pix : pixmaps)
+        {
+            std::vector<char> before, after;
+            auto data = reinterpret_cast<unsigned char *>(pix.data());
+            encodeWithTransform(data, 256, 256, before, LOK_TILEMODE_BGRA);
+            Png::encodeBufferToPNG(data, 256, 256, after, LOK_TILEMODE_BGRA);
+            if (before != after)
+                std::cerr << "Error: PNG output differs from the row transform path\n";
+        }
+    }
+};
+
+class WatermarkTests {
+public:
+    /// Time keyframe encoding of the tiles, as rendering does, with and
+    /// without blending a watermark over them first.
+    static void timeRender(bool watermark)
+    {
+        // A grey 205x205 (80% of a tile) pattern, transparent at the edges
+        // like the rotated text.
+        constexpr int size = 205;
+        Watermark::Bitmap bitmap;
+        bitmap._pixels.resize(size * size * 4);
+        for (int y = 0; y < size; ++y)
+        {
+            for (int x = 0; x < size; ++x)
+            {
+                if (std::abs(x - y) > size / 4)
+                    continue;
+                const unsigned char alpha = 32 + (x * 7 + y * 3) % 64;
+                unsigned char* p = bitmap._pixels.data() + 4 * (y * size + x);
+                p[0] = p[1] = p[2] = alpha / 2;
+                p[3] = alpha;
+            }
+        }
+        Watermark::computeSpans(bitmap, size, size);
+
+        constexpr int iterations = 20;
+        DeltaGenerator gen;
+        std::vector<char> output;
+        Pixmap tile;
+        TileWireId wid = 1;
+        const auto start = std::chrono::steady_clock::now();
+        for (int it = 0; it < iterations; ++it)
+        {
+            for (const Pixmap &pix : pixmaps)
+            {
+                tile = pix;
+                auto data = reinterpret_cast<unsigned char *>(tile.data());
+                if (watermark)
+                    Watermark::alphaBlend(bitmap, size, size, 25, 25, data, 256, 256,
+                                          /*blendAll*/ false);
+
+                output.clear();
+                TileLocation loc(0, 0, 3840, 0, CanonicalViewId::None, 0);
+                gen.compressOrDelta(data, 0, 0, 256, 256, 256, 256, loc, output, wid++,
+                                    /*forceKeyframe*/ true, false, LOK_TILEMODE_RGBA);
+            }
+        }
+        const auto end = std::chrono::steady_clock::now();
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        const double tiles = static_cast<double>(iterations) * pixmaps.size();
+
+        std::cout << "Render " << (watermark ? "with" : "without") << " watermark took: "
+                  << us / 1000 << "ms - " << (tiles * 1000000.0) / std::max<int64_t>(us, 1)
+                  << " tiles/s\n";
+    }
+};
+
+class SocketPollPoolTests {
+public:
+    /// Compare running many idle polls on a thread each with running them on a
+    /// SocketPollPool: the memory and threads they take, and how soon they run callbacks.
+    static void timePolls()
+    {
+#ifdef HAVE_EPOLL
+        // Each poll needs an epoll set and a wakeup pipe.
+        rlimit rlim;
+        if (getrlimit(RLIMIT_NOFILE, &rlim) == 0)
+        {
+            rlim.rlim_cur = rlim.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &rlim);
+        }
+
+        constexpr std::size_t poolThreads = 4;
+        constexpr std::size_t samples = 100;
+        for (const std::size_t count : { 100, 1000, 5000 })
+        {
+            if (count * 3 + 64 > rlim.rlim_cur)
+            {
+                std::cout << "Skipping " << count << " polls, RLIMIT_NOFILE is " << rlim.rlim_cur
+                          << '\n';
+                continue;
+            }
+
+            for (const bool pooled : { false, true })
+                timePolls(count, pooled, poolThreads, samples);
+        }
+#endif
+    }
+
+private:
+    static void timePolls(std::size_t count, bool pooled, std::size_t poolThreads,
+                          std::size_t samples)
+    {
+        const std::size_t rssBefore = Util::getMemoryUsageRSS(getpid());
+        const std::size_t threadsBefore = Util::getCurrentThreadCount();
+
+        std::unique_ptr<SocketPollPool> pool;
+        if (pooled)
+            pool = std::make_unique<SocketPollPool>("pool_bench", poolThreads);
+
+        std::vector<std::shared_ptr<SocketPoll>> polls;
+        bool started = true;
+        for (std::size_t i = 0; i < count && started; ++i)
+        {
+            polls.emplace_back(std::make_shared<SocketPoll>("poll_bench_" + std::to_string(i),
+                                                            SocketPoll::Backend::Epoll));
+            started = (pooled ? pool->startPoll(polls.back()) : polls.back()->startThread());
+        }
+
+        // Have them all polling before measuring.
+        std::atomic<std::size_t> ready(0);
+        for (const auto& poll : polls)
+            poll->addCallback([&ready]() { ++ready; });
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (started && ready < polls.size() && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        if (!started)
+        {
+            // Too many threads, most likely.
+            std::cout << "Skipping " << count << " polls on threads, only " << polls.size() - 1
+                      << " started\n";
+        }
+        else if (ready < polls.size())
+        {
+            std::cerr << "Error: only " << ready << " of " << count << " polls are polling\n";
+        }
+        else
+        {
+            const std::size_t rss = Util::getMemoryUsageRSS(getpid());
+            const std::size_t threads = Util::getCurrentThreadCount();
+
+            // The time from queuing a callback to running it, one poll at a time.
+            std::vector<int64_t> latencies;
+            for (std::size_t i = 0; i < samples; ++i)
+            {
+                std::atomic<bool> done(false);
+                const auto start = std::chrono::steady_clock::now();
+                polls[i * count / samples]->addCallback([&done]() { done = true; });
+                while (!done)
+                    std::this_thread::yield();
+
+                latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                                        std::chrono::steady_clock::now() - start)
+                                        .count());
+            }
+
+            std::sort(latencies.begin(), latencies.end());
+            std::cout << count << " polls on " << (pooled ? "a pool of " : "")
+                      << threads - threadsBefore << " threads: "
+                      << static_cast<int64_t>(rss) - static_cast<int64_t>(rssBefore)
+                      << " KB RSS, callback latency p50: " << latencies[samples / 2]
+                      << "us, p99: " << latencies[samples * 99 / 100] << "us\n";
+        }
+
+        for (const auto& poll : polls)
+            poll->stop();
+        for (const auto& poll : polls)
+            poll->joinThread();
+
+        if (pooled)
+            pool->stop();
+    }
+};
+
+class LogTests {
+public:
+    /// Measure the throughput and the latency of trace logging from several
+    /// threads, as seen by the logging threads, with the given channel config.
+    static void timeLog(const char *description, const std::map<std::string, std::string>& config,
+                        unsigned threadCount)
+    {
+        constexpr int entriesPerThread = 100000;
+
+        Log::initialize(std::string("bench-") + description, "trace", false, false, config, false,
+                        {});
+        const std::uint64_t droppedBefore = Log::droppedCount();
+
+        std::vector<std::vector<int64_t>> latencies(threadCount);
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < threadCount; ++t)
+        {
+            threads.emplace_back([&latencies, t]() {
+                std::vector<int64_t> &latency = latencies[t];
+                latency.reserve(entriesPerThread);
+                for (int i = 0; i < entriesPerThread; ++i)
+                {
+                    const auto before = std::chrono::steady_clock::now();
+                    LOG_TRC("Benchmark entry #" << i << " of thread #" << t
+                                                << " with a payload of " << 0.5 * i);
+                    latency.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now() - before)
+                                          .count());
+                }
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+
+        const auto end = std::chrono::steady_clock::now();
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        std::vector<int64_t> all;
+        for (const auto &latency : latencies)
+            all.insert(all.end(), latency.begin(), latency.end());
+        std::sort(all.begin(), all.end());
+        const auto percentile = [&all](double p) {
+            return all[std::min<size_t>(all.size() - 1, all.size() * p)] / 1000.0;
+        };
+
+        std::cout << "Log " << description << " with " << threadCount << " threads took: "
+                  << us / 1000 << "ms - " << (all.size() * 1000000.0) / std::max<int64_t>(us, 1)
+                  << " entries/s, latency p50: " << percentile(0.5)
+                  << "us, p99: " << percentile(0.99) << "us, p99.9: " << percentile(0.999)
+                  << "us, max: " << all.back() / 1000.0
+                  << "us, dropped: " << Log::droppedCount() - droppedBefore << '\n';
+    }
+
+    /// Compare the buffered console channel, the default, with the asynchronous one.
+    /// The log is written to /dev/null, to measure the cost to the logging threads.
+    static void timeChannels()
+    {
+        std::cout.flush();
+        const int stderrFd = dup(STDERR_FILENO);
+        const int nullFd = open("/dev/null", O_WRONLY);
+        if (stderrFd < 0 || nullFd < 0 || dup2(nullFd, STDERR_FILENO) < 0)
+        {
+            std::cerr << "Error: failed to redirect stderr for the log benchmark\n";
+            return;
+        }
+
+        const unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1U);
+        for (unsigned threads = 1; threads <= maxThreads; threads *= 4)
+        {
+            timeLog("buffered", {}, threads);
+            timeLog("async", { { "async", "true" } }, threads);
+        }
+
+        // Write out everything before restoring stderr.
+        Log::shutdown();
+
+        dup2(stderrFd, STDERR_FILENO);
+        close(stderrFd);
+        close(nullFd);
+    }
 };
 
 int main (int argc, char **argv)
@@ -73,12 +456,35 @@ int main (int argc, char **argv)
 //        std::cout << "Loaded: " << argv[i] << " " << width << "x" << height << "\n";
     }
 
+    if (pixmaps.empty())
+    {
+        std::cerr << "Usage: " << argv[0] << " <256x256 tile.png>...\n";
+        return 1;
+    }
+
     DeltaTests::timeRLE("CPU");
 
-    simd::init();
+    if (simd::init())
+        simd_deltaInit();
 
     DeltaTests::timeRLE("SIMD");
 
+    PngTests::checkEncode();
+    PngTests::timeEncode("with row transform", true);
+    PngTests::timeEncode("with scratch buffer", false);
+
+    WatermarkTests::timeRender(false);
+    WatermarkTests::timeRender(true);
+
+    const unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1U);
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2)
+        DeltaTests::timeCreateDelta(threads);
+
+    SocketPollPoolTests::timePolls();
+
+    // Last, as it shuts down logging.
+    LogTests::timeChannels();
+
     return 0;
 }
 
@@ -0,0 +1,232 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+/*
+ * Measures the throughput and latency of convert-to on a running coolwsd,
+ * e.g. to compare with and without per_document.convert_kit_reuse.
+ */
+
+#include <config.h>
+
+#include <sysexits.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Poco/Net/AcceptCertificateHandler.h>
+#include <Poco/Net/FilePartSource.h>
+#include <Poco/Net/HTMLForm.h>
+#include <Poco/Net/HTTPClientSession.h>
+#include <Poco/Net/HTTPRequest.h>
+#include <Poco/Net/HTTPResponse.h>
+#include <Poco/Net/HTTPSClientSession.h>
+#include <Poco/Net/KeyConsoleHandler.h>
+#include <Poco/Net/SSLManager.h>
+#include <Poco/NullStream.h>
+#include <Poco/StreamCopier.h>
+#include <Poco/URI.h>
+
+#include <Common.hpp>
+
+namespace
+{
+struct Options
+{
+    std::string _serverURI =
+#if ENABLE_SSL
+        "https://127.0.0.1:" + std::to_string(DEFAULT_CLIENT_PORT_NUMBER);
+#else
+        "http://127.0.0.1:" + std::to_string(DEFAULT_CLIENT_PORT_NUMBER);
+#endif
+    std::string _format = "pdf";
+    unsigned _parallelism = 4;
+    unsigned _count = 100;
+};
+
+void displayHelp(const char* command)
+{
+    std::cout << "Collabora Online conversion benchmark.\n"
+              << "Usage: " << command << " [options] file...\n"
+              << "Converts the files, in turn, until the given number of conversions is done.\n"
+              << "Options are:\n"
+              << "  --help                      Show this text\n"
+              << "  --convert-to=format         File format to convert to (default: pdf)\n"
+              << "  --count=conversions         Number of conversions to do (default: 100)\n"
+              << "  --parallelism=connections   Number of simultaneous conversions (default: 4)\n"
+              << "  --server=uri                URI of COOL server\n"
+              << "  --no-check-certificate      Disable checking of SSL certificate"
+              << std::endl;
+}
+
+/// Converts @document, discarding the result. Returns false on failure.
+bool convert(const Options& options, const std::string& document)
+{
+    const Poco::URI uri(options._serverURI);
+    std::unique_ptr<Poco::Net::HTTPClientSession> session;
+    if (uri.getScheme() == "https")
+        session = std::make_unique<Poco::Net::HTTPSClientSession>(uri.getHost(), uri.getPort());
+    else
+        session = std::make_unique<Poco::Net::HTTPClientSession>(uri.getHost(), uri.getPort());
+
+    try
+    {
+        Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST,
+                                       "/cool/convert-to/" + options._format);
+        Poco::Net::HTMLForm form;
+        form.setEncoding(Poco::Net::HTMLForm::ENCODING_MULTIPART);
+        form.addPart("data", new Poco::Net::FilePartSource(document));
+        form.prepareSubmit(request);
+        form.write(session->sendRequest(request));
+
+        Poco::Net::HTTPResponse response;
+        std::istream& responseStream = session->receiveResponse(response);
+        Poco::NullOutputStream nullStream;
+        Poco::StreamCopier::copyStream(responseStream, nullStream);
+        if (response.getStatus() == Poco::Net::HTTPResponse::HTTP_OK)
+            return true;
+
+        std::cerr << "Failed to convert " << document << ": " << response.getStatus() << ' '
+                  << response.getReason() << '\n';
+    }
+    catch (const Poco::Exception& exc)
+    {
+        std::cerr << "Failed to convert " << document << ": " << exc.displayText() << '\n';
+    }
+
+    return false;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg.size() < 2 || arg[0] != '-')
+        {
+            files.push_back(arg);
+            continue;
+        }
+
+        const std::string option = arg.substr(arg.find_first_not_of('-'));
+        const std::size_t equals = option.find('=');
+        const std::string name = option.substr(0, equals);
+        const std::string value = (equals != std::string::npos ? option.substr(equals + 1) : "");
+        if (name == "help")
+        {
+            displayHelp(argv[0]);
+            return EX_OK;
+        }
+        else if (name == "convert-to" || name == "extension")
+            options._format = value;
+        else if (name == "count")
+            options._count = std::max(std::atoi(value.c_str()), 1);
+        else if (name == "parallelism")
+            options._parallelism = std::max(std::atoi(value.c_str()), 1);
+        else if (name == "server")
+            options._serverURI = value;
+        else if (name == "no-check-certificate")
+        {
+            Poco::SharedPtr<Poco::Net::PrivateKeyPassphraseHandler> consoleClientHandler =
+                new Poco::Net::KeyConsoleHandler(false);
+            Poco::SharedPtr<Poco::Net::InvalidCertificateHandler> invalidClientCertHandler =
+                new Poco::Net::AcceptCertificateHandler(false);
+            Poco::Net::Context::Ptr sslClientContext =
+                new Poco::Net::Context(Poco::Net::Context::CLIENT_USE, "");
+            Poco::Net::SSLManager::instance().initializeClient(
+                std::move(consoleClientHandler), std::move(invalidClientCertHandler),
+                std::move(sslClientContext));
+        }
+        else
+        {
+            std::cerr << "Unknown option: " << arg << '\n';
+            displayHelp(argv[0]);
+            return EX_USAGE;
+        }
+    }
+
+    if (files.empty())
+    {
+        std::cerr << "Nothing to do." << std::endl;
+        displayHelp(argv[0]);
+        return EX_NOINPUT;
+    }
+
+    std::atomic<unsigned> next(0);
+    std::atomic<unsigned> failed(0);
+    std::mutex latenciesMutex;
+    std::vector<std::chrono::microseconds> latencies;
+    latencies.reserve(options._count);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> clients;
+    clients.reserve(options._parallelism);
+    for (unsigned i = 0; i < options._parallelism; ++i)
+    {
+        clients.emplace_back(
+            [&]
+            {
+                std::vector<std::chrono::microseconds> ours;
+                for (unsigned index = next++; index < options._count; index = next++)
+                {
+                    const auto begin = std::chrono::steady_clock::now();
+                    if (convert(options, files[index % files.size()]))
+                        ours.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - begin));
+                    else
+                        ++failed;
+                }
+
+                std::lock_guard<std::mutex> lock(latenciesMutex);
+                latencies.insert(latencies.end(), ours.begin(), ours.end());
+            });
+    }
+
+    for (auto& client : clients)
+        client.join();
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    std::cout << "Converted " << latencies.size() << " documents (" << failed << " failed) to "
+              << options._format << " in " << elapsed.count() << "ms with "
+              << options._parallelism << " connections: "
+              << (elapsed.count() > 0 ? latencies.size() * 60000 / elapsed.count() : 0)
+              << " per minute\n";
+
+    if (!latencies.empty())
+    {
+        std::sort(latencies.begin(), latencies.end());
+        const auto percentile = [&latencies](double p)
+        {
+            const std::size_t index = static_cast<std::size_t>(p * (latencies.size() - 1));
+            return std::chrono::duration_cast<std::chrono::milliseconds>(latencies[index]).count();
+        };
+
+        std::cout << "Latency p50: " << percentile(0.5) << "ms, p90: " << percentile(0.9)
+                  << "ms, p99: " << percentile(0.99) << "ms, max: " << percentile(1.0) << "ms\n";
+    }
+
+    return failed ? EX_SOFTWARE : EX_OK;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -962,6 +962,19 @@ void Admin::addBytes(const std::string& docKey, uint64_t sent, uint64_t recv)
     addCallback([this, docKey, sent, recv] { _model.addBytes(docKey, sent, recv); });
 }
 
+void Admin::setDocTileCacheStats(const std::string& docKey, uint64_t lookups, uint64_t hits,
+                                 uint64_t evictions, uint64_t compactions,
+                                 std::vector<uint64_t> chainLengths)
+{
+    addCallback(
+        [this, docKey, lookups, hits, evictions, compactions,
+         chainLengths = std::move(chainLengths)]() mutable
+        {
+            _model.setDocTileCacheStats(docKey, lookups, hits, evictions, compactions,
+                                        std::move(chainLengths));
+        });
+}
+
 void Admin::setViewLoadDuration(const std::string& docKey, const std::string& sessionId, std::chrono::milliseconds viewLoadDuration)
 {
     addCallback([this, docKey, sessionId, viewLoadDuration]{ _model.setViewLoadDuration(docKey, sessionId, viewLoadDuration); });
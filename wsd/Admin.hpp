@@ -148,6 +148,9 @@ public:
 
     void updateLastActivityTime(const std::string& docKey);
     void addBytes(const std::string& docKey, uint64_t sent, uint64_t recv);
+    void setDocTileCacheStats(const std::string& docKey, uint64_t lookups, uint64_t hits,
+                              uint64_t evictions, uint64_t compactions,
+                              std::vector<uint64_t> chainLengths);
 
     void dumpState(std::ostream& os) const override;
 
@@ -29,7 +29,10 @@
 #include <common/ConfigUtil.hpp>
 #include <net/WebSocketHandler.hpp>
 #include <wsd/COOLWSD.hpp>
+#include <wsd/ConvertCache.hpp>
+#include <wsd/DocumentCache.hpp>
 #include <wsd/Exceptions.hpp>
+#include <wsd/TileCache.hpp>
 
 #include <fnmatch.h>
 #include <dirent.h>
@@ -164,6 +167,21 @@ void Document::setLastJiffies(size_t newJ)
     _lastJiffyTime = now;
 }
 
+void Document::setTileCacheStats(uint64_t lookups, uint64_t hits, uint64_t evictions,
+                                 uint64_t compactions, std::vector<uint64_t> chainLengths)
+{
+    const auto now = std::chrono::steady_clock::now();
+    auto sinceMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - _tileCacheStatsTime).count();
+    if (_tileCacheStatsTime.time_since_epoch().count() && sinceMs > 0 && evictions >= _tileCacheEvictions)
+        _tileCacheEvictionsPerSec = 1000.0 * (evictions - _tileCacheEvictions) / sinceMs;
+    _tileCacheLookups = lookups;
+    _tileCacheHits = hits;
+    _tileCacheEvictions = evictions;
+    _tileCacheCompactions = compactions;
+    _tileCacheChainLengths = std::move(chainLengths);
+    _tileCacheStatsTime = now;
+}
+
 bool Subscriber::notify(const std::string& message)
 {
     // If there is no socket, then return false to
@@ -501,6 +519,18 @@ void AdminModel::addBytes(const std::string& docKey, uint64_t sent, uint64_t rec
     _recvBytesTotal += recv;
 }
 
+void AdminModel::setDocTileCacheStats(const std::string& docKey, uint64_t lookups, uint64_t hits,
+                                      uint64_t evictions, uint64_t compactions,
+                                      std::vector<uint64_t> chainLengths)
+{
+    ASSERT_CORRECT_THREAD_OWNER(_owner);
+
+    auto doc = _documents.find(docKey);
+    if (doc != _documents.end())
+        doc->second->setTileCacheStats(lookups, hits, evictions, compactions,
+                                       std::move(chainLengths));
+}
+
 void AdminModel::modificationAlert(const std::string& docKey, pid_t pid, bool value)
 {
     ASSERT_CORRECT_THREAD_OWNER(_owner);
@@ -1233,6 +1263,12 @@ void AdminModel::getMetrics(std::ostringstream &oss)
     oss << "error_parse_error " << ParseError::count << "\n";
     oss << std::endl;
 
+    DocumentCache::dumpMetrics(oss);
+    oss << std::endl;
+
+    ConvertCache::dumpMetrics(oss);
+    oss << std::endl;
+
     int tick_per_sec = sysconf(_SC_CLK_TCK);
     // dump document data
     for (const auto& it : _documents)
@@ -1257,6 +1293,15 @@ void AdminModel::getMetrics(std::ostringstream &oss)
         oss << "doc_idle_time_seconds" << suffix << doc.getIdleTime() << "\n";
         oss << "doc_download_time_seconds" << suffix << ((double)doc.getWopiDownloadDuration().count() / 1000) << "\n";
         oss << "doc_upload_time_seconds" << suffix << ((double)doc.getWopiUploadDuration().count() / 1000) << "\n";
+        oss << "doc_tile_cache_hit_ratio" << suffix << doc.getTileCacheHitRatio() << "\n";
+        oss << "doc_tile_cache_evictions_per_second" << suffix << doc.getTileCacheEvictionsPerSec() << "\n";
+        oss << "doc_tile_cache_compactions" << suffix << doc.getTileCacheCompactions() << "\n";
+        const std::vector<uint64_t>& chainLengths = doc.getTileCacheChainLengths();
+        for (std::size_t i = 0; i < chainLengths.size(); ++i)
+        {
+            oss << "doc_tile_cache_delta_chains{pid=\"" << pid << "\",deltas=\""
+                << TileCache::getChainLengthBucketName(i) << "\"} " << chainLengths[i] << "\n";
+        }
         oss << std::endl;
     }
 }
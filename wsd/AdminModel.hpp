@@ -174,6 +174,11 @@ public:
         , _recvBytes(0)
         , _wopiDownloadDuration(0)
         , _wopiUploadDuration(0)
+        , _tileCacheLookups(0)
+        , _tileCacheHits(0)
+        , _tileCacheEvictions(0)
+        , _tileCacheEvictionsPerSec(0)
+        , _tileCacheCompactions(0)
         , _procSMaps(nullptr)
         , _lastTimeSMapsRead(0)
         , _badBehaviorDetectionTime(0)
@@ -249,6 +254,15 @@ public:
     std::chrono::milliseconds getWopiDownloadDuration() const { return _wopiDownloadDuration; }
     void setWopiUploadDuration(const std::chrono::milliseconds wopiUploadDuration) { _wopiUploadDuration = wopiUploadDuration; }
     std::chrono::milliseconds getWopiUploadDuration() const { return _wopiUploadDuration; }
+    void setTileCacheStats(uint64_t lookups, uint64_t hits, uint64_t evictions,
+                           uint64_t compactions, std::vector<uint64_t> chainLengths);
+    double getTileCacheHitRatio() const
+    {
+        return _tileCacheLookups ? static_cast<double>(_tileCacheHits) / _tileCacheLookups : 0;
+    }
+    double getTileCacheEvictionsPerSec() const { return _tileCacheEvictionsPerSec; }
+    uint64_t getTileCacheCompactions() const { return _tileCacheCompactions; }
+    const std::vector<uint64_t>& getTileCacheChainLengths() const { return _tileCacheChainLengths; }
     void setProcSMapsFD(const int smapsFD) { _procSMaps = fdopen(smapsFD, "r"); }
     bool hasMemDirtyChanged() const { return _hasMemDirtyChanged; }
     void setMemDirtyChanged(bool changeStatus) { _hasMemDirtyChanged = changeStatus; }
@@ -283,6 +297,17 @@ private:
     std::chrono::milliseconds _wopiDownloadDuration;
     std::chrono::milliseconds _wopiUploadDuration;
 
+    /// Tile cache counters, and the eviction rate since their last update.
+    uint64_t _tileCacheLookups;
+    uint64_t _tileCacheHits;
+    uint64_t _tileCacheEvictions;
+    double _tileCacheEvictionsPerSec;
+    /// Keyframes requested to compact delta chains, and the
+    /// number of tiles by chain length (see TileCache::getChainLengthCounts).
+    uint64_t _tileCacheCompactions;
+    std::vector<uint64_t> _tileCacheChainLengths;
+    std::chrono::steady_clock::time_point _tileCacheStatsTime;
+
     FILE* _procSMaps;
     std::time_t _lastTimeSMapsRead;
 
@@ -403,6 +428,10 @@ public:
 
     void addBytes(const std::string& docKey, uint64_t sent, uint64_t recv);
 
+    void setDocTileCacheStats(const std::string& docKey, uint64_t lookups, uint64_t hits,
+                              uint64_t evictions, uint64_t compactions,
+                              std::vector<uint64_t> chainLengths);
+
     uint64_t getSentBytesTotal() { return _sentBytesTotal; }
     uint64_t getRecvBytesTotal() { return _recvBytesTotal; }
 
@@ -73,6 +73,8 @@
 #include "Admin.hpp"
 #include "Auth.hpp"
 #include "CacheUtil.hpp"
+#include "ConvertCache.hpp"
+#include "DocumentCache.hpp"
 #include "FileServer.hpp"
 #include "UserMessages.hpp"
 #include <wsd/RemoteConfig.hpp>
@@ -171,6 +173,12 @@ static std::mutex NewChildrenMutex;
 static std::condition_variable NewChildrenCV;
 static std::vector<std::shared_ptr<ChildProcess> > NewChildren;
 
+#if !MOBILEAPP
+// Tracks the conversion Kits waiting for the next conversion.
+static std::mutex WarmChildrenMutex;
+static std::vector<std::shared_ptr<ChildProcess>> WarmChildren;
+#endif
+
 static std::atomic<int> TotalOutstandingForks(0);
 std::map<std::string, int> OutstandingForks;
 std::map<std::string, std::chrono::steady_clock::time_point> LastForkRequestTimes;
@@ -825,7 +833,8 @@ static std::shared_ptr<TerminatingPoll> WebServerPoll;
 class PrisonPoll : public TerminatingPoll
 {
 public:
-    PrisonPoll() : TerminatingPoll("prisoner_poll") {}
+    /// One socket per Kit process, possibly hundreds; use epoll.
+    PrisonPoll() : TerminatingPoll("prisoner_poll", Backend::Epoll) {}
 
     /// Check prisoners are still alive and balanced.
     void wakeupHook() override;
@@ -992,6 +1001,65 @@ std::shared_ptr<ChildProcess> getNewChild_Blocks(SocketPoll &destPoll, const std
     return nullptr;
 }
 
+#if !MOBILEAPP
+std::shared_ptr<ChildProcess> getWarmChild(SocketPoll& destPoll, const std::string& configId)
+{
+    std::unique_lock<std::mutex> lock(WarmChildrenMutex);
+
+    // The most recently used first, it's the most likely to be still in memory.
+    auto it = WarmChildren.rbegin();
+    while (it != WarmChildren.rend())
+    {
+        if ((*it)->getConfigId() != configId)
+        {
+            ++it;
+            continue;
+        }
+
+        std::shared_ptr<ChildProcess> child = *it;
+        it = std::make_reverse_iterator(WarmChildren.erase(std::next(it).base()));
+        if (!child->isAlive())
+        {
+            LOG_WRN("getWarmChild: Removing dead warm child [" << child->getPid() << "].");
+            continue;
+        }
+
+        const std::size_t available = WarmChildren.size();
+        lock.unlock();
+
+        LOG_DBG("getWarmChild: Have " << available << " warm "
+                                      << (available == 1 ? "child" : "children")
+                                      << " after popping [" << child->getPid() << "], after "
+                                      << child->getDocumentCount() << " documents");
+
+        // Change ownership now.
+        child->moveSocketFromTo(PrisonerPoll, destPoll);
+        return child;
+    }
+
+    return nullptr;
+}
+
+bool putWarmChild(const std::shared_ptr<ChildProcess>& child, SocketPoll& fromPoll,
+                  std::size_t maxWarmChildren)
+{
+    std::lock_guard<std::mutex> lock(WarmChildrenMutex);
+
+    if (!PrisonerPoll || SigUtil::getShutdownRequestFlag() ||
+        WarmChildren.size() >= maxWarmChildren)
+        return false;
+
+    // Detach while locked, lest the next conversion takes it before it's in the PrisonerPoll.
+    child->detachDocumentBroker(fromPoll, *PrisonerPoll);
+    WarmChildren.push_back(child);
+
+    LOG_DBG("putWarmChild: Have " << WarmChildren.size() << " warm "
+                                  << (WarmChildren.size() == 1 ? "child" : "children")
+                                  << " after pushing [" << child->getPid() << ']');
+    return true;
+}
+#endif
+
 #ifdef __linux__
 #if !MOBILEAPP
 class InotifySocket : public Socket
@@ -1185,6 +1253,11 @@ void COOLWSD::requestTerminateSpareKits()
                 const int count = NewChildren.size();
                 for (int i = count - 1; i >= 0; --i)
                     NewChildren[i]->requestTermination();
+
+                std::lock_guard<std::mutex> warmLock(WarmChildrenMutex);
+                for (const auto& child : WarmChildren)
+                    child->requestTermination();
+                WarmChildren.clear();
             });
     }
 }
@@ -1411,6 +1484,11 @@ void COOLWSD::innerInitialize(Poco::Util::Application& self)
             }
         }
     }
+    else if (ConfigUtil::getConfigValue<bool>(conf, "logging.async", false))
+    {
+        // Only for the console, and only here, as ForKit must not start threads.
+        logProperties.emplace("async", "true");
+    }
 
     // Do the same for ui command logging
     const bool logToFileUICmd =
@@ -1812,6 +1890,54 @@ void COOLWSD::innerInitialize(Poco::Util::Application& self)
         LOG_INF("Quarantine is disabled in config");
     }
 
+    if (ConfigUtil::getConfigValue<bool>(conf, "document_cache[@enable]", false))
+    {
+        const std::string path =
+            Util::trimmed(ConfigUtil::getPathFromConfig("document_cache.path"));
+        LOG_INF("Document cache path is set to [" << path << "] in config");
+        if (path.empty())
+        {
+            LOG_WRN("Document caching is enabled via document_cache config, but no path is set "
+                    "in document_cache.path. Disabling document cache");
+        }
+        else
+        {
+            try
+            {
+                DocumentCache::initialize(path);
+            }
+            catch (const std::exception& ex)
+            {
+                LOG_ERR("Failed to initialize the document cache at [" << path
+                                                                       << "]: " << ex.what());
+            }
+        }
+    }
+
+    if (ConfigUtil::getConfigValue<bool>(conf, "convert_cache[@enable]", false))
+    {
+        const std::string path =
+            Util::trimmed(ConfigUtil::getPathFromConfig("convert_cache.path"));
+        LOG_INF("Convert cache path is set to [" << path << "] in config");
+        if (path.empty())
+        {
+            LOG_WRN("Conversion caching is enabled via convert_cache config, but no path is set "
+                    "in convert_cache.path. Disabling convert cache");
+        }
+        else
+        {
+            try
+            {
+                ConvertCache::initialize(path);
+            }
+            catch (const std::exception& ex)
+            {
+                LOG_ERR("Failed to initialize the convert cache at [" << path
+                                                                      << "]: " << ex.what());
+            }
+        }
+    }
+
     {
         // creating cache directory
         std::string path = Util::trimmed(ConfigUtil::getPathFromConfig("cache_files.path"));
@@ -1872,6 +1998,20 @@ void COOLWSD::innerInitialize(Poco::Util::Application& self)
     }
     LOG_INF("MAX_CONCURRENCY set to " << maxConcurrency << '.');
 
+    // Machine-wide, shared by the Kits through ForKit; 0 for the number of CPU threads.
+    const int maxEncoderThreads =
+        ConfigUtil::getConfigValue<int>(conf, "max_encoder_threads", 0);
+    setenv("MAX_ENCODER_THREADS", std::to_string(maxEncoderThreads).c_str(), 1);
+    LOG_INF("MAX_ENCODER_THREADS set to " << maxEncoderThreads << '.');
+
+    const int tileStreamBatch =
+        ConfigUtil::getConfigValue<int>(conf, "per_document.tile_stream_batch", 0);
+    if (tileStreamBatch > 0)
+    {
+        setenv("TILE_STREAM_BATCH", std::to_string(tileStreamBatch).c_str(), 1);
+        LOG_INF("TILE_STREAM_BATCH set to " << tileStreamBatch << '.');
+    }
+
     // It is worth avoiding configuring with a large number of under-weight
     // containers / VMs - better to have fewer, stronger ones.
     if (threads < 4)
@@ -2113,7 +2253,9 @@ void COOLWSD::innerInitialize(Poco::Util::Application& self)
         std::make_unique<FileServerRequestHandler>(COOLWSD::FileServerRoot);
 #endif
 
-    WebServerPoll = std::make_unique<TerminatingPoll>("websrv_poll");
+    // Holds every connection that isn't (yet) attached to a document.
+    WebServerPoll =
+        std::make_unique<TerminatingPoll>("websrv_poll", SocketPoll::Backend::Epoll);
 
 #if !MOBILEAPP
     net::AsyncDNS::startAsyncDNS();
@@ -3053,7 +3195,10 @@ private:
                 else if (param.first == "configid")
                     configId = param.second;
                 else if (param.first == "version")
+                {
                     COOLWSD::LOKitVersion = param.second;
+                    ConvertCache::setCoreVersion(param.second);
+                }
             }
 
             if (pid <= 0)
@@ -3303,6 +3448,9 @@ public:
            << "\n  TerminationFlag: " << SigUtil::getTerminationFlag()
            << "\n  isShuttingDown: " << SigUtil::getShutdownRequestFlag()
            << "\n  NewChildren: " << NewChildren.size() << " (" << NewChildren.capacity() << ')'
+#if !MOBILEAPP
+           << "\n  WarmChildren: " << WarmChildren.size()
+#endif
            << "\n  OutstandingForks: " << TotalOutstandingForks
            << "\n  NumPreSpawnedChildren: " << COOLWSD::NumPreSpawnedChildren
            << "\n  ChildSpawnTimeoutMs: " << ChildSpawnTimeoutMs.load()
@@ -3376,6 +3524,9 @@ public:
 
         os << '\n';
         COOLWSD::FileRequestHandler->dumpState(os);
+
+        os << '\n';
+        DocumentBroker::dumpPollPoolState(os);
 #endif
 
         os << "\nDocument Broker polls " << "[ " << DocBrokers.size() << " ]:\n";
@@ -3649,6 +3800,17 @@ int COOLWSD::innerMain()
 
     TmpFontDir = ChildRoot + JailUtil::CHILDROOT_TMP_INCOMING_PATH;
 
+#if !MOBILEAPP
+    // Run the polls of the documents on a few threads, rather than a thread each.
+    const int pollPoolThreads =
+        ConfigUtil::getConfigValue<int>("per_document.poll_pool_threads", 0);
+    if (pollPoolThreads > 0)
+    {
+        LOG_INF("Running the document polls on " << pollPoolThreads << " threads");
+        DocumentBroker::startPollPool(pollPoolThreads);
+    }
+#endif
+
     // Start the internal prisoner server and spawn forkit,
     // which in turn forks first child.
     Server->startPrisoners();
@@ -3953,6 +4115,10 @@ int COOLWSD::innerMain()
         DocBrokers.clear();
     }
 
+#if !MOBILEAPP
+    DocumentBroker::stopPollPool();
+#endif
+
     SigUtil::addActivity("save traces");
 
     if (TraceEventFile != NULL)
@@ -3998,6 +4164,9 @@ int COOLWSD::innerMain()
 
     SigUtil::addActivity("async DNS stopped");
 
+    // Its lookups call back into the WebServerPoll.
+    ConvertCache::uninitialize();
+
     WebServerPoll.reset();
 
     // Terminate child processes
@@ -4009,6 +4178,15 @@ int COOLWSD::innerMain()
 
     NewChildren.clear();
 
+#if !MOBILEAPP
+    for (auto& child : WarmChildren)
+    {
+        child->terminate();
+    }
+
+    WarmChildren.clear();
+#endif
+
     SigUtil::addActivity("terminated unused children");
 
     ClientRequestDispatcher::uninitialize();
@@ -4190,6 +4368,15 @@ std::set<pid_t> COOLWSD::getSpareKitPids()
                 pids.emplace(pid);
         }
     }
+    {
+        std::unique_lock<std::mutex> lock(WarmChildrenMutex);
+        for (const auto& child : WarmChildren)
+        {
+            pid = child->getPid();
+            if (pid > 0)
+                pids.emplace(pid);
+        }
+    }
     return pids;
 }
 
@@ -44,6 +44,18 @@ class TraceFileWriter;
 std::shared_ptr<ChildProcess> getNewChild_Blocks(SocketPoll &destPoll, const std::string& configId,
                                                  unsigned mobileAppDocId);
 
+#if !MOBILEAPP
+/// Returns a Kit kept by putWarmChild(), if any, for the given config,
+/// moving its socket to @destPoll.
+std::shared_ptr<ChildProcess> getWarmChild(SocketPoll& destPoll, const std::string& configId);
+
+/// Keeps the Kit, done with its document, for getWarmChild(), unless we
+/// have @maxWarmChildren already. Called from the thread of @fromPoll,
+/// the poll of its DocumentBroker, which gives it up.
+bool putWarmChild(const std::shared_ptr<ChildProcess>& child, SocketPoll& fromPoll,
+                  std::size_t maxWarmChildren);
+#endif
+
 /// The Server class which is responsible for all
 /// external interactions.
 class COOLWSD final : public Poco::Util::ServerApplication,
@@ -36,6 +36,8 @@
 #include <net/AsyncDNS.hpp>
 #include <net/HttpHelper.hpp>
 #include <wsd/ClientRequestDispatcher.hpp>
+#include <wsd/ConvertBatch.hpp>
+#include <wsd/ConvertCache.hpp>
 #include <wsd/DocumentBroker.hpp>
 #include <wsd/RequestVettingStation.hpp>
 #if !MOBILEAPP
@@ -217,6 +219,48 @@ public:
     }
 };
 
+/// Returns the path to store the uploaded file, of the given filename,
+/// at in a new temporary directory under the child-root.
+std::string getIncomingFilePath(const std::string& fileParam)
+{
+    // The temporary directory is child-root/<CHILDROOT_TMP_INCOMING_PATH>.
+    // Always create a random sub-directory to avoid file-name collision.
+    Poco::Path tempPath = Poco::Path::forDirectory(
+        FileUtil::createRandomTmpDir(COOLWSD::ChildRoot + JailUtil::CHILDROOT_TMP_INCOMING_PATH) +
+        '/');
+    LOG_TRC("Created temporary convert-to/insert path: " << tempPath.toString());
+
+    // Prevent user inputting anything funny here.
+    std::string cleanFilename = Util::cleanupFilename(fileParam);
+    if (fileParam != cleanFilename)
+        LOG_DBG("Unexpected characters in conversion filename '"
+                << fileParam << "' cleaned to '" << cleanFilename << "'");
+
+    // A "filename" should always be a filename, not a path
+    const Poco::Path filenameParam(cleanFilename);
+    if (filenameParam.getFileName() == "callback:")
+        tempPath.setFileName("incoming_file"); // A sensible name.
+    else
+        tempPath.setFileName(filenameParam.getFileName()); //TODO: Sanitize.
+    return tempPath.toString();
+}
+
+/// Stores the uploaded file, of the given filename, from @stream in
+/// a new temporary directory under the child-root. Returns its path.
+std::string storeIncomingFile(const std::string& fileParam, std::istream& stream)
+{
+    const std::string filename = getIncomingFilePath(fileParam);
+    LOG_DBG("Storing incoming file to: " << filename);
+
+    // Copy the stream to filename.
+    std::ofstream fileStream;
+    fileStream.open(filename);
+    Poco::StreamCopier::copyStream(stream, fileStream);
+    fileStream.close();
+
+    return filename;
+}
+
 /// Handles the filename part of the convert-to POST request payload,
 /// Also owns the file - cleaning it up when destroyed.
 class ConvertToPartHandler : public Poco::Net::PartHandler
@@ -254,35 +298,398 @@ public:
         if (!params.has("filename"))
             return;
 
-        // The temporary directory is child-root/<CHILDROOT_TMP_INCOMING_PATH>.
-        // Always create a random sub-directory to avoid file-name collision.
-        Poco::Path tempPath = Poco::Path::forDirectory(
-            FileUtil::createRandomTmpDir(COOLWSD::ChildRoot +
-                                         JailUtil::CHILDROOT_TMP_INCOMING_PATH) +
-            '/');
-        LOG_TRC("Created temporary convert-to/insert path: " << tempPath.toString());
-
-        // Prevent user inputting anything funny here.
-        std::string fileParam = params.get("filename");
-        std::string cleanFilename = Util::cleanupFilename(fileParam);
-        if (fileParam != cleanFilename)
-            LOG_DBG("Unexpected characters in conversion filename '"
-                    << fileParam << "' cleaned to '" << cleanFilename << "'");
-
-        // A "filename" should always be a filename, not a path
-        const Poco::Path filenameParam(cleanFilename);
-        if (filenameParam.getFileName() == "callback:")
-            tempPath.setFileName("incoming_file"); // A sensible name.
-        else
-            tempPath.setFileName(filenameParam.getFileName()); //TODO: Sanitize.
-        _filename = tempPath.toString();
-        LOG_DBG("Storing incoming file to: " << _filename);
+        _filename = storeIncomingFile(params.get("filename"), stream);
+    }
+};
+
+/// Receives the multipart/form-data body of a convert-to-batch request as it
+/// arrives, writing each uploaded document straight to its own file, rather
+/// than waiting for the whole request in memory. Only the other form fields
+/// are kept in memory. Replaces the ClientRequestDispatcher of the client's
+/// socket, which it hands over to the ConvertBatch once all is received.
+/// Also owns the files - cleaning them up when destroyed.
+class ConvertBatchReceiver final : public SimpleSocketHandler
+{
+    /// Where we are in the body.
+    enum class State
+    {
+        Preamble, ///< Before the first boundary.
+        Boundary, ///< After a boundary, followed by a part, unless it's the last.
+        Headers, ///< In the headers of a part.
+        Content, ///< In the content of a part.
+        Epilogue ///< After the last boundary.
+    };
+
+    /// Where we are in a chunked body.
+    enum class ChunkState
+    {
+        Size, ///< In the line with the size of the next chunk.
+        Data, ///< In the data of a chunk.
+        DataEnd, ///< After the data of a chunk, before its CRLF.
+        Trailer ///< After the last chunk.
+    };
+
+    /// The limit on the headers of a part, and on the form fields, which we keep in memory.
+    static constexpr std::size_t MaxFieldSize = 64 * 1024;
+
+    std::weak_ptr<StreamSocket> _socket;
+    const std::string _delimiter; ///< The boundary, after a CRLF, before each part.
+    const bool _chunked;
+    std::size_t _remaining; ///< The bytes of the body, or the chunk, yet to be received.
+    std::size_t _received; ///< The bytes of the body received.
+    const std::size_t _maxSize; ///< 0 for unlimited.
+    const std::size_t _maxFiles; ///< 0 for unlimited.
+    const std::string _format; ///< The format in the URI, if any.
+    State _state;
+    ChunkState _chunkState;
+    bool _complete; ///< True once all of the body is received.
+    std::string _body; ///< What is received, but not parsed yet.
+    std::map<std::string, std::string> _fields;
+    std::string _fieldName; ///< The name of the field being received, unless a file.
+    std::string _fieldValue;
+    std::ofstream _file; ///< The file being received, if any.
+    std::vector<std::string> _filenames;
+
+public:
+    /// Receives the body of @contentLength bytes, unless @chunked, of at most @maxSize.
+    ConvertBatchReceiver(const std::string& boundary, bool chunked, std::size_t contentLength,
+                         std::size_t maxSize, std::size_t maxFiles, std::string format)
+        : _delimiter("\r\n--" + boundary)
+        , _chunked(chunked)
+        , _remaining(chunked ? 0 : contentLength)
+        , _received(0)
+        , _maxSize(maxSize)
+        , _maxFiles(maxFiles)
+        , _format(std::move(format))
+        , _state(State::Preamble)
+        , _chunkState(ChunkState::Size)
+        , _complete(false)
+    {
+    }
+
+    ~ConvertBatchReceiver()
+    {
+        for (const std::string& filename : _filenames)
+        {
+            LOG_TRC("Remove un-handled temporary file '" << filename << '\'');
+            StatelessBatchBroker::removeFile(filename);
+        }
+    }
+
+private:
+    void onConnect(const std::shared_ptr<StreamSocket>& socket) override
+    {
+        _socket = socket;
+        setLogContext(socket->getFD());
+    }
 
-        // Copy the stream to _filename.
-        std::ofstream fileStream;
-        fileStream.open(_filename);
-        Poco::StreamCopier::copyStream(stream, fileStream);
-        fileStream.close();
+    void handleIncomingMessage(SocketDisposition& /* disposition */) override
+    {
+        std::shared_ptr<StreamSocket> socket = _socket.lock();
+        if (!socket || _complete)
+            return;
+
+        if (!receive(socket->getInBuffer()))
+        {
+            LOG_INF("Invalid, or too large, batch conversion request");
+            HttpHelper::sendErrorAndShutdown(http::StatusCode::BadRequest, socket);
+            return;
+        }
+
+        std::size_t consumed = 0;
+        const bool valid = parse(_body, consumed);
+        _body.erase(0, consumed);
+        if (!valid || (_complete && _state != State::Epilogue))
+        {
+            LOG_INF("Invalid, or too many documents in, batch conversion request");
+            HttpHelper::sendErrorAndShutdown(http::StatusCode::BadRequest, socket);
+            return;
+        }
+
+        if (_complete)
+            finish(socket);
+    }
+
+    int getPollEvents(std::chrono::steady_clock::time_point /* now */,
+                      int64_t& /* timeoutMaxMicroS */) override
+    {
+        return POLLIN;
+    }
+
+    void performWrites(std::size_t /* capacity */) override {}
+
+    void onDisconnect() override
+    {
+        if (!_complete)
+            LOG_WRN("Client disconnected after " << _received
+                                                 << " bytes of the batch conversion request");
+    }
+
+    /// Moves what we have of the body from @data to _body, without the chunking,
+    /// if any. Returns false if invalid.
+    bool receive(Buffer& data)
+    {
+        while (!_complete && !data.empty())
+        {
+            const std::string_view rest(data.data(), data.size());
+            if (!_chunked || _chunkState == ChunkState::Data)
+            {
+                const std::size_t size = std::min(rest.size(), _remaining);
+                _body.append(rest.data(), size);
+                data.eraseFirst(size);
+                _remaining -= size;
+                _received += size;
+                if (_maxSize > 0 && _received > _maxSize)
+                    return false;
+
+                if (_remaining == 0)
+                {
+                    _complete = !_chunked;
+                    _chunkState = ChunkState::DataEnd;
+                }
+
+                continue;
+            }
+
+            if (_chunkState == ChunkState::DataEnd)
+            {
+                if (rest.size() < 2)
+                    return true;
+
+                if (!rest.starts_with("\r\n"))
+                    return false;
+
+                data.eraseFirst(2);
+                _chunkState = ChunkState::Size;
+                continue;
+            }
+
+            const std::size_t eol = rest.find("\r\n");
+            if (eol == std::string_view::npos)
+                return rest.size() <= MaxFieldSize;
+
+            if (_chunkState == ChunkState::Trailer)
+            {
+                // The trailer ends with an empty line.
+                data.eraseFirst(eol + 2);
+                _complete = (eol == 0);
+                continue;
+            }
+
+            // The size of the chunk in hex, possibly followed by extensions.
+            std::size_t size = 0;
+            std::size_t digits = 0;
+            for (; digits < eol && Util::hexDigitFromChar(rest[digits]) >= 0; ++digits)
+                size = size * 16 + Util::hexDigitFromChar(rest[digits]);
+
+            if (digits == 0 || digits > 8)
+                return false;
+
+            data.eraseFirst(eol + 2);
+            _remaining = size;
+            _chunkState = (size > 0 ? ChunkState::Data : ChunkState::Trailer);
+        }
+
+        return true;
+    }
+
+    /// Consumes as much of @data as we can, adding to @consumed. Returns false if invalid.
+    bool parse(std::string_view data, std::size_t& consumed)
+    {
+        for (;;)
+        {
+            const std::string_view rest = data.substr(consumed);
+            switch (_state)
+            {
+                case State::Preamble:
+                {
+                    // The first boundary needn't follow a CRLF.
+                    const std::string_view boundary = std::string_view(_delimiter).substr(2);
+                    const std::size_t pos = rest.find(boundary);
+                    if (pos == std::string_view::npos)
+                    {
+                        // Keep what could be the start of the boundary.
+                        if (rest.size() >= boundary.size())
+                            consumed += rest.size() - boundary.size() + 1;
+                        return true;
+                    }
+
+                    consumed += pos + boundary.size();
+                    _state = State::Boundary;
+                    break;
+                }
+                case State::Boundary:
+                {
+                    if (rest.size() < 2)
+                        return true;
+
+                    if (rest.starts_with("--"))
+                    {
+                        consumed += 2;
+                        _state = State::Epilogue;
+                    }
+                    else if (rest.starts_with("\r\n"))
+                    {
+                        // The CRLF is left to start the headers, which could be empty.
+                        _state = State::Headers;
+                    }
+                    else
+                        return false;
+                    break;
+                }
+                case State::Headers:
+                {
+                    constexpr std::string_view marker("\r\n\r\n");
+                    const std::size_t pos = rest.find(marker);
+                    if (pos == std::string_view::npos)
+                        return rest.size() <= MaxFieldSize;
+
+                    if (!startPart(rest.substr(2, pos + 2)))
+                        return false;
+
+                    consumed += pos + marker.size();
+                    _state = State::Content;
+                    break;
+                }
+                case State::Content:
+                {
+                    const std::size_t pos = rest.find(_delimiter);
+                    std::size_t size = pos;
+                    if (pos == std::string_view::npos)
+                    {
+                        // Keep what could be the start of the delimiter.
+                        size = rest.size() >= _delimiter.size()
+                                   ? rest.size() - _delimiter.size() + 1
+                                   : 0;
+                    }
+
+                    if (!appendContent(rest.substr(0, size)))
+                        return false;
+
+                    consumed += size;
+                    if (pos == std::string_view::npos)
+                        return true;
+
+                    consumed += _delimiter.size();
+                    if (!endPart())
+                        return false;
+
+                    _state = State::Boundary;
+                    break;
+                }
+                case State::Epilogue:
+                {
+                    consumed = data.size();
+                    return true;
+                }
+            }
+        }
+    }
+
+    /// Starts receiving the part with the given @headers. Returns false if invalid.
+    bool startPart(std::string_view headers)
+    {
+        Poco::MemoryInputStream stream(headers.data(), headers.size());
+        Poco::Net::MessageHeader header;
+        header.read(stream);
+
+        std::string disp;
+        Poco::Net::NameValueCollection params;
+        if (header.has("Content-Disposition"))
+        {
+            std::string cd = header.get("Content-Disposition");
+            Poco::Net::MessageHeader::splitParameters(cd, disp, params);
+        }
+
+        if (!params.has("filename"))
+        {
+            _fieldName = params.get("name", std::string());
+            _fieldValue.clear();
+            return true;
+        }
+
+        if (_maxFiles > 0 && _filenames.size() >= _maxFiles)
+        {
+            LOG_INF("Batch conversion request of more than " << _maxFiles << " documents");
+            return false;
+        }
+
+        _filenames.push_back(getIncomingFilePath(params.get("filename")));
+        LOG_DBG("Storing incoming file to: " << _filenames.back());
+        _file.open(_filenames.back(), std::ios::binary);
+        if (!_file.is_open())
+        {
+            LOG_ERR("Failed to create incoming file [" << _filenames.back() << ']');
+            return false;
+        }
+
+        return true;
+    }
+
+    bool appendContent(std::string_view content)
+    {
+        if (_file.is_open())
+        {
+            _file.write(content.data(), content.size());
+            return static_cast<bool>(_file);
+        }
+
+        if (_fieldName.empty())
+            return true; // Of no interest.
+
+        _fieldValue.append(content);
+        return _fieldValue.size() <= MaxFieldSize;
+    }
+
+    bool endPart()
+    {
+        if (_file.is_open())
+        {
+            _file.close();
+            if (!_file)
+            {
+                LOG_ERR("Failed to store incoming file [" << _filenames.back() << ']');
+                return false;
+            }
+
+            _file.clear();
+        }
+        else if (!_fieldName.empty())
+        {
+            _fields[_fieldName] = std::move(_fieldValue);
+            _fieldName.clear();
+        }
+
+        return true;
+    }
+
+    std::string getField(const std::string& name) const
+    {
+        const auto it = _fields.find(name);
+        return it != _fields.end() ? it->second : std::string();
+    }
+
+    /// Hands the socket, and the documents, over to a new ConvertBatch.
+    void finish(const std::shared_ptr<StreamSocket>& socket)
+    {
+        // Prefer what is in the URI.
+        const std::string format = _format.empty() ? getField("format") : _format;
+
+        LOG_INF("Batch conversion request for " << _filenames.size()
+                                                << " documents to format [" << format << "].");
+        if (_filenames.empty() || format.empty())
+        {
+            LOG_INF("Missing parameters for batch conversion request.");
+            HttpHelper::sendErrorAndShutdown(http::StatusCode::BadRequest, socket);
+            return;
+        }
+
+        // Allow specifying options as-is, as with convert-to.
+        std::vector<std::string> filenames = std::move(_filenames);
+        _filenames.clear();
+        ConvertBatch::start(std::make_shared<ConvertBatch>(std::move(filenames), format,
+                                                           getField("options"), getField("lang")),
+                            socket);
     }
 };
 
@@ -399,6 +806,76 @@ getConvertToBrokerImplementation(const std::string& requestType, const std::stri
     return nullptr;
 }
 
+/// Creates, and registers, the DocumentBroker to convert the upload at @fromPath.
+std::shared_ptr<ConvertToBroker>
+createConvertToBroker(const std::string& requestType, const std::string& fromPath,
+                      const std::string& format, const std::string& options,
+                      const std::string& lang, const std::string& target,
+                      const std::string& filter, const std::string& transformJSON,
+                      const std::string& cacheKey)
+{
+    Poco::URI uriPublic = RequestDetails::sanitizeURI(fromPath);
+    const std::string docKey = RequestDetails::getDocKey(uriPublic);
+
+    // This lock could become a bottleneck.
+    // In that case, we can use a pool and index by publicPath.
+    std::unique_lock<std::mutex> docBrokersLock(DocBrokersMutex);
+
+    LOG_DBG("New DocumentBroker for docKey [" << docKey << "].");
+    auto docBroker = getConvertToBrokerImplementation(requestType, fromPath, uriPublic, docKey,
+                                                      format, options, lang, target, filter,
+                                                      transformJSON);
+    docBroker->setCacheKey(cacheKey);
+
+    cleanupDocBrokers();
+
+    DocBrokers.emplace(docKey, docBroker);
+    LOG_TRC("Have " << DocBrokers.size() << " DocBrokers after inserting [" << docKey << "].");
+
+    return docBroker;
+}
+
+/// Sends the cached result of converting @fromPath, supplied next to it, as the response
+/// to a convert-to or get-thumbnail request, like the ClientSession of a conversion would.
+/// Returns true iff the result was served from the ConvertCache.
+bool sendCachedConversion(bool isThumbnail, const std::string& fromPath,
+                          const std::string& format, const std::shared_ptr<StreamSocket>& socket)
+{
+    const std::string cachedPath = fromPath + ".cached";
+
+    http::Response response(http::StatusCode::OK);
+    FileServerRequestHandler::hstsHeaders(response);
+    if (isThumbnail)
+    {
+        response.set("Last-Modified", Util::getHttpTimeNow());
+        response.set("X-Content-Type-Options", "nosniff");
+        response.setContentType("image/png");
+    }
+    else
+    {
+        Poco::Path toPath(fromPath);
+        toPath.setExtension(format);
+        response.set("Content-Disposition", "attachment; filename=\"" + toPath.getFileName() + '"');
+        response.setContentType("application/octet-stream");
+    }
+
+    LOG_INF("Sending cached conversion of [" << fromPath << ']');
+    try
+    {
+        // Thumbnails were never sent with caching headers, keep it so.
+        HttpHelper::sendFileAndShutdown(socket, cachedPath, response, /*noCache=*/isThumbnail);
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERR("Failed to send cached conversion [" << cachedPath << "]: " << ex.what());
+        FileUtil::removeFile(cachedPath);
+        return false;
+    }
+
+    FileUtil::removeFile(cachedPath);
+    return true;
+}
+
 class ConvertToAddressResolver : public std::enable_shared_from_this<ConvertToAddressResolver>
 {
     std::shared_ptr<ConvertToAddressResolver> _selfLifecycle;
@@ -694,6 +1171,10 @@ void ClientRequestDispatcher::handleIncomingMessage(SocketDisposition& dispositi
         }
 #endif
 
+    // Don't wait for all of a batch in memory, as parseHeader would.
+    if (handleConvertBatchRequest(socket))
+        return;
+
     Poco::Net::HTTPRequest request;
 
     StreamSocket::MessageMap map;
@@ -1083,7 +1564,7 @@ bool ClientRequestDispatcher::handleFaviconRequest(const RequestDetails& request
     if (!Poco::File(faviconPath).exists())
         faviconPath = COOLWSD::FileServerRoot + "/favicon.ico";
 
-    HttpHelper::sendFile(socket, faviconPath, response);
+    HttpHelper::sendStaticFile(socket, faviconPath, response);
     return true;
 }
 
@@ -1806,6 +2287,100 @@ bool ClientRequestDispatcher::isSpreadsheet(const std::string& fileName)
            sContentType == "application/vnd.ms-excel";
 }
 
+bool ClientRequestDispatcher::handleConvertBatchRequest(const std::shared_ptr<StreamSocket>& socket)
+{
+    // Rule out anything else cheaply, from the request line.
+    const Buffer& data = socket->getInBuffer();
+    const std::string_view start(data.data(), data.size());
+    const std::string_view requestLine = start.substr(0, start.find('\n'));
+    if (!start.starts_with("POST ") ||
+        requestLine.find("/convert-to-batch") == std::string_view::npos)
+    {
+        return false;
+    }
+
+    // Find the end of the header, if any.
+    constexpr std::string_view marker("\r\n\r\n");
+    const std::size_t headerSize = start.find(marker);
+    if (headerSize == std::string_view::npos)
+        return requestLine.size() < start.size(); // Wait for the rest of the header.
+
+    Poco::Net::HTTPRequest request;
+    Poco::MemoryInputStream message(data.data(), headerSize + marker.size());
+    request.read(message);
+
+    const RequestDetails requestDetails(request, COOLWSD::ServiceRoot);
+    if (requestDetails.isWebSocket() || !requestDetails.equals(1, "convert-to-batch") ||
+        !(requestDetails.equals(RequestDetails::Field::Type, "cool") ||
+          requestDetails.equals(RequestDetails::Field::Type, "lool")))
+    {
+        return false;
+    }
+
+    LOG_INF("Batch conversion request: [" << COOLWSD::anonymizeUrl(requestDetails.getURI())
+                                          << "], Content-Length: " << request.getContentLength()
+                                          << ", chunked: " << request.getChunkedTransferEncoding());
+
+    // Reject what we can before the client sends the documents.
+    if (!allowConvertTo(socket->clientAddress(), request, nullptr))
+    {
+        LOG_WRN("Conversion requests not allowed from this address: " << socket->clientAddress());
+        HttpHelper::sendErrorAndShutdown(http::StatusCode::Forbidden, socket);
+        return true;
+    }
+
+    const bool chunked = request.getChunkedTransferEncoding();
+    if (!chunked && request.getContentLength() <= 0)
+    {
+        LOG_INF("Batch conversion request without a body");
+        HttpHelper::sendErrorAndShutdown(
+            request.getContentLength() == Poco::Net::HTTPMessage::UNKNOWN_CONTENT_LENGTH
+                ? http::StatusCode::LengthRequired
+                : http::StatusCode::BadRequest,
+            socket);
+        return true;
+    }
+
+    // A chunked request is checked against the limit as it arrives.
+    const std::size_t contentLength = (chunked ? 0 : request.getContentLength());
+    const std::size_t maxSizeBytes =
+        ConfigUtil::getConfigValue<std::size_t>("per_document.convert_batch.max_upload_size_mb",
+                                                1024) *
+        1024 * 1024;
+    if (maxSizeBytes > 0 && contentLength > maxSizeBytes)
+    {
+        LOG_INF("Batch conversion request of " << contentLength << " bytes is over the limit of "
+                                               << maxSizeBytes);
+        HttpHelper::sendErrorAndShutdown(http::StatusCode::PayloadTooLarge, socket);
+        return true;
+    }
+
+    std::string mediaType;
+    Poco::Net::NameValueCollection params;
+    Poco::Net::MessageHeader::splitParameters(request.getContentType(), mediaType, params);
+    const std::string boundary = params.get("boundary", std::string());
+    if (!Util::iequal(mediaType, "multipart/form-data") || boundary.empty())
+    {
+        LOG_INF("Batch conversion request is not multipart/form-data");
+        HttpHelper::sendErrorAndShutdown(http::StatusCode::BadRequest, socket);
+        return true;
+    }
+
+    if (Util::iequal(request.get("Expect", std::string()), "100-continue"))
+    {
+        LOG_TRC("Got Expect: 100-continue, sending Continue");
+        socket->send("HTTP/1.1 100 Continue\r\n\r\n");
+    }
+
+    // The receiver takes the rest, and hands over to the ConvertBatch.
+    socket->getInBuffer().eraseFirst(headerSize + marker.size());
+    socket->setHandler(std::make_shared<ConvertBatchReceiver>(
+        boundary, chunked, contentLength, maxSizeBytes,
+        ConfigUtil::getConfigValue<std::size_t>("per_document.convert_batch.max_documents", 1000),
+        requestDetails.size() > 2 ? requestDetails[2] : std::string()));
+    return true;
+}
+
 bool ClientRequestDispatcher::handlePostRequest(const RequestDetails& requestDetails,
                                                 const Poco::Net::HTTPRequest& request,
                                                 Poco::MemoryInputStream& message,
@@ -1847,9 +2422,6 @@ bool ClientRequestDispatcher::handlePostRequest(const RequestDetails& requestDet
         LOG_INF("Conversion request for URI [" << fromPath << "] format [" << format << "].");
         if (!fromPath.empty() && hasRequiredParameters)
         {
-            Poco::URI uriPublic = RequestDetails::sanitizeURI(fromPath);
-            const std::string docKey = RequestDetails::getDocKey(uriPublic);
-
             std::string options;
             if (form.has("options"))
             {
@@ -1894,26 +2466,61 @@ bool ClientRequestDispatcher::handlePostRequest(const RequestDetails& requestDet
                 Poco::URI::encode(transformJSON, "", encodedTransformJSON);
             }
 
-            // This lock could become a bottleneck.
-            // In that case, we can use a pool and index by publicPath.
-            std::unique_lock<std::mutex> docBrokersLock(DocBrokersMutex);
-
-            LOG_DBG("New DocumentBroker for docKey [" << docKey << "].");
-            auto docBroker = getConvertToBrokerImplementation(
-                requestDetails[1], fromPath, uriPublic, docKey, format, options, lang, target,
-                filter, encodedTransformJSON);
-            handler.takeFile();
+            // Serve repeated conversions of the same document from the cache, without a Kit.
+            if (ConvertCache::isEnabled() &&
+                (requestDetails.equals(1, "convert-to") || requestDetails.equals(1, "get-thumbnail")))
+            {
+                // The hashing, and copying, is done off this thread, while the client waits.
+                handler.takeFile();
 
-            cleanupDocBrokers();
+                const std::string requestType = requestDetails[1];
+                const std::string id = _id;
+                ConvertCache::LookupFn lookupCb =
+                    [=](const std::string& cacheKey, bool hit)
+                {
+                    COOLWSD::getWebServerPoll()->addCallback(
+                        [=]()
+                        {
+                            if (hit && sendCachedConversion(requestType == "get-thumbnail",
+                                                            fromPath, format, socket))
+                            {
+                                StatelessBatchBroker::removeFile(fromPath);
+                                return;
+                            }
+
+                            FileUtil::removeFile(fromPath + ".cached");
+                            if (!COOLWSD::getWebServerPoll()->releaseSocket(socket))
+                            {
+                                LOG_INF("Client disconnected before converting [" << fromPath
+                                                                                  << ']');
+                                StatelessBatchBroker::removeFile(fromPath);
+                                return;
+                            }
+
+                            auto docBroker = createConvertToBroker(
+                                requestType, fromPath, format, options, lang, target, filter,
+                                encodedTransformJSON, cacheKey);
+                            docBroker->startConversion(socket, id);
+                        });
+                };
+
+                // Next to the upload, to be cleaned up with it.
+                ConvertCache::lookup(fromPath, requestType, format, options, lang, target,
+                                     fromPath + ".cached", lookupCb);
+                return false;
+            }
 
-            DocBrokers.emplace(docKey, docBroker);
-            LOG_TRC("Have " << DocBrokers.size() << " DocBrokers after inserting [" << docKey
-                            << "].");
+            auto docBroker = createConvertToBroker(requestDetails[1], fromPath, format, options,
+                                                   lang, target, filter, encodedTransformJSON,
+                                                   std::string());
+            handler.takeFile();
 
             if (!docBroker->startConversion(disposition, _id))
             {
                 LOG_WRN("Failed to create Client Session with id [" << _id << "] on docKey ["
-                                                                    << docKey << "].");
+                                                                    << docBroker->getDocKey()
+                                                                    << "].");
+                std::unique_lock<std::mutex> docBrokersLock(DocBrokersMutex);
                 cleanupDocBrokers();
             }
         }
@@ -2418,7 +3025,10 @@ static std::string getCapabilitiesJson(bool convertToAvailable)
     Poco::Dynamic::Var available = convertToAvailable;
     convert_to->set("available", available);
     if (available)
+    {
         convert_to->set("endpoint", "/cool/convert-to");
+        convert_to->set("batchEndpoint", "/cool/convert-to-batch");
+    }
 
     Poco::JSON::Object::Ptr capabilities = new Poco::JSON::Object;
     capabilities->set("convert-to", convert_to);
@@ -104,6 +104,10 @@ private:
 
     static bool isSpreadsheet(const std::string& fileName);
 
+    /// Takes over a convert-to-batch request as soon as its header arrives,
+    /// to receive its body straight to disk. @return true if it is one.
+    bool handleConvertBatchRequest(const std::shared_ptr<StreamSocket>& socket);
+
     /// @return true if request has been handled synchronously and response sent, otherwise false
     bool handlePostRequest(const RequestDetails& requestDetails,
                            const Poco::Net::HTTPRequest& request, Poco::MemoryInputStream& message,
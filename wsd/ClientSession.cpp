@@ -30,6 +30,7 @@
 #include <Poco/JSON/Parser.h>
 
 #include "ConfigUtil.hpp"
+#include "ConvertCache.hpp"
 #include "DocumentBroker.hpp"
 #include "COOLWSD.hpp"
 #include "FileServer.hpp"
@@ -860,6 +861,10 @@ bool ClientSession::_handleInput(const char *buffer, int length)
     {
         return sendFontRendering(buffer, length, tokens, docBroker);
     }
+    else if (tokens.equals(0, "getslide"))
+    {
+        return sendSlide(buffer, length, tokens, docBroker);
+    }
     else if (tokens.equals(0, "status") || tokens.equals(0, "statusupdate"))
     {
         assert(firstLine.size() == static_cast<std::size_t>(length));
@@ -980,6 +985,8 @@ bool ClientSession::_handleInput(const char *buffer, int length)
         }
 
         _clientVisibleArea = Util::Rectangle(x, y, width, height);
+        _tracker.updateViewPort(getNormalizedVisiblePaneAreas(), _tileWidthTwips,
+                                _tileHeightTwips, getCanonicalViewId());
         return forwardToChild(std::string(buffer, length), docBroker);
     }
     else if (tokens.equals(0, "setclientpart"))
@@ -1054,6 +1061,8 @@ bool ClientSession::_handleInput(const char *buffer, int length)
         _tileHeightPixel = tilePixelHeight;
         _tileWidthTwips = tileTwipWidth;
         _tileHeightTwips = tileTwipHeight;
+        _tracker.updateViewPort(getNormalizedVisiblePaneAreas(), _tileWidthTwips,
+                                _tileHeightTwips, getCanonicalViewId());
         return forwardToChild(std::string(buffer, length), docBroker);
     }
     else if (tokens.equals(0, "tileprocessed"))
@@ -1294,7 +1303,6 @@ bool ClientSession::_handleInput(const char *buffer, int length)
              tokens.equals(0, "urp") ||
              tokens.equals(0, "useractive") ||
              tokens.equals(0, "userinactive") ||
-             tokens.equals(0, "getslide") ||
              tokens.equals(0, "paintwindow") ||
              tokens.equals(0, "windowcommand") ||
              tokens.equals(0, "asksignaturestatus") ||
@@ -1784,6 +1792,58 @@ bool ClientSession::sendFontRendering(const char *buffer, int length, const Stri
     return forwardToChild(std::string(buffer, length), docBroker);
 }
 
+bool ClientSession::sendSlide(const char* buffer, int length, const StringVector& tokens,
+                              const std::shared_ptr<DocumentBroker>& docBroker)
+{
+    if (!docBroker->hasTileCache() || getCanonicalViewId() == CanonicalViewId::None)
+        return forwardToChild(std::string(buffer, length), docBroker);
+
+    // The layers depend only on the request and the view's
+    // rendering options, including the watermark.
+    const std::string key =
+        std::to_string(to_underlying(getCanonicalViewId())) + ' ' + tokens.cat(' ', 1);
+
+    TileCache& tileCache = docBroker->tileCache();
+    if (const TileCache::SlideLayers* layers = tileCache.lookupSlideLayers(key))
+    {
+        for (const std::shared_ptr<Message>& layer : *layers)
+            forwardToClient(layer);
+        return true;
+    }
+
+    if (tileCache.subscribeToSlideRendering(key, client_from_this(),
+                                            std::chrono::steady_clock::now()))
+    {
+        // Another view is rendering it; we'll get a copy.
+        return true;
+    }
+
+    _slideRenderingKeys.push_back(key);
+    return forwardToChild(std::string(buffer, length), docBroker);
+}
+
+void ClientSession::abandonSlideRendering(const std::shared_ptr<DocumentBroker>& docBroker)
+{
+    if (!docBroker->hasTileCache())
+        return;
+
+    const auto now = std::chrono::steady_clock::now();
+    for (const std::string& key : _slideRenderingKeys)
+    {
+        const std::shared_ptr<ClientSession> session =
+            docBroker->tileCache().handOverSlideRendering(key, this, now);
+        if (session)
+        {
+            // The key is the CanonicalViewId, which is the same, followed by the arguments.
+            session->_slideRenderingKeys.push_back(key);
+            session->forwardToChild("getslide " + key.substr(key.find(' ') + 1), docBroker);
+        }
+    }
+
+    _slideRenderingKeys.clear();
+    _slideLayers.clear();
+}
+
 bool ClientSession::sendTile(const char * /*buffer*/, int /*length*/, const StringVector& tokens,
                              const std::shared_ptr<DocumentBroker>& docBroker)
 {
@@ -1947,7 +2007,9 @@ void ClientSession::writeQueuedMessages(std::size_t capacity)
 
             if (item->isBinary())
             {
-                Session::sendBinaryFrame(data.data(), size);
+                // Messages are not modified once queued, and may be queued
+                // to many sessions (eg. tiles), so send them by reference.
+                Session::sendSharedBinaryFrame(item, data.data(), size);
             }
             else
             {
@@ -2177,6 +2239,16 @@ bool ClientSession::handleKitToClientMessage(const std::shared_ptr<Message>& pay
                     return false;
                 }
             }
+            else if (errorCommand == "getslide" && !_slideRenderingKeys.empty())
+            {
+                // No sliderenderingcomplete: will follow, let the followers know.
+                LOG_ERR(errorCommand << " error failure: " << errorKind);
+                _slideLayers.push_back(payload);
+                docBroker->tileCache().saveSlideLayersAndNotify(
+                    _slideRenderingKeys.front(), std::move(_slideLayers), /*success=*/false);
+                _slideLayers.clear();
+                _slideRenderingKeys.pop_front();
+            }
             else
             {
                 LOG_ERR(errorCommand << " error failure: " << errorKind);
@@ -2307,6 +2379,9 @@ bool ClientSession::handleKitToClientMessage(const std::shared_ptr<Message>& pay
                     response.set("Content-Disposition", "attachment; filename=\"" + fileName + '"');
                 response.setContentType("application/octet-stream");
 
+                // Only links it here, before we respond and remove the jail, copied later.
+                ConvertCache::cacheResult(_convertCacheKey, resultURL.getPath());
+
                 HttpHelper::sendFileAndShutdown(_saveAsSocket, resultURL.getPath(), response);
             }
 
@@ -2763,6 +2838,25 @@ bool ClientSession::handleKitToClientMessage(const std::shared_ptr<Message>& pay
                                               payload->data().size() - firstLine.size() - 1);
             return forwardToClient(payload);
         }
+        else if (tokens.equals(0, "slidelayer:"))
+        {
+            if (!_slideRenderingKeys.empty())
+                _slideLayers.push_back(payload);
+            return forwardToClient(payload);
+        }
+        else if (tokens.equals(0, "sliderenderingcomplete:"))
+        {
+            if (!_slideRenderingKeys.empty())
+            {
+                _slideLayers.push_back(payload);
+                docBroker->tileCache().saveSlideLayersAndNotify(
+                    _slideRenderingKeys.front(), std::move(_slideLayers),
+                    tokens.equals(1, "success"));
+                _slideLayers.clear();
+                _slideRenderingKeys.pop_front();
+            }
+            return forwardToClient(payload);
+        }
         else if (tokens.equals(0, "extractedlinktargets:"))
         {
             LOG_TRC("Sending extracted link targets response.");
@@ -2837,6 +2931,8 @@ bool ClientSession::handleKitToClientMessage(const std::shared_ptr<Message>& pay
                     int firstLineSize = firstLine.size() + 1;
                     std::string thumbnail(payload->data().data() + firstLineSize, payload->data().size() - firstLineSize);
 
+                    ConvertCache::cacheResultData(_convertCacheKey, thumbnail);
+
                     http::Response httpResponse(http::StatusCode::OK);
                     FileServerRequestHandler::hstsHeaders(httpResponse);
                     httpResponse.set("Last-Modified", Util::getHttpTimeNow());
@@ -3083,6 +3179,8 @@ void ClientSession::dumpState(std::ostream& os)
             std::chrono::duration_cast<std::chrono::milliseconds>(
                 std::chrono::steady_clock::now() - _tilesOnFly.back().second) << " ms ";
 
+    _tracker.dumpState(os);
+
     os << '\n';
     _senderQueue.dumpState(os);
 
@@ -3257,6 +3355,25 @@ Util::Rectangle ClientSession::getNormalizedVisiblePaneArea(const SplitPaneName
     return Util::Rectangle();
 }
 
+std::vector<Util::Rectangle> ClientSession::getNormalizedVisiblePaneAreas() const
+{
+    constexpr SplitPaneName panes[4] = {
+        TOPLEFT_PANE,
+        TOPRIGHT_PANE,
+        BOTTOMLEFT_PANE,
+        BOTTOMRIGHT_PANE
+    };
+
+    std::vector<Util::Rectangle> areas;
+    for (const SplitPaneName pane : panes)
+    {
+        if (isSplitPane(pane))
+            areas.push_back(getNormalizedVisiblePaneArea(pane));
+    }
+
+    return areas;
+}
+
 bool ClientSession::isTileInsideVisibleArea(const TileDesc& tile) const
 {
     if (!_splitX && !_splitY)
@@ -90,6 +90,10 @@ public:
         return false;
     }
 
+    /// Hands the slides we are rendering over to the views waiting for
+    /// them, as we are going away and won't get their layers.
+    void abandonSlideRendering(const std::shared_ptr<DocumentBroker>& docBroker);
+
     void resetTileSeq(const TileDesc &desc)
     {
         _tracker.resetTileSeq(desc);
@@ -114,28 +118,27 @@ public:
         else
             header = desc.serialize("delta:", "\n");
 
-        // FIXME: performance - optimize away this copy ...
-        std::vector<char> output;
-
-        // copy in the header
-        output.resize(header.size());
-        std::memcpy(output.data(), header.data(), header.size());
+        if (isCloseFrame())
+            return false;
 
-        bool hasContent = tile->appendChangesSince(output, tile->isPng() ? 0 : lastSentId);
-        LOG_TRC("Sending tile message: " << header << " lastSendId " << lastSentId << " content " << hasContent);
-        return sendBinaryFrame(output.data(), output.size());
+        // Shared with the other sessions sent the same changes.
+        std::shared_ptr<Message> message =
+            tile->getChangesMessage(header, tile->isPng() ? 0 : lastSentId);
+        LOG_TRC("Sending tile message: " << header << " lastSendId " << lastSentId << " content "
+                                         << (message->size() > header.size()));
+        enqueueSendMessage(message);
+        return true;
     }
 
     bool sendBlob(const std::string &header, const Blob &blob)
     {
-        // FIXME: performance - optimize away this copy ...
-        std::vector<char> output;
-
-        output.resize(header.size() + blob->size());
-        std::memcpy(output.data(), header.data(), header.size());
-        std::memcpy(output.data() + header.size(), blob->data(), blob->size());
+        if (isCloseFrame())
+            return false;
 
-        return sendBinaryFrame(output.data(), output.size());
+        auto message = std::make_shared<Message>(header, Message::Dir::Out);
+        message->append(blob->data(), blob->size());
+        enqueueSendMessage(message);
+        return true;
     }
 
     bool sendTextFrame(const char* buffer, const int length) override
@@ -207,6 +210,9 @@ public:
     /// Returns the normalized visible area of a given split-pane.
     Util::Rectangle getNormalizedVisiblePaneArea(SplitPaneName) const;
 
+    /// Returns the normalized visible areas of all the valid split-panes.
+    std::vector<Util::Rectangle> getNormalizedVisiblePaneAreas() const;
+
     int getTileWidthInTwips() const { return _tileWidthTwips; }
     int getTileHeightInTwips() const { return _tileHeightTwips; }
 
@@ -218,6 +224,9 @@ public:
 
     const std::string& getThumbnailTarget() const { return _thumbnailTarget; }
 
+    /// Set the ConvertCache key to store the conversion result under.
+    void setConvertCacheKey(const std::string& key) { _convertCacheKey = key; }
+
     void setThumbnailPosition(const std::pair<int, int>& pos) { _thumbnailPosition = pos; }
 
     const std::pair<int, int>& getThumbnailPosition() const { return _thumbnailPosition; }
@@ -331,6 +340,11 @@ private:
     bool sendFontRendering(const char* buffer, int length, const StringVector& tokens,
                            const std::shared_ptr<DocumentBroker>& docBroker);
 
+    /// Sends the layers of the slide from the cache, when another view
+    /// with the same rendering options rendered it, or renders it.
+    bool sendSlide(const char* buffer, int length, const StringVector& tokens,
+                   const std::shared_ptr<DocumentBroker>& docBroker);
+
     bool forwardToChild(const std::string& message,
                         const std::shared_ptr<DocumentBroker>& docBroker);
 
@@ -374,12 +388,21 @@ private:
     /// Target used for thumbnail rendering
     std::string _thumbnailTarget;
 
+    /// The ConvertCache key of the conversion result, if cacheable.
+    std::string _convertCacheKey;
+
     /// Secure session id token for proxyprotocol authentication
     std::string _proxyAccess;
 
     /// Store last sent payload of form field button, so we can filter out redundant messages.
     std::string _lastSentFormFielButtonMessage;
 
+    /// The keys of the slides we requested the Kit to render, in order.
+    std::deque<std::string> _slideRenderingKeys;
+
+    /// The layers of the slide being rendered, received so far.
+    TileCache::SlideLayers _slideLayers;
+
     std::weak_ptr<DocumentBroker> _docBroker;
 
     /// The socket to which the converted (saveas) doc is sent.
@@ -0,0 +1,548 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include "ConvertBatch.hpp"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include <Poco/Path.h>
+#include <Poco/URI.h>
+
+#include <common/ConfigUtil.hpp>
+#include <common/FileUtil.hpp>
+#include <common/JsonUtil.hpp>
+#include <common/Log.hpp>
+#include <common/Util.hpp>
+#include <wsd/COOLWSD.hpp>
+#include <wsd/ConvertCache.hpp>
+#include <wsd/FileServer.hpp>
+#include <wsd/RequestDetails.hpp>
+#include <wsd/SpecialBrokers.hpp>
+
+extern std::map<std::string, std::shared_ptr<DocumentBroker>> DocBrokers;
+extern std::mutex DocBrokersMutex;
+extern void cleanupDocBrokers();
+
+namespace
+{
+/// The results are read from the spool, and sent, in chunks of at most this size.
+constexpr std::size_t SendChunkSize = 64 * 1024;
+} // namespace
+
+std::size_t ConvertBatch::TotalInProgress = 0;
+std::deque<std::weak_ptr<ConvertBatch>> ConvertBatch::Waiting;
+
+/// Receives the response of a ConvertToBroker, on our end of its socketpair,
+/// spooling the converted document to file.
+class ConvertBatch::ResultHandler final : public SimpleSocketHandler
+{
+    std::weak_ptr<ConvertBatch> _batch;
+    const std::size_t _index;
+    std::weak_ptr<StreamSocket> _socket;
+    http::Response _response;
+    bool _done;
+
+public:
+    ResultHandler(const std::shared_ptr<ConvertBatch>& batch, std::size_t index,
+                  const std::string& resultPath)
+        : _batch(batch)
+        , _index(index)
+        , _response(
+              [this]()
+              {
+                  done(_response.state() == http::Response::State::Complete
+                           ? _response.statusCode()
+                           : http::StatusCode::InternalServerError,
+                       _response.get("X-ERROR-KIND"));
+              })
+        , _done(false)
+    {
+        // Only successful results go to file, errors are kept in memory.
+        _response.saveBodyToFile(resultPath);
+    }
+
+private:
+    void onConnect(const std::shared_ptr<StreamSocket>& socket) override
+    {
+        _socket = socket;
+        setLogContext(socket->getFD());
+    }
+
+    void handleIncomingMessage(SocketDisposition& disposition) override
+    {
+        std::shared_ptr<StreamSocket> socket = _socket.lock();
+        if (!socket)
+            return;
+
+        Buffer& data = socket->getInBuffer();
+        if (data.empty())
+            return;
+
+        const int64_t read = _response.readData(data.data(), data.size());
+        if (read >= 0)
+        {
+            // Remove consumed data.
+            if (read)
+                data.eraseFirst(read);
+
+            // We have all we wanted, the DocBroker will close its end.
+            if (_done)
+                disposition.setClosed();
+            return;
+        }
+
+        LOG_ERR("Invalid response to the conversion of document #" << _index);
+        disposition.setClosed();
+        done(http::StatusCode::InternalServerError, std::string());
+    }
+
+    int getPollEvents(std::chrono::steady_clock::time_point /* now */,
+                      int64_t& /* timeoutMaxMicroS */) override
+    {
+        return POLLIN;
+    }
+
+    void performWrites(std::size_t /* capacity */) override {}
+
+    void onDisconnect() override
+    {
+        if (!_done)
+            LOG_WRN("Conversion of document #" << _index << " ended without a complete response");
+
+        done(http::StatusCode::InternalServerError, std::string());
+    }
+
+    /// Reports the result to the batch, once.
+    void done(http::StatusCode status, std::string errorKind)
+    {
+        if (_done)
+            return;
+
+        _done = true;
+
+        // The conversion holds its place until it ends, even when nobody wants it anymore.
+        --TotalInProgress;
+        if (std::shared_ptr<ConvertBatch> batch = _batch.lock())
+            batch->onConverted(_index, status, std::move(errorKind));
+        else
+            resumeWaiting();
+    }
+};
+
+ConvertBatch::ConvertBatch(std::vector<std::string> fromPaths, std::string format,
+                           std::string options, std::string lang)
+    : _format(std::move(format))
+    , _options(std::move(options))
+    , _lang(std::move(lang))
+    , _boundary("cool-batch-" + Util::rng::getHexString(16))
+    , _spoolDir(FileUtil::createRandomTmpDir())
+    , _maxParallel(std::max<std::size_t>(
+          ConfigUtil::getConfigValue<std::size_t>("per_document.convert_batch.parallelism", 4), 1))
+    , _maxTotalParallel(std::max<std::size_t>(
+          ConfigUtil::getConfigValue<std::size_t>("per_document.convert_batch.total_parallelism",
+                                                  8),
+          1))
+    , _nextToConvert(0)
+    , _inProgress(0)
+    , _convertedCount(0)
+    , _sentCount(0)
+    , _finished(false)
+    , _disconnected(false)
+    , _waiting(false)
+{
+    _documents.reserve(fromPaths.size());
+    for (std::string& fromPath : fromPaths)
+    {
+        Poco::Path toPath(fromPath);
+        toPath.setExtension(_format);
+
+        Document document;
+        document._resultName = toPath.getFileName();
+        document._fromPath = std::move(fromPath);
+        _documents.push_back(std::move(document));
+    }
+
+    LOG_INF("Created ConvertBatch of " << _documents.size() << " documents to [" << _format
+                                       << "], converting " << _maxParallel << " at a time, of "
+                                       << _maxTotalParallel << " for all batches, spooling to ["
+                                       << _spoolDir << ']');
+}
+
+ConvertBatch::~ConvertBatch()
+{
+    // The documents we didn't get to convert.
+    for (const Document& document : _documents)
+    {
+        if (!document._fromPath.empty())
+            StatelessBatchBroker::removeFile(document._fromPath);
+    }
+
+    if (!_spoolDir.empty())
+        FileUtil::removeFile(_spoolDir, /*recursive=*/true);
+
+    LOG_INF("ConvertBatch done: converted " << _convertedCount << " of " << _documents.size()
+                                            << " documents, sent " << _sentCount);
+}
+
+void ConvertBatch::start(const std::shared_ptr<ConvertBatch>& batch,
+                         const std::shared_ptr<StreamSocket>& socket)
+{
+    // The rest of the request is of no interest.
+    socket->ignoreInput();
+    socket->setHandler(batch);
+
+    http::Response response(http::StatusCode::OK);
+    FileServerRequestHandler::hstsHeaders(response);
+    response.setContentType("multipart/mixed; boundary=" + batch->_boundary);
+    response.set("X-Content-Type-Options", "nosniff");
+    response.header().setConnectionToken(http::Header::ConnectionToken::Close);
+    socket->send(response);
+
+    batch->convertNext();
+}
+
+void ConvertBatch::onConnect(const std::shared_ptr<StreamSocket>& socket)
+{
+    _socket = socket;
+    setLogContext(socket->getFD());
+}
+
+void ConvertBatch::handleIncomingMessage(SocketDisposition& /* disposition */)
+{
+    if (std::shared_ptr<StreamSocket> socket = _socket.lock())
+        socket->getInBuffer().clear();
+}
+
+int ConvertBatch::getPollEvents(std::chrono::steady_clock::time_point /* now */,
+                                int64_t& /* timeoutMaxMicroS */)
+{
+    if (_finished)
+        return POLLIN;
+
+    const bool haveMore =
+        _sending.is_open() || !_ready.empty() || _sentCount == _documents.size();
+    return haveMore ? POLLIN | POLLOUT : POLLIN;
+}
+
+void ConvertBatch::performWrites(std::size_t capacity)
+{
+    std::shared_ptr<StreamSocket> socket = _socket.lock();
+    if (!socket)
+        return;
+
+    std::vector<char> buffer;
+    std::size_t sent = 0;
+    while (sent < capacity)
+    {
+        if (!_sending.is_open())
+        {
+            if (!startNextPart())
+                break;
+
+            continue;
+        }
+
+        buffer.resize(std::min(capacity - sent, SendChunkSize));
+        _sending.read(buffer.data(), buffer.size());
+        const std::streamsize read = _sending.gcount();
+        if (read > 0)
+        {
+            socket->send(buffer.data(), static_cast<int>(read), /*doFlush=*/false);
+            sent += static_cast<std::size_t>(read);
+        }
+
+        if (_sending.bad())
+        {
+            // We promised a Content-Length we can't deliver.
+            LOG_ERR("Failed to read the spooled result [" << _sendingPath << ']');
+            _finished = true;
+            socket->shutdown();
+            return;
+        }
+
+        if (_sending.eof())
+        {
+            _sending.close();
+            _sending.clear();
+            FileUtil::removeFile(_sendingPath);
+            _sendingPath.clear();
+            socket->send("\r\n", /*doFlush=*/false);
+        }
+    }
+}
+
+void ConvertBatch::onDisconnect()
+{
+    if (!_finished)
+        LOG_WRN("Client disconnected after " << _sentCount << " of " << _documents.size()
+                                             << " results; abandoning the rest");
+
+    _disconnected = true;
+    _sending.close();
+}
+
+void ConvertBatch::convertNext()
+{
+    while (!_disconnected && _inProgress < _maxParallel && _nextToConvert < _documents.size())
+    {
+        if (TotalInProgress >= _maxTotalParallel)
+        {
+            if (!_waiting)
+            {
+                LOG_DBG("ConvertBatch waiting for " << TotalInProgress
+                                                    << " conversions of all batches to finish");
+                Waiting.push_back(std::static_pointer_cast<ConvertBatch>(shared_from_this()));
+                _waiting = true;
+            }
+
+            return;
+        }
+
+        const std::size_t index = _nextToConvert++;
+        ++_inProgress;
+        ++TotalInProgress;
+
+        if (ConvertCache::isEnabled())
+        {
+            lookup(index);
+        }
+        else if (!convert(index))
+        {
+            --_inProgress;
+            --TotalInProgress;
+            setResult(index, http::StatusCode::InternalServerError, std::string());
+        }
+    }
+}
+
+void ConvertBatch::resumeWaiting()
+{
+    // Those that still can't convert wait again.
+    std::deque<std::weak_ptr<ConvertBatch>> waiting;
+    std::swap(waiting, Waiting);
+    for (const std::weak_ptr<ConvertBatch>& weak : waiting)
+    {
+        if (std::shared_ptr<ConvertBatch> batch = weak.lock())
+        {
+            batch->_waiting = false;
+            batch->convertNext();
+        }
+    }
+}
+
+void ConvertBatch::lookup(std::size_t index)
+{
+    // Hashed, and supplied, on the cache's thread, then back to us.
+    const std::weak_ptr<ConvertBatch> weak =
+        std::static_pointer_cast<ConvertBatch>(shared_from_this());
+    ConvertCache::lookup(
+        _documents[index]._fromPath, "convert-to", _format, _options, _lang, std::string(),
+        getResultPath(index),
+        [weak, index](const std::string& cacheKey, bool hit)
+        {
+            COOLWSD::getWebServerPoll()->addCallback(
+                [weak, index, cacheKey, hit]()
+                {
+                    if (std::shared_ptr<ConvertBatch> batch = weak.lock())
+                        batch->onLookedUp(index, cacheKey, hit);
+                    else
+                    {
+                        --TotalInProgress;
+                        resumeWaiting();
+                    }
+                });
+        });
+}
+
+void ConvertBatch::onLookedUp(std::size_t index, const std::string& cacheKey, bool hit)
+{
+    Document& document = _documents[index];
+    document._cacheKey = cacheKey;
+    if (hit)
+    {
+        StatelessBatchBroker::removeFile(document._fromPath);
+        document._fromPath.clear();
+        --TotalInProgress;
+        onConverted(index, http::StatusCode::OK, std::string());
+    }
+    else if (_disconnected || !convert(index))
+    {
+        --TotalInProgress;
+        onConverted(index, http::StatusCode::InternalServerError, std::string());
+    }
+}
+
+bool ConvertBatch::convert(std::size_t index)
+{
+    Document& document = _documents[index];
+
+    std::shared_ptr<StreamSocket> parent;
+    std::shared_ptr<StreamSocket> child;
+    if (!StreamSocket::socketpair(std::chrono::steady_clock::now(), parent, child))
+    {
+        LOG_SYS("Failed to create socketpair to convert document #" << index);
+        return false;
+    }
+
+    const Poco::URI uriPublic = RequestDetails::sanitizeURI(document._fromPath);
+    const std::string docKey = RequestDetails::getDocKey(uriPublic);
+
+    LOG_DBG("New DocumentBroker for docKey [" << docKey << "] of batch document #" << index);
+    auto docBroker = std::make_shared<ConvertToBroker>(document._fromPath, uriPublic, docKey,
+                                                       _format, _options, _lang);
+    docBroker->setCacheKey(document._cacheKey);
+    document._fromPath.clear(); // The DocBroker removes it when done.
+    {
+        std::unique_lock<std::mutex> docBrokersLock(DocBrokersMutex);
+
+        cleanupDocBrokers();
+
+        DocBrokers.emplace(docKey, docBroker);
+        LOG_TRC("Have " << DocBrokers.size() << " DocBrokers after inserting [" << docKey
+                        << "].");
+    }
+
+    // Our end of the pair shares the WebServerPoll with the client.
+    parent->setHandler(std::make_shared<ResultHandler>(
+        std::static_pointer_cast<ConvertBatch>(shared_from_this()), index, getResultPath(index)));
+    COOLWSD::getWebServerPoll()->insertNewSocket(parent);
+
+    return docBroker->startConversion(child, COOLWSD::GetConnectionId());
+}
+
+void ConvertBatch::onConverted(std::size_t index, http::StatusCode status, std::string errorKind)
+{
+    --_inProgress;
+    setResult(index, status, std::move(errorKind));
+    convertNext();
+    resumeWaiting();
+}
+
+void ConvertBatch::setResult(std::size_t index, http::StatusCode status, std::string errorKind)
+{
+    Document& document = _documents[index];
+    document._status = status;
+    document._errorKind = std::move(errorKind);
+    if (status == http::StatusCode::OK)
+        ++_convertedCount;
+
+    LOG_DBG("Batch document #" << index << " converted with status "
+                               << static_cast<unsigned>(status) << ", " << _convertedCount
+                               << " of " << _documents.size() << " documents converted");
+
+    if (_disconnected)
+        FileUtil::removeFile(getResultPath(index));
+    else
+        _ready.push_back(index);
+}
+
+std::string ConvertBatch::getResultPath(std::size_t index) const
+{
+    return _spoolDir + '/' + std::to_string(index);
+}
+
+bool ConvertBatch::startNextPart()
+{
+    std::shared_ptr<StreamSocket> socket = _socket.lock();
+    if (!socket || _finished)
+        return false;
+
+    if (_ready.empty())
+    {
+        if (_sentCount < _documents.size())
+            return false; // Wait for more results.
+
+        // All sent, close with the report.
+        std::ostringstream oss;
+        oss << "--" << _boundary << "\r\n"
+            << "Content-Type: application/json\r\n"
+            << "\r\n"
+            << getReport() << "\r\n"
+            << "--" << _boundary << "--\r\n";
+        socket->send(oss.str(), /*doFlush=*/false);
+        socket->shutdown();
+        _finished = true;
+
+        LOG_INF("ConvertBatch sent all " << _documents.size() << " results, "
+                                         << _convertedCount << " converted");
+        return false;
+    }
+
+    const std::size_t index = _ready.front();
+    _ready.pop_front();
+    ++_sentCount;
+
+    const Document& document = _documents[index];
+    const std::string resultPath = getResultPath(index);
+    const FileUtil::Stat stat(resultPath);
+    const bool haveResult = (document._status == http::StatusCode::OK && stat.isFile());
+
+    std::ostringstream oss;
+    oss << "--" << _boundary << "\r\n"
+        << "Content-Type: application/octet-stream\r\n"
+        << "Content-Disposition: attachment; filename=\"" << document._resultName << "\"\r\n"
+        << "Content-Length: " << (haveResult ? stat.size() : 0) << "\r\n"
+        << "X-Batch-Index: " << index << "\r\n"
+        << "X-Batch-Progress: " << _sentCount << '/' << _documents.size() << "\r\n"
+        << "X-Conversion-Status: " << static_cast<unsigned>(document._status) << "\r\n";
+    if (!document._errorKind.empty())
+        oss << "X-ERROR-KIND: " << document._errorKind << "\r\n";
+    oss << "\r\n";
+    socket->send(oss.str(), /*doFlush=*/false);
+
+    if (haveResult)
+    {
+        _sending.open(resultPath, std::ios::binary);
+        if (_sending.is_open())
+        {
+            _sendingPath = resultPath;
+            return true;
+        }
+
+        LOG_ERR("Failed to open the spooled result [" << resultPath << ']');
+        _finished = true;
+        socket->shutdown();
+        return false;
+    }
+
+    FileUtil::removeFile(resultPath);
+    socket->send("\r\n", /*doFlush=*/false);
+    return true;
+}
+
+std::string ConvertBatch::getReport() const
+{
+    std::ostringstream oss;
+    oss << "{\"total\":" << _documents.size() << ",\"converted\":" << _convertedCount
+        << ",\"failed\":" << (_sentCount - _convertedCount) << ",\"documents\":[";
+    for (std::size_t index = 0; index < _documents.size(); ++index)
+    {
+        const Document& document = _documents[index];
+        if (index > 0)
+            oss << ',';
+        oss << "{\"index\":" << index << ",\"filename\":\""
+            << JsonUtil::escapeJSONValue(document._resultName)
+            << "\",\"status\":" << static_cast<unsigned>(document._status);
+        if (!document._errorKind.empty())
+            oss << ",\"errorKind\":\"" << JsonUtil::escapeJSONValue(document._errorKind) << '"';
+        oss << '}';
+    }
+
+    oss << "]}";
+    return oss.str();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
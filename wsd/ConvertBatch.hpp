@@ -0,0 +1,137 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#if MOBILEAPP
+#error This file should be excluded from Mobile App builds
+#endif // MOBILEAPP
+
+#include <net/HttpRequest.hpp>
+#include <net/Socket.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// Converts all the documents uploaded in a single convert-to-batch request.
+/// A few documents are converted at a time, each by its own ConvertToBroker,
+/// which responds on one end of a socketpair as it would to a convert-to
+/// request. The results are spooled to disk, as they arrive, and streamed back
+/// to the client, in the order they complete, as the parts of a multipart/mixed
+/// response, as fast as the client reads them. The last part is a JSON report.
+/// Replaces the ClientRequestDispatcher of the client's socket, and, with the
+/// sockets the results are received on, lives in the WebServerPoll.
+/// The conversions of all the batches together are limited too, so many
+/// concurrent batches can't claim all the Kits.
+class ConvertBatch final : public SimpleSocketHandler
+{
+    /// One of the uploaded documents.
+    struct Document
+    {
+        std::string _fromPath; ///< The upload, until handed to its ConvertToBroker.
+        std::string _resultName; ///< The filename of the converted document.
+        std::string _cacheKey; ///< The ConvertCache key of the result, if cacheable.
+        http::StatusCode _status = http::StatusCode::None;
+        std::string _errorKind; ///< The X-ERROR-KIND of a failed conversion, if any.
+    };
+
+    /// Receives the result of converting one document.
+    class ResultHandler;
+
+public:
+    /// Takes ownership of the uploaded documents at @fromPaths.
+    ConvertBatch(std::vector<std::string> fromPaths, std::string format, std::string options,
+                 std::string lang);
+
+    ~ConvertBatch();
+
+    /// Takes over the given socket, from the ClientRequestDispatcher,
+    /// to respond with the results of converting the documents.
+    static void start(const std::shared_ptr<ConvertBatch>& batch,
+                      const std::shared_ptr<StreamSocket>& socket);
+
+private:
+    void onConnect(const std::shared_ptr<StreamSocket>& socket) override;
+
+    void handleIncomingMessage(SocketDisposition& disposition) override;
+
+    int getPollEvents(std::chrono::steady_clock::time_point now,
+                      int64_t& timeoutMaxMicroS) override;
+
+    void performWrites(std::size_t capacity) override;
+
+    void onDisconnect() override;
+
+    /// Starts converting the next documents, while under the parallelism limit.
+    void convertNext();
+
+    /// Supplies the result of the document at @index from the ConvertCache, if
+    /// cached, otherwise converts it, once looked up on the cache's thread.
+    void lookup(std::size_t index);
+
+    /// Called once the document at @index is looked up in the ConvertCache.
+    void onLookedUp(std::size_t index, const std::string& cacheKey, bool hit);
+
+    /// Starts converting the document at @index, returns false on failure.
+    bool convert(std::size_t index);
+
+    /// Called by the ResultHandler when the conversion of the document at @index is done,
+    /// after its place in TotalInProgress is released.
+    void onConverted(std::size_t index, http::StatusCode status, std::string errorKind);
+
+    /// Lets the batches waiting for the conversions of others to finish convert theirs.
+    static void resumeWaiting();
+
+    /// Queues the result of the document at @index to be sent.
+    void setResult(std::size_t index, http::StatusCode status, std::string errorKind);
+
+    /// Returns the path where the result of the document at @index is spooled.
+    std::string getResultPath(std::size_t index) const;
+
+    /// Starts sending the next part of the response, if any; returns false if there is none.
+    bool startNextPart();
+
+    /// Returns the JSON report of the batch, sent as the last part.
+    std::string getReport() const;
+
+    std::weak_ptr<StreamSocket> _socket;
+    std::vector<Document> _documents;
+    const std::string _format;
+    const std::string _options;
+    const std::string _lang;
+    const std::string _boundary; ///< The multipart boundary.
+    std::string _spoolDir; ///< Where the results are spooled.
+    const std::size_t _maxParallel; ///< The maximum number of conversions in progress.
+    const std::size_t _maxTotalParallel; ///< The maximum of all the batches together.
+    std::size_t _nextToConvert; ///< The index of the next document to start converting.
+    std::size_t _inProgress; ///< The number of conversions in progress.
+    std::size_t _convertedCount; ///< The number of documents converted successfully.
+    std::size_t _sentCount; ///< The number of results sent.
+    std::deque<std::size_t> _ready; ///< The converted documents, to be sent, in order.
+    std::ifstream _sending; ///< The result being sent, if any.
+    std::string _sendingPath; ///< The path of the result being sent.
+    bool _finished; ///< True once the report is sent.
+    bool _disconnected;
+    bool _waiting; ///< True while in Waiting.
+
+    /// The conversions in progress, of all the batches, including those of batches whose
+    /// client disconnected, until they end. Only used in the WebServerPoll.
+    static std::size_t TotalInProgress;
+    /// The batches waiting for TotalInProgress to drop. Only used in the WebServerPoll.
+    static std::deque<std::weak_ptr<ConvertBatch>> Waiting;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
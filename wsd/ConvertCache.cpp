@@ -0,0 +1,420 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include "ConvertCache.hpp"
+
+#include <Poco/Crypto/DigestEngine.h>
+#include <Poco/File.h>
+#include <Poco/Path.h>
+
+#include <common/ConfigUtil.hpp>
+#include <common/FileUtil.hpp>
+#include <common/Log.hpp>
+#include <common/Util.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+#include <vector>
+
+std::list<ConvertCache::Entry> ConvertCache::Entries;
+std::unordered_map<std::string, std::list<ConvertCache::Entry>::iterator>
+    ConvertCache::EntriesMap;
+std::mutex ConvertCache::Mutex;
+std::string ConvertCache::CachePath;
+std::size_t ConvertCache::MaxSizeBytes;
+std::size_t ConvertCache::SizeBytes;
+std::string ConvertCache::CoreVersion;
+std::unique_ptr<std::thread> ConvertCache::Thread;
+std::queue<std::function<void()>> ConvertCache::Queue;
+std::mutex ConvertCache::QueueMutex;
+std::condition_variable ConvertCache::QueueCondition;
+bool ConvertCache::Exit;
+std::atomic<uint64_t> ConvertCache::HitCount;
+std::atomic<uint64_t> ConvertCache::MissCount;
+std::atomic<uint64_t> ConvertCache::BytesSaved;
+
+void ConvertCache::initialize(const std::string& path)
+{
+    if (!ConfigUtil::getConfigValue<bool>("convert_cache[@enable]", false) || !CachePath.empty())
+    {
+        return;
+    }
+
+    initialize(path,
+               ConfigUtil::getConfigValue<std::size_t>("convert_cache.limit_dir_size_mb", 256) *
+                   1024 * 1024);
+
+    Exit = false;
+    Thread = std::make_unique<std::thread>(&ConvertCache::run);
+}
+
+void ConvertCache::initialize(const std::string& path, std::size_t maxSizeBytes)
+{
+    MaxSizeBytes = maxSizeBytes;
+    LOG_INF("Initializing ConvertCache at [" << path << "] with Max Size: " << MaxSizeBytes
+                                             << " bytes");
+
+    // Make sure the cache directory exists, or we throw if we can't create it.
+    Poco::File(path).createDirectories();
+
+    std::lock_guard<std::mutex> lock(Mutex);
+
+    Entries.clear();
+    EntriesMap.clear();
+    SizeBytes = 0;
+
+    CachePath = Poco::Path(path).makeDirectory().toString();
+
+    // Pick up what we cached before, in no particular order.
+    for (const std::string& name : FileUtil::getDirEntries(path))
+    {
+        const std::string filePath = CachePath + name;
+        if (name.find('.') != std::string::npos)
+        {
+            // Left behind while being written.
+            FileUtil::removeFile(filePath);
+            continue;
+        }
+
+        const FileUtil::Stat stat(filePath);
+        if (stat.isFile())
+        {
+            SizeBytes += stat.size();
+            Entries.push_back(Entry{ name, stat.size() });
+            EntriesMap.emplace(name, std::prev(Entries.end()));
+        }
+    }
+
+    makeSpace(0);
+
+    LOG_INF("ConvertCache has " << Entries.size() << " results in " << SizeBytes << " bytes");
+}
+
+void ConvertCache::uninitialize()
+{
+    if (!Thread)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(QueueMutex);
+        Exit = true;
+    }
+
+    QueueCondition.notify_all();
+    Thread->join();
+    Thread.reset();
+}
+
+void ConvertCache::post(std::function<void()> fn)
+{
+    if (!Thread)
+    {
+        fn();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(QueueMutex);
+        Queue.push(std::move(fn));
+    }
+
+    QueueCondition.notify_one();
+}
+
+void ConvertCache::run()
+{
+    Util::setThreadName("convertcache");
+    std::unique_lock<std::mutex> lock(QueueMutex);
+    while (true)
+    {
+        QueueCondition.wait(lock, [] { return Exit || !Queue.empty(); });
+        if (Exit)
+            break;
+
+        std::function<void()> fn = std::move(Queue.front());
+        Queue.pop();
+
+        // Unlock to allow more work to queue up meanwhile.
+        lock.unlock();
+
+        try
+        {
+            fn();
+        }
+        catch (const std::exception& ex)
+        {
+            LOG_ERR("ConvertCache failed: " << ex.what());
+        }
+
+        lock.lock();
+    }
+}
+
+void ConvertCache::lookup(const std::string& filePath, const std::string& requestType,
+                          const std::string& format, const std::string& options,
+                          const std::string& lang, const std::string& target,
+                          const std::string& destPath, const LookupFn& cb)
+{
+    post(
+        [=]()
+        {
+            const std::string key = getKey(filePath, requestType, format, options, lang, target);
+            cb(key, supplyResult(key, destPath));
+        });
+}
+
+void ConvertCache::setCoreVersion(const std::string& version)
+{
+    std::lock_guard<std::mutex> lock(Mutex);
+    CoreVersion = version;
+}
+
+std::string ConvertCache::getKey(const std::string& filePath, const std::string& requestType,
+                                 const std::string& format, const std::string& options,
+                                 const std::string& lang, const std::string& target)
+{
+    if (!isEnabled())
+        return std::string();
+
+    std::string coreVersion;
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        coreVersion = CoreVersion;
+    }
+
+    if (coreVersion.empty())
+    {
+        LOG_DBG("ConvertCache will not cache until the core version is known");
+        return std::string();
+    }
+
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file)
+    {
+        LOG_WRN("ConvertCache failed to read [" << filePath << ']');
+        return std::string();
+    }
+
+    Poco::Crypto::DigestEngine sha256("SHA256");
+    std::vector<char> buffer(64 * 1024);
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        if (file.gcount() > 0)
+            sha256.update(buffer.data(), static_cast<std::size_t>(file.gcount()));
+    }
+
+    if (file.bad())
+    {
+        LOG_WRN("ConvertCache failed to read [" << filePath << ']');
+        return std::string();
+    }
+
+    // The extension selects the import filter, and a different core may convert differently.
+    sha256.update('\n' + requestType + '\n' + FileUtil::extractFileExtension(filePath) + '\n' +
+                  format + '\n' + options + '\n' + lang + '\n' + target + '\n' +
+                  coreVersion);
+    return Poco::Crypto::DigestEngine::digestToHex(sha256.digest());
+}
+
+bool ConvertCache::supplyResult(const std::string& key, const std::string& destPath)
+{
+    if (!isEnabled() || key.empty())
+        return false;
+
+    std::size_t size = 0;
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+
+        const auto mapIt = EntriesMap.find(key);
+        if (mapIt == EntriesMap.end())
+        {
+            ++MissCount;
+            LOG_DBG("ConvertCache miss for [" << key << ']');
+            return false;
+        }
+
+        // Most recently used.
+        Entries.splice(Entries.begin(), Entries, mapIt->second);
+        size = mapIt->second->_size;
+    }
+
+    if (!FileUtil::linkOrCopyFile(CachePath + key, destPath))
+    {
+        LOG_ERR("ConvertCache failed to supply [" << key << "] to [" << destPath
+                                                  << "]; evicting");
+        std::lock_guard<std::mutex> lock(Mutex);
+
+        const auto mapIt = EntriesMap.find(key);
+        if (mapIt != EntriesMap.end())
+            removeEntry(mapIt->second);
+
+        ++MissCount;
+        return false;
+    }
+
+    ++HitCount;
+    BytesSaved += size;
+    LOG_INF("ConvertCache hit for [" << key << "], supplied " << size << " bytes to ["
+                                     << destPath << ']');
+    return true;
+}
+
+void ConvertCache::cacheResult(const std::string& key, const std::string& filePath)
+{
+    if (!isEnabled() || key.empty())
+        return;
+
+    const FileUtil::Stat fileStat(filePath);
+    if (!fileStat.isFile() || fileStat.size() > MaxSizeBytes)
+    {
+        LOG_DBG("ConvertCache will not cache [" << filePath << "] of " << fileStat.size()
+                                                << " bytes");
+        return;
+    }
+
+    // The jail, and the result in it, may be gone by the time we copy it, so keep a link.
+    // Failing that, e.g. across file-systems, copy from the jail, while it's still there.
+    const std::string linkPath = getTempPath(key);
+    if (::link(filePath.c_str(), linkPath.c_str()) != 0)
+    {
+        LOG_DBG("ConvertCache failed to link [" << filePath << "] to [" << linkPath
+                                                << "]: " << Util::symbolicErrno(errno));
+        post([key, filePath]() { copyResult(key, filePath); });
+        return;
+    }
+
+    post(
+        [key, linkPath]()
+        {
+            copyResult(key, linkPath);
+            FileUtil::removeFile(linkPath);
+        });
+}
+
+void ConvertCache::copyResult(const std::string& key, const std::string& filePath)
+{
+    // Always copy, never link, the result may be written to by the Kit.
+    const std::string tempPath = getTempPath(key);
+    if (!FileUtil::copy(filePath, tempPath, /*log=*/false, /*throw_on_error=*/false))
+    {
+        LOG_ERR("ConvertCache failed to cache [" << filePath << ']');
+        FileUtil::removeFile(tempPath);
+        return;
+    }
+
+    insertFile(key, tempPath);
+}
+
+void ConvertCache::cacheResultData(const std::string& key, std::string_view data)
+{
+    if (!isEnabled() || key.empty())
+        return;
+
+    if (data.empty() || data.size() > MaxSizeBytes)
+    {
+        LOG_DBG("ConvertCache will not cache result of " << data.size() << " bytes");
+        return;
+    }
+
+    post(
+        [key, content = std::string(data)]()
+        {
+            const std::string tempPath = getTempPath(key);
+            std::ofstream file(tempPath, std::ios::binary);
+            file.write(content.data(), content.size());
+            file.close();
+            if (!file)
+            {
+                LOG_ERR("ConvertCache failed to write [" << tempPath << ']');
+                FileUtil::removeFile(tempPath);
+                return;
+            }
+
+            insertFile(key, tempPath);
+        });
+}
+
+std::string ConvertCache::getTempPath(const std::string& key)
+{
+    return CachePath + key + '.' + Util::rng::getFilename(12);
+}
+
+void ConvertCache::insertFile(const std::string& key, const std::string& tempPath)
+{
+    const FileUtil::Stat stat(tempPath);
+
+    std::lock_guard<std::mutex> lock(Mutex);
+
+    const auto mapIt = EntriesMap.find(key);
+    if (mapIt != EntriesMap.end())
+        removeEntry(mapIt->second);
+
+    makeSpace(stat.size());
+
+    const std::string cachedPath = CachePath + key;
+    if (std::rename(tempPath.c_str(), cachedPath.c_str()) != 0)
+    {
+        LOG_SYS("ConvertCache failed to rename [" << tempPath << "] to [" << cachedPath << ']');
+        FileUtil::removeFile(tempPath);
+        return;
+    }
+
+    Entries.push_front(Entry{ key, stat.size() });
+    EntriesMap.emplace(key, Entries.begin());
+    SizeBytes += stat.size();
+
+    LOG_INF("ConvertCache cached [" << key << "] of " << stat.size() << " bytes, "
+                                    << Entries.size() << " results in " << SizeBytes
+                                    << " bytes");
+}
+
+void ConvertCache::makeSpace(std::size_t headroomBytes)
+{
+    while (!Entries.empty() && SizeBytes + headroomBytes > MaxSizeBytes)
+    {
+        LOG_DBG("ConvertCache evicting [" << Entries.back()._name << "] of "
+                                          << Entries.back()._size << " bytes");
+        removeEntry(std::prev(Entries.end()));
+    }
+}
+
+void ConvertCache::removeEntry(std::list<Entry>::iterator it)
+{
+    FileUtil::removeFile(CachePath + it->_name);
+
+    SizeBytes -= it->_size;
+    EntriesMap.erase(it->_name);
+    Entries.erase(it);
+}
+
+void ConvertCache::dumpMetrics(std::ostream& os)
+{
+    std::size_t entryCount = 0;
+    std::size_t sizeBytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        entryCount = Entries.size();
+        sizeBytes = SizeBytes;
+    }
+
+    os << "convert_cache_hit_count " << HitCount << '\n';
+    os << "convert_cache_miss_count " << MissCount << '\n';
+    os << "convert_cache_saved_bytes " << BytesSaved << '\n';
+    os << "convert_cache_entry_count " << entryCount << '\n';
+    os << "convert_cache_size_bytes " << sizeBytes << '\n';
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,142 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+/// A bounded, on-disk cache of convert-to and get-thumbnail results.
+/// Entries are keyed by the SHA-256 of the uploaded document together
+/// with everything else that affects the result (the request type,
+/// target format, options, etc.), so converting the same attachment
+/// again is served without claiming a Kit. Evicted least-recently-used
+/// first when the cache exceeds its size limit.
+/// The hashing and copying is done on the cache's own thread, never
+/// on the polls of the WebServer or DocumentBrokers, and never while
+/// holding the lock.
+class ConvertCache
+{
+    friend class ConvertCacheTests;
+
+    struct Entry
+    {
+        std::string _name; ///< The filename in the cache directory.
+        std::size_t _size; ///< The size of the file in bytes.
+    };
+
+public:
+    /// Called on the cache's thread with the key of the lookup, empty when
+    /// not cacheable, and whether the cached result was supplied.
+    using LookupFn = std::function<void(const std::string& key, bool hit)>;
+
+    static void initialize(const std::string& path);
+
+    /// Stops the cache's thread, abandoning what is still queued.
+    static void uninitialize();
+
+    static bool isEnabled() { return !CachePath.empty(); }
+
+    /// Sets the version of the core converting, which is part of every key.
+    /// Nothing is cached until it is known, a different core may convert differently.
+    static void setCoreVersion(const std::string& version);
+
+    /// Hashes the uploaded document at @filePath and supplies the cached result of
+    /// converting it, if any, to @destPath, then calls @cb, all on the cache's thread.
+    static void lookup(const std::string& filePath, const std::string& requestType,
+                       const std::string& format, const std::string& options,
+                       const std::string& lang, const std::string& target,
+                       const std::string& destPath, const LookupFn& cb);
+
+    /// Returns the cache key for converting the uploaded document at @filePath.
+    /// Returns an empty string when disabled, the core version is not yet known,
+    /// or the document can't be read.
+    static std::string getKey(const std::string& filePath, const std::string& requestType,
+                              const std::string& format, const std::string& options,
+                              const std::string& lang, const std::string& target);
+
+    /// Hard-links, or copies, the cached result with the given key to @destPath.
+    /// Returns true on a hit, false when not in the cache.
+    static bool supplyResult(const std::string& key, const std::string& destPath);
+
+    /// Adds a copy of the result at @filePath to the cache under the given key.
+    /// Only links it here, so it outlives its jail, and copies it on the cache's thread.
+    static void cacheResult(const std::string& key, const std::string& filePath);
+
+    /// Adds the in-memory result @data to the cache under the given key, on the cache's thread.
+    static void cacheResultData(const std::string& key, std::string_view data);
+
+    /// Writes the cache metrics, in the format of the admin metrics.
+    static void dumpMetrics(std::ostream& os);
+
+private:
+    /// Creates the, empty, cache at @path, limited to @maxSizeBytes.
+    /// Without a thread, the work is done on the calling thread.
+    static void initialize(const std::string& path, std::size_t maxSizeBytes);
+
+    /// Runs @fn on the cache's thread.
+    static void post(std::function<void()> fn);
+
+    /// The body of the cache's thread.
+    static void run();
+
+    /// Copies the result at @filePath into the cache under the given key.
+    static void copyResult(const std::string& key, const std::string& filePath);
+
+    /// Moves the file at @tempPath into the cache under the given key.
+    static void insertFile(const std::string& key, const std::string& tempPath);
+
+    /// Returns a unique path in the cache directory to write the result for @key to.
+    static std::string getTempPath(const std::string& key);
+
+    /// Evicts the least-recently-used entries until there is
+    /// room for @headroomBytes. Must be called with the lock held.
+    static void makeSpace(std::size_t headroomBytes);
+
+    /// Removes the given entry, and its file. Must be called with the lock held.
+    static void removeEntry(std::list<Entry>::iterator it);
+
+    /// The entries, most-recently-used first.
+    static std::list<Entry> Entries;
+    /// The entries, by filename.
+    static std::unordered_map<std::string, std::list<Entry>::iterator> EntriesMap;
+    /// Protects the shared Entries from concurrent modification.
+    /// Never held while hashing or copying files.
+    static std::mutex Mutex;
+    static std::string CachePath;
+    static std::size_t MaxSizeBytes; ///< Total limit on all cached files.
+    static std::size_t SizeBytes; ///< Total size of all cached files.
+    static std::string CoreVersion; ///< Protected by Mutex, set by the prisoner poll.
+
+    static std::unique_ptr<std::thread> Thread;
+    static std::queue<std::function<void()>> Queue; ///< The work for Thread.
+    static std::mutex QueueMutex; ///< Protects Queue and Exit.
+    static std::condition_variable QueueCondition;
+    static bool Exit;
+
+    static std::atomic<uint64_t> HitCount;
+    static std::atomic<uint64_t> MissCount;
+    static std::atomic<uint64_t> BytesSaved; ///< Total size of the results served from the cache.
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -39,6 +39,7 @@
 #include "Common.hpp"
 #include "Exceptions.hpp"
 #include "COOLWSD.hpp"
+#include "DocumentCache.hpp"
 #include "FileServer.hpp"
 #include "Socket.hpp"
 #include "Storage.hpp"
@@ -63,8 +64,10 @@
 
 #if !MOBILEAPP
 #include <wopi/CheckFileInfo.hpp>
+#include <wopi/GetFile.hpp>
 #include <wopi/StorageConnectionManager.hpp>
 #include <net/HttpHelper.hpp>
+#include <net/SocketPollPool.hpp>
 #endif
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -103,6 +106,7 @@ void ChildProcess::setDocumentBroker(const std::shared_ptr<DocumentBroker>& docB
 {
     assert(docBroker && "Invalid DocumentBroker instance.");
     _docBroker = docBroker;
+    ++_documentCount;
 
     // The prisoner socket is added in 'takeSocket'
 
@@ -135,24 +139,51 @@ void DocumentBroker::broadcastLastModificationTime(
     broadcastMessage(message);
 }
 
-/// The Document Broker Poll - one of these in a thread per document
+/// The Document Broker Poll - one of these in a thread per document,
+/// or on the PollPool.
 class DocumentBroker::DocumentBrokerPoll final : public TerminatingPoll
 {
     /// The DocumentBroker owning us.
     DocumentBroker& _docBroker;
 
 public:
-    DocumentBrokerPoll(const std::string &threadName, DocumentBroker& docBroker) :
-        TerminatingPoll(threadName),
+    DocumentBrokerPoll(const std::string& threadName, DocumentBroker& docBroker,
+                       Backend backend) :
+        TerminatingPoll(threadName, backend),
         _docBroker(docBroker)
     {
     }
 
-    void pollingThread() override
+protected:
+    void threadOwnerChanged() override
     {
-        // Delegate to the docBroker.
-        _docBroker.pollThread();
+        if (_docBroker._tileCache)
+            _docBroker._tileCache->setThreadOwner(getThreadOwner());
+    }
+
+private:
+    // Delegate to the docBroker.
+    bool pollingStart() override
+    {
+        if (_docBroker.startPolling())
+            return true;
+
+        finished();
+        return false;
+    }
+
+    std::chrono::microseconds pollingTimeout() override { return _docBroker.getPollTimeout(); }
+
+    bool pollingStep() override { return _docBroker.pollIteration(); }
 
+    void pollingFinish() override
+    {
+        _docBroker.finishPolling();
+        finished();
+    }
+
+    static void finished()
+    {
         // We are done; let's clean up. (Is it excessive to be impatient?)
         LOG_TRC("Waking up world after finishing DocBroker poll");
         SocketPoll::wakeupWorld();
@@ -161,6 +192,31 @@ public:
 
 std::atomic<unsigned> DocumentBroker::DocBrokerId(1);
 
+#if !MOBILEAPP
+std::unique_ptr<SocketPollPool> DocumentBroker::PollPool;
+
+void DocumentBroker::startPollPool(std::size_t threadCount)
+{
+    assert(!PollPool && "Document poll pool started already");
+    PollPool = std::make_unique<SocketPollPool>("docpool", threadCount);
+}
+
+void DocumentBroker::stopPollPool()
+{
+    if (PollPool)
+    {
+        PollPool->stop();
+        PollPool.reset();
+    }
+}
+
+void DocumentBroker::dumpPollPoolState(std::ostream& os)
+{
+    if (PollPool)
+        PollPool->dumpState(os);
+}
+#endif
+
 DocumentBroker::DocumentBroker(ChildType type, const std::string& uri, const Poco::URI& uriPublic,
                                const std::string& docKey, const std::string& configId,
                                unsigned mobileAppDocId)
@@ -183,8 +239,14 @@ DocumentBroker::DocumentBroker(ChildType type, const std::string& uri, const Poc
     , _docKey(docKey)
     , _docId(Util::encodeId(DocBrokerId++, 3))
     , _configId(configId)
-    , _poll(
-          std::make_shared<DocumentBrokerPoll>("doc" SHARED_DOC_THREADNAME_SUFFIX + _docId, *this))
+    , _downloadStarted(false)
+    , _poll(std::make_shared<DocumentBrokerPoll>("doc" SHARED_DOC_THREADNAME_SUFFIX + _docId,
+                                                 *this,
+#if !MOBILEAPP
+                                                 // Only an epoll set can wait on the pool.
+                                                 PollPool ? SocketPoll::Backend::Epoll :
+#endif
+                                                          SocketPoll::Backend::Poll))
     , _lockCtx(std::make_unique<LockContext>())
 #if !MOBILEAPP
     , _admin(Admin::instance())
@@ -193,6 +255,8 @@ DocumentBroker::DocumentBroker(ChildType type, const std::string& uri, const Poc
     , _loadDuration(0)
     , _wopiDownloadDuration(0)
     , _tileVersion(0)
+    , _tileScheduler(std::chrono::milliseconds(
+          ConfigUtil::getConfigValue<int>("per_document.tile_coalesce_ms", 0)))
     , _cursorPosX(0)
     , _cursorPosY(0)
     , _cursorWidth(0)
@@ -242,9 +306,24 @@ void DocumentBroker::setupPriorities()
     }
 }
 
+void DocumentBroker::startPoll()
+{
+#if !MOBILEAPP
+    if (PollPool)
+    {
+        PollPool->startPoll(_poll);
+        return;
+    }
+#endif
+
+    _poll->startThread();
+}
+
 void DocumentBroker::setupTransfer(SocketDisposition &disposition,
                                    SocketDisposition::MoveFunction transferFn)
 {
+    // Start it before the disposition does, on its own thread.
+    startPoll();
     disposition.setTransfer(*_poll, std::move(transferFn));
 }
 
@@ -254,7 +333,7 @@ void DocumentBroker::setupTransfer(const std::shared_ptr<StreamSocket>& socket,
     // Drop pretentions of ownership before _socketMove.
     SocketThreadOwnerChange::resetThreadOwner(*socket);
 
-    _poll->startThread();
+    startPoll();
     _poll->addCallback(
         [this, socket, transferFn]()
         {
@@ -275,9 +354,9 @@ void DocumentBroker::assertCorrectThread(const char* filename, int line) const
 }
 
 // The inner heart of the DocumentBroker - our poll loop.
-void DocumentBroker::pollThread()
+bool DocumentBroker::startPolling()
 {
-    std::chrono::steady_clock::time_point threadStart = std::chrono::steady_clock::now();
+    _pollState._threadStart = std::chrono::steady_clock::now();
 
     LOG_INF("Starting docBroker polling thread for docKey [" << _docKey << ']' << " and configId [" << _configId << ']');
 
@@ -285,10 +364,12 @@ void DocumentBroker::pollThread()
     do
     {
         static constexpr std::chrono::milliseconds timeoutMs(COMMAND_TIMEOUT_MS * 5);
-        _childProcess = getNewChild_Blocks(*_poll, _configId, _mobileAppDocId);
+        _childProcess = getRecycledChild();
+        if (!_childProcess)
+            _childProcess = getNewChild_Blocks(*_poll, _configId, _mobileAppDocId);
         if (_childProcess
             || std::chrono::duration_cast<std::chrono::milliseconds>(
-                   std::chrono::steady_clock::now() - threadStart)
+                   std::chrono::steady_clock::now() - _pollState._threadStart)
                    > timeoutMs)
             break;
 
@@ -318,26 +399,24 @@ void DocumentBroker::pollThread()
         COOLWSD::doHousekeeping();
 
         LOG_INF("Finished docBroker polling thread for docKey [" << _docKey << "].");
-        return;
+        return false;
     }
 
     // We have a child process.
     _childProcess->setDocumentBroker(shared_from_this());
     LOG_INF("Doc [" << _docKey << "] attached to child [" << _childProcess->getPid() << "].");
 
+    // Have the Kit unload the document when done, rather than exit, to take another.
+    if (isChildRecyclable())
+        _childProcess->sendTextFrame("recycle");
+
     setupPriorities();
 
 #if !MOBILEAPP
-    CONFIG_STATIC const std::size_t IdleDocTimeoutSecs =
-        ConfigUtil::getConfigValue<int>("per_document.idle_timeout_secs", 3600);
+    _pollState._lastBWUpdateTime = std::chrono::steady_clock::now();
+    _pollState._lastClipboardHashUpdateTime = _pollState._lastBWUpdateTime;
 
-    // Used to accumulate B/W deltas.
-    uint64_t adminSent = 0;
-    uint64_t adminRecv = 0;
-    auto lastBWUpdateTime = std::chrono::steady_clock::now();
-    auto lastClipboardHashUpdateTime = std::chrono::steady_clock::now();
-
-    const std::chrono::seconds limit_load_secs =
+    _pollState._limitLoadSecs =
 #if ENABLE_DEBUG
         // paused waiting for a debugger to attach
         // ignore load time out
@@ -345,339 +424,382 @@ void DocumentBroker::pollThread()
 #endif
                                         getLimitLoadSecs();
 
-    auto loadDeadline = std::chrono::steady_clock::now() + limit_load_secs;
+    _pollState._loadDeadline = std::chrono::steady_clock::now() + _pollState._limitLoadSecs;
 #endif
 
-    const auto limStoreFailures =
+    _pollState._limStoreFailures =
         ConfigUtil::getConfigValue<int>("per_document.limit_store_failures", 5);
 
-    bool waitingForMigrationMsg = false;
-    std::chrono::time_point<std::chrono::steady_clock> migrationMsgStartTime;
+    return true;
+}
+
+std::chrono::microseconds DocumentBroker::getPollTimeout() const
+{
+    const auto now = std::chrono::steady_clock::now();
+
+    // Wake up in time to give up waiting for the Kit to be recycled.
+    if (_pollState._recycleDeadline != std::chrono::steady_clock::time_point())
+        return std::max(std::chrono::duration_cast<std::chrono::microseconds>(
+                            _pollState._recycleDeadline - now),
+                        std::chrono::microseconds::zero());
+
+    // Poll more frequently while unloading to cleanup sooner.
+    // Wake up in time to render the tiles waiting for other views, if any.
+    return isUnloading() ? SocketPoll::DefaultPollTimeoutMicroS / 16
+                         : _tileScheduler.getTimeout(now, SocketPoll::DefaultPollTimeoutMicroS);
+}
+
+bool DocumentBroker::pollIteration()
+{
+#if !MOBILEAPP
+    CONFIG_STATIC const std::size_t IdleDocTimeoutSecs =
+        ConfigUtil::getConfigValue<int>("per_document.idle_timeout_secs", 3600);
+#endif
+
     static const std::chrono::microseconds migrationMsgTimeout = std::chrono::seconds(
         ConfigUtil::getConfigValue<int>("indirection_endpoint.migration_timeout_secs", 180));
 
-    // Main polling loop goodness.
-    while (!_stop && _poll->continuePolling() && !SigUtil::getTerminationFlag())
-    {
-        // Poll more frequently while unloading to cleanup sooner.
-        _poll->poll(isUnloading() ? SocketPoll::DefaultPollTimeoutMicroS / 16
-                                  : SocketPoll::DefaultPollTimeoutMicroS);
+    // Consolidate updates across multiple processed events.
+    processBatchUpdates();
 
-        // Consolidate updates across multiple processed events.
-        processBatchUpdates();
+    if (_stop)
+    {
+        if (waitingToRecycleChild())
+            return true;
 
-        if (_stop)
-        {
-            LOG_DBG("Doc [" << _docKey << "] is flagged to stop after returning from poll.");
-            break;
-        }
+        LOG_DBG("Doc [" << _docKey << "] is flagged to stop after returning from poll.");
+        return false;
+    }
 
-        if (_unitWsd && _unitWsd->isFinished())
-        {
-            stop("UnitTestFinished");
-            break;
-        }
+    if (_unitWsd && _unitWsd->isFinished())
+    {
+        stop("UnitTestFinished");
+        return false;
+    }
 
 #if !MOBILEAPP
-        const auto now = std::chrono::steady_clock::now();
+    const auto now = std::chrono::steady_clock::now();
 
-        // a tile's data is ~8k, a 4k screen is ~256 256x256 tiles -
-        // so double that - 4Mb per view.
-        if (_tileCache)
-            _tileCache->setMaxCacheSize(8 * 1024 * 256 * 2 * _sessions.size());
+    // a tile's data is ~8k, a 4k screen is ~256 256x256 tiles -
+    // so double that - 4Mb per view.
+    if (_tileCache)
+        _tileCache->setMaxCacheSize(8 * 1024 * 256 * 2 * _sessions.size());
 
-        if (isInteractive())
+    if (isInteractive())
+    {
+        // It is possible to dismiss the interactive dialog,
+        // exit the Kit process, or even crash. We would deadlock.
+        if (isUnloading())
         {
-            // It is possible to dismiss the interactive dialog,
-            // exit the Kit process, or even crash. We would deadlock.
-            if (isUnloading())
-            {
-                // We expect to have either isMarkedToDestroy() or
-                // isCloseRequested() in that case.
-                stop("abortedinteractive");
-            }
-
-            // Extend the deadline while we are interactiving with the user.
-            loadDeadline = now + limit_load_secs;
-            continue;
+            // We expect to have either isMarkedToDestroy() or
+            // isCloseRequested() in that case.
+            stop("abortedinteractive");
         }
 
-        if (!isLoaded() && (limit_load_secs > std::chrono::seconds::zero()) && (now > loadDeadline))
-        {
-            LOG_ERR("Doc [" << _docKey << "] is taking too long to load. Will kill process ["
-                    << _childProcess->getPid() << "]. per_document.limit_load_secs set to "
-                    << limit_load_secs << " secs.");
-            broadcastMessage("error: cmd=load kind=docloadtimeout");
+        // Extend the deadline while we are interactiving with the user.
+        _pollState._loadDeadline = now + _pollState._limitLoadSecs;
+        return !_stop;
+    }
 
-            // Brutal but effective.
-            if (_childProcess)
-                _childProcess->terminate();
+    if (!isLoaded() && (_pollState._limitLoadSecs > std::chrono::seconds::zero()) &&
+        (now > _pollState._loadDeadline))
+    {
+        LOG_ERR("Doc [" << _docKey << "] is taking too long to load. Will kill process ["
+                << _childProcess->getPid() << "]. per_document.limit_load_secs set to "
+                << _pollState._limitLoadSecs << " secs.");
+        broadcastMessage("error: cmd=load kind=docloadtimeout");
 
-            stop("Doc lifetime expired");
-            continue;
-        }
+        // Brutal but effective.
+        if (_childProcess)
+            _childProcess->terminate();
 
-        // Check if we had a sunset time and expired.
-        if (_limitLifeSeconds > std::chrono::seconds::zero()
-            && std::chrono::duration_cast<std::chrono::seconds>(now - threadStart)
-                   > _limitLifeSeconds)
-        {
-            LOG_WRN("Doc [" << _docKey << "] is taking too long to convert. Will kill process ["
-                            << _childProcess->getPid()
-                            << "]. per_document.limit_convert_secs set to "
-                            << _limitLifeSeconds.count() << " secs.");
-            broadcastMessage("error: cmd=load kind=docexpired");
+        stop("Doc lifetime expired");
+        return !_stop;
+    }
 
-            // Brutal but effective.
-            if (_childProcess)
-                _childProcess->terminate();
+    // Check if we had a sunset time and expired.
+    if (_limitLifeSeconds > std::chrono::seconds::zero()
+        && std::chrono::duration_cast<std::chrono::seconds>(now - _pollState._threadStart)
+               > _limitLifeSeconds)
+    {
+        LOG_WRN("Doc [" << _docKey << "] is taking too long to convert. Will kill process ["
+                        << _childProcess->getPid()
+                        << "]. per_document.limit_convert_secs set to "
+                        << _limitLifeSeconds.count() << " secs.");
+        broadcastMessage("error: cmd=load kind=docexpired");
 
-            stop("Convert-to timed out");
-            continue;
-        }
+        // Brutal but effective.
+        if (_childProcess)
+            _childProcess->terminate();
 
-        if (std::chrono::duration_cast<std::chrono::milliseconds>
-                    (now - lastBWUpdateTime).count() >= COMMAND_TIMEOUT_MS)
-        {
-            lastBWUpdateTime = now;
-            uint64_t sent = 0, recv = 0;
-            getIOStats(sent, recv);
+        stop("Convert-to timed out");
+        return !_stop;
+    }
 
-            uint64_t deltaSent = 0, deltaRecv = 0;
+    if (std::chrono::duration_cast<std::chrono::milliseconds>
+                (now - _pollState._lastBWUpdateTime).count() >= COMMAND_TIMEOUT_MS)
+    {
+        _pollState._lastBWUpdateTime = now;
+        uint64_t sent = 0, recv = 0;
+        getIOStats(sent, recv);
 
-            // connection drop transiently reduces this.
-            if (sent > adminSent)
-            {
-                deltaSent = sent - adminSent;
-                adminSent = sent;
-            }
-            if (recv > deltaRecv)
-            {
-                deltaRecv = recv - adminRecv;
-                adminRecv = recv;
-            }
-            LOG_TRC("Doc [" << _docKey << "] added stats sent: +" << deltaSent << ", recv: +" << deltaRecv << " bytes to totals.");
+        uint64_t deltaSent = 0, deltaRecv = 0;
 
-            // send change since last notification.
-            _admin.addBytes(getDocKey(), deltaSent, deltaRecv);
+        // connection drop transiently reduces this.
+        if (sent > _pollState._adminSent)
+        {
+            deltaSent = sent - _pollState._adminSent;
+            _pollState._adminSent = sent;
+        }
+        if (recv > deltaRecv)
+        {
+            deltaRecv = recv - _pollState._adminRecv;
+            _pollState._adminRecv = recv;
         }
+        LOG_TRC("Doc [" << _docKey << "] added stats sent: +" << deltaSent << ", recv: +" << deltaRecv << " bytes to totals.");
 
-        if (_storage && !_lockStateUpdateRequest && _lockCtx->needsRefresh(now))
+        // send change since last notification.
+        _admin.addBytes(getDocKey(), deltaSent, deltaRecv);
+
+        if (_tileCache)
         {
-            refreshLock();
+            const TileCache::ChainLengthCounts chainLengths =
+                _tileCache->getChainLengthCounts();
+            _admin.setDocTileCacheStats(
+                getDocKey(), _tileCache->getLookupCount(), _tileCache->getHitCount(),
+                _tileCache->getEvictionCount(), _tileCache->getCompactionCount(),
+                std::vector<uint64_t>(chainLengths.begin(), chainLengths.end()));
         }
+    }
+
+    if (_storage && !_lockStateUpdateRequest && _lockCtx->needsRefresh(now))
+    {
+        refreshLock();
+    }
 #endif
 
-        LOG_TRC("Poll: current activity: " << DocumentState::name(_docState.activity()));
-        switch (_docState.activity())
+    LOG_TRC("Poll: current activity: " << DocumentState::name(_docState.activity()));
+    switch (_docState.activity())
+    {
+        case DocumentState::Activity::None:
         {
-            case DocumentState::Activity::None:
-            {
 #if !MOBILEAPP
-                if (_checkFileInfo)
-                {
-                    // We are done. Safe to reset.
-                    LOG_TRC("Resetting checkFileInfo instance");
-                    _checkFileInfo.reset();
-                }
+            if (_checkFileInfo)
+            {
+                // We are done. Safe to reset.
+                LOG_TRC("Resetting checkFileInfo instance");
+                _checkFileInfo.reset();
+            }
 #endif
 
-                // Check if there are queued activities.
-                if (!_renameFilename.empty() && !_renameSessionId.empty())
-                {
-                    startRenameFileCommand();
-                    // Nothing more to do until the save is complete.
-                    continue;
-                }
+            // Check if there are queued activities.
+            if (!_renameFilename.empty() && !_renameSessionId.empty())
+            {
+                startRenameFileCommand();
+                // Nothing more to do until the save is complete.
+                return !_stop;
+            }
 
 #if !MOBILEAPP
-                // Remove idle documents after 1 hour.
-                if (isLoaded() && getIdleTimeSecs() >= IdleDocTimeoutSecs)
-                {
-                    autoSaveAndStop("idle");
-                }
-                else
+            // Remove idle documents after 1 hour.
+            if (isLoaded() && getIdleTimeSecs() >= IdleDocTimeoutSecs)
+            {
+                autoSaveAndStop("idle");
+            }
+            else
 #endif
-                if (_sessions.empty() && (isLoaded() || _docState.isMarkedToDestroy()))
-                {
-                    if (!isLoaded())
-                    {
-                        // Nothing to do; no sessions, not loaded, marked to destroy.
-                        stop("dead");
-                    }
-                    else if (_saveManager.isSaving() || isAsyncUploading())
-                    {
-                        LOG_DBG("Don't terminate dead DocumentBroker: async saving in progress for "
-                                "docKey ["
-                                << getDocKey() << "].");
-                        continue;
-                    }
-
-                    autoSaveAndStop("dead");
-                }
-                else if (COOLWSD::IndirectionServerEnabled && SigUtil::getShutdownRequestFlag() &&
-                         !_migrateMsgReceived)
+            if (_sessions.empty() && (isLoaded() || _docState.isMarkedToDestroy()))
+            {
+                if (!isLoaded())
                 {
-                    if (!waitingForMigrationMsg)
-                    {
-                        migrationMsgStartTime = std::chrono::steady_clock::now();
-                        waitingForMigrationMsg = true;
-                        break;
-                    }
-
-                    const auto timeNow = std::chrono::steady_clock::now();
-                    const auto elapsedMicroS =
-                        std::chrono::duration_cast<std::chrono::microseconds>(
-                            timeNow - migrationMsgStartTime);
-                    if (elapsedMicroS > migrationMsgTimeout)
-                    {
-                        LOG_WRN("Timeout waiting for migration message for docKey[" << _docKey
-                                                                                    << ']');
-                        _migrateMsgReceived = true;
-                        break;
-                    }
-                    LOG_DBG("Waiting for migration message to arrive before closing the document "
-                            "for docKey["
-                            << _docKey << ']');
+                    // Nothing to do; no sessions, not loaded, marked to destroy.
+                    stop("dead");
                 }
-                else if (_docState.isUnloadRequested() || SigUtil::getShutdownRequestFlag() ||
-                         _docState.isCloseRequested())
+                else if (_saveManager.isSaving() || isAsyncUploading())
                 {
-                    if (limStoreFailures > 0 && (_saveManager.saveFailureCount() >=
-                                                     static_cast<std::size_t>(limStoreFailures) ||
-                                                 _storageManager.uploadFailureCount() >=
-                                                     static_cast<std::size_t>(limStoreFailures)))
-                    {
-                        LOG_ERR(
-                            "Failed to store the document and reached maximum retry count of "
-                            << limStoreFailures
-                            << " Save failures: " << _saveManager.saveFailureCount()
-                            << ", Upload failures: " << _storageManager.uploadFailureCount()
-#if !MOBILEAPP
-                            << ". Giving up"
-                            << (_storage && _quarantine && _quarantine->isEnabled()
-                                    ? ". The document should be recoverable from the quarantine. "
-                                    : ", but Quarantine is disabled. ")
-#endif // !MOBILEAPP
-                        );
-                        stop("storefailed");
-                        continue;
-                    }
-
-                    const std::string reason =
-                        SigUtil::getShutdownRequestFlag()
-                            ? "recycling"
-                            : (!_closeReason.empty() ? _closeReason : "unloading");
-                    autoSaveAndStop(reason);
+                    LOG_DBG("Don't terminate dead DocumentBroker: async saving in progress for "
+                            "docKey ["
+                            << getDocKey() << "].");
+                    return !_stop;
                 }
-                else if (!_stop && _saveManager.needAutoSaveCheck())
+
+                autoSaveAndStop("dead");
+            }
+            else if (COOLWSD::IndirectionServerEnabled && SigUtil::getShutdownRequestFlag() &&
+                     !_migrateMsgReceived)
+            {
+                if (!_pollState._waitingForMigrationMsg)
                 {
-                    LOG_TRC("Triggering an autosave by timer");
-                    autoSave(/*force=*/false, /*dontSaveIfUnmodified=*/true);
+                    _pollState._migrationMsgStartTime = std::chrono::steady_clock::now();
+                    _pollState._waitingForMigrationMsg = true;
+                    break;
                 }
-                else if (!isAsyncUploading() && !_storageManager.lastUploadSuccessful() &&
-                         needToUploadToStorage() != NeedToUpload::No)
+
+                const auto timeNow = std::chrono::steady_clock::now();
+                const auto elapsedMicroS =
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        timeNow - _pollState._migrationMsgStartTime);
+                if (elapsedMicroS > migrationMsgTimeout)
                 {
-                    // Retry uploading, if the last one failed and we can try again.
-                    const auto session = getWriteableSession();
-                    if (session && !session->getAuthorization().isExpired())
-                    {
-                        checkAndUploadToStorage(session, /*justSaved=*/false);
-                    }
+                    LOG_WRN("Timeout waiting for migration message for docKey[" << _docKey
+                                                                                << ']');
+                    _migrateMsgReceived = true;
+                    break;
                 }
+                LOG_DBG("Waiting for migration message to arrive before closing the document "
+                        "for docKey["
+                        << _docKey << ']');
             }
-            break;
-
-            case DocumentState::Activity::Save:
-            case DocumentState::Activity::SaveAs:
+            else if (_docState.isUnloadRequested() || SigUtil::getShutdownRequestFlag() ||
+                     _docState.isCloseRequested())
             {
-                if (_docState.isKitDisconnected())
+                if (_pollState._limStoreFailures > 0 && (_saveManager.saveFailureCount() >=
+                                                 static_cast<std::size_t>(_pollState._limStoreFailures) ||
+                                             _storageManager.uploadFailureCount() >=
+                                                 static_cast<std::size_t>(_pollState._limStoreFailures)))
                 {
-                    // We will never save. No need to wait for timeout.
-                    LOG_DBG("Doc disconnected while saving. Ending save activity.");
-                    _saveManager.setLastSaveResult(/*success=*/false, /*newVersion=*/false);
-                    endActivity();
-                }
-                else
-                if (_saveManager.hasSavingTimedOut())
-                {
-                    LOG_DBG("Saving timedout. Ending save activity.");
-                    _saveManager.setLastSaveResult(/*success=*/false, /*newVersion=*/false);
-                    endActivity();
+                    LOG_ERR(
+                        "Failed to store the document and reached maximum retry count of "
+                        << _pollState._limStoreFailures
+                        << " Save failures: " << _saveManager.saveFailureCount()
+                        << ", Upload failures: " << _storageManager.uploadFailureCount()
+#if !MOBILEAPP
+                        << ". Giving up"
+                        << (_storage && _quarantine && _quarantine->isEnabled()
+                                ? ". The document should be recoverable from the quarantine. "
+                                : ", but Quarantine is disabled. ")
+#endif // !MOBILEAPP
+                    );
+                    stop("storefailed");
+                    return !_stop;
                 }
-            }
-            break;
 
-            case DocumentState::Activity::SyncFileTimestamp:
+                const std::string reason =
+                    SigUtil::getShutdownRequestFlag()
+                        ? "recycling"
+                        : (!_closeReason.empty() ? _closeReason : "unloading");
+                autoSaveAndStop(reason);
+            }
+            else if (!_stop && _saveManager.needAutoSaveCheck())
             {
-                // Last upload failed, redo CheckFileInfo to reset the modified time.
-                assert(!isAsyncUploading() && "Unexpected async-upload in progress");
-
-#if !MOBILEAPP
-                if (!_checkFileInfo)
+                LOG_TRC("Triggering an autosave by timer");
+                autoSave(/*force=*/false, /*dontSaveIfUnmodified=*/true);
+            }
+            else if (!isAsyncUploading() && !_storageManager.lastUploadSuccessful() &&
+                     needToUploadToStorage() != NeedToUpload::No)
+            {
+                // Retry uploading, if the last one failed and we can try again.
+                const auto session = getWriteableSession();
+                if (session && !session->getAuthorization().isExpired())
                 {
-                    const auto session = getFirstAuthorizedSession();
-                    if (!session)
-                    {
-                        // No session to synchronize the timestamp with.
-                        // Last resort; reset the timestamp and let it be.
-                        // We can't upload without a valid token anyway.
-                        LOG_WRN("No valid session to synchronize the timestamp with. Setting "
-                                "timestamp as unsafe");
-                        _storage->setLastModifiedTimeUnSafe();
-                        endActivity(); // End the SyncFileTimestamp activity.
-                    }
-                    else
-                    {
-                        checkFileInfo(session, HTTP_REDIRECTION_LIMIT);
-                    }
+                    checkAndUploadToStorage(session, /*justSaved=*/false);
                 }
-#endif
             }
-            break;
+        }
+        break;
 
-            // We have some activity ongoing.
-            default:
+        case DocumentState::Activity::Save:
+        case DocumentState::Activity::SaveAs:
+        {
+            if (_docState.isKitDisconnected())
             {
-                constexpr std::chrono::seconds postponeAutosaveDuration(30);
-                LOG_TRC("Postponing autosave check by " << postponeAutosaveDuration);
-                _saveManager.postponeAutosave(postponeAutosaveDuration);
+                // We will never save. No need to wait for timeout.
+                LOG_DBG("Doc disconnected while saving. Ending save activity.");
+                _saveManager.setLastSaveResult(/*success=*/false, /*newVersion=*/false);
+                endActivity();
+            }
+            else
+            if (_saveManager.hasSavingTimedOut())
+            {
+                LOG_DBG("Saving timedout. Ending save activity.");
+                _saveManager.setLastSaveResult(/*success=*/false, /*newVersion=*/false);
+                endActivity();
             }
-            break;
         }
+        break;
 
-#if !MOBILEAPP
-        if (std::chrono::duration_cast<std::chrono::minutes>(now - lastClipboardHashUpdateTime).count() >= 2)
+        case DocumentState::Activity::SyncFileTimestamp:
         {
-            for (const auto& it : _sessions)
+            // Last upload failed, redo CheckFileInfo to reset the modified time.
+            assert(!isAsyncUploading() && "Unexpected async-upload in progress");
+
+#if !MOBILEAPP
+            if (!_checkFileInfo)
             {
-                if (it.second->staleWaitDisconnect(now))
+                const auto session = getFirstAuthorizedSession();
+                if (!session)
                 {
-                    LOG_WRN("Unusual, Kit session " << it.second->getId()
-                                                    << " failed its disconnect handshake, killing");
-                    finalRemoveSession(it.second);
-                    break; // it invalid.
+                    // No session to synchronize the timestamp with.
+                    // Last resort; reset the timestamp and let it be.
+                    // We can't upload without a valid token anyway.
+                    LOG_WRN("No valid session to synchronize the timestamp with. Setting "
+                            "timestamp as unsafe");
+                    _storage->setLastModifiedTimeUnSafe();
+                    endActivity(); // End the SyncFileTimestamp activity.
+                }
+                else
+                {
+                    checkFileInfo(session, HTTP_REDIRECTION_LIMIT);
                 }
             }
+#endif
         }
+        break;
 
-        if (std::chrono::duration_cast<std::chrono::minutes>(now - lastClipboardHashUpdateTime).count() >= 5)
+        // We have some activity ongoing.
+        default:
         {
-            LOG_TRC("Rotating clipboard keys");
-            for (const auto& it : _sessions)
-                it.second->rotateClipboardKey(true);
+            constexpr std::chrono::seconds postponeAutosaveDuration(30);
+            LOG_TRC("Postponing autosave check by " << postponeAutosaveDuration);
+            _saveManager.postponeAutosave(postponeAutosaveDuration);
+        }
+        break;
+    }
 
-            lastClipboardHashUpdateTime = now;
+#if !MOBILEAPP
+    if (std::chrono::duration_cast<std::chrono::minutes>(now - _pollState._lastClipboardHashUpdateTime).count() >= 2)
+    {
+        for (const auto& it : _sessions)
+        {
+            if (it.second->staleWaitDisconnect(now))
+            {
+                LOG_WRN("Unusual, Kit session " << it.second->getId()
+                                                << " failed its disconnect handshake, killing");
+                finalRemoveSession(it.second);
+                break; // it invalid.
+            }
         }
-#endif
     }
 
+    if (std::chrono::duration_cast<std::chrono::minutes>(now - _pollState._lastClipboardHashUpdateTime).count() >= 5)
+    {
+        LOG_TRC("Rotating clipboard keys");
+        for (const auto& it : _sessions)
+            it.second->rotateClipboardKey(true);
+
+        _pollState._lastClipboardHashUpdateTime = now;
+    }
+#endif
+
+    return !_stop;
+}
+
+void DocumentBroker::finishPolling()
+{
     LOG_INF("Finished polling doc ["
             << _docKey << "]. stop: " << _stop << ", continuePolling: " << _poll->continuePolling()
             << ", CloseReason: [" << _closeReason << ']'
             << ", ShutdownRequestFlag: " << SigUtil::getShutdownRequestFlag()
             << ", TerminationFlag: " << SigUtil::getTerminationFlag());
 
+    if (_childProcess && _pollState._childRecycled && _sessions.empty() &&
+        !_docState.isKitDisconnected() && recycleChild(_childProcess))
+    {
+        LOG_INF("Handed over child [" << getPid() << "] of doc [" << _docKey
+                                      << "] to load another document");
+        _childProcess.reset();
+    }
+
     if (_childProcess && _sessions.empty())
     {
         LOG_INF("Requesting termination of child [" << getPid() << "] for doc [" << _docKey
@@ -903,6 +1025,29 @@ void DocumentBroker::joinThread()
     _poll->joinThread();
 }
 
+bool DocumentBroker::waitingToRecycleChild()
+{
+    if (!_childProcess || !isChildRecyclable() || !isLoaded() || _pollState._childRecycled ||
+        _docState.isKitDisconnected())
+        return false;
+
+    // Keep polling, rather than block, for the Kit's 'recycled:'.
+    const auto now = std::chrono::steady_clock::now();
+    if (_pollState._recycleDeadline == std::chrono::steady_clock::time_point())
+    {
+        LOG_DBG("Waiting for child [" << getPid() << "] to unload doc [" << _docKey
+                                      << "] to load another document");
+        _pollState._recycleDeadline = now + std::chrono::milliseconds(COMMAND_TIMEOUT_MS);
+    }
+    else if (now >= _pollState._recycleDeadline)
+    {
+        LOG_WRN("Child [" << getPid() << "] didn't unload doc [" << _docKey << "] in time");
+        return false;
+    }
+
+    return true;
+}
+
 void DocumentBroker::stop(const std::string& reason)
 {
     if (_closeReason.empty() || _closeReason == reason)
@@ -961,6 +1106,7 @@ bool DocumentBroker::download(
     bool firstInstance = false;
     if (_storage == nullptr)
     {
+        _downloadStarted = true;
         _docState.setStatus(DocumentState::Status::Downloading);
 
         if(_unitWsd != nullptr)
@@ -1218,16 +1364,61 @@ bool DocumentBroker::doDownloadDocument(const Authorization& auth,
 {
     assert(_storage && !_storage->isDownloaded());
 
-    LOG_DBG("Download file for docKey [" << _docKey << ']');
+    std::string localPath;
+#if !MOBILEAPP
+    auto* wopiStorage = dynamic_cast<WopiStorage*>(_storage.get());
+    const std::string cacheKey =
+        wopiStorage != nullptr && templateSource.empty()
+            ? DocumentCache::getKey(_docKey, wopiStorage->getVersion(),
+                                    _storage->getLastModifiedTime())
+            : std::string();
+
     std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-    std::string localPath = _storage->downloadStorageFileToLocal(auth, *_lockCtx, templateSource);
+    bool fromCache = false;
+    if (!cacheKey.empty() && DocumentCache::isEnabled())
+    {
+        localPath = wopiStorage->downloadFromCache(cacheKey);
+        fromCache = !localPath.empty();
+        getFileCallDurationMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+    }
+
+    // Adopt the document if it was prefetched while we were spawning the Kit.
+    if (localPath.empty() && _getFile && _getFile->state() == GetFile::State::Pass &&
+        wopiStorage != nullptr && templateSource.empty())
+    {
+        LOG_DBG("Adopting prefetched file for docKey [" << _docKey << ']');
+        localPath = wopiStorage->adoptDownloadedFile(_getFile->filePath(), _getFile->wopiCert(),
+                                                     _getFile->subjectHash());
+        getFileCallDurationMs = _getFile->duration();
+    }
+    else if (localPath.empty() && _getFile)
+    {
+        LOG_DBG("Prefetching file for docKey [" << _docKey << "] was not successful: "
+                                                << GetFile::name(_getFile->state()));
+    }
+
+    _getFile.reset(); // Done with it, and removes the temporary file, if not adopted.
+#endif // !MOBILEAPP
+
     if (localPath.empty())
     {
-        throw std::runtime_error("Failed to retrieve document from storage");
+        LOG_DBG("Download file for docKey [" << _docKey << ']');
+        const auto downloadStart = std::chrono::steady_clock::now();
+        localPath = _storage->downloadStorageFileToLocal(auth, *_lockCtx, templateSource);
+        if (localPath.empty())
+        {
+            throw std::runtime_error("Failed to retrieve document from storage");
+        }
+
+        getFileCallDurationMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - downloadStart);
     }
 
-    getFileCallDurationMs = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::steady_clock::now() - start);
+#if !MOBILEAPP
+    if (!fromCache && !cacheKey.empty())
+        DocumentCache::cacheDocument(cacheKey, _storage->getRootFilePath());
+#endif // !MOBILEAPP
 
     _docState.setStatus(DocumentState::Status::Loading); // Done downloading.
 
@@ -1282,6 +1473,26 @@ bool DocumentBroker::doDownloadDocument(const Authorization& auth,
     _tileCache = std::make_unique<TileCache>(_storage->getUri().toString(),
                                              _saveManager.getLastModifiedTime(), dontUseCache);
     _tileCache->setThreadOwner(std::this_thread::get_id());
+    if (ConfigUtil::getConfigValue<bool>("per_document.tile_compaction[@enable]", false))
+    {
+        _tileCache->setCompactionLimits(
+            ConfigUtil::getConfigValue<std::size_t>("per_document.tile_compaction.max_deltas", 32),
+            ConfigUtil::getConfigValue<std::size_t>(
+                "per_document.tile_compaction.max_delta_percent", 100));
+    }
+    _tileCache->setVisibleAreaProvider(
+        [this](std::vector<TileCache::VisibleArea>& areas)
+        {
+            for (const auto& it : _sessions)
+            {
+                const std::shared_ptr<ClientSession>& session = it.second;
+                const Util::Rectangle area = session->getNormalizedVisibleArea();
+                if (area.hasSurface())
+                    areas.push_back({ session->getCanonicalViewId(),
+                                      session->getTileWidthInTwips(),
+                                      session->getTileHeightInTwips(), area });
+            }
+        });
 
     return true;
 }
@@ -3958,6 +4169,7 @@ void DocumentBroker::finalRemoveSession(const std::shared_ptr<ClientSession>& se
         }
 
         const bool readonly = session->isReadOnly();
+        session->abandonSlideRendering(shared_from_this());
         session->dispose();
 
         // Remove. The caller must have a reference to the session
@@ -4269,6 +4481,13 @@ bool DocumentBroker::handleInput(const std::shared_ptr<Message>& message)
                                                       message->size() - firstLine.size() - 1);
             }
         }
+        else if (message->firstTokenMatches("recycled:"))
+        {
+            LOG_CHECK_RET(message->tokens().size() == 1, false);
+            LOG_DBG("Child [" << getPid() << "] unloaded doc [" << _docKey
+                              << "] and cleaned up after it");
+            _pollState._childRecycled = true;
+        }
         else if (message->firstTokenMatches("forcedtraceevent:"))
         {
             LOG_CHECK_RET(message->tokens().size() == 1, false);
@@ -4418,9 +4637,8 @@ void DocumentBroker::handleTileCombinedRequest(TileCombined& tileCombined, bool
     if (hasOldWireId)
         tileCombined.setHasOldWireId();
 
-    // Send rendering request, prerender before we actually send the tiles
-    if (!tilesNeedsRendering.empty())
-        sendTileCombine(TileCombined::create(tilesNeedsRendering));
+    // Request rendering, prerender before we actually send the tiles
+    scheduleTileRendering(tilesNeedsRendering, session, now);
 
     // Accumulate tiles
     std::deque<TileDesc>& requestedTiles = session->getRequestedTiles();
@@ -4575,12 +4793,11 @@ void DocumentBroker::handleMediaRequest(const std::string_view range,
     }
 }
 
-bool DocumentBroker::requestTileRendering(TileDesc& tile, bool forceKeyframe, int version,
+void DocumentBroker::requestTileRendering(TileDesc& tile, bool forceKeyframe, int version,
                                           const std::chrono::steady_clock::time_point now,
                                           std::vector<TileDesc>& tilesNeedsRendering,
                                           const std::shared_ptr<ClientSession>& session)
 {
-    bool allSamePartAndSize = true;
     if (!tileCache().hasTileBeingRendered(tile, &now) || // There is no in progress rendering of the given tile
         tileCache().getTileBeingRenderedVersion(tile) < tile.getVersion()) // We need a newer version
     {
@@ -4591,13 +4808,81 @@ bool DocumentBroker::requestTileRendering(TileDesc& tile, bool forceKeyframe, in
             LOG_TRC("Forcing keyframe for tile was oldwid " << tile.getOldWireId());
             tile.forceKeyframe();
         }
-        allSamePartAndSize &= tilesNeedsRendering.empty() || tile.sameTileCombineParams(tilesNeedsRendering.back());
         tilesNeedsRendering.push_back(tile);
         _debugRenderedTileCount++;
     }
 
     tileCache().subscribeToTileRendering(tile, session, now);
-    return allSamePartAndSize;
+}
+
+void DocumentBroker::scheduleTileRendering(const std::vector<TileDesc>& tilesNeedsRendering,
+                                           const std::shared_ptr<ClientSession>& session,
+                                           std::chrono::steady_clock::time_point now)
+{
+    if (tilesNeedsRendering.empty())
+        return;
+
+    _tileScheduler.enqueue(tilesNeedsRendering, now);
+
+    // Only wait for the views that could request the same tiles.
+    const CanonicalViewId canonicalViewId = session->getCanonicalViewId();
+    const bool shared = std::any_of(_sessions.begin(), _sessions.end(),
+                                    [&](const auto& pair)
+                                    {
+                                        return pair.second != session &&
+                                               pair.second->getCanonicalViewId() ==
+                                                   canonicalViewId;
+                                    });
+    if (!shared || _tileScheduler.isDue(now))
+        flushTileRendering();
+}
+
+void DocumentBroker::requestTileCompaction()
+{
+    std::vector<TileDesc> tiles = tileCache().takeTilesToCompact();
+    if (tiles.empty())
+        return;
+
+    // Render a fresh keyframe to replace each long delta chain. This is
+    // done by the Kit, which has the pixels at hand, in the background.
+    // The views requesting these tiles meanwhile get the keyframe.
+    const auto now = std::chrono::steady_clock::now();
+    ++_tileVersion;
+    for (TileDesc& tile : tiles)
+    {
+        tile.setVersion(_tileVersion);
+        tile.forceKeyframe();
+        tileCache().registerTileRendering(tile, now);
+    }
+
+    LOG_DBG("Requesting " << tiles.size() << " keyframes to compact long delta chains");
+    _tileScheduler.enqueue(tiles, now);
+}
+
+void DocumentBroker::flushTileRendering()
+{
+    ASSERT_CORRECT_THREAD();
+
+    const std::size_t requestCount = _tileScheduler.getRequestCount();
+    const std::size_t combineCount = _tileScheduler.getCombineCount();
+
+    const std::vector<TileCombined> tileCombines = _tileScheduler.flush();
+    for (const TileCombined& tileCombined : tileCombines)
+    {
+        if (_childProcess)
+            sendTileCombine(tileCombined);
+        else
+        {
+            // Don't leave the views waiting for tiles that won't come.
+            LOG_WRN("No child to render " << tileCombined.getTiles().size() << " tiles");
+            for (const TileDesc& tile : tileCombined.getTiles())
+                tileCache().abandonTileRendering(tile);
+        }
+    }
+
+    if (_unitWsd)
+        _unitWsd->onTileCombinesScheduled(_tileScheduler.getRequestCount() - requestCount,
+                                          _tileScheduler.getCombineCount() - combineCount);
 }
 
 void DocumentBroker::sendRequestedTiles(const std::shared_ptr<ClientSession>& session)
@@ -4618,7 +4903,6 @@ void DocumentBroker::sendRequestedTiles(const std::shared_ptr<ClientSession>& se
     if (!requestedTiles.empty() && hasTileCache())
     {
         std::vector<TileDesc> tilesNeedsRendering;
-        bool allSamePartAndSize = true;
         while (!requestedTiles.empty() &&
                session->getTilesOnFlyCount() < tilesOnFlyUpperLimit)
         {
@@ -4650,52 +4934,13 @@ void DocumentBroker::sendRequestedTiles(const std::shared_ptr<ClientSession>& se
                     bumpedVersion = true;
                 }
                 bool forceKeyFrame = !cachedTile;
-                allSamePartAndSize &= requestTileRendering(tile, forceKeyFrame, _tileVersion, now, tilesNeedsRendering, session);
+                requestTileRendering(tile, forceKeyFrame, _tileVersion, now, tilesNeedsRendering, session);
             }
             requestedTiles.pop_front();
         }
 
-        // Send rendering request for those tiles which were not prerendered
-        if (!tilesNeedsRendering.empty())
-        {
-            if (allSamePartAndSize)
-            {
-                // typically all requests match sufficiently to form a single tilecombine
-                sendTileCombine(TileCombined::create(tilesNeedsRendering));
-            }
-            else
-            {
-                // but if not, split them by matching groups of requests to send a separate
-                // tilecombine for each group
-                std::vector<std::vector<TileDesc>> groupsNeedsRendering(1);
-                auto it = tilesNeedsRendering.begin();
-                // start off with one group bucket
-                groupsNeedsRendering[0].push_back(*it++);
-                while (it != tilesNeedsRendering.end())
-                {
-                    bool inserted = false;
-                    // check if tile should go into an existing group bucket
-                    for (size_t i = 0; i < groupsNeedsRendering.size(); ++i)
-                    {
-                        if (it->sameTileCombineParams(groupsNeedsRendering[i][0]))
-                        {
-                            groupsNeedsRendering[i].push_back(*it);
-                            inserted = true;
-                            break;
-                        }
-                    }
-                    // if not, add another and put it there
-                    if (!inserted)
-                    {
-                        groupsNeedsRendering.emplace_back();
-                        groupsNeedsRendering.back().push_back(*it);
-                    }
-                    ++it;
-                }
-                for (const auto& group : groupsNeedsRendering)
-                    sendTileCombine(TileCombined::create(group));
-            }
-        }
+        // Request rendering for those tiles which were not prerendered
+        scheduleTileRendering(tilesNeedsRendering, session, now);
     }
 }
 
@@ -4716,6 +4961,7 @@ void DocumentBroker::handleTileResponse(const std::shared_ptr<Message>& message)
             const std::size_t offset = firstLine.size() + 1;
 
             tileCache().saveTileAndNotify(tile, buffer + offset, length - offset);
+            requestTileCompaction();
         }
         else
         {
@@ -4745,11 +4991,24 @@ void DocumentBroker::handleTileCombinedResponse(const std::shared_ptr<Message>&
             const char* buffer = message->data().data();
             std::size_t offset = firstLine.size() + 1;
 
+            // The Kit may stream a render as several partial tilecombines,
+            // each carrying only the tiles encoded so far; every tile is
+            // saved and forwarded to its subscribers independently.
             for (const auto& tile : tileCombined.getTiles())
             {
+                if (offset + tile.getImgSize() > length)
+                {
+                    LOG_ERR("Truncated tilecombine response, tile " << tile.debugName()
+                                                                    << " exceeds message size of "
+                                                                    << length << " bytes");
+                    break;
+                }
+
                 tileCache().saveTileAndNotify(tile, buffer + offset, tile.getImgSize());
                 offset += tile.getImgSize();
             }
+
+            requestTileCompaction();
         }
         else
         {
@@ -5083,6 +5342,9 @@ void DocumentBroker::broadcastMessageToOthers(const std::string& message,
 
 void DocumentBroker::processBatchUpdates()
 {
+    if (_tileScheduler.isDue(std::chrono::steady_clock::now()))
+        flushTileRendering();
+
 #if !MOBILEAPP
     const auto timeSinceLastNotifyMs =
         std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -5306,6 +5568,8 @@ void DocumentBroker::dumpState(std::ostream& os)
     os << '\n';
     _lockCtx->dumpState(os);
 
+    _tileScheduler.dumpState(os);
+
     if (_tileCache)
     {
         os << '\n';
@@ -29,6 +29,7 @@
 #include "Log.hpp"
 #include "QuarantineUtil.hpp"
 #include "TileDesc.hpp"
+#include "TileScheduler.hpp"
 #include "Util.hpp"
 #include "net/Socket.hpp"
 #include "net/WebSocketHandler.hpp"
@@ -49,8 +50,10 @@
 class PrisonerRequestDispatcher;
 class CheckFileInfo;
 class DocumentBroker;
+class GetFile;
 class LockContext;
 class PresetsInstallTask;
+class SocketPollPool;
 class TileCache;
 class Message;
 
@@ -228,6 +231,9 @@ class DocumentBroker : public std::enable_shared_from_this<DocumentBroker>
 
     void setupPriorities();
 
+    /// Starts polling, on the PollPool if any, or on its own thread.
+    void startPoll();
+
 public:
     /// How to prioritize this document.
     enum class ChildType {
@@ -252,6 +258,17 @@ public:
     /// Called when removed from the DocBrokers list
     virtual void dispose() {}
 
+#if !MOBILEAPP
+    /// Runs the polls of the documents created from now on a pool of
+    /// @threadCount threads, instead of a thread each.
+    static void startPollPool(std::size_t threadCount);
+
+    /// Stops the pool, once all the documents are done.
+    static void stopPollPool();
+
+    static void dumpPollPoolState(std::ostream& os);
+#endif
+
     /// setup the transfer of a socket into this DocumentBroker poll.
     void setupTransfer(SocketDisposition &disposition,
                        SocketDisposition::MoveFunction transferFn);
@@ -260,6 +277,20 @@ public:
     void setupTransfer(const std::shared_ptr<StreamSocket>& socket,
                        const SocketDisposition::MoveFunction& transferFn);
 
+#if !MOBILEAPP
+    /// Returns true iff this is the first to download the document,
+    /// which can then be prefetched with WOPI::GetFile asynchronously.
+    bool claimDownload() { return !_downloadStarted.exchange(true); }
+
+    /// Set the prefetched document to adopt, instead of downloading it.
+    /// Must be called in the DocBroker thread. Ignored once the storage exists.
+    void setPrefetchedDownload(const std::shared_ptr<GetFile>& getFile)
+    {
+        if (!_storage)
+            _getFile = getFile;
+    }
+#endif
+
     /// Flag for termination. Note that this doesn't save any unsaved changes in the document
     void stop(const std::string& reason);
 
@@ -411,6 +442,19 @@ public:
     void sendRequestedTiles(const std::shared_ptr<ClientSession>& session);
     void sendTileCombine(const TileCombined& tileCombined);
 
+    /// Queues the tiles that need rendering for the given session in the
+    /// TileScheduler, to be rendered together with those of the views
+    /// sharing its CanonicalViewId, or immediately when there are none.
+    void scheduleTileRendering(const std::vector<TileDesc>& tilesNeedsRendering,
+                               const std::shared_ptr<ClientSession>& session,
+                               std::chrono::steady_clock::time_point now);
+
+    /// Sends all the tiles pending in the TileScheduler to be rendered.
+    void flushTileRendering();
+
+    /// Queues a keyframe render for the cached tiles with long delta chains.
+    void requestTileCompaction();
+
     enum ClipboardRequest {
         CLIP_REQUEST_SET,
         CLIP_REQUEST_GET,
@@ -590,8 +634,7 @@ public:
 
 private:
     /// Checks if we really need to request tile rendering or it's in progress
-    /// returns true if all tiles are of the same part and size so can be grouped
-    inline bool requestTileRendering(TileDesc& tile, bool forceKeyFrame, int version,
+    inline void requestTileRendering(TileDesc& tile, bool forceKeyFrame, int version,
                                      const std::chrono::steady_clock::time_point now,
                                      std::vector<TileDesc>& tilesNeedsRendering,
                                      const std::shared_ptr<ClientSession>& session);
@@ -844,9 +887,20 @@ private:
     /// Forward a message from child session to its respective client session.
     bool forwardToClient(const std::shared_ptr<Message>& payload);
 
-    /// The thread function that all of the I/O for all sessions
-    /// associated with this document.
-    void pollThread();
+    /// The polling loop that does all of the I/O for all sessions associated
+    /// with this document, one iteration at a time, on its own thread or on
+    /// the PollPool.
+    /// Gets a Kit process. Returns false to finish without polling.
+    bool startPolling();
+    /// The maximum time to wait for events in the next poll.
+    std::chrono::microseconds getPollTimeout() const;
+    /// Handles what the last poll got. Returns false to stop polling.
+    bool pollIteration();
+    /// Saves, flushes and terminates the Kit after polling.
+    void finishPolling();
+    /// Returns true while, stopped, we wait for the Kit to unload our
+    /// document and clean up after it, to hand it over to another.
+    bool waitingToRecycleChild();
 
     /// Sum the I/O stats from all connected sessions
     void getIOStats(uint64_t &sent, uint64_t &recv);
@@ -857,6 +911,20 @@ private:
     /// a convert-to request or doctored to look like one.
     virtual bool isConvertTo() const { return false; }
 
+    /// Returns true iff our Kit may be kept, once done with our document,
+    /// to load another, rather than terminated. See recycleChild().
+    virtual bool isChildRecyclable() const { return false; }
+
+    /// Returns a Kit, done with another document, to reuse, if any.
+    virtual std::shared_ptr<ChildProcess> getRecycledChild() { return nullptr; }
+
+    /// Takes over our Kit, done with our document, to reuse it.
+    /// Returns false to have it terminated instead.
+    virtual bool recycleChild(const std::shared_ptr<ChildProcess>& /*childProcess*/)
+    {
+        return false;
+    }
+
     /// Request manager.
     /// Encapsulates common fields for
     /// Save and Upload requests.
@@ -1709,11 +1777,37 @@ private:
 #if !MOBILEAPP
     /// The current CheckFileInfo request, if any.
     std::shared_ptr<CheckFileInfo> _checkFileInfo;
+    /// The prefetched document, if any, to adopt when downloading.
+    std::shared_ptr<GetFile> _getFile;
     std::shared_ptr<PresetsInstallTask> _asyncInstallTask;
 #endif
 
+    /// Set once the document download is claimed or started.
+    std::atomic<bool> _downloadStarted;
+
     std::shared_ptr<DocumentBrokerPoll> _poll;
 
+    /// The state of the polling loop, across its iterations.
+    struct PollState
+    {
+        std::chrono::steady_clock::time_point _threadStart;
+        /// Used to accumulate B/W deltas.
+        uint64_t _adminSent = 0;
+        uint64_t _adminRecv = 0;
+        std::chrono::steady_clock::time_point _lastBWUpdateTime;
+        std::chrono::steady_clock::time_point _lastClipboardHashUpdateTime;
+        std::chrono::seconds _limitLoadSecs{};
+        std::chrono::steady_clock::time_point _loadDeadline;
+        int _limStoreFailures = 0;
+        bool _waitingForMigrationMsg = false;
+        std::chrono::steady_clock::time_point _migrationMsgStartTime;
+        /// Until when we wait for the Kit to be recycled, once stopped.
+        std::chrono::steady_clock::time_point _recycleDeadline;
+        /// The Kit unloaded our document, and cleaned up after it.
+        bool _childRecycled = false;
+    };
+    PollState _pollState;
+
     /// The current upload request, if any.
     /// For now we can only have one at a time.
     std::unique_ptr<UploadRequest> _uploadRequest;
@@ -1750,6 +1844,9 @@ private:
     /// painting and invalidation.
     std::atomic<std::size_t> _tileVersion;
 
+    /// Batches the tiles to render from all the sessions.
+    TileScheduler _tileScheduler;
+
     int _cursorPosX;
     int _cursorPosY;
     int _cursorWidth;
@@ -1789,6 +1886,11 @@ private:
 
     /// Unique DocBroker ID for tracing and debugging.
     static std::atomic<unsigned> DocBrokerId;
+
+#if !MOBILEAPP
+    /// Runs the polls of all the documents, when enabled.
+    static std::unique_ptr<SocketPollPool> PollPool;
+#endif
 };
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
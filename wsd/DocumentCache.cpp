@@ -0,0 +1,352 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include "DocumentCache.hpp"
+
+#include <Poco/Crypto/DigestEngine.h>
+#include <Poco/DigestEngine.h>
+#include <Poco/File.h>
+#include <Poco/Path.h>
+#include <Poco/SHA1Engine.h>
+
+#include <common/ConfigUtil.hpp>
+#include <common/FileUtil.hpp>
+#include <common/Log.hpp>
+#include <common/Util.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+/// The WOPI server certificate, if any, is stored in this directory next to the document.
+constexpr const char CertsSuffix[] = ".certs";
+
+/// True iff @name is one of our keys, a SHA-1 in hex, possibly with a suffix.
+bool isCacheFile(const std::string& name)
+{
+    constexpr std::size_t KeyLength = 40;
+    return name.size() >= KeyLength &&
+           std::all_of(name.begin(), name.begin() + KeyLength,
+                       [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); }) &&
+           (name.size() == KeyLength || name[KeyLength] == '.');
+}
+
+/// Copies @srcPath to the new file @destPath, created with @mode.
+/// Returns the SHA-256 of the content copied, or an empty string on failure.
+std::string copyAndHash(const std::string& srcPath, const std::string& destPath, mode_t mode)
+{
+    const int src = ::open(srcPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src < 0)
+    {
+        LOG_SYS("DocumentCache failed to open [" << srcPath << ']');
+        return std::string();
+    }
+
+    const int dest = ::open(destPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+    if (dest < 0)
+    {
+        LOG_SYS("DocumentCache failed to create [" << destPath << ']');
+        ::close(src);
+        return std::string();
+    }
+
+    Poco::Crypto::DigestEngine sha256("SHA256");
+    std::vector<char> buffer(64 * 1024);
+    bool failed = false;
+    for (;;)
+    {
+        const ssize_t len = FileUtil::read(src, buffer.data(), buffer.size());
+        if (len <= 0)
+        {
+            failed = len < 0;
+            break;
+        }
+
+        sha256.update(buffer.data(), len);
+        for (ssize_t offset = 0; offset < len && !failed;)
+        {
+            const ssize_t wrote = ::write(dest, buffer.data() + offset, len - offset);
+            if (wrote < 0 && errno == EINTR)
+                continue;
+
+            failed = wrote <= 0;
+            offset += wrote;
+        }
+
+        if (failed)
+            break;
+    }
+
+    ::close(src);
+    if (::close(dest) != 0 || failed)
+    {
+        LOG_SYS("DocumentCache failed to copy [" << srcPath << "] to [" << destPath << ']');
+        FileUtil::removeFile(destPath);
+        return std::string();
+    }
+
+    return Poco::Crypto::DigestEngine::digestToHex(sha256.digest());
+}
+
+/// Copies all the files in @srcDir into @destDir, creating it.
+void copyDir(const std::string& srcDir, const std::string& destDir, mode_t mode)
+{
+    if (::mkdir(destDir.c_str(), S_IRWXU) < 0 && errno != EEXIST)
+    {
+        LOG_SYS("Failed to create directory [" << destDir << ']');
+        return;
+    }
+
+    for (const std::string& name : FileUtil::getDirEntries(srcDir))
+    {
+        copyAndHash(Poco::Path(srcDir, name).toString(), Poco::Path(destDir, name).toString(),
+                    mode);
+    }
+}
+
+} // namespace
+
+std::list<DocumentCache::Entry> DocumentCache::Entries;
+std::unordered_map<std::string, std::list<DocumentCache::Entry>::iterator>
+    DocumentCache::EntriesMap;
+std::mutex DocumentCache::Mutex;
+std::string DocumentCache::CachePath;
+std::size_t DocumentCache::MaxSizeBytes;
+std::size_t DocumentCache::SizeBytes;
+std::atomic<uint64_t> DocumentCache::HitCount;
+std::atomic<uint64_t> DocumentCache::MissCount;
+std::atomic<uint64_t> DocumentCache::BytesSaved;
+
+void DocumentCache::initialize(const std::string& path)
+{
+    if (!ConfigUtil::getConfigValue<bool>("document_cache[@enable]", false) ||
+        !CachePath.empty())
+    {
+        return;
+    }
+
+    initialize(path,
+               ConfigUtil::getConfigValue<std::size_t>("document_cache.limit_dir_size_mb", 1024) *
+                   1024 * 1024);
+}
+
+void DocumentCache::initialize(const std::string& path, std::size_t maxSizeBytes)
+{
+    MaxSizeBytes = maxSizeBytes;
+    LOG_INF("Initializing DocumentCache at [" << path << "] with Max Size: " << MaxSizeBytes
+                                              << " bytes");
+
+    // Make sure the cache directory exists, or we throw if we can't create it.
+    Poco::File(path).createDirectories();
+
+    // Earlier versions linked the entries into the jails, where they could have been
+    // modified, and we have no hashes of them, so we can't vouch for what we find.
+    for (const std::string& name : FileUtil::getDirEntries(path))
+    {
+        if (isCacheFile(name))
+            FileUtil::removeFile(Poco::Path(path, name).toString(), /*recursive=*/true);
+    }
+
+    // This function should ever be called once, but for consistency, take the lock.
+    std::lock_guard<std::mutex> lock(Mutex);
+
+    Entries.clear();
+    EntriesMap.clear();
+    SizeBytes = 0;
+
+    CachePath = Poco::Path(path).makeDirectory().toString();
+}
+
+std::string DocumentCache::getKey(const std::string& docKey, const std::string& version,
+                                  const std::string& lastModifiedTime)
+{
+    if (version.empty() && lastModifiedTime.empty())
+        return std::string();
+
+    // The DocKey has no access_token, but might be long, so we use a hash.
+    Poco::SHA1Engine sha1;
+    sha1.update(docKey);
+    sha1.update(version.empty() ? "\nt:" + lastModifiedTime : "\nv:" + version);
+    return Poco::DigestEngine::digestToHex(sha1.digest());
+}
+
+bool DocumentCache::contains(const std::string& key)
+{
+    if (!isEnabled() || key.empty())
+        return false;
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    return EntriesMap.find(key) != EntriesMap.end();
+}
+
+bool DocumentCache::supplyDocument(const std::string& key, const std::string& destPath)
+{
+    if (!isEnabled() || key.empty())
+        return false;
+
+    std::size_t size = 0;
+    std::string hash;
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+
+        const auto mapIt = EntriesMap.find(key);
+        if (mapIt == EntriesMap.end())
+        {
+            ++MissCount;
+            LOG_DBG("DocumentCache miss for [" << key << ']');
+            return false;
+        }
+
+        // Most recently used.
+        const auto it = mapIt->second;
+        Entries.splice(Entries.begin(), Entries, it);
+        size = it->_size;
+        hash = it->_hash;
+    }
+
+    // If evicted meanwhile, we either fail to open it, or copy what we opened.
+    const std::string cachedPath = CachePath + key;
+    const std::string copiedHash = copyAndHash(cachedPath, destPath, 0644);
+    if (copiedHash != hash)
+    {
+        if (!copiedHash.empty())
+        {
+            LOG_ERR("DocumentCache entry [" << key << "] doesn't match its hash; evicting");
+            FileUtil::removeFile(destPath);
+
+            std::lock_guard<std::mutex> lock(Mutex);
+            const auto mapIt = EntriesMap.find(key);
+            if (mapIt != EntriesMap.end() && mapIt->second->_hash == hash)
+                removeEntry(mapIt->second);
+        }
+        else
+            LOG_ERR("DocumentCache failed to supply [" << key << "] to [" << destPath << ']');
+
+        ++MissCount;
+        return false;
+    }
+
+    const std::string certsPath = cachedPath + CertsSuffix;
+    if (FileUtil::Stat(certsPath).isDirectory())
+        copyDir(certsPath, destPath + CertsSuffix, 0644);
+
+    ++HitCount;
+    BytesSaved += size;
+    LOG_INF("DocumentCache hit for [" << key << "], supplied " << size << " bytes to ["
+                                      << destPath << ']');
+    return true;
+}
+
+void DocumentCache::cacheDocument(const std::string& key, const std::string& filePath)
+{
+    if (!isEnabled() || key.empty())
+        return;
+
+    const FileUtil::Stat fileStat(filePath);
+    if (!fileStat.isFile() || fileStat.size() > MaxSizeBytes)
+    {
+        LOG_DBG("DocumentCache will not cache [" << filePath << "] of " << fileStat.size()
+                                                 << " bytes");
+        return;
+    }
+
+    // Always copy, never link, the Kit can write to the document in its jail.
+    // What we hash is what we copied, whatever happens to the original meanwhile.
+    const std::string tempPath = CachePath + key + '.' + Util::rng::getFilename(12);
+    const std::string hash = copyAndHash(filePath, tempPath, S_IRUSR);
+    if (hash.empty())
+    {
+        LOG_ERR("DocumentCache failed to cache [" << filePath << ']');
+        return;
+    }
+
+    const std::string certsPath = filePath + CertsSuffix;
+    if (FileUtil::Stat(certsPath).isDirectory())
+        copyDir(certsPath, tempPath + CertsSuffix, S_IRUSR);
+
+    const std::size_t size = FileUtil::Stat(tempPath).size();
+
+    std::lock_guard<std::mutex> lock(Mutex);
+
+    const auto mapIt = EntriesMap.find(key);
+    if (mapIt != EntriesMap.end())
+        removeEntry(mapIt->second);
+
+    makeSpace(size);
+
+    const std::string cachedPath = CachePath + key;
+    if (std::rename(tempPath.c_str(), cachedPath.c_str()) != 0 ||
+        (FileUtil::Stat(tempPath + CertsSuffix).isDirectory() &&
+         std::rename((tempPath + CertsSuffix).c_str(), (cachedPath + CertsSuffix).c_str()) != 0))
+    {
+        LOG_SYS("DocumentCache failed to rename [" << tempPath << "] to [" << cachedPath << ']');
+        FileUtil::removeFile(tempPath);
+        FileUtil::removeFile(tempPath + CertsSuffix, /*recursive=*/true);
+        FileUtil::removeFile(cachedPath);
+        return;
+    }
+
+    Entries.push_front(Entry{ key, size, hash });
+    EntriesMap.emplace(key, Entries.begin());
+    SizeBytes += size;
+
+    LOG_INF("DocumentCache cached [" << key << "] of " << size << " bytes, " << Entries.size()
+                                     << " documents in " << SizeBytes << " bytes");
+}
+
+void DocumentCache::makeSpace(std::size_t headroomBytes)
+{
+    while (!Entries.empty() && SizeBytes + headroomBytes > MaxSizeBytes)
+    {
+        LOG_DBG("DocumentCache evicting [" << Entries.back()._name << "] of "
+                                           << Entries.back()._size << " bytes");
+        removeEntry(std::prev(Entries.end()));
+    }
+}
+
+void DocumentCache::removeEntry(std::list<Entry>::iterator it)
+{
+    const std::string cachedPath = CachePath + it->_name;
+    FileUtil::removeFile(cachedPath);
+    FileUtil::removeFile(cachedPath + CertsSuffix, /*recursive=*/true);
+
+    SizeBytes -= it->_size;
+    EntriesMap.erase(it->_name);
+    Entries.erase(it);
+}
+
+void DocumentCache::dumpMetrics(std::ostream& os)
+{
+    std::size_t entryCount = 0;
+    std::size_t sizeBytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        entryCount = Entries.size();
+        sizeBytes = SizeBytes;
+    }
+
+    os << "document_cache_hit_count " << HitCount << '\n';
+    os << "document_cache_miss_count " << MissCount << '\n';
+    os << "document_cache_saved_bytes " << BytesSaved << '\n';
+    os << "document_cache_entry_count " << entryCount << '\n';
+    os << "document_cache_size_bytes " << sizeBytes << '\n';
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
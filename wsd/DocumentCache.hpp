@@ -0,0 +1,94 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+/// A bounded, on-disk cache of downloaded documents.
+/// Entries are keyed by the DocKey (i.e. WOPISrc) and the version
+/// of the document reported by CheckFileInfo, so a document that is
+/// reopened unchanged after all its views are closed needn't be
+/// downloaded again. Each entry is a private, read-only, copy, which
+/// is never linked into a jail, where the Kit could write to it, and
+/// whose content is checked against its hash every time it's copied
+/// out. Evicted least-recently-used first when the cache exceeds its
+/// size limit.
+class DocumentCache
+{
+    friend class DocumentCacheTests;
+
+    struct Entry
+    {
+        std::string _name; ///< The filename in the cache directory.
+        std::size_t _size; ///< The size of the file in bytes.
+        std::string _hash; ///< The SHA-256 of the file's content.
+    };
+
+public:
+    static void initialize(const std::string& path);
+
+    static bool isEnabled() { return !CachePath.empty(); }
+
+    /// Returns the cache key for the given document version, which is
+    /// the WOPI Version, if provided, otherwise the LastModifiedTime.
+    /// Returns an empty string when the version is unknown, which isn't cacheable.
+    static std::string getKey(const std::string& docKey, const std::string& version,
+                              const std::string& lastModifiedTime);
+
+    /// Returns true iff the document with the given key is cached.
+    static bool contains(const std::string& key);
+
+    /// Copies the cached document with the given key to @destPath.
+    /// Returns true on a hit, false when not in the cache, or no longer intact.
+    static bool supplyDocument(const std::string& key, const std::string& destPath);
+
+    /// Adds a copy of the downloaded document at @filePath to the cache under the given key.
+    static void cacheDocument(const std::string& key, const std::string& filePath);
+
+    /// Writes the cache metrics, in the format of the admin metrics.
+    static void dumpMetrics(std::ostream& os);
+
+private:
+    /// Creates the, empty, cache at @path, limited to @maxSizeBytes.
+    static void initialize(const std::string& path, std::size_t maxSizeBytes);
+
+    /// Evicts the least-recently-used entries until there is
+    /// room for @headroomBytes. Must be called with the lock held.
+    static void makeSpace(std::size_t headroomBytes);
+
+    /// Removes the given entry, and its files. Must be called with the lock held.
+    static void removeEntry(std::list<Entry>::iterator it);
+
+    /// The entries, most-recently-used first.
+    static std::list<Entry> Entries;
+    /// The entries, by filename.
+    static std::unordered_map<std::string, std::list<Entry>::iterator> EntriesMap;
+    /// Protects the shared Entries from concurrent modification.
+    /// Never held while copying files.
+    static std::mutex Mutex;
+    static std::string CachePath;
+    static std::size_t MaxSizeBytes; ///< Total limit on all cached files.
+    static std::size_t SizeBytes; ///< Total size of all cached files.
+
+    static std::atomic<uint64_t> HitCount;
+    static std::atomic<uint64_t> MissCount;
+    static std::atomic<uint64_t> BytesSaved; ///< Bytes we didn't have to download.
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -65,12 +65,13 @@
 #include <chrono>
 #include <iomanip>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <zlib.h>
 #include <security/pam_appl.h>
 
 #include <wasm/base64.hpp>
@@ -84,7 +85,7 @@ using Poco::Util::Application;
 
 // We have files that are at least 2.5 MB already.
 // WASM files are in the order of 30 MB, however,
-constexpr auto MaxFileSizeToCacheInBytes = 50 * 1024 * 1024;
+constexpr auto MaxFileSizeToCompressInBytes = 50 * 1024 * 1024;
 
 namespace
 {
@@ -218,22 +219,22 @@ std::string stringifyBoolFromConfig(const Poco::Util::LayeredConfiguration& conf
     return config.getBool(propertyName, defaultValue) ? "true" : "false";
 }
 
+/// True for the files we substitute variables in before serving.
+bool isTemplate(const std::string_view filename)
+{
+    return filename.ends_with(".html") || filename.ends_with("localizations.json") ||
+           filename.ends_with("localizations-override.json");
+}
+
 } // namespace
 
 FileServerRequestHandler::FileServerRequestHandler(const std::string& root)
 {
-    // Read all files that we can serve into memory and compress them.
+    // Map all files that we can serve and compress them.
     // cool files
     try
     {
         readDirToHash(root, "/browser/dist");
-
-        // Shrink this from approx 200M to 50M for debug version
-        for (auto& entry : FileHash)
-        {
-            entry.second.first.shrink_to_fit();
-            entry.second.second.shrink_to_fit();
-        }
     }
     catch (...)
     {
@@ -247,19 +248,23 @@ void FileServerRequestHandler::dumpState(std::ostream& os)
     os << "FileHash with " << FileHash.size() << " entries\n";
 
     size_t fileHashEstSize = sizeof(FileHash);
+    size_t fileHashMappedSize = 0;
     for (const auto& entry : FileHash)
     {
-        fileHashEstSize += entry.first.capacity();
-        fileHashEstSize += entry.second.first.capacity();
-        fileHashEstSize += entry.second.second.capacity();
+        fileHashEstSize += entry.first.capacity() + sizeof(entry.second);
+        fileHashEstSize += entry.second.heapSize();
+        fileHashMappedSize += entry.second.mappedSize();
     }
 
     os << "\t Estimated allocation size: " << fileHashEstSize << " bytes\n";
+    os << "\t Mapped size: " << fileHashMappedSize << " bytes\n";
+    os << "TemplateHash with " << TemplateHash.size() << " entries\n";
 }
 
 FileServerRequestHandler::~FileServerRequestHandler()
 {
     // Clean cached files.
+    TemplateHash.clear();
     FileHash.clear();
 }
 
@@ -992,8 +997,8 @@ bool FileServerRequestHandler::handleRequest(const HTTPRequest& request,
         }
 
         // Is this a file we read at startup - if not; it's not for serving.
-        if (FileHash.find(relPath) == FileHash.end() &&
-            FileHash.find(relPath + ".br") == FileHash.end())
+        const auto assetIt = FileHash.find(relPath);
+        if (assetIt == FileHash.end())
         {
             throw Poco::FileNotFoundException("Invalid URI request (hash): [" +
                                               requestUri.toString() + "].");
@@ -1078,7 +1083,7 @@ bool FileServerRequestHandler::handleRequest(const HTTPRequest& request,
             if (it != request.end())
             {
                 // if ETags match avoid re-sending the file.
-                if (!noCache && it->second == etagString)
+                if (!noCache && HttpHelper::matchesETag(it->second, etagString))
                 {
                     // TESTME: harder ... - do we even want ETag support ?
                     std::ostringstream oss;
@@ -1118,29 +1123,23 @@ bool FileServerRequestHandler::handleRequest(const HTTPRequest& request,
                     response.set("Content-Encoding", "br");
                 }
 
-                HttpHelper::sendFile(socket, filePath, response, noCache);
+                HttpHelper::sendStaticFile(socket, filePath, response, noCache);
                 return true;
             }
 #endif
 
-            bool compressed = false;
-            const std::string* content;
-            if (brotli && FileHash.find(relPath + ".br") != FileHash.end())
-            {
-                compressed = true;
-                response.set("Content-Encoding", "br");
-                content = getUncompressedFile(relPath + ".br");
-            }
-            else if (request.hasToken("Accept-Encoding", "gzip"))
-            {
-                compressed = true;
-                response.set("Content-Encoding", "gzip");
-                content = getCompressedFile(relPath);
-            }
-            else
-                content = getUncompressedFile(relPath);
+            // Everything was compressed at startup, just pick the best variant.
+            const StaticAsset& asset = assetIt->second;
+            const StaticAsset::Encoding encoding =
+                asset.select(brotli, request.hasToken("Accept-Encoding", "zstd"),
+                             request.hasToken("Accept-Encoding", "gzip"));
+            const std::string_view content = asset.get(encoding);
+            const bool compressed = (encoding != StaticAsset::Encoding::Identity);
+            if (compressed)
+                response.set("Content-Encoding", StaticAsset::name(encoding));
 
-            response.add("Content-Length", std::to_string(content->size()));
+            response.add("Vary", "Accept-Encoding");
+            response.add("Content-Length", std::to_string(content.size()));
 
             if (!noCache)
             {
@@ -1151,10 +1150,12 @@ bool FileServerRequestHandler::handleRequest(const HTTPRequest& request,
             response.add("X-Content-Type-Options", "nosniff");
 
             LOG_TRC('#' << socket->getFD() << ": Sending " << (!compressed ? "un" : "")
-                        << "compressed : file [" << relPath << "]: " << response.header());
+                        << "compressed (" << StaticAsset::name(encoding) << ") : file ["
+                        << relPath << "]: " << response.header());
 
+            // Straight from the mapping (or the compressed copy), no reading.
             socket->send(response);
-            socket->send(*content);
+            socket->send(content.data(), content.size());
         }
     }
     catch (const Poco::Net::NotAuthenticatedException& exc)
@@ -1250,101 +1251,39 @@ void FileServerRequestHandler::readDirToHash(const std::string &basePath, const
 
         else if (S_ISREG(fileStat.st_mode) && relPath.ends_with(".br"))
         {
-            // Only cache without compressing.
+            // Pre-compressed by the build, attach to the original.
             fileCount++;
             filesRead.append(currentFile->d_name);
             filesRead += ' ';
 
-            std::string uncompressedFile;
-            const ssize_t size =
-                FileUtil::readFile(basePath + relPath, uncompressedFile, MaxFileSizeToCacheInBytes);
-            assert(size < MaxFileSizeToCacheInBytes && "MaxFileSizeToCacheInBytes is too small for "
-                                                       "static-file serving; please increase it");
-            if (size <= 0)
-            {
-                assert(uncompressedFile.empty() &&
-                       "Unexpected data in uncompressedFile after failed read");
-                if (size < 0)
-                {
-                    LOG_ERR("Failed to read file [" << basePath + relPath
-                                                    << "] or is too large to cache and serve");
-                }
-            }
-
-            FileHash.emplace(prefix + relPath,
-                             std::make_pair(std::move(uncompressedFile), std::string()));
+            StaticAsset& asset = FileHash[prefix + relPath.substr(0, relPath.size() - 3)];
+            if (!asset.loadBrotli(basePath + relPath))
+                LOG_ERR("Failed to map file [" << basePath + relPath << "] to serve");
         }
         else if (S_ISREG(fileStat.st_mode))
         {
-            std::string uncompressedFile;
-            const ssize_t size =
-                FileUtil::readFile(basePath + relPath, uncompressedFile, MaxFileSizeToCacheInBytes);
-            assert(size < MaxFileSizeToCacheInBytes && "MaxFileSizeToCacheInBytes is too small for "
-                                                       "static-file serving; please increase it");
-            if (size <= 0)
-            {
-                assert(uncompressedFile.empty() &&
-                       "Unexpected data in uncompressedFile after failed read");
-                if (size < 0)
-                {
-                    LOG_ERR("Failed to read file [" << basePath + relPath
-                                                    << "] or is too large to cache and serve");
-                }
-
-                // Always add the entry, even if the contents are empty.
-                FileHash.emplace(prefix + relPath,
-                                 std::make_pair(std::move(uncompressedFile), std::string()));
-                continue;
-            }
-
-            z_stream strm;
-            strm.zalloc = Z_NULL;
-            strm.zfree = Z_NULL;
-            strm.opaque = Z_NULL;
-            const int initResult = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);
-            if (initResult != Z_OK)
-            {
-                LOG_ERR("Failed to deflateInit2 for file [" << basePath + relPath
-                                                            << "], result: " << initResult);
-                // Add the uncompressed version; it's better to serve uncompressed than nothing at all.
-                FileHash.emplace(prefix + relPath,
-                                 std::make_pair(std::move(uncompressedFile), std::string()));
-
-                deflateEnd(&strm);
-                continue;
-            }
-
             fileCount++;
             filesRead.append(currentFile->d_name);
             filesRead += ' ';
 
-            // Compress.
-            assert(size > 0 && "No data to compress");
-            assert(!uncompressedFile.empty() && "Unexpected empty uncompressedFile");
-            std::string compressedFile;
-            const long unsigned int compSize = compressBound(size);
-            compressedFile.resize(compSize);
-            strm.next_in = (unsigned char*)uncompressedFile.data();
-            strm.avail_in = size;
-            strm.avail_out = compSize;
-            strm.next_out = (unsigned char*)compressedFile.data();
-            strm.total_out = strm.total_in = 0;
-
-            const int deflateResult = deflate(&strm, Z_FINISH);
-            if (deflateResult != Z_OK && deflateResult != Z_STREAM_END)
+            // Always add the entry, even if the contents are empty.
+            StaticAsset& asset = FileHash[prefix + relPath];
+            if (!asset.load(basePath + relPath))
             {
-                LOG_ERR("Failed to deflate [" << basePath + relPath
-                                              << "], result: " << deflateResult);
-                compressedFile.clear(); // Can't trust the compressed data, if any.
+                LOG_ERR("Failed to map file [" << basePath + relPath << "] to serve");
+                continue;
             }
-            else
+
+            if (fileStat.st_size <= MaxFileSizeToCompressInBytes)
+                asset.compress();
+
+            if (isTemplate(currentFile->d_name))
             {
-                compressedFile.resize(compSize - strm.avail_out);
+                TemplateHash.emplace(
+                    std::piecewise_construct, std::forward_as_tuple(prefix + relPath),
+                    std::forward_as_tuple(currentFile->d_name,
+                                          asset.get(StaticAsset::Encoding::Identity)));
             }
-
-            FileHash.emplace(prefix + relPath, std::make_pair(std::move(uncompressedFile),
-                                                              std::move(compressedFile)));
-            deflateEnd(&strm);
         }
     }
     closedir(workingdir);
@@ -1354,16 +1293,19 @@ void FileServerRequestHandler::readDirToHash(const std::string &basePath, const
                             << filesRead);
 }
 
-const std::string *FileServerRequestHandler::getCompressedFile(const std::string &path)
+std::string_view FileServerRequestHandler::getUncompressedFile(const std::string& path) const
 {
-    // If a compressed version is not available, return the original uncompressed data.
-    const auto& pair = FileHash[path];
-    return pair.second.empty() ? &pair.first : &pair.second;
+    const auto it = FileHash.find(path);
+    return it != FileHash.end() ? it->second.get(StaticAsset::Encoding::Identity)
+                                : std::string_view();
 }
 
-const std::string *FileServerRequestHandler::getUncompressedFile(const std::string &path)
+std::string
+FileServerRequestHandler::renderFile(const std::string& path,
+                                     const std::unordered_map<std::string, std::string>& vars) const
 {
-    return &FileHash[path].first;
+    const auto it = TemplateHash.find(path);
+    return it != TemplateHash.end() ? it->second.substitute(vars) : std::string();
 }
 
 std::string FileServerRequestHandler::getRequestPathname(const HTTPRequest& request,
@@ -1644,7 +1586,6 @@ FileServerRequestHandler::ResourceAccessDetails FileServerRequestHandler::prepro
     // Is this a file we read at startup - if not; it's not for serving.
     const std::string relPath = getRequestPathname(request, requestDetails);
     LOG_DBG("Preprocessing file: " << relPath);
-    std::string preprocess = *getUncompressedFile(relPath);
 
     // We need to pass certain parameters from the cool html GET URI
     // to the embedded document URI. Here we extract those params
@@ -1653,6 +1594,9 @@ FileServerRequestHandler::ResourceAccessDetails FileServerRequestHandler::prepro
 
     const UserRequestVars urv(request, form);
 
+    // The values to substitute, by variable name.
+    std::unordered_map<std::string, std::string> vars;
+
     std::string buyProduct;
     {
         std::lock_guard<std::mutex> lock(COOLWSD::RemoteConfigMutex);
@@ -1665,7 +1609,7 @@ FileServerRequestHandler::ResourceAccessDetails FileServerRequestHandler::prepro
     std::string socketProxy = "false";
     if (requestDetails.isProxy())
         socketProxy = "true";
-    Poco::replaceInPlace(preprocess, std::string("%SOCKET_PROXY%"), socketProxy);
+    vars["SOCKET_PROXY"] = socketProxy;
 
     const std::string responseRoot = cnxDetails.getResponseRoot();
     std::string userInterfaceMode;
@@ -1673,42 +1617,41 @@ FileServerRequestHandler::ResourceAccessDetails FileServerRequestHandler::prepro
     std::string savedUIState = "true";
     const std::string& theme = urv[BRANDING_THEME];
 
-    Poco::replaceInPlace(preprocess, ACCESS_TOKEN, urv[ACCESS_TOKEN]);
-    Poco::replaceInPlace(preprocess, ACCESS_TOKEN_TTL, urv[ACCESS_TOKEN_TTL]);
-    Poco::replaceInPlace(preprocess, ACCESS_HEADER, urv[ACCESS_HEADER]);
-    Poco::replaceInPlace(preprocess, std::string("%HOST%"), cnxDetails.getWebSocketUrl());
-    Poco::replaceInPlace(preprocess, std::string("%VERSION%"), Util::getCoolVersionHash());
-    Poco::replaceInPlace(preprocess, std::string("%COOLWSD_VERSION%"), Util::getCoolVersion());
-    Poco::replaceInPlace(preprocess, std::string("%SERVICE_ROOT%"), responseRoot);
-    Poco::replaceInPlace(preprocess, UI_DEFAULTS, macaron::Base64::Encode(
-                         uiDefaultsToJSON(urv[UI_DEFAULTS], userInterfaceMode, userInterfaceTheme, savedUIState)));
-    Poco::replaceInPlace(preprocess, std::string("%UI_THEME%"), userInterfaceTheme); // UI_THEME refers to light or dark theme
-    Poco::replaceInPlace(preprocess, BRANDING_THEME, urv[BRANDING_THEME]);
-    Poco::replaceInPlace(preprocess, std::string("%SAVED_UI_STATE%"), savedUIState);
-    Poco::replaceInPlace(preprocess, POSTMESSAGE_ORIGIN, urv[POSTMESSAGE_ORIGIN]);
-    Poco::replaceInPlace(preprocess, CHECK_FILE_INFO_OVERRIDE,
-                         checkFileInfoToJSON(urv[CHECK_FILE_INFO_OVERRIDE]));
-    Poco::replaceInPlace(preprocess, std::string("%WOPI_HOST_ID%"), form.get("host_session_id", ""));
+    vars["ACCESS_TOKEN"] = urv[ACCESS_TOKEN];
+    vars["ACCESS_TOKEN_TTL"] = urv[ACCESS_TOKEN_TTL];
+    vars["ACCESS_HEADER"] = urv[ACCESS_HEADER];
+    vars["HOST"] = cnxDetails.getWebSocketUrl();
+    vars["VERSION"] = Util::getCoolVersionHash();
+    vars["COOLWSD_VERSION"] = Util::getCoolVersion();
+    vars["SERVICE_ROOT"] = responseRoot;
+    vars["UI_DEFAULTS"] = macaron::Base64::Encode(
+        uiDefaultsToJSON(urv[UI_DEFAULTS], userInterfaceMode, userInterfaceTheme, savedUIState));
+    vars["UI_THEME"] = userInterfaceTheme; // UI_THEME refers to light or dark theme
+    vars["BRANDING_THEME"] = urv[BRANDING_THEME];
+    vars["SAVED_UI_STATE"] = savedUIState;
+    vars["POSTMESSAGE_ORIGIN"] = urv[POSTMESSAGE_ORIGIN];
+    vars["CHECK_FILE_INFO_OVERRIDE"] = checkFileInfoToJSON(urv[CHECK_FILE_INFO_OVERRIDE]);
+    vars["WOPI_HOST_ID"] = form.get("host_session_id", "");
 
     const auto& config = Application::instance().config();
 
     std::string protocolDebug = stringifyBoolFromConfig(config, "logging.protocol", false);
-    Poco::replaceInPlace(preprocess, std::string("%PROTOCOL_DEBUG%"), protocolDebug);
+    vars["PROTOCOL_DEBUG"] = protocolDebug;
 
     bool enableDebug = false;
 #if ENABLE_DEBUG
     enableDebug = true;
 #endif
     std::string enableDebugStr = stringifyBoolFromConfig(config, "logging.protocol", enableDebug);
-    Poco::replaceInPlace(preprocess, std::string("%ENABLE_DEBUG%"), enableDebugStr);
+    vars["ENABLE_DEBUG"] = enableDebugStr;
 
     static const std::string hexifyEmbeddedUrls =
         ConfigUtil::getConfigValue<bool>("hexify_embedded_urls", false) ? "true" : "false";
-    Poco::replaceInPlace(preprocess, std::string("%HEXIFY_URL%"), hexifyEmbeddedUrls);
+    vars["HEXIFY_URL"] = hexifyEmbeddedUrls;
 
     static const std::string useStatusbarSaveIndicator =
         config.getBool("user_interface.statusbar_save_indicator", false) ? "true" : "false";
-    Poco::replaceInPlace(preprocess, std::string("%STATUSBAR_SAVE_INDICATOR%"), useStatusbarSaveIndicator);
+    vars["STATUSBAR_SAVE_INDICATOR"] = useStatusbarSaveIndicator;
 
     static const bool useIntegrationTheme =
         config.getBool("user_interface.use_integration_theme", true);
@@ -1733,26 +1676,25 @@ FileServerRequestHandler::ResourceAccessDetails FileServerRequestHandler::prepro
         }
     }
 
-    Poco::replaceInPlace(preprocess, std::string("<!--%BRANDING_CSS%-->"), brandCSS);
-    Poco::replaceInPlace(preprocess, std::string("<!--%BRANDING_JS%-->"), brandJS);
-    Poco::replaceInPlace(preprocess, CSS_VARS, cssVarsToStyle(urv[CSS_VARS]));
+    vars["BRANDING_CSS"] = std::move(brandCSS);
+    vars["BRANDING_JS"] = std::move(brandJS);
+    vars["CSS_VARIABLES"] = cssVarsToStyle(urv[CSS_VARS]);
 
     if (config.getBool("browser_logging", false))
     {
         Poco::SHA1Engine engine;
         engine.update(COOLWSD::LogToken);
-        Poco::replaceInPlace(preprocess, std::string("%BROWSER_LOGGING%"),
-                             Poco::DigestEngine::digestToHex(engine.digest()));
+        vars["BROWSER_LOGGING"] = Poco::DigestEngine::digestToHex(engine.digest());
     }
     else
-        Poco::replaceInPlace(preprocess, std::string("%BROWSER_LOGGING%"), std::string());
+        vars["BROWSER_LOGGING"] = std::string();
 
     const unsigned int outOfFocusTimeoutSecs = config.getUInt("per_view.out_of_focus_timeout_secs", 300);
-    Poco::replaceInPlace(preprocess, std::string("%OUT_OF_FOCUS_TIMEOUT_SECS%"), std::to_string(outOfFocusTimeoutSecs));
+    vars["OUT_OF_FOCUS_TIMEOUT_SECS"] = std::to_string(outOfFocusTimeoutSecs);
     const unsigned int idleTimeoutSecs = config.getUInt("per_view.idle_timeout_secs", 900);
-    Poco::replaceInPlace(preprocess, std::string("%IDLE_TIMEOUT_SECS%"), std::to_string(idleTimeoutSecs));
+    vars["IDLE_TIMEOUT_SECS"] = std::to_string(idleTimeoutSecs);
     const unsigned int minSavedMessTimeoutSecs = config.getUInt("per_view.min_saved_message_timeout_secs", 0);
-    Poco::replaceInPlace(preprocess, std::string("%MIN_SAVED_MESSAGE_TIMEOUT_SECS%"), std::to_string(minSavedMessTimeoutSecs));
+    vars["MIN_SAVED_MESSAGE_TIMEOUT_SECS"] = std::to_string(minSavedMessTimeoutSecs);
 
     #if ENABLE_WELCOME_MESSAGE
         std::string enableWelcomeMessage = "true";
@@ -1761,23 +1703,23 @@ FileServerRequestHandler::ResourceAccessDetails FileServerRequestHandler::prepro
         {
             autoShowWelcome = stringifyBoolFromConfig(config, "welcome.enable", false);
         }
-        Poco::replaceInPlace(preprocess, std::string("%PRODUCT_BRANDING_NAME%"), std::string());
-        Poco::replaceInPlace(preprocess, std::string("%PRODUCT_BRANDING_URL%"), std::string());
+        vars["PRODUCT_BRANDING_NAME"] = std::string();
+        vars["PRODUCT_BRANDING_URL"] = std::string();
     #else // configurable
         std::string enableWelcomeMessage = stringifyBoolFromConfig(config, "welcome.enable", false);
         std::string autoShowWelcome = stringifyBoolFromConfig(config, "welcome.enable", false);
 
         std::string brandProductURL = ConfigUtil::getConfigValue<std::string>(config, "user_interface.brandProductURL", "");
         std::string brandProductName = ConfigUtil::getConfigValue<std::string>(config, "user_interface.brandProductName", "");
-        Poco::replaceInPlace(preprocess, std::string("%PRODUCT_BRANDING_NAME%"), brandProductName);
-        Poco::replaceInPlace(preprocess, std::string("%PRODUCT_BRANDING_URL%"), brandProductURL);
+        vars["PRODUCT_BRANDING_NAME"] = brandProductName;
+        vars["PRODUCT_BRANDING_URL"] = brandProductURL;
     #endif
 
-    Poco::replaceInPlace(preprocess, std::string("%ENABLE_WELCOME_MSG%"), enableWelcomeMessage);
-    Poco::replaceInPlace(preprocess, std::string("%AUTO_SHOW_WELCOME%"), autoShowWelcome);
+    vars["ENABLE_WELCOME_MSG"] = enableWelcomeMessage;
+    vars["AUTO_SHOW_WELCOME"] = autoShowWelcome;
 
     std::string enableAccessibility = stringifyBoolFromConfig(config, "accessibility.enable", false);
-    Poco::replaceInPlace(preprocess, std::string("%ENABLE_ACCESSIBILITY%"), enableAccessibility);
+    vars["ENABLE_ACCESSIBILITY"] = enableAccessibility;
 
     // the config value of 'notebookbar/tabbed' or 'classic/compact' overrides the UIMode
     // from the WOPI
@@ -1796,44 +1738,46 @@ FileServerRequestHandler::ResourceAccessDetails FileServerRequestHandler::prepro
     if (enableAccessibility == "true" || (userInterfaceMode != "classic" && userInterfaceMode != "notebookbar"))
         userInterfaceMode = "notebookbar";
 
-    Poco::replaceInPlace(preprocess, std::string("%USER_INTERFACE_MODE%"), userInterfaceMode);
+    vars["USER_INTERFACE_MODE"] = userInterfaceMode;
 
     std::string uiRtlSettings;
     if (LangUtil::isRtlLanguage(requestDetails.getParam("lang")))
         uiRtlSettings = " dir=\"rtl\" ";
-    Poco::replaceInPlace(preprocess, std::string("%UI_RTL_SETTINGS%"), uiRtlSettings);
+    vars["UI_RTL_SETTINGS"] = std::move(uiRtlSettings);
 
     const std::string useIntegrationThemeString = useIntegrationTheme && hasIntegrationTheme ? "true" : "false";
-    Poco::replaceInPlace(preprocess, std::string("%USE_INTEGRATION_THEME%"), useIntegrationThemeString);
+    vars["USE_INTEGRATION_THEME"] = useIntegrationThemeString;
 
     std::string enableMacrosExecution = stringifyBoolFromConfig(config, "security.enable_macros_execution", false);
-    Poco::replaceInPlace(preprocess, std::string("%ENABLE_MACROS_EXECUTION%"), enableMacrosExecution);
+    vars["ENABLE_MACROS_EXECUTION"] = enableMacrosExecution;
 
 
     if (config.getBool("home_mode.enable", false))
     {
-        Poco::replaceInPlace(preprocess, std::string("%AUTO_SHOW_FEEDBACK%"), (std::string)"false");
+        vars["AUTO_SHOW_FEEDBACK"] = "false";
     }
     else
     {
-        Poco::replaceInPlace(preprocess, std::string("%AUTO_SHOW_FEEDBACK%"), (std::string)"true");
+        vars["AUTO_SHOW_FEEDBACK"] = "true";
     }
 
     bool allowUpdateNotification = config.getBool("allow_update_popup", true);
-    Poco::replaceInPlace(preprocess, std::string("%ENABLE_UPDATE_NOTIFICATION%"), boolToString(allowUpdateNotification));
+    vars["ENABLE_UPDATE_NOTIFICATION"] = boolToString(allowUpdateNotification);
 
-    Poco::replaceInPlace(preprocess, std::string("%FEEDBACK_URL%"), std::string(FEEDBACK_URL));
-    Poco::replaceInPlace(preprocess, std::string("%WELCOME_URL%"), std::string(WELCOME_URL));
+    vars["FEEDBACK_URL"] = FEEDBACK_URL;
+    vars["WELCOME_URL"] = WELCOME_URL;
 
-    Poco::replaceInPlace(preprocess, BUYPRODUCT_URL, urv[BUYPRODUCT_URL]);
+    vars["BUYPRODUCT_URL"] = urv[BUYPRODUCT_URL];
 
-    Poco::replaceInPlace(preprocess, std::string("%DEEPL_ENABLED%"), boolToString(config.getBool("deepl.enabled", false)));
-    Poco::replaceInPlace(preprocess, std::string("%ZOTERO_ENABLED%"), boolToString(config.getBool("zotero.enable", true)));
-    Poco::replaceInPlace(preprocess, std::string("%DOCUMENT_SIGNING_ENABLED%"), boolToString(config.getBool("document_signing.enable", true)));
-    Poco::replaceInPlace(preprocess, std::string("%WASM_ENABLED%"), boolToString(ConfigUtil::getConfigValue<bool>("wasm.enable", false)));
-    Poco::replaceInPlace(preprocess, std::string("%CANVAS_SLIDESHOW_ENABLED%"), boolToString(ConfigUtil::getConfigValue<bool>("canvas_slideshow_enabled", true)));
+    vars["DEEPL_ENABLED"] = boolToString(config.getBool("deepl.enabled", false));
+    vars["ZOTERO_ENABLED"] = boolToString(config.getBool("zotero.enable", true));
+    vars["DOCUMENT_SIGNING_ENABLED"] =
+        boolToString(config.getBool("document_signing.enable", true));
+    vars["WASM_ENABLED"] = boolToString(ConfigUtil::getConfigValue<bool>("wasm.enable", false));
+    vars["CANVAS_SLIDESHOW_ENABLED"] =
+        boolToString(ConfigUtil::getConfigValue<bool>("canvas_slideshow_enabled", true));
     Poco::URI indirectionURI(config.getString("indirection_endpoint.url", ""));
-    Poco::replaceInPlace(preprocess, std::string("%INDIRECTION_URL%"), indirectionURI.toString());
+    vars["INDIRECTION_URL"] = indirectionURI.toString();
 
     std::string extraExportFormats;
     if (ConfigUtil::getConfigValue<bool>("extra_export_formats.impress_swf", false))
@@ -1848,12 +1792,11 @@ FileServerRequestHandler::ResourceAccessDetails FileServerRequestHandler::prepro
         extraExportFormats += " impress_svg";
     if (ConfigUtil::getConfigValue<bool>("extra_export_formats.impress_tiff", false))
         extraExportFormats += " impress_tiff";
-    Poco::replaceInPlace(preprocess, std::string("%EXTRA_EXPORT_FORMATS%"), extraExportFormats);
+    vars["EXTRA_EXPORT_FORMATS"] = std::move(extraExportFormats);
 
     bool geoLocationSetup = config.getBool("indirection_endpoint.geolocation_setup.enable", false);
     if (geoLocationSetup)
-        Poco::replaceInPlace(preprocess, std::string("%GEOLOCATION_SETUP%"),
-                             boolToString(geoLocationSetup));
+        vars["GEOLOCATION_SETUP"] = boolToString(geoLocationSetup);
 
     ContentSecurityPolicy csp;
     csp.appendDirective("default-src", "'none'");
@@ -1941,7 +1884,7 @@ FileServerRequestHandler::ResourceAccessDetails FileServerRequestHandler::prepro
         csp.appendDirective("img-src", frameAncestors);
         csp.appendDirective("frame-ancestors", frameAncestors);
         const std::string escapedFrameAncestors = Uri::encode(frameAncestors, "'");
-        Poco::replaceInPlace(preprocess, std::string("%FRAME_ANCESTORS%"), escapedFrameAncestors);
+        vars["FRAME_ANCESTORS"] = escapedFrameAncestors;
     }
     else
     {
@@ -2043,10 +1986,12 @@ FileServerRequestHandler::ResourceAccessDetails FileServerRequestHandler::prepro
         }
     }
 
-    httpResponse.setBody(preprocess, "text/html");
+    // Render the page in one pass now that we have all the values.
+    std::string preprocess = renderFile(relPath, vars);
+    LOG_TRC("Sent file: " << relPath << ": " << preprocess);
+    httpResponse.setBody(std::move(preprocess), "text/html");
 
     socket->send(httpResponse);
-    LOG_TRC("Sent file: " << relPath << ": " << preprocess);
 
     return ResourceAccessDetails(std::move(wopiSrc), urv[ACCESS_TOKEN], urv[PERMISSION], urv[DEBUG_WOPI_CONFIG_ID]);
 }
@@ -2059,12 +2004,11 @@ void FileServerRequestHandler::preprocessWelcomeFile(const HTTPRequest& request,
 {
     const std::string relPath = getRequestPathname(request, requestDetails);
     LOG_DBG("Preprocessing file: " << relPath);
-    std::string templateWelcome = *getUncompressedFile(relPath);
 
     HTMLForm form(request, message);
     std::string uiTheme = form.get("ui_theme", "");
     uiTheme = (uiTheme == "dark") ? "dark" : "light";
-    Poco::replaceInPlace(templateWelcome, std::string("%UI_THEME%"), uiTheme);
+    std::string templateWelcome = renderFile(relPath, { { "UI_THEME", uiTheme } });
 
     // Ask UAs to block if they detect any XSS attempt
     httpResponse.add("X-XSS-Protection", "1; mode=block");
@@ -2371,25 +2315,24 @@ void FileServerRequestHandler::preprocessIntegratorAdminFile(const HTTPRequest&
 
     const std::string relPath = getRequestPathname(request, requestDetails);
     LOG_DBG("Preprocessing file: " << relPath);
-    std::string adminFile = *getUncompressedFile(relPath);
 
     HTMLForm form(request, message);
     const UserRequestVars urv(request, form);
 
-    Poco::replaceInPlace(adminFile, ACCESS_TOKEN, urv[ACCESS_TOKEN]);
-    Poco::replaceInPlace(adminFile, ACCESS_TOKEN_TTL, urv[ACCESS_TOKEN_TTL]);
-    Poco::replaceInPlace(adminFile, WOPI_SETTING_BASE_URL, urv[WOPI_SETTING_BASE_URL]);
-    Poco::replaceInPlace(adminFile, ACCESS_HEADER, urv[ACCESS_HEADER]);
-    Poco::replaceInPlace(adminFile, IFRAME_TYPE, urv[IFRAME_TYPE]);
-    Poco::replaceInPlace(adminFile, CSS_VARS, cssVarsToStyle(urv[CSS_VARS]));
-    Poco::replaceInPlace(adminFile, UI_THEME, urv[UI_THEME]);
+    std::unordered_map<std::string, std::string> vars;
+    vars["ACCESS_TOKEN"] = urv[ACCESS_TOKEN];
+    vars["ACCESS_TOKEN_TTL"] = urv[ACCESS_TOKEN_TTL];
+    vars["WOPI_SETTING_BASE_URL"] = urv[WOPI_SETTING_BASE_URL];
+    vars["ACCESS_HEADER"] = urv[ACCESS_HEADER];
+    vars["IFRAME_TYPE"] = urv[IFRAME_TYPE];
+    vars["CSS_VARIABLES"] = cssVarsToStyle(urv[CSS_VARS]);
+    vars["UI_THEME"] = urv[UI_THEME];
 #if ENABLE_DEBUG
     const bool enableDebug = true;
 #else
     const bool enableDebug = false;
 #endif
-    Poco::replaceInPlace(adminFile, std::string("%ENABLE_DEBUG%"),
-                         std::string(enableDebug ? "true" : "false"));
+    vars["ENABLE_DEBUG"] = enableDebug ? "true" : "false";
 
     std::string brandJS(Poco::format(scriptJS, responseRoot, std::string(BRANDING)));
     std::string brandFooter;
@@ -2407,9 +2350,10 @@ void FileServerRequestHandler::preprocessIntegratorAdminFile(const HTTPRequest&
         }
     }
 
-    Poco::replaceInPlace(adminFile, std::string("<!--%BRANDING_JS%-->"), brandJS);
-    Poco::replaceInPlace(adminFile, std::string("%VERSION%"), std::string(COOLWSD_VERSION_HASH));
-    Poco::replaceInPlace(adminFile, std::string("%SERVICE_ROOT%"), responseRoot);
+    vars["BRANDING_JS"] = std::move(brandJS);
+    vars["VERSION"] = COOLWSD_VERSION_HASH;
+    vars["SERVICE_ROOT"] = responseRoot;
+    std::string adminFile = renderFile(relPath, vars);
 
     ContentSecurityPolicy csp;
     csp.appendDirective("frame-src", "'self'");
@@ -2480,31 +2424,6 @@ void FileServerRequestHandler::preprocessAdminFile(const HTTPRequest& request,
 
     const std::string relPath = getRequestPathname(request, requestDetails);
     LOG_DBG("Preprocessing file: " << relPath);
-    std::string adminFile = *getUncompressedFile(relPath);
-    const std::string templatePath =
-        Poco::Path(relPath).setFileName("admintemplate.html").toString();
-    std::string templateFile = *getUncompressedFile(templatePath);
-
-    const std::string escapedJwtToken = Uri::encode(jwtToken, "'");
-    Poco::replaceInPlace(templateFile, std::string("%JWT_TOKEN%"), escapedJwtToken);
-    if (relPath == "/browser/dist/admin/adminClusterOverview.html" ||
-        relPath == "/browser/dist/admin/adminClusterOverviewAbout.html")
-    {
-        std::string bodyPath = Poco::Path(relPath).setFileName("adminClusterBody.html").toString();
-        std::string bodyFile = *getUncompressedFile(bodyPath);
-        Poco::replaceInPlace(templateFile, std::string("<!--%BODY%-->"), bodyFile);
-        Poco::replaceInPlace(templateFile, std::string("<!--%MAIN_CONTENT%-->"), adminFile);
-        Poco::replaceInPlace(templateFile, std::string("%ROUTE_TOKEN%"), COOLWSD::RouteToken);
-    }
-    else
-    {
-        std::string bodyPath = Poco::Path(relPath).setFileName("adminBody.html").toString();
-        std::string bodyFile = *getUncompressedFile(bodyPath);
-        Poco::replaceInPlace(templateFile, std::string("<!--%BODY%-->"), bodyFile);
-        Poco::replaceInPlace(templateFile, std::string("<!--%MAIN_CONTENT%-->"),
-                             adminFile); // Now template has the main content..
-    }
-
     std::string brandJS(Poco::format(scriptJS, responseRoot, std::string(BRANDING)));
     std::string brandFooter;
 
@@ -2521,10 +2440,26 @@ void FileServerRequestHandler::preprocessAdminFile(const HTTPRequest& request,
         }
     }
 
-    Poco::replaceInPlace(templateFile, std::string("<!--%BRANDING_JS%-->"), brandJS);
-    Poco::replaceInPlace(templateFile, std::string("<!--%FOOTER%-->"), brandFooter);
-    Poco::replaceInPlace(templateFile, std::string("%VERSION%"), std::string(COOLWSD_VERSION_HASH));
-    Poco::replaceInPlace(templateFile, std::string("%SERVICE_ROOT%"), responseRoot);
+    std::unordered_map<std::string, std::string> vars;
+    vars["BRANDING_JS"] = std::move(brandJS);
+    vars["FOOTER"] = std::move(brandFooter);
+    vars["VERSION"] = COOLWSD_VERSION_HASH;
+    vars["SERVICE_ROOT"] = responseRoot;
+
+    // The page is nested as admintemplate.html(body(main content)).
+    std::string bodyName = "adminBody.html";
+    if (relPath == "/browser/dist/admin/adminClusterOverview.html" ||
+        relPath == "/browser/dist/admin/adminClusterOverviewAbout.html")
+    {
+        bodyName = "adminClusterBody.html";
+        vars["ROUTE_TOKEN"] = COOLWSD::RouteToken;
+    }
+
+    vars["MAIN_CONTENT"] = renderFile(relPath, vars);
+    vars["BODY"] = renderFile(Poco::Path(relPath).setFileName(bodyName).toString(), vars);
+    vars["JWT_TOKEN"] = Uri::encode(jwtToken, "'");
+    std::string templateFile =
+        renderFile(Poco::Path(relPath).setFileName("admintemplate.html").toString(), vars);
 
     // Ask UAs to block if they detect any XSS attempt
     response.add("X-XSS-Protection", "1; mode=block");
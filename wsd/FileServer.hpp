@@ -17,7 +17,9 @@
 #include <Poco/Net/PartHandler.h>
 #include <Socket.hpp>
 
+#include <map>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 class RequestDetails;
@@ -35,6 +37,8 @@ class HTTPBasicCredentials;
 
 /// Represents a file that is preprocessed for variable
 /// expansion/replacement before serving.
+/// The file is parsed once into literal and variable segments,
+/// so serving it only costs a single copy of the output.
 class PreProcessedFile
 {
     friend class FileServeTests;
@@ -47,13 +51,16 @@ public:
         CommentedVariable
     };
 
-    PreProcessedFile(std::string filename, const std::string& data);
+    PreProcessedFile(std::string filename, std::string_view data);
 
     const std::string& filename() const { return _filename; }
     std::size_t size() const { return _size; }
 
-    /// Substitute variables per the given map.
-    std::string substitute(const std::unordered_map<std::string, std::string>& values);
+    /// Substitute variables per the given map, keyed by the variable
+    /// name without the '%' markers. Unknown variables are left as-is.
+    /// Renders in a single pass into an exactly-sized buffer, so values
+    /// are never themselves scanned for variables.
+    std::string substitute(const std::unordered_map<std::string, std::string>& values) const;
 
 private:
     const std::string _filename; ///< Filename on disk, with extension.
@@ -80,6 +87,90 @@ inline std::ostream& operator<<(std::ostream& os, const PreProcessedFile::Segmen
     return os;
 }
 
+/// A static file served from memory. The original (and the brotli
+/// variant, which the browser build produces as a .br sibling) is
+/// mapped read-only, and the gzip and zstd variants are compressed
+/// once when loading, so that serving a cold client costs no CPU.
+/// Note: the files must be replaced (as package managers do), not
+/// rewritten in place, while mapped.
+class StaticAsset
+{
+    friend class FileServeTests;
+
+public:
+    /// The Content-Encodings we can serve, in order of preference.
+    enum class Encoding : uint8_t
+    {
+        Brotli,
+        Zstd,
+        Gzip,
+        Identity
+    };
+
+    StaticAsset() = default;
+    StaticAsset(StaticAsset&&) noexcept = default;
+    StaticAsset(const StaticAsset&) = delete;
+    StaticAsset& operator=(const StaticAsset&) = delete;
+    StaticAsset& operator=(StaticAsset&&) = delete;
+
+    /// Map the original file. Returns false on failure.
+    bool load(const std::string& path) { return _identity.map(path); }
+
+    /// Map the pre-compressed brotli variant. Returns false on failure.
+    bool loadBrotli(const std::string& path) { return _brotli.map(path); }
+
+    /// Build the gzip and zstd variants of the original,
+    /// keeping only those that are worth sending.
+    void compress();
+
+    /// The content in the given encoding, empty if we don't have it.
+    std::string_view get(Encoding encoding) const;
+
+    /// The preferred encoding that we have and the client accepts.
+    Encoding select(bool acceptBrotli, bool acceptZstd, bool acceptGzip) const;
+
+    /// The Content-Encoding token of the given encoding.
+    static const char* name(Encoding encoding);
+
+    /// Bytes mapped from disk, shared with the page-cache.
+    std::size_t mappedSize() const { return _identity.size() + _brotli.size(); }
+
+    /// Bytes held in memory by the compressed variants.
+    std::size_t heapSize() const { return _gzip.size() + _zstd.size(); }
+
+private:
+    /// A read-only, private mapping of a whole file.
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile() { unmap(); }
+
+        bool map(const std::string& path);
+        void unmap();
+
+        bool loaded() const { return _loaded; }
+        std::string_view data() const
+        {
+            return std::string_view(static_cast<const char*>(_data), _size);
+        }
+        std::size_t size() const { return _size; }
+
+    private:
+        void* _data = nullptr;
+        std::size_t _size = 0;
+        bool _loaded = false;
+    };
+
+    MappedFile _identity;
+    MappedFile _brotli;
+    std::string _zstd;
+    std::string _gzip;
+};
+
 /// Handles file requests over HTTP(S).
 class FileServerRequestHandler
 {
@@ -193,9 +284,13 @@ public:
 
     void readDirToHash(const std::string &basePath, const std::string &path, const std::string &prefix = std::string());
 
-    const std::string *getCompressedFile(const std::string &path);
+    /// The original content of a static file, empty if we don't have it.
+    std::string_view getUncompressedFile(const std::string& path) const;
 
-    const std::string *getUncompressedFile(const std::string &path);
+    /// Renders the preprocessed template at path with the given variables,
+    /// keyed by name without the '%' markers. Empty if we don't have it.
+    std::string renderFile(const std::string& path,
+                           const std::unordered_map<std::string, std::string>& vars) const;
 
     /// If configured and necessary, sets the HSTS headers.
     static void hstsHeaders([[maybe_unused]] http::Response& response)
@@ -219,7 +314,9 @@ public:
     void dumpState(std::ostream& os);
 
 private:
-    std::map<std::string, std::pair<std::string, std::string>> FileHash;
+    std::map<std::string, StaticAsset> FileHash;
+    /// The subset of FileHash that we substitute variables in before serving.
+    std::map<std::string, PreProcessedFile> TemplateHash;
     static void sendError(http::StatusCode errorCode, const std::string& requestPath,
                           const std::shared_ptr<StreamSocket>& socket,
                           const std::string& shortMessage, const std::string& longMessage,
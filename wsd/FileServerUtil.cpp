@@ -18,9 +18,16 @@
 
 #include <cctype>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <zstd.h>
+
 #include <wasm/base64.hpp>
 
-PreProcessedFile::PreProcessedFile(std::string filename, const std::string& data)
+PreProcessedFile::PreProcessedFile(std::string filename, std::string_view data)
     : _filename(std::move(filename))
     , _size(data.length())
 {
@@ -140,47 +147,70 @@ PreProcessedFile::PreProcessedFile(std::string filename, const std::string& data
     }
 }
 
-std::string PreProcessedFile::substitute(const std::unordered_map<std::string, std::string>& values)
+std::string
+PreProcessedFile::substitute(const std::unordered_map<std::string, std::string>& values) const
 {
-    std::string recon;
-    recon.reserve(_size * 2);
-    for (const auto& seg : _segments)
+    // Resolve the variables first, so we can size the output exactly
+    // and render it in one pass without reallocating.
+    std::vector<const std::string*> resolved(_segments.size(), nullptr);
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < _segments.size(); ++i)
     {
+        const auto& seg = _segments[i];
         switch (seg.first)
         {
             case SegmentType::Data:
-                recon.append(seg.second);
+                size += seg.second.size();
                 break;
             case SegmentType::Variable:
             case SegmentType::CommentedVariable:
             {
                 const auto it = values.find(seg.second);
-                if (it == values.end())
+                if (it != values.end())
                 {
-                    // Leave original variable as-is.
-                    if (seg.first == SegmentType::Variable)
-                    {
-                        recon.push_back('%');
-                        recon.append(seg.second);
-                        recon.push_back('%');
-                    }
-                    else if (seg.first == SegmentType::CommentedVariable)
-                    {
-                        recon.append("<!--%");
-                        recon.append(seg.second);
-                        recon.append("%-->");
-                    }
+                    resolved[i] = &it->second;
+                    size += it->second.size();
                 }
                 else
                 {
-                    // Substitute with the given value.
-                    recon.append(it->second);
+                    // "%VAR%" or "<!--%VAR%-->".
+                    size += seg.second.size() + (seg.first == SegmentType::Variable ? 2 : 9);
                 }
             }
             break;
         }
     }
 
+    std::string recon;
+    recon.reserve(size);
+    for (std::size_t i = 0; i < _segments.size(); ++i)
+    {
+        const auto& seg = _segments[i];
+        if (seg.first == SegmentType::Data)
+        {
+            recon.append(seg.second);
+        }
+        else if (resolved[i])
+        {
+            // Substitute with the given value.
+            recon.append(*resolved[i]);
+        }
+        else if (seg.first == SegmentType::Variable)
+        {
+            // Leave original variable as-is.
+            recon.push_back('%');
+            recon.append(seg.second);
+            recon.push_back('%');
+        }
+        else
+        {
+            recon.append("<!--%");
+            recon.append(seg.second);
+            recon.append("%-->");
+        }
+    }
+
+    assert(recon.size() == size && "Mis-sized the substituted output");
     return recon;
 }
 
@@ -371,6 +401,184 @@ std::string FileServerRequestHandler::checkFileInfoToJSON(const std::string& che
     return previousCheckFileInfoJSON;
 }
 
+StaticAsset::MappedFile::MappedFile(MappedFile&& other) noexcept
+    : _data(other._data)
+    , _size(other._size)
+    , _loaded(other._loaded)
+{
+    other._data = nullptr;
+    other._size = 0;
+    other._loaded = false;
+}
+
+bool StaticAsset::MappedFile::map(const std::string& path)
+{
+    unmap();
+
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_SYS("Failed to open [" << path << "] to map");
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+        LOG_SYS("Failed to stat [" << path << "] to map");
+        ::close(fd);
+        return false;
+    }
+
+    // mmap(2) refuses empty mappings, which we represent with null.
+    if (st.st_size > 0)
+    {
+        void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            LOG_SYS("Failed to map [" << path << "] of " << st.st_size << " bytes");
+            ::close(fd);
+            return false;
+        }
+
+        _data = data;
+        _size = st.st_size;
+    }
+
+    // The mapping stays valid without the fd.
+    ::close(fd);
+    _loaded = true;
+    return true;
+}
+
+void StaticAsset::MappedFile::unmap()
+{
+    if (_data)
+        ::munmap(_data, _size);
+
+    _data = nullptr;
+    _size = 0;
+    _loaded = false;
+}
+
+namespace
+{
+/// Compressing to more than this fraction isn't worth the Content-Encoding.
+constexpr std::size_t MinCompressionPercent = 90;
+
+bool isWorthSending(const std::size_t compressedSize, const std::size_t originalSize)
+{
+    return compressedSize * 100 < originalSize * MinCompressionPercent;
+}
+} // namespace
+
+void StaticAsset::compress()
+{
+    _gzip.clear();
+    _zstd.clear();
+
+    const std::string_view data = _identity.data();
+    if (data.empty())
+        return;
+
+    // We compress only once, so can afford a bit more than the defaults.
+    constexpr int GzipLevel = Z_BEST_COMPRESSION;
+    constexpr int ZstdLevel = 12;
+
+    z_stream strm{};
+    const int initResult =
+        deflateInit2(&strm, GzipLevel, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY); // 31: gzip wrapper.
+    if (initResult == Z_OK)
+    {
+        _gzip.resize(deflateBound(&strm, data.size()));
+        strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        strm.avail_in = data.size();
+        strm.next_out = reinterpret_cast<Bytef*>(_gzip.data());
+        strm.avail_out = _gzip.size();
+
+        const int deflateResult = deflate(&strm, Z_FINISH);
+        if (deflateResult == Z_STREAM_END)
+            _gzip.resize(strm.total_out);
+        else
+        {
+            LOG_ERR("Failed to gzip " << data.size() << " bytes, result: " << deflateResult);
+            _gzip.clear(); // Can't trust the compressed data, if any.
+        }
+
+        deflateEnd(&strm);
+    }
+    else
+        LOG_ERR("Failed to deflateInit2 for gzip, result: " << initResult);
+
+    _zstd.resize(ZSTD_compressBound(data.size()));
+    const std::size_t zstdSize =
+        ZSTD_compress(_zstd.data(), _zstd.size(), data.data(), data.size(), ZstdLevel);
+    if (ZSTD_isError(zstdSize))
+    {
+        LOG_ERR("Failed to zstd compress " << data.size()
+                                           << " bytes: " << ZSTD_getErrorName(zstdSize));
+        _zstd.clear();
+    }
+    else
+        _zstd.resize(zstdSize);
+
+    // Already compressed formats (png, woff2, etc.) don't benefit.
+    if (!isWorthSending(_gzip.size(), data.size()))
+        _gzip.clear();
+    if (!isWorthSending(_zstd.size(), data.size()))
+        _zstd.clear();
+
+    _gzip.shrink_to_fit();
+    _zstd.shrink_to_fit();
+}
+
+std::string_view StaticAsset::get(const Encoding encoding) const
+{
+    switch (encoding)
+    {
+        case Encoding::Brotli:
+            return _brotli.data();
+        case Encoding::Zstd:
+            return _zstd;
+        case Encoding::Gzip:
+            return _gzip;
+        case Encoding::Identity:
+            return _identity.data();
+    }
+
+    return std::string_view();
+}
+
+StaticAsset::Encoding StaticAsset::select(const bool acceptBrotli, const bool acceptZstd,
+                                          const bool acceptGzip) const
+{
+    if (acceptBrotli && _brotli.loaded())
+        return Encoding::Brotli;
+    if (acceptZstd && !_zstd.empty())
+        return Encoding::Zstd;
+    if (acceptGzip && !_gzip.empty())
+        return Encoding::Gzip;
+
+    return Encoding::Identity;
+}
+
+const char* StaticAsset::name(const Encoding encoding)
+{
+    switch (encoding)
+    {
+        case Encoding::Brotli:
+            return "br";
+        case Encoding::Zstd:
+            return "zstd";
+        case Encoding::Gzip:
+            return "gzip";
+        case Encoding::Identity:
+            return "identity";
+    }
+
+    return "identity";
+}
+
 namespace
 {
 constexpr bool isValidCss(const std::string_view token)
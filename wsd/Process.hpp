@@ -202,6 +202,7 @@ public:
                     std::make_shared<WebSocketHandler>(socket, request))
         , _jailId(jailId)
         , _configId(configId)
+        , _documentCount(0)
         , _smapsFD(-1)
     {
         const int urpFromKitFD = socket->getIncomingFD(SharedFDType::URPFromKit);
@@ -252,6 +253,8 @@ public:
 
     void setDocumentBroker(const std::shared_ptr<DocumentBroker>& docBroker);
     std::shared_ptr<DocumentBroker> getDocumentBroker() const { return _docBroker.lock(); }
+    /// The number of DocumentBrokers we were given, in turn, so far.
+    std::size_t getDocumentCount() const { return _documentCount; }
     const std::string& getJailId() const { return _jailId; }
     const std::string& getConfigId() const { return _configId; }
     void setSMapsFD(int smapsFD) { _smapsFD = smapsFD; }
@@ -262,12 +265,31 @@ public:
         to.takeSocket(from, getSocket());
     }
 
+    /// Detaches from our DocumentBroker, to be given another one, moving our socket
+    /// from its poll @from, on its thread, to @to. The URP sockets are left out until
+    /// the next DocumentBroker adds them to its poll.
+    void detachDocumentBroker(SocketPoll& from, SocketPoll& to)
+    {
+        // Messages we get from now on are no longer for it.
+        _docBroker.reset();
+
+        const std::shared_ptr<StreamSocket> socket = getSocket();
+        if (socket && from.releaseSocket(socket))
+            to.insertNewSocket(socket);
+
+        if (_urpFromKit)
+            from.releaseSocket(_urpFromKit);
+        if (_urpToKit)
+            from.releaseSocket(_urpToKit);
+    }
+
 private:
     const std::string _jailId;
     const std::string _configId;
     std::weak_ptr<DocumentBroker> _docBroker;
     std::shared_ptr<StreamSocket> _urpFromKit;
     std::shared_ptr<StreamSocket> _urpToKit;
+    std::size_t _documentCount;
     int _smapsFD;
 };
 
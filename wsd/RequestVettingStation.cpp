@@ -25,11 +25,13 @@
 #include <common/JsonUtil.hpp>
 #include <Poco/Base64Encoder.h>
 #include <CacheUtil.hpp>
+#include <DocumentCache.hpp>
 #include <Util.hpp>
 #include <ServerAuditUtil.hpp>
 
 #if !MOBILEAPP
 #include <wopi/CheckFileInfo.hpp>
+#include <wopi/GetFile.hpp>
 #endif // !MOBILEAPP
 
 extern std::pair<std::shared_ptr<DocumentBroker>, std::string>
@@ -325,6 +327,7 @@ void RequestVettingStation::handleRequest(const std::string& id,
                         if (std::shared_ptr<DocumentBroker> docBroker = createDocBroker(docKey,
                                     sharedSettings.getConfigId(), url, uriPublic))
                         {
+                            getFile(docBroker, uriPublic);
                             createClientSession(docBroker, docKey, url, uriPublic, isReadOnly);
                             // If there is anything dubious about the ssl
                             // connection provide a warning about that.
@@ -386,6 +389,7 @@ void RequestVettingStation::checkFileInfo(const Poco::URI& uri, bool isReadOnly,
                         sharedSettings.getConfigId(), url, uriPublic))
             {
                 launchInstallPresets();
+                getFile(docBroker, uriPublic);
                 if (_ws)
                 {
                     // If we don't have the WebSocket, defer creating the client session.
@@ -417,6 +421,77 @@ void RequestVettingStation::checkFileInfo(const Poco::URI& uri, bool isReadOnly,
     _checkFileInfo = std::make_shared<CheckFileInfo>(_poll, uri, std::move(cfiContinuation));
     _checkFileInfo->checkFileInfo(redirectLimit);
 }
+
+void RequestVettingStation::getFile(const std::shared_ptr<DocumentBroker>& docBroker,
+                                    const Poco::URI& uriPublic)
+{
+    if (_getFile || !_checkFileInfo || !_checkFileInfo->wopiInfo())
+        return; // Already prefetching, or not a WOPI document.
+
+    // Templates are downloaded from their source when loading.
+    std::string templateSource;
+    JsonUtil::findJSONValue(_checkFileInfo->wopiInfo(), "TemplateSource", templateSource);
+    if (!templateSource.empty())
+        return;
+
+    // No need to download what we have cached; DocBroker will use it.
+    std::string version;
+    JsonUtil::findJSONValue(_checkFileInfo->wopiInfo(), "Version", version);
+    std::string lastModifiedTime;
+    JsonUtil::findJSONValue(_checkFileInfo->wopiInfo(), "LastModifiedTime", lastModifiedTime);
+    if (DocumentCache::contains(
+            DocumentCache::getKey(docBroker->getDocKey(), version, lastModifiedTime)))
+    {
+        LOG_DBG("Document for DocBroker [" << docBroker->getDocKey() << "] is cached");
+        return;
+    }
+
+    if (!docBroker->claimDownload())
+        return;
+
+    std::string fileUrl;
+    JsonUtil::findJSONValue(_checkFileInfo->wopiInfo(), "FileUrl", fileUrl);
+
+    LOG_DBG("Prefetching the document for DocBroker [" << docBroker->getDocKey() << ']');
+
+    auto onProgress = [selfWeak = weak_from_this(), this,
+                       lastPercent = 0](GetFile&, int64_t received, int64_t total) mutable
+    {
+        std::shared_ptr<RequestVettingStation> selfLifecycle = selfWeak.lock();
+        if (!selfLifecycle || !_ws || total <= 0)
+            return;
+
+        // Keep it in 10% steps, as this is for the user.
+        const int percent =
+            static_cast<int>(std::min<int64_t>(100, received * 100 / total)) / 10 * 10;
+        if (percent > lastPercent)
+        {
+            lastPercent = percent;
+            _ws->sendMessage("progress: { \"id\":\"download\", \"value\":" +
+                             std::to_string(percent) + " }");
+        }
+    };
+
+    auto onFinish = [selfWeak = weak_from_this(), this](GetFile& getFile)
+    {
+        std::shared_ptr<RequestVettingStation> selfLifecycle = selfWeak.lock();
+        if (!selfLifecycle)
+            return;
+
+        LOG_DBG("Prefetching the document finished: " << GetFile::name(getFile.state()));
+        if (_getFileContinuation)
+        {
+            // Invoke a copy, as it may get reset in the call.
+            std::function<void()> continuation = std::move(_getFileContinuation);
+            _getFileContinuation = nullptr;
+            continuation();
+        }
+    };
+
+    _getFile = std::make_shared<GetFile>(_poll, uriPublic, std::move(fileUrl),
+                                         std::move(onProgress), std::move(onFinish));
+    _getFile->getFile(HTTP_REDIRECTION_LIMIT);
+}
 #endif //!MOBILEAPP
 
 std::shared_ptr<DocumentBroker> RequestVettingStation::createDocBroker(
@@ -467,6 +542,17 @@ void RequestVettingStation::createClientSession(const std::shared_ptr<DocumentBr
     assert(docBroker && "Must have DocBroker");
     assert(_ws && "Must have WebSocket");
 
+#if !MOBILEAPP
+    if (_getFile && !_getFile->completed())
+    {
+        // Wait for the prefetching to finish, to transfer it with the socket.
+        LOG_DBG("GetFile request is in progress. Will resume when done");
+        _getFileContinuation = [this, docBroker, docKey, url, uriPublic, isReadOnly]()
+        { createClientSession(docBroker, docKey, url, uriPublic, isReadOnly); };
+        return;
+    }
+#endif // !MOBILEAPP
+
     std::shared_ptr<ClientSession> clientSession =
         docBroker->createNewClientSession(_ws, _id, uriPublic, isReadOnly, _requestDetails);
     if (!clientSession)
@@ -495,17 +581,30 @@ void RequestVettingStation::createClientSession(const std::shared_ptr<DocumentBr
     std::shared_ptr<StreamSocket> socket = _socket;
     _socket.reset();
 
+#if !MOBILEAPP
+    // The prefetched document, if any, is handed over to DocBroker.
+    std::shared_ptr<GetFile> getFile = std::move(_getFile);
+#endif // !MOBILEAPP
+
     // Transfer the client socket to the DocumentBroker when we get back to the poll:
     std::shared_ptr<WebSocketHandler> ws = _ws;
     docBroker->setupTransfer(
         socket,
         [clientSession = std::move(clientSession), wopiFileInfo = std::move(wopiFileInfo),
+#if !MOBILEAPP
+         getFile = std::move(getFile),
+#endif // !MOBILEAPP
          ws = std::move(ws), docBroker](const std::shared_ptr<Socket>& moveSocket)
         {
             try
             {
                 LOG_DBG_S("Transfering docBroker [" << docBroker->getDocKey() << ']');
 
+#if !MOBILEAPP
+                if (getFile)
+                    docBroker->setPrefetchedDownload(getFile);
+#endif // !MOBILEAPP
+
                 auto streamSocket = std::static_pointer_cast<StreamSocket>(moveSocket);
 
                 // Set WebSocketHandler's socket after its construction for shared_ptr goodness.
@@ -514,7 +613,8 @@ void RequestVettingStation::createClientSession(const std::shared_ptr<DocumentBr
                 LOG_DBG_S('#' << moveSocket->getFD() << " handler is " << clientSession->getName());
 
                 // Add and load the session.
-                // Will download synchronously, but in own docBroker thread.
+                // Will adopt the prefetched document, if any, or download
+                // synchronously, but in own docBroker thread.
                 docBroker->addSession(clientSession, std::move(*wopiFileInfo));
 
                 COOLWSD::checkDiskSpaceAndWarnClients(true);
@@ -21,6 +21,7 @@
 #include <string>
 
 class CheckFileInfo;
+class GetFile;
 class PresetsInstallTask;
 
 /// RequestVettingStation is used to vet the request in the background.
@@ -99,6 +100,13 @@ private:
 
     void checkFileInfo(const Poco::URI& uri, bool isReadOnly, int redirectionLimit);
     std::shared_ptr<CheckFileInfo> _checkFileInfo;
+
+    /// Prefetch the document with GetFile, while the Kit is spawned,
+    /// iff we are the first to load it in the given DocBroker.
+    void getFile(const std::shared_ptr<DocumentBroker>& docBroker, const Poco::URI& uriPublic);
+    std::shared_ptr<GetFile> _getFile;
+    /// Creates the ClientSession once the prefetching is done.
+    std::function<void()> _getFileContinuation;
     std::shared_ptr<PresetsInstallTask> _asyncInstallTask;
 #endif // !MOBILEAPP
 
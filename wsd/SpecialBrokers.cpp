@@ -44,6 +44,7 @@
 #include <common/FileUtil.hpp>
 #include <common/Uri.hpp>
 #include <CommandControl.hpp>
+#include <wsd/Process.hpp>
 
 #if !MOBILEAPP
 #include <wopi/CheckFileInfo.hpp>
@@ -91,6 +92,19 @@ ConvertToBroker::ConvertToBroker(const std::string& uri, const Poco::URI& uriPub
 ConvertToBroker::~ConvertToBroker() {}
 
 bool ConvertToBroker::startConversion(SocketDisposition& disposition, const std::string& id)
+{
+    setupTransfer(disposition, prepareConversion(id));
+    return true;
+}
+
+bool ConvertToBroker::startConversion(const std::shared_ptr<StreamSocket>& socket,
+                                      const std::string& id)
+{
+    setupTransfer(socket, prepareConversion(id));
+    return true;
+}
+
+SocketDisposition::MoveFunction ConvertToBroker::prepareConversion(const std::string& id)
 {
     std::shared_ptr<ConvertToBroker> docBroker =
         std::static_pointer_cast<ConvertToBroker>(shared_from_this());
@@ -103,26 +117,24 @@ bool ConvertToBroker::startConversion(SocketDisposition& disposition, const std:
     _clientSession = std::make_shared<ClientSession>(nullPtr, id, docBroker, getPublicUri(),
                                                      isReadOnly, requestDetails);
     _clientSession->construct();
+    _clientSession->setConvertCacheKey(_cacheKey);
 
-    docBroker->setupTransfer(
-        disposition,
-        [docBroker](const std::shared_ptr<Socket>& moveSocket)
-        {
-            auto streamSocket = std::static_pointer_cast<StreamSocket>(moveSocket);
-            docBroker->_clientSession->setSaveAsSocket(streamSocket);
+    return [docBroker](const std::shared_ptr<Socket>& moveSocket)
+    {
+        auto streamSocket = std::static_pointer_cast<StreamSocket>(moveSocket);
+        docBroker->_clientSession->setSaveAsSocket(streamSocket);
 
-            // First add and load the session.
-            docBroker->addSession(docBroker->_clientSession);
+        // First add and load the session.
+        docBroker->addSession(docBroker->_clientSession);
 
-            // Load the document manually and request saving in the target format.
-            std::string encodedFrom;
-            Poco::URI::encode(docBroker->getPublicUri().getPath(), "", encodedFrom);
+        // Load the document manually and request saving in the target format.
+        std::string encodedFrom;
+        Poco::URI::encode(docBroker->getPublicUri().getPath(), "", encodedFrom);
 
-            docBroker->sendStartMessage(docBroker->_clientSession, encodedFrom);
+        docBroker->sendStartMessage(docBroker->_clientSession, encodedFrom);
 
-            // Save is done in the setLoaded
-        });
-    return true;
+        // Save is done in the setLoaded
+    };
 }
 
 void ConvertToBroker::sendStartMessage(const std::shared_ptr<ClientSession>& clientSession,
@@ -211,6 +223,63 @@ void ConvertToBroker::setLoaded()
     std::vector<char> saveasRequest(saveAsCmd.begin(), saveAsCmd.end());
 
     _clientSession->handleMessage(saveasRequest);
+
+    // To clean up after it, if the Kit is kept for the next conversion.
+    _saveAsPath = COOLWSD::NoCapsForKit
+                      ? toJailURL.substr(std::string("file://").size())
+                      : FileUtil::buildLocalPathToJail(COOLWSD::EnableMountNamespaces,
+                                                       getJailRoot(),
+                                                       std::string(JAILED_DOCUMENT_ROOT).substr(1) +
+                                                           toPath.getFileName());
+}
+
+bool ConvertToBroker::isChildRecyclable() const
+{
+    CONFIG_STATIC const bool reuseKits =
+        ConfigUtil::getConfigValue<bool>("per_document.convert_kit_reuse[@enable]", false);
+    return reuseKits;
+}
+
+std::shared_ptr<ChildProcess> ConvertToBroker::getRecycledChild()
+{
+    return isChildRecyclable() ? getWarmChild(*getPoll(), getConfigId()) : nullptr;
+}
+
+bool ConvertToBroker::recycleChild(const std::shared_ptr<ChildProcess>& childProcess)
+{
+    CONFIG_STATIC const std::size_t maxIdle =
+        ConfigUtil::getConfigValue<std::size_t>("per_document.convert_kit_reuse.max_idle", 4);
+    CONFIG_STATIC const std::size_t maxDocuments = ConfigUtil::getConfigValue<std::size_t>(
+        "per_document.convert_kit_reuse.max_documents", 100);
+    CONFIG_STATIC const std::size_t maxRssMb =
+        ConfigUtil::getConfigValue<std::size_t>("per_document.convert_kit_reuse.max_rss_mb", 1024);
+
+    if (maxDocuments > 0 && childProcess->getDocumentCount() >= maxDocuments)
+    {
+        LOG_DBG("Retiring child [" << childProcess->getPid() << "] after "
+                                   << childProcess->getDocumentCount() << " documents");
+        return false;
+    }
+
+    const std::size_t rssKb = Util::getMemoryUsageRSS(childProcess->getPid());
+    if (maxRssMb > 0 && rssKb > maxRssMb * 1024)
+    {
+        LOG_DBG("Retiring child [" << childProcess->getPid() << "] with " << rssKb
+                                   << " KB resident, over the limit of " << maxRssMb << " MB");
+        return false;
+    }
+
+    // Leave nothing of ours behind for the next conversion.
+    if (StorageBase* storage = getStorage())
+    {
+        const std::string jobDir = Poco::Path(storage->getRootFilePath()).parent().toString();
+        FileUtil::removeFile(jobDir, /*recursive=*/true);
+    }
+
+    if (!_saveAsPath.empty())
+        FileUtil::removeFile(_saveAsPath);
+
+    return putWarmChild(childProcess, *getPoll(), maxIdle);
 }
 
 static std::atomic<std::size_t> gRenderSearchResultBrokerInstanceCouter;
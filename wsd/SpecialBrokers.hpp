@@ -48,6 +48,8 @@ class ConvertToBroker : public StatelessBatchBroker
     const std::string _format;
     const std::string _sOptions;
     const std::string _lang;
+    std::string _saveAsPath; ///< Where the Kit saves the result, as seen from here.
+    std::string _cacheKey; ///< The ConvertCache key of the result, if cacheable.
 
 public:
     /// Construct DocumentBroker with URI and docKey
@@ -59,9 +61,15 @@ public:
     /// _lang accessors
     const std::string& getLang() { return _lang; }
 
+    /// Cache the result under the given ConvertCache key.
+    void setCacheKey(const std::string& key) { _cacheKey = key; }
+
     /// Move socket to this broker for response & do conversion
     bool startConversion(SocketDisposition& disposition, const std::string& id);
 
+    /// Respond on the given socket, e.g. one end of a socketpair, & do conversion
+    bool startConversion(const std::shared_ptr<StreamSocket>& socket, const std::string& id);
+
     /// When the load completes - lets start saving
     void setLoaded() override;
 
@@ -78,8 +86,18 @@ protected:
 
     virtual bool isGetThumbnail() const { return false; }
 
+    bool isChildRecyclable() const override;
+
+    std::shared_ptr<ChildProcess> getRecycledChild() override;
+
+    bool recycleChild(const std::shared_ptr<ChildProcess>& childProcess) override;
+
     virtual void sendStartMessage(const std::shared_ptr<ClientSession>& clientSession,
                                   const std::string& encodedFrom);
+
+private:
+    /// Creates the session to convert with, and returns how to start with the socket to respond on.
+    SocketDisposition::MoveFunction prepareConversion(const std::string& id);
 };
 
 class ExtractLinkTargetsBroker final : public ConvertToBroker
@@ -13,6 +13,7 @@
 
 #include "TileCache.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <climits>
 #include <cstddef>
@@ -37,10 +38,17 @@ using namespace COOLProtocol;
 
 TileCache::TileCache(std::string docURL, const std::chrono::system_clock::time_point& modifiedTime,
                      bool dontCache)
-    : _docURL(std::move(docURL))
+    : _slideLayersSize(0)
+    , _docURL(std::move(docURL))
     , _cacheSize(0)
     , _maxCacheSize(1024 * 1024)
     , _dontCache(dontCache)
+    , _lookupCount(0)
+    , _hitCount(0)
+    , _evictionCount(0)
+    , _compactionMaxDeltas(0)
+    , _compactionMaxDeltaPercent(0)
+    , _compactionCount(0)
 {
 #ifndef BUILDING_TESTS
     LOG_INF("TileCache ctor for uri [" << COOLWSD::anonymizeUrl(_docURL) <<
@@ -61,9 +69,15 @@ TileCache::~TileCache()
 void TileCache::clear()
 {
     _cache.clear();
+    _tilesToCompact.clear();
+    _cacheIndex.clear();
+    _clock.clear();
     _cacheSize = 0;
     for (std::map<std::string, Blob>& i : _streamCache)
         i.clear();
+    _slideLayersCache.clear();
+    _slideLayersKeys.clear();
+    _slideLayersSize = 0;
 
     LOG_INF("Completely cleared tile cache for: " << _docURL);
 }
@@ -164,6 +178,20 @@ void TileCache::forgetTileBeingRendered(const TileDesc &descForKitReply,
                 " waiting for ver " << tileBeingRendered->getVersion() << " but have " << descForKitReply.getVersion());
 }
 
+void TileCache::abandonTileRendering(const TileDesc& tile)
+{
+    ASSERT_CORRECT_THREAD_OWNER(_owner);
+
+    const std::shared_ptr<TileBeingRendered> tileBeingRendered = findTileBeingRendered(tile);
+    if (tileBeingRendered)
+        forgetTileBeingRendered(tile, tileBeingRendered);
+
+    // The keyframe to compact its deltas isn't coming either.
+    const Tile cached = findTile(tile);
+    if (cached)
+        cached->_compactionRequested = false;
+}
+
 int TileCache::getTileBeingRenderedVersion(const TileDesc& tile)
 {
     std::shared_ptr<TileBeingRendered> tileBeingRendered = findTileBeingRendered(tile);
@@ -177,6 +205,13 @@ Tile TileCache::lookupTile(const TileDesc& tile)
 
     Tile ret = findTile(tile);
 
+    ++_lookupCount;
+    if (ret && ret->isValid())
+    {
+        ++_hitCount;
+        ret->reference();
+    }
+
     UnitWSD::get().lookupTile(tile.getPart(), tile.getEditMode(),
                               tile.getWidth(), tile.getHeight(),
                               tile.getTilePosX(), tile.getTilePosY(),
@@ -297,32 +332,143 @@ bool TileCache::invalidateTiles(int part, int mode, int x, int y, int width, int
         return false;
     }
 
-    for (auto it = _cache.begin(); it != _cache.end();)
+    std::vector<TileDesc> candidates;
+    _cacheIndex.findCandidates(part, mode, x, y, width, height, canonicalViewId, candidates);
+
+    size_t invalidated = 0;
+    for (const TileDesc& desc : candidates)
     {
-        if (intersectsTile(it->first, part, mode, x, y, width, height, canonicalViewId))
+        if (!intersectsTile(desc, part, mode, x, y, width, height, canonicalViewId))
+            continue;
+
+        const auto it = _cache.find(desc);
+        assert(it != _cache.end() && "tile cache index out of sync");
+        if (it != _cache.end())
         {
             // FIXME: only want to keep as invalid keyframes in the view area(s)
             it->second->invalidate();
-            ++it;
+            ++invalidated;
         }
-#if 0
+    }
+
+    LOG_TRC("Invalidated " << invalidated << " of " << candidates.size() << " candidate tiles out of "
+                           << _cache.size());
+
+    return true;
+}
+
+const TileCache::SlideLayers* TileCache::lookupSlideLayers(const std::string& key)
+{
+    const auto it = _slideLayersCache.find(key);
+    if (it == _slideLayersCache.end())
+        return nullptr;
+
+    LOG_TRC("Found " << it->second.size() << " cached slide layers for: " << key);
+    return &it->second;
+}
+
+bool TileCache::subscribeToSlideRendering(const std::string& key,
+                                          const std::shared_ptr<ClientSession>& subscriber,
+                                          const std::chrono::steady_clock::time_point now)
+{
+    const auto it = _slidesBeingRendered.find(key);
+    if (it == _slidesBeingRendered.end())
+    {
+        _slidesBeingRendered.emplace(key, SlideBeingRendered{ now, {} });
+        return false;
+    }
+
+    if (now - it->second._startTime > std::chrono::milliseconds(COMMAND_TIMEOUT_MS))
+    {
+        // Perhaps the session rendering it went away; render it again.
+        LOG_DBG("Slide being rendered for too long, rendering it again: " << key);
+        it->second._startTime = now;
+        return false;
+    }
+
+    LOG_DBG("Subscribing to the slide being rendered: " << key);
+    it->second._subscribers.push_back(subscriber);
+    return true;
+}
+
+std::shared_ptr<ClientSession>
+TileCache::handOverSlideRendering(const std::string& key, const ClientSession* renderer,
+                                  const std::chrono::steady_clock::time_point now)
+{
+    const auto it = _slidesBeingRendered.find(key);
+    if (it == _slidesBeingRendered.end())
+        return nullptr;
+
+    std::vector<std::weak_ptr<ClientSession>>& subscribers = it->second._subscribers;
+    while (!subscribers.empty())
+    {
+        const std::shared_ptr<ClientSession> session = subscribers.front().lock();
+        subscribers.erase(subscribers.begin());
+        if (session && session.get() != renderer)
         {
-            LOG_TRC("Removing tile: " << it->first.serialize());
-            _cacheSize -= itemCacheSize(it->second);
-            it = _cache.erase(it);
+            LOG_DBG("Handing the rendering of the slide over to a subscriber: " << key);
+            it->second._startTime = now;
+            return session;
         }
-#endif
-        else
+    }
+
+    LOG_DBG("No subscribers left for the abandoned slide: " << key);
+    _slidesBeingRendered.erase(it);
+    return nullptr;
+}
+
+void TileCache::saveSlideLayersAndNotify(const std::string& key, SlideLayers layers, bool success)
+{
+    const auto it = _slidesBeingRendered.find(key);
+    if (it != _slidesBeingRendered.end())
+    {
+        for (const std::weak_ptr<ClientSession>& subscriber : it->second._subscribers)
         {
-            ++it;
+            const std::shared_ptr<ClientSession> session = subscriber.lock();
+            if (!session)
+                continue;
+
+            for (const std::shared_ptr<Message>& layer : layers)
+                session->enqueueSendMessage(layer);
         }
+
+        _slidesBeingRendered.erase(it);
     }
 
-    return true;
+    if (!success || _dontCache || _slideLayersCache.count(key))
+        return;
+
+    size_t size = 0;
+    for (const std::shared_ptr<Message>& layer : layers)
+        size += layer->size();
+
+    // Keep the slides within a fraction of the tile cache.
+    const size_t maxSize = _maxCacheSize / 4;
+    if (size > maxSize)
+        return;
+
+    while (!_slideLayersKeys.empty() && _slideLayersSize + size > maxSize)
+    {
+        const auto oldest = _slideLayersCache.find(_slideLayersKeys.front());
+        for (const std::shared_ptr<Message>& layer : oldest->second)
+            _slideLayersSize -= layer->size();
+        _slideLayersCache.erase(oldest);
+        _slideLayersKeys.pop_front();
+    }
+
+    LOG_DBG("Caching " << layers.size() << " slide layers of " << size << " bytes for: " << key);
+    _slideLayersCache.emplace(key, std::move(layers));
+    _slideLayersKeys.push_back(key);
+    _slideLayersSize += size;
 }
 
 bool TileCache::invalidateTiles(const std::string& tiles, CanonicalViewId canonicalViewId)
 {
+    // Any change can affect the slides, rendered independently of the tiles.
+    _slideLayersCache.clear();
+    _slideLayersKeys.clear();
+    _slideLayersSize = 0;
+
     int part = 0, mode = 0;
     TileWireId wireId = 0;
     const Util::Rectangle invalidateRect = TileCache::parseInvalidateMsg(tiles, part, mode, wireId);
@@ -489,6 +635,25 @@ bool TileCache::subscribeToTileRendering(const TileDesc& tile,
     return true;
 }
 
+void TileCache::registerTileRendering(const TileDesc& tile,
+                                      const std::chrono::steady_clock::time_point now)
+{
+    ASSERT_CORRECT_THREAD_OWNER(_owner);
+
+    std::shared_ptr<TileBeingRendered> tileBeingRendered = findTileBeingRendered(tile);
+    if (tileBeingRendered)
+    {
+        // Keep the subscribers until this newer version arrives.
+        if (tileBeingRendered->getVersion() < tile.getVersion())
+            tileBeingRendered->setVersion(tile.getVersion());
+        return;
+    }
+
+    LOG_TRC("Rendering tile " << tile.debugName() << " ver=" << tile.getVersion()
+                              << " without subscribers");
+    _tilesBeingRendered[tile] = std::make_shared<TileBeingRendered>(tile, now);
+}
+
 Tile TileCache::findTile(const TileDesc &desc)
 {
     const auto it = _cache.find(desc);
@@ -508,7 +673,8 @@ Tile TileCache::saveDataToCache(const TileDesc &desc, const char *data, const si
 
     ensureCacheSize();
 
-    Tile tile = _cache[desc];
+    const auto it = _cache.find(desc);
+    Tile tile = it != _cache.end() ? it->second : Tile();
     if (!tile)
     {
         if (!TileData::isKeyframe(data, size))
@@ -518,14 +684,15 @@ Tile TileCache::saveDataToCache(const TileDesc &desc, const char *data, const si
             // underlying keyframe.
             LOG_TRC("rare race between canceltiles and delta rendering - "
                     "discarding delta for " << desc.serialize());
-            _cache.erase(desc);
             return Tile();
         }
         else
         {
             LOG_TRC("new tile for " << desc.serialize() << " of size " << size);
             tile = std::make_shared<TileData>(desc.getWireId(), data, size);
-            _cache[desc] = tile;
+            _cache.emplace(desc, tile);
+            _cacheIndex.insert(desc);
+            _clock.push_back(desc);
             _cacheSize += itemCacheSize(tile);
         }
     }
@@ -533,11 +700,55 @@ Tile TileCache::saveDataToCache(const TileDesc &desc, const char *data, const si
     {
         LOG_TRC("append blob to " << desc.serialize() << " of size " << size);
         _cacheSize += tile->appendBlob(desc.getWireId(), data, size);
+        tile->reference();
+
+        // Late viewers get the keyframe and the whole chain, so keep it short.
+        if ((_compactionMaxDeltas > 0 || _compactionMaxDeltaPercent > 0) &&
+            !tile->_compactionRequested &&
+            tile->needsCompaction(_compactionMaxDeltas, _compactionMaxDeltaPercent))
+        {
+            LOG_TRC("Requesting a keyframe to compact " << tile->getDeltaCount() << " deltas of "
+                                                        << desc.serialize());
+            tile->_compactionRequested = true;
+            _tilesToCompact.push_back(desc);
+            ++_compactionCount;
+        }
     }
 
     return tile;
 }
 
+TileCache::ChainLengthCounts TileCache::getChainLengthCounts() const
+{
+    ChainLengthCounts counts{};
+    for (const auto& it : _cache)
+    {
+        // Bucket by the bit length of the count: 0, 1, 2-3, 4-7, ...
+        size_t bucket = 0;
+        for (size_t deltas = it.second->getDeltaCount(); deltas > 0 && bucket < ChainLengthBuckets - 1;
+             deltas >>= 1)
+        {
+            ++bucket;
+        }
+
+        ++counts[bucket];
+    }
+
+    return counts;
+}
+
+std::string TileCache::getChainLengthBucketName(size_t bucket)
+{
+    if (bucket <= 1)
+        return std::to_string(bucket);
+
+    const size_t low = size_t(1) << (bucket - 1);
+    if (bucket == ChainLengthBuckets - 1)
+        return std::to_string(low) + '+';
+
+    return std::to_string(low) + '-' + std::to_string(2 * low - 1);
+}
+
 size_t TileCache::itemCacheSize(const Tile &tile)
 {
     return sizeof(Tile) + sizeof(TileDesc) + tile->size();
@@ -552,9 +763,29 @@ void TileCache::assertCacheSize()
         recalcSize += itemCacheSize(it.second);
     }
     assert(recalcSize == _cacheSize);
+    assert(_cacheIndex.size() == _cache.size());
+    assert(_clock.size() == _cache.size());
 #endif
 }
 
+bool TileCache::isTileVisible(const TileDesc& desc, const std::vector<VisibleArea>& areas)
+{
+    for (const VisibleArea& area : areas)
+    {
+        // Only the current zoom of a view is visible, but as the
+        // part of a Writer tile need not match the selected part,
+        // ignore the part and mode here.
+        if (area._canonicalViewId == desc.getCanonicalViewId() &&
+            area._tileWidth == desc.getTileWidth() && area._tileHeight == desc.getTileHeight() &&
+            intersectsTile(desc, desc.getPart(), desc.getEditMode(), area._area.getLeft(),
+                           area._area.getTop(), area._area.getWidth(), area._area.getHeight(),
+                           area._canonicalViewId))
+            return true;
+    }
+
+    return false;
+}
+
 void TileCache::ensureCacheSize()
 {
     assertCacheSize();
@@ -565,70 +796,64 @@ void TileCache::ensureCacheSize()
     LOG_TRC("Cleaning tile cache of size " << _cacheSize << " vs. " << _maxCacheSize <<
             " with " << _cache.size() << " entries");
 
-    struct WidSize {
-        TileWireId _wid;
-        size_t     _size;
-        WidSize(TileWireId w, size_t s) : _wid(w), _size(s) {}
-    };
-    std::vector<WidSize> wids;
-    wids.reserve(_cache.size());
-    for (const auto& it : _cache)
-        wids.emplace_back(it.first.getWireId(), itemCacheSize(it.second));
-
-    std::sort(wids.begin(), wids.end(),
-              [](const WidSize &a, const WidSize &b) { return a._wid < b._wid; });
+    std::vector<VisibleArea> visibleAreas;
+    if (_visibleAreaProvider)
+        _visibleAreaProvider(visibleAreas);
 
-    // FIXME: should we just take a wid 25% into the list ?
-    TileWireId maxToRemove = wids.front()._wid;
+    // Free a quarter of the budget, so that the sweep is amortized over
+    // the many insertions it takes to get back here.
+    const size_t targetSize = _maxCacheSize - _maxCacheSize / 4;
+    const size_t oldCount = _cache.size();
 
-    // do we have (the very rare) WID wrap-around
-    if (wids.back()._wid - wids.front()._wid > 256 * 256 * 256)
-    {
-        maxToRemove = wids.back()._wid;
-        LOG_TRC("Rare wid wrap-around detected, clear tile cache");
-    }
-    else
+    // A CLOCK sweep over the tiles in insertion (ie. roughly wid) order:
+    // the first pass gives recently used and visible tiles a second
+    // chance, the second takes anything we are not waiting on.
+    for (int pass = 0; pass < 2 && _cacheSize > targetSize; ++pass)
     {
-        // calculate which wid to start at.
-        size_t total = 0;
-        for (const auto &it : wids)
+        size_t steps = pass == 0 ? _clock.size() * 2 : _clock.size();
+        while (steps-- > 0 && _cacheSize > targetSize && _cache.size() > 1)
         {
-            total += it._size;
-            maxToRemove = it._wid;
-            if (total > _maxCacheSize / 4)
-                break;
-        }
-    }
-    LOG_TRC("cleaning up to wid " << maxToRemove << " between " <<
-            wids.front()._wid << " and " << wids.back()._wid);
+            TileDesc desc = _clock.front();
+            _clock.pop_front();
 
-    for (auto it = _cache.begin(); it != _cache.end();)
-    {
-        if (it->first.getWireId() <= maxToRemove)
-        {
-            auto rit = _tilesBeingRendered.find(it->first);
-            if (rit != _tilesBeingRendered.end())
+            const auto it = _cache.find(desc);
+            assert(it != _cache.end() && "tile cache clock out of sync");
+            if (it == _cache.end())
+                continue;
+
+            const Tile& tile = it->second;
+            bool keep = false;
+            if (_tilesBeingRendered.find(desc) != _tilesBeingRendered.end())
             {
                 // avoid getting a delta instead of a keyframe at the bottom.
-                LOG_TRC("skip cleaning tile we are waiting on: " << it->first.serialize() <<
-                        " which has " << rit->second->getSubscribers().size() << " waiting");
-                ++it;
+                keep = true;
             }
-            else
+            else if (pass == 0 && tile->_referenced)
             {
-                LOG_TRC("cleaned out tile: " << it->first.serialize());
-                _cacheSize -= itemCacheSize(it->second);
-                it = _cache.erase(it);
+                tile->_referenced = false;
+                keep = true;
             }
-        }
-        else
-        {
-            ++it;
+            else if (pass == 0 && isTileVisible(desc, visibleAreas))
+            {
+                keep = true;
+            }
+
+            if (keep)
+            {
+                _clock.push_back(desc);
+                continue;
+            }
+
+            LOG_TRC("cleaned out tile: " << it->first.serialize());
+            _cacheSize -= itemCacheSize(tile);
+            _cacheIndex.erase(it->first);
+            _cache.erase(it);
+            ++_evictionCount;
         }
     }
 
-    LOG_TRC("Cache is now of size " << _cacheSize << " and " <<
-            _cache.size() << " entries after cleaning");
+    LOG_TRC("Cache is now of size " << _cacheSize << " and " << _cache.size()
+                                    << " entries after cleaning " << oldCount - _cache.size());
 
     assertCacheSize();
 }
@@ -649,6 +874,135 @@ void TileCache::saveDataToStreamCache(StreamType type, const std::string &fileNa
     _streamCache[type][fileName] = std::move(blob);
 }
 
+TileGridIndex::GroupKey TileGridIndex::groupKey(const TileDesc& desc)
+{
+    return GroupKey(desc.getPart(), desc.getEditMode(), to_underlying(desc.getCanonicalViewId()),
+                    desc.getWidth(), desc.getHeight(), desc.getTileWidth(), desc.getTileHeight());
+}
+
+uint64_t TileGridIndex::cellKey(int64_t col, int64_t row)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(col)) << 32) |
+           static_cast<uint32_t>(row);
+}
+
+int64_t TileGridIndex::floorDiv(int64_t value, int64_t step)
+{
+    const int64_t quot = value / step;
+    return (value % step != 0 && value < 0) ? quot - 1 : quot;
+}
+
+void TileGridIndex::insert(const TileDesc& desc)
+{
+    Group& group = _groups[groupKey(desc)];
+    const int64_t tileWidth = std::max(1, desc.getTileWidth());
+    const int64_t tileHeight = std::max(1, desc.getTileHeight());
+    group._cells[cellKey(floorDiv(desc.getTilePosX(), tileWidth),
+                         floorDiv(desc.getTilePosY(), tileHeight))].push_back(desc);
+    ++group._count;
+    ++_size;
+}
+
+void TileGridIndex::erase(const TileDesc& desc)
+{
+    const auto groupIt = _groups.find(groupKey(desc));
+    if (groupIt == _groups.end())
+        return;
+
+    Group& group = groupIt->second;
+    const int64_t tileWidth = std::max(1, desc.getTileWidth());
+    const int64_t tileHeight = std::max(1, desc.getTileHeight());
+    const auto cellIt = group._cells.find(cellKey(floorDiv(desc.getTilePosX(), tileWidth),
+                                                  floorDiv(desc.getTilePosY(), tileHeight)));
+    if (cellIt == group._cells.end())
+        return;
+
+    std::vector<TileDesc>& tiles = cellIt->second;
+    const TileDescCacheCompareEq pred;
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        if (pred(tiles[i], desc))
+        {
+            tiles[i] = tiles.back();
+            tiles.pop_back();
+            --group._count;
+            --_size;
+            break;
+        }
+    }
+
+    if (tiles.empty())
+        group._cells.erase(cellIt);
+    if (group._cells.empty())
+        _groups.erase(groupIt);
+}
+
+void TileGridIndex::clear()
+{
+    _groups.clear();
+    _size = 0;
+}
+
+void TileGridIndex::findCandidates(int part, int mode, int x, int y, int width, int height,
+                                   CanonicalViewId canonicalViewId,
+                                   std::vector<TileDesc>& result) const
+{
+    const int viewId = to_underlying(canonicalViewId);
+    for (const auto& it : _groups)
+    {
+        const GroupKey& key = it.first;
+        if ((part != -1 && std::get<0>(key) != part) || std::get<1>(key) != mode ||
+            std::get<2>(key) != viewId)
+            continue;
+
+        const Group& group = it.second;
+
+        // A tile at pos spans [pos, pos + size] and touching edges count as
+        // intersecting, so look at every cell from (x - size) to (x + width).
+        const int64_t tileWidth = std::max(1, std::get<5>(key));
+        const int64_t tileHeight = std::max(1, std::get<6>(key));
+        const int64_t colStart = floorDiv(static_cast<int64_t>(x) - tileWidth, tileWidth);
+        const int64_t colEnd = floorDiv(static_cast<int64_t>(x) + width, tileWidth);
+        const int64_t rowStart = floorDiv(static_cast<int64_t>(y) - tileHeight, tileHeight);
+        const int64_t rowEnd = floorDiv(static_cast<int64_t>(y) + height, tileHeight);
+        if (colEnd < colStart || rowEnd < rowStart)
+            continue;
+
+        // Huge areas (eg. EMPTY) cover more cells than we have tiles.
+        const uint64_t cells = static_cast<uint64_t>(colEnd - colStart + 1) *
+                               static_cast<uint64_t>(rowEnd - rowStart + 1);
+        if (cells >= group._cells.size())
+        {
+            for (const auto& cell : group._cells)
+                result.insert(result.end(), cell.second.begin(), cell.second.end());
+            continue;
+        }
+
+        for (int64_t row = rowStart; row <= rowEnd; ++row)
+        {
+            for (int64_t col = colStart; col <= colEnd; ++col)
+            {
+                const auto cellIt = group._cells.find(cellKey(col, row));
+                if (cellIt != group._cells.end())
+                    result.insert(result.end(), cellIt->second.begin(), cellIt->second.end());
+            }
+        }
+    }
+}
+
+void TileGridIndex::dumpState(std::ostream& os) const
+{
+    os << "    index: " << _size << " tiles in " << _groups.size() << " groups\n";
+    for (const auto& it : _groups)
+    {
+        const GroupKey& key = it.first;
+        os << "      part: " << std::get<0>(key) << ", mode: " << std::get<1>(key)
+           << ", viewid: " << std::get<2>(key) << ", " << std::get<3>(key) << 'x'
+           << std::get<4>(key) << " @ " << std::get<5>(key) << 'x' << std::get<6>(key) << ": "
+           << it.second._count << " tiles in " << it.second._cells.size() << " cells\n";
+    }
+}
+
 void TileCache::TileBeingRendered::dumpState(std::ostream& os)
 {
     os << "    " << _tile.serialize() << ' ' << std::setw(4)
@@ -670,6 +1024,8 @@ void TileCache::dumpState(std::ostream& os)
     os << "\n  TileCache:";
     os << "\n    num: " << _cache.size() << ", size: " << _cacheSize << " (" << _maxCacheSize
        << ") bytes\n";
+    os << "    lookups: " << _lookupCount << ", hits: " << _hitCount
+       << ", evictions: " << _evictionCount << '\n';
     size_t totalSize = 0;
     size_t totalCapacity = 0;
     for (const auto& it : _cache)
@@ -681,6 +1037,7 @@ void TileCache::dumpState(std::ostream& os)
         it.second->dumpState(os);
         os << '\n';
     }
+    _cacheIndex.dumpState(os);
 
     int type = 0;
     for (const auto& i : _streamCache)
@@ -706,10 +1063,205 @@ void TileCache::dumpState(std::ostream& os)
         }
     }
 
+    os << "    slide layers: " << _slideLayersCache.size() << ", size: " << _slideLayersSize
+       << " bytes, being rendered: " << _slidesBeingRendered.size() << '\n';
+    for (const auto& it : _slideLayersCache)
+        os << "    " << it.first << '\t' << it.second.size() << " layers\n";
+
     os << "    total size: " << totalSize << ", total capacity: " << totalCapacity << " bytes\n";
+    os << "    delta chains:";
+    const ChainLengthCounts chainLengths = getChainLengthCounts();
+    for (size_t i = 0; i < chainLengths.size(); ++i)
+        os << ' ' << getChainLengthBucketName(i) << ": " << chainLengths[i];
+    os << ", compactions: " << _compactionCount << '\n';
     os << "    tiles being rendered " << _tilesBeingRendered.size() << '\n';
     for (const auto& it : _tilesBeingRendered)
         it.second->dumpState(os);
 }
 
+TileWireId* ClientDeltaTracker::findWireId(const TileDesc& desc, bool create)
+{
+    const LayerKey key(desc.getPart(), desc.getEditMode(), to_underlying(desc.getCanonicalViewId()),
+                       desc.getWidth(), desc.getHeight(), desc.getTileWidth(),
+                       desc.getTileHeight());
+    auto layerIt = _layers.find(key);
+    if (layerIt == _layers.end())
+    {
+        if (!create)
+            return nullptr;
+
+        layerIt = _layers.emplace(key, Layer()).first;
+    }
+
+    Layer& layer = layerIt->second;
+    const int x = desc.getTilePosX();
+    const int y = desc.getTilePosY();
+    if (x % desc.getTileWidth() != 0 || y % desc.getTileHeight() != 0)
+    {
+        if (!create)
+        {
+            const auto it = layer._unaligned.find(positionKey(x, y));
+            return it != layer._unaligned.end() ? &it->second : nullptr;
+        }
+
+        return &layer._unaligned[positionKey(x, y)];
+    }
+
+    const int col = x / desc.getTileWidth();
+    const int row = y / desc.getTileHeight();
+    const uint64_t pageKey = positionKey(col >> PageShift, row >> PageShift);
+    Page* page = nullptr;
+    if (create)
+    {
+        std::unique_ptr<Page>& slot = layer._pages[pageKey];
+        if (!slot)
+            slot = std::make_unique<Page>();
+        page = slot.get();
+    }
+    else
+    {
+        const auto it = layer._pages.find(pageKey);
+        if (it == layer._pages.end())
+            return nullptr;
+        page = it->second.get();
+    }
+
+    return &page->_wids[(row & (PageSize - 1)) * PageSize + (col & (PageSize - 1))];
+}
+
+void ClientDeltaTracker::updateViewPort(const std::vector<Util::Rectangle>& visibleAreas,
+                                        int tileWidth, int tileHeight,
+                                        CanonicalViewId canonicalViewId)
+{
+    if (tileWidth <= 0 || tileHeight <= 0)
+        return;
+
+    // Keep the tiles around each pane, for scrolling back and forth.
+    struct Bounds
+    {
+        int64_t _left, _top, _right, _bottom;
+    };
+    std::vector<Bounds> kept;
+    for (const Util::Rectangle& area : visibleAreas)
+    {
+        if (area.hasSurface())
+        {
+            kept.push_back({ static_cast<int64_t>(area.getLeft()) - area.getWidth(),
+                             static_cast<int64_t>(area.getTop()) - area.getHeight(),
+                             static_cast<int64_t>(area.getRight()) + area.getWidth(),
+                             static_cast<int64_t>(area.getBottom()) + area.getHeight() });
+        }
+    }
+
+    if (kept.empty())
+        return;
+
+    const auto isOutside = [&kept](int64_t left, int64_t top, int64_t right, int64_t bottom)
+    {
+        return std::none_of(kept.begin(), kept.end(),
+                            [&](const Bounds& bounds)
+                            {
+                                return right > bounds._left && left < bounds._right &&
+                                       bottom > bounds._top && top < bounds._bottom;
+                            });
+    };
+
+    std::size_t prunedPages = 0;
+    for (auto layerIt = _layers.begin(); layerIt != _layers.end();)
+    {
+        const LayerKey& key = layerIt->first;
+        if (std::get<2>(key) != to_underlying(canonicalViewId) || std::get<5>(key) != tileWidth ||
+            std::get<6>(key) != tileHeight)
+        {
+            prunedPages += layerIt->second._pages.size();
+            layerIt = _layers.erase(layerIt);
+            continue;
+        }
+
+        Layer& layer = layerIt->second;
+        const int64_t pageWidth = static_cast<int64_t>(tileWidth) * PageSize;
+        const int64_t pageHeight = static_cast<int64_t>(tileHeight) * PageSize;
+        for (auto pageIt = layer._pages.begin(); pageIt != layer._pages.end();)
+        {
+            const int64_t pageLeft = (pageIt->first >> 32) * pageWidth;
+            const int64_t pageTop = static_cast<uint32_t>(pageIt->first) * pageHeight;
+            if (isOutside(pageLeft, pageTop, pageLeft + pageWidth, pageTop + pageHeight))
+            {
+                ++prunedPages;
+                pageIt = layer._pages.erase(pageIt);
+            }
+            else
+                ++pageIt;
+        }
+
+        for (auto it = layer._unaligned.begin(); it != layer._unaligned.end();)
+        {
+            const int64_t x = it->first >> 32;
+            const int64_t y = static_cast<uint32_t>(it->first);
+            if (isOutside(x, y, x + tileWidth, y + tileHeight))
+                it = layer._unaligned.erase(it);
+            else
+                ++it;
+        }
+
+        if (layer._pages.empty() && layer._unaligned.empty())
+            layerIt = _layers.erase(layerIt);
+        else
+        {
+            // Give back the buckets of the pruned pages.
+            layer._pages.rehash(0);
+            layer._unaligned.rehash(0);
+            ++layerIt;
+        }
+    }
+
+    if (prunedPages)
+        LOG_TRC("ClientDeltaTracker pruned " << prunedPages << " pages outside of the viewport");
+}
+
+std::size_t ClientDeltaTracker::size() const
+{
+    std::size_t count = 0;
+    for (const auto& layerIt : _layers)
+    {
+        for (const auto& pageIt : layerIt.second._pages)
+        {
+            count += std::count_if(pageIt.second->_wids.begin(), pageIt.second->_wids.end(),
+                                   [](TileWireId wid) { return wid != 0; });
+        }
+
+        count += layerIt.second._unaligned.size();
+    }
+
+    return count;
+}
+
+std::size_t ClientDeltaTracker::getMemorySize() const
+{
+    // Approximate the allocations of the nodes and buckets of the maps.
+    constexpr std::size_t nodeOverhead = 2 * sizeof(void*);
+    std::size_t size = sizeof(*this);
+    for (const auto& layerIt : _layers)
+    {
+        const Layer& layer = layerIt.second;
+        size += sizeof(layerIt) + nodeOverhead;
+        size += layer._pages.size() * (sizeof(Page) + sizeof(std::pair<uint64_t, void*>) + nodeOverhead);
+        size += layer._pages.bucket_count() * sizeof(void*);
+        size += layer._unaligned.size() * (sizeof(std::pair<uint64_t, TileWireId>) + nodeOverhead);
+        size += layer._unaligned.bucket_count() * sizeof(void*);
+    }
+
+    return size;
+}
+
+void ClientDeltaTracker::dumpState(std::ostream& os) const
+{
+    std::size_t pages = 0;
+    for (const auto& layerIt : _layers)
+        pages += layerIt.second._pages.size();
+
+    os << "\n\t\tdeltaTracker: " << size() << " tiles in " << _layers.size() << " layers, "
+       << pages << " pages, " << getMemorySize() << " bytes";
+}
+
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -11,17 +11,26 @@
 
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <iosfwd>
+#include <map>
 #include <memory>
 #include <string>
 #include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include <Rectangle.hpp>
 
 #include "Log.hpp"
 #include "Common.hpp"
+#include "Message.hpp"
 #include "TileDesc.hpp"
 
 class ClientSession;
@@ -66,6 +75,9 @@ struct TileDescCacheHasher final
 struct TileData
 {
     TileData(TileWireId start, const char *data, const size_t size)
+        : _referenced(false)
+        , _compactionRequested(false)
+        , _messageOffset(0)
     {
         appendBlob(start, data, size);
     }
@@ -82,6 +94,7 @@ struct TileData
             _wids.clear();
             _offsets.clear();
             _deltas.clear();
+            _compactionRequested = false;
         }
         else
         {
@@ -121,6 +134,9 @@ struct TileData
         // FIXME: possible race - should store a seq. from the invalidation(s) ?
         _valid = true;
 
+        // Any message we built no longer has the latest changes.
+        _message.reset();
+
         return size() - oldCacheSize;
     }
 
@@ -134,6 +150,21 @@ struct TileData
         return deltaSize > 128 * 1024; // deltas should be cumulatively small.
     }
 
+    /// The number of deltas after the keyframe.
+    size_t getDeltaCount() const { return _offsets.size() > 1 ? _offsets.size() - 1 : 0; }
+
+    /// Is the delta chain long enough, in count or in bytes relative to the
+    /// keyframe, that a fresh keyframe would be cheaper to send and decode ?
+    bool needsCompaction(size_t maxDeltas, size_t maxDeltaPercent) const
+    {
+        if (_offsets.size() <= 1 || isPng())
+            return false;
+        const size_t keyframeSize = _offsets[1];
+        const size_t deltaSize = size() - keyframeSize;
+        return (maxDeltas > 0 && getDeltaCount() > maxDeltas) ||
+               (maxDeltaPercent > 0 && deltaSize * 100 > keyframeSize * maxDeltaPercent);
+    }
+
     bool isPng() const { return (_deltas.size() > 1 &&
                                  _deltas[0] == (char)0x89); }
 
@@ -146,10 +177,18 @@ struct TileData
     bool isValid() const { return _valid; }
     void invalidate() { _valid = false; }
 
+    /// Mark as recently used, giving it a second chance on eviction.
+    void reference() { _referenced = true; }
+
     std::vector<TileWireId> _wids;
     std::vector<size_t> _offsets; // offset of the start of data
     BlobData _deltas; // first item is a key-frame, followed by deltas at _offsets
     bool _valid; // not true - waiting for a new tile if in view.
+    bool _referenced; // used since the eviction clock last passed.
+    bool _compactionRequested; // a keyframe was requested to replace the deltas.
+    std::weak_ptr<Message> _message; // last built by getChangesMessage, while still queued.
+    std::string _messageHeader;
+    size_t _messageOffset;
 
     size_t size() const
     {
@@ -197,6 +236,29 @@ struct TileData
         }
     }
 
+    /// The @header followed by the changes since @since, as a message.
+    /// Every session sent the same header at the same point shares one
+    /// message, so a tile goes out to many viewers without a copy each.
+    /// We don't own it: it is freed once the last session has sent it,
+    /// so it never lingers in the cache outside of size().
+    std::shared_ptr<Message> getChangesMessage(const std::string& header, TileWireId since)
+    {
+        size_t i;
+        for (i = 0; since != 0 && i < _wids.size() && _wids[i] <= since; ++i);
+        const size_t offset = i < _offsets.size() ? _offsets[i] : _deltas.size();
+
+        std::shared_ptr<Message> message = _message.lock();
+        if (message && _messageOffset == offset && _messageHeader == header)
+            return message;
+
+        message = std::make_shared<Message>(header, Message::Dir::Out);
+        message->append(_deltas.data() + offset, _deltas.size() - offset);
+        _message = message;
+        _messageHeader = header;
+        _messageOffset = offset;
+        return message;
+    }
+
     void dumpState(std::ostream& os)
     {
         if (_wids.size() < 2)
@@ -213,6 +275,42 @@ struct TileData
 };
 using Tile = std::shared_ptr<TileData>;
 
+/// Spatial index over the cached tiles, so that an invalidation only
+/// needs to visit the tiles that can possibly intersect it. Tiles are
+/// grouped by everything that must match exactly (part, mode, view and
+/// zoom), and within a group bucketed by their grid cell.
+class TileGridIndex final
+{
+    using GroupKey = std::tuple<int, int, int, int, int, int, int>;
+    struct Group
+    {
+        std::unordered_map<uint64_t, std::vector<TileDesc>> _cells;
+        size_t _count = 0;
+    };
+
+    std::map<GroupKey, Group> _groups;
+    size_t _size;
+
+    static GroupKey groupKey(const TileDesc& desc);
+    static uint64_t cellKey(int64_t col, int64_t row);
+    static int64_t floorDiv(int64_t value, int64_t step);
+
+public:
+    TileGridIndex() : _size(0) {}
+
+    void insert(const TileDesc& desc);
+    void erase(const TileDesc& desc);
+    void clear();
+    size_t size() const { return _size; }
+
+    /// Appends to @result all indexed tiles that may intersect the area,
+    /// callers still need to check each candidate precisely.
+    void findCandidates(int part, int mode, int x, int y, int width, int height,
+                        CanonicalViewId canonicalViewId, std::vector<TileDesc>& result) const;
+
+    void dumpState(std::ostream& os) const;
+};
+
 /// Handles the caching of tiles of one document.
 class TileCache
 {
@@ -234,12 +332,32 @@ public:
     TileCache(const TileCache&) = delete;
     TileCache& operator=(const TileCache&) = delete;
 
+    /// An area a client is looking at, whose tiles we prefer to keep.
+    struct VisibleArea
+    {
+        CanonicalViewId _canonicalViewId;
+        int _tileWidth;
+        int _tileHeight;
+        Util::Rectangle _area;
+    };
+    using VisibleAreaProvider = std::function<void(std::vector<VisibleArea>&)>;
+
+    /// Set the callback used to find the visible areas when evicting.
+    void setVisibleAreaProvider(VisibleAreaProvider provider)
+    {
+        _visibleAreaProvider = std::move(provider);
+    }
+
     /// Subscribes if no subscription exists and returns true.
     /// Otherwise returns false to signify a subscription already exists.
     bool subscribeToTileRendering(const TileDesc& tile,
                                   const std::shared_ptr<ClientSession>& subscriber,
                                   const std::chrono::steady_clock::time_point now);
 
+    /// Registers the rendering of the given tile, requested by us rather than
+    /// by a view, so the views requesting it meanwhile wait for it instead.
+    void registerTileRendering(const TileDesc& tile, std::chrono::steady_clock::time_point now);
+
     /// Cancels all tile requests by the given subscriber.
     std::string cancelTiles(const std::shared_ptr<ClientSession>& subscriber);
 
@@ -269,6 +387,33 @@ public:
     /// Return the data if we have it, or nothing.
     Blob lookupCachedStream(StreamType type, const std::string& name);
 
+    /// The layers of a rendered slide: the slidelayer: messages, followed
+    /// by the sliderenderingcomplete: one, as sent by the Kit.
+    using SlideLayers = std::vector<std::shared_ptr<Message>>;
+
+    /// Returns the cached layers of the slide rendered for the given getslide
+    /// key (see ClientSession::sendSlide), or nullptr if not cached.
+    const SlideLayers* lookupSlideLayers(const std::string& key);
+
+    /// Subscribes to the rendering of the slide with the given key and returns
+    /// true when it's already being rendered. Otherwise returns false, and the
+    /// caller is expected to render it, and call saveSlideLayersAndNotify().
+    bool subscribeToSlideRendering(const std::string& key,
+                                   const std::shared_ptr<ClientSession>& subscriber,
+                                   std::chrono::steady_clock::time_point now);
+
+    /// Hands the rendering of the slide with the given key, abandoned by
+    /// @renderer, over to the first of its subscribers still around, and
+    /// returns it. It's then expected to render it, as if it didn't
+    /// subscribe. Returns nullptr, forgetting the slide, when none is left.
+    std::shared_ptr<ClientSession> handOverSlideRendering(const std::string& key,
+                                                          const ClientSession* renderer,
+                                                          std::chrono::steady_clock::time_point now);
+
+    /// Caches the rendered layers of a slide, when successfully rendered,
+    /// and sends them to the subscribers waiting for them.
+    void saveSlideLayersAndNotify(const std::string& key, SlideLayers layers, bool success);
+
     /// The tiles parameter is an invalidatetiles: message as sent by the child process
     /// returns true if cache wasn't empty
     bool invalidateTiles(const std::string& tiles, CanonicalViewId canonicalViewId);
@@ -280,6 +425,10 @@ public:
     void forgetTileBeingRendered(const TileDesc& descForKitReply,
                                  const std::shared_ptr<TileCache::TileBeingRendered>& tileBeingRendered);
 
+    /// Forgets the rendering of the given tile, which won't be rendered
+    /// after all, so it's rendered, or compacted, again when next needed.
+    void abandonTileRendering(const TileDesc& tile);
+
     size_t countTilesBeingRenderedForSession(const std::shared_ptr<ClientSession>& session,
                                              std::chrono::steady_clock::time_point now);
     bool hasTileBeingRendered(const TileDesc& tileDesc, const std::chrono::steady_clock::time_point *now = nullptr) const;
@@ -292,6 +441,41 @@ public:
     /// Get the current memory use.
     size_t getMemorySize() const { return _cacheSize; }
 
+    /// Number of lookups, of those which found a valid tile, and of evicted tiles.
+    uint64_t getLookupCount() const { return _lookupCount; }
+    uint64_t getHitCount() const { return _hitCount; }
+    uint64_t getEvictionCount() const { return _evictionCount; }
+
+    /// Request a fresh keyframe for tiles with more than @maxDeltas deltas,
+    /// or with deltas larger than @maxDeltaPercent of their keyframe.
+    /// Either limit is ignored when 0, and compaction disabled when both are.
+    void setCompactionLimits(size_t maxDeltas, size_t maxDeltaPercent)
+    {
+        _compactionMaxDeltas = maxDeltas;
+        _compactionMaxDeltaPercent = maxDeltaPercent;
+    }
+
+    /// Returns, and forgets, the tiles whose delta chains need a fresh keyframe.
+    std::vector<TileDesc> takeTilesToCompact()
+    {
+        std::vector<TileDesc> tiles;
+        tiles.swap(_tilesToCompact);
+        return tiles;
+    }
+
+    /// Number of keyframes requested to compact delta chains.
+    uint64_t getCompactionCount() const { return _compactionCount; }
+
+    /// The buckets of the delta chain length histogram: 0, 1, 2-3, 4-7, 8-15, 16-31, 32+.
+    static constexpr size_t ChainLengthBuckets = 7;
+    using ChainLengthCounts = std::array<uint64_t, ChainLengthBuckets>;
+
+    /// The number of cached tiles by the length of their delta chain.
+    ChainLengthCounts getChainLengthCounts() const;
+
+    /// The name of the given bucket of ChainLengthCounts, e.g. "4-7".
+    static std::string getChainLengthBucketName(size_t bucket);
+
     // Debugging bits ...
     void dumpState(std::ostream& os);
     void setThreadOwner(const std::thread::id& id) { _owner = id; }
@@ -301,6 +485,9 @@ private:
     void ensureCacheSize();
     static size_t itemCacheSize(const Tile &tile);
 
+    /// Is this tile in one of the @areas any client is looking at.
+    static bool isTileVisible(const TileDesc& desc, const std::vector<VisibleArea>& areas);
+
     /// Removes the invalid tiles from the cache
     /// returns true if cache wasn't empty
     bool invalidateTiles(int part, int mode, int x, int y, int width, int height, CanonicalViewId canonicalViewId);
@@ -324,10 +511,30 @@ private:
     // old-style file-name to data grab-bag.
     std::map<std::string, Blob> _streamCache[static_cast<int>(StreamType::Last)];
 
+    /// The rendered slides, shared by all the views with the same CanonicalViewId,
+    /// so followers of a presentation needn't each render the same layers.
+    std::unordered_map<std::string, SlideLayers> _slideLayersCache;
+    /// The keys in _slideLayersCache, oldest first, for eviction.
+    std::deque<std::string> _slideLayersKeys;
+    /// The total size of the messages in _slideLayersCache.
+    size_t _slideLayersSize;
+
+    /// The sessions waiting for a slide being rendered, and when it started.
+    struct SlideBeingRendered
+    {
+        std::chrono::steady_clock::time_point _startTime;
+        std::vector<std::weak_ptr<ClientSession>> _subscribers;
+    };
+    std::unordered_map<std::string, SlideBeingRendered> _slidesBeingRendered;
+
     // FIXME: should we have a tile-desc to WID map instead and a simpler lookup ?
     std::unordered_map<TileDesc, Tile,
                        TileDescCacheHasher,
                        TileDescCacheCompareEq> _cache;
+    /// Spatial index of the keys in _cache, kept in sync with it.
+    TileGridIndex _cacheIndex;
+    /// The keys in _cache in insertion order, swept by the eviction clock.
+    std::deque<TileDesc> _clock;
     // FIXME: TileBeingRendered contains TileDesc too ...
     std::unordered_map<TileDesc, std::shared_ptr<TileBeingRendered>,
                        TileDescCacheHasher,
@@ -343,52 +550,89 @@ private:
     /// Maximum (high watermark) size of the tilecache in bytes
     size_t _maxCacheSize;
 
+    VisibleAreaProvider _visibleAreaProvider;
+
+    uint64_t _lookupCount;
+    uint64_t _hitCount;
+    uint64_t _evictionCount;
+
+    size_t _compactionMaxDeltas;
+    size_t _compactionMaxDeltaPercent;
+    std::vector<TileDesc> _tilesToCompact;
+    uint64_t _compactionCount;
+
     const bool _dontCache;
 };
 
-/// Tracks view-port area tiles to track which we last
-/// sent to avoid re-sending an existing delta causing grief
+/// Tracks the wire-id of the last tile sent to a client, so that we
+/// can send it just the delta from it.
+/// The wire-ids are kept in a grid per layer, i.e. per part, zoom and
+/// canonical view, in sparse pages of PageSize x PageSize tiles, which
+/// packs a zoomed-out spreadsheet in 4 bytes per tile. The tiles far
+/// from the viewport, and those of other zooms, are forgotten as the
+/// view moves, which costs a keyframe if they are needed again.
 class ClientDeltaTracker final
 {
-    // FIXME: could be a simple 2d TileWireId array for better packing.
-    std::unordered_set<TileDesc,
-                       TileDescCacheHasher,
-                       TileDescCacheCompareEq> _cache;
-
 public:
-    // FIXME: only need to store this for the current viewports
-    void updateViewPort( /* ... */ )
-    {
-        // copy the set to another while filtering I guess.
-    }
+    static constexpr int PageShift = 4;
+    static constexpr int PageSize = 1 << PageShift;
 
     /// return wire-id of last tile sent - or 0 if not present
-    /// update last-tile sent wire-id to curSeq if found.
-    TileWireId updateTileSeq(const TileDesc &desc)
+    /// update last-tile sent wire-id to that of @desc.
+    TileWireId updateTileSeq(const TileDesc& desc)
     {
-        auto it = _cache.find(desc);
-        if (it == _cache.end())
-        {
-            _cache.insert(desc);
-            return 0;
-        }
-        const TileWireId curSeq = desc.getWireId();
-        TileWireId last = it->getWireId();
-        // id is not included in the hash.
-        auto pDesc = const_cast<TileDesc *>(&(*it));
-        pDesc->setWireId(curSeq);
+        TileWireId* wid = findWireId(desc, /*create=*/true);
+        const TileWireId last = *wid;
+        *wid = desc.getWireId();
         return last;
     }
 
-    void resetTileSeq(const TileDesc &desc)
+    void resetTileSeq(const TileDesc& desc)
     {
-        auto it = _cache.find(desc);
-        if (it == _cache.end())
-            return;
-        // id is not included in the hash.
-        auto pDesc = const_cast<TileDesc *>(&(*it));
-        pDesc->setWireId(0);
+        TileWireId* wid = findWireId(desc, /*create=*/false);
+        if (wid)
+            *wid = 0;
     }
+
+    /// Forgets the tiles outside of all the visible areas, i.e. the split
+    /// panes, each extended by its size on each side, and those of another
+    /// zoom or canonical view.
+    void updateViewPort(const std::vector<Util::Rectangle>& visibleAreas, int tileWidth,
+                        int tileHeight, CanonicalViewId canonicalViewId);
+
+    /// The number of tiles with a wire-id.
+    std::size_t size() const;
+
+    std::size_t getMemorySize() const;
+
+    void dumpState(std::ostream& os) const;
+
+private:
+    using LayerKey = std::tuple<int, int, int, int, int, int, int>;
+
+    struct Page
+    {
+        std::array<TileWireId, PageSize * PageSize> _wids{};
+    };
+
+    struct Layer
+    {
+        /// The pages, by their column and row.
+        std::unordered_map<uint64_t, std::unique_ptr<Page>> _pages;
+        /// Tiles not aligned to the grid, by their position; rare.
+        std::unordered_map<uint64_t, TileWireId> _unaligned;
+    };
+
+    static uint64_t positionKey(int x, int y)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) |
+               static_cast<uint32_t>(y);
+    }
+
+    /// Returns the wire-id slot of the given tile, or nullptr when not tracked and !@create.
+    TileWireId* findWireId(const TileDesc& desc, bool create);
+
+    std::map<LayerKey, Layer> _layers;
 };
 
 inline std::ostream& operator<< (std::ostream& os, const Tile& tile)
@@ -0,0 +1,194 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include "TileScheduler.hpp"
+
+#include <Log.hpp>
+#include <Rectangle.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <ostream>
+
+namespace
+{
+/// A rectangle of requested tiles.
+struct TileRect
+{
+    Util::Rectangle _area;
+    std::vector<TileDesc> _tiles;
+};
+
+} // namespace
+
+TileScheduler::TileScheduler(std::chrono::milliseconds window)
+    : _window(window)
+    , _pendingRequests(0)
+    , _requestCount(0)
+    , _combineCount(0)
+{
+}
+
+void TileScheduler::enqueue(const std::vector<TileDesc>& tiles,
+                            std::chrono::steady_clock::time_point now)
+{
+    if (tiles.empty())
+        return;
+
+    if (_groups.empty())
+        _firstEnqueueTime = now;
+
+    ++_pendingRequests;
+    ++_requestCount;
+    for (const TileDesc& tile : tiles)
+    {
+        auto groupIt = std::find_if(_groups.begin(), _groups.end(),
+                                    [&tile](const TileGroup& group)
+                                    { return tile.sameTileCombineParams(group._tiles.front()); });
+        if (groupIt == _groups.end())
+        {
+            _groups.emplace_back();
+            groupIt = std::prev(_groups.end());
+        }
+
+        const auto [it, inserted] = groupIt->_index.emplace(
+            std::make_pair(tile.getTilePosY(), tile.getTilePosX()), groupIt->_tiles.size());
+        if (inserted)
+            groupIt->_tiles.push_back(tile);
+        else
+        {
+            // Requested by another view already, render the newest version once.
+            TileDesc& pending = groupIt->_tiles[it->second];
+            if (tile.getVersion() > pending.getVersion())
+                pending.setVersion(tile.getVersion());
+            if (tile.isForcedKeyFrame())
+                pending.forceKeyframe();
+        }
+    }
+}
+
+std::chrono::microseconds TileScheduler::getTimeout(std::chrono::steady_clock::time_point now,
+                                                    std::chrono::microseconds maxTimeout) const
+{
+    if (!hasPending())
+        return maxTimeout;
+
+    const auto due = _firstEnqueueTime + _window;
+    if (now >= due)
+        return std::chrono::microseconds::zero();
+
+    return std::min(maxTimeout, std::chrono::duration_cast<std::chrono::microseconds>(due - now));
+}
+
+std::vector<TileCombined> TileScheduler::flush()
+{
+    // Splitting into rectangles only pays when the tiles of several requests were merged.
+    const bool coalesced = _pendingRequests > 1;
+
+    std::vector<TileCombined> tileCombines;
+    for (const TileGroup& group : _groups)
+    {
+        if (!coalesced)
+        {
+            tileCombines.push_back(TileCombined::create(group._tiles));
+            continue;
+        }
+
+        std::vector<TileCombined> combined = combine(group._tiles);
+        std::move(combined.begin(), combined.end(), std::back_inserter(tileCombines));
+    }
+
+    LOG_TRC("TileScheduler flushing " << _groups.size() << " groups of tiles from "
+                                      << _pendingRequests << " requests in "
+                                      << tileCombines.size() << " tilecombines");
+    _combineCount += tileCombines.size();
+    _pendingRequests = 0;
+    _groups.clear();
+    return tileCombines;
+}
+
+std::vector<TileCombined> TileScheduler::combine(const std::vector<TileDesc>& tiles)
+{
+    std::vector<TileCombined> tileCombines;
+    if (tiles.empty())
+        return tileCombines;
+
+    std::vector<TileDesc> sorted = tiles;
+    std::sort(sorted.begin(), sorted.end(),
+              [](const TileDesc& lhs, const TileDesc& rhs)
+              {
+                  return lhs.getTilePosY() != rhs.getTilePosY()
+                             ? lhs.getTilePosY() < rhs.getTilePosY()
+                             : lhs.getTilePosX() < rhs.getTilePosX();
+              });
+
+    const int tileWidth = sorted.front().getTileWidth();
+    const int tileHeight = sorted.front().getTileHeight();
+
+    // Split each row into runs of adjacent tiles, and extend the rectangle
+    // ending right above a run when it spans exactly the same columns.
+    std::vector<TileRect> rects;
+    for (std::size_t begin = 0; begin < sorted.size();)
+    {
+        std::size_t end = begin + 1;
+        while (end < sorted.size() && sorted[end].getTilePosY() == sorted[begin].getTilePosY() &&
+               sorted[end].getTilePosX() == sorted[end - 1].getTilePosX() + tileWidth)
+        {
+            ++end;
+        }
+
+        const Util::Rectangle run(sorted[begin].getTilePosX(), sorted[begin].getTilePosY(),
+                                  sorted[end - 1].getTilePosX() + tileWidth -
+                                      sorted[begin].getTilePosX(),
+                                  tileHeight);
+        auto it = std::find_if(rects.begin(), rects.end(),
+                               [&run](const TileRect& rect)
+                               {
+                                   return rect._area.getLeft() == run.getLeft() &&
+                                          rect._area.getRight() == run.getRight() &&
+                                          rect._area.getBottom() == run.getTop();
+                               });
+        if (it == rects.end())
+        {
+            rects.push_back(TileRect{ run, {} });
+            it = std::prev(rects.end());
+        }
+        else
+            it->_area.extend(run);
+
+        it->_tiles.insert(it->_tiles.end(), sorted.begin() + begin, sorted.begin() + end);
+        begin = end;
+    }
+
+    tileCombines.reserve(rects.size());
+    for (const TileRect& rect : rects)
+        tileCombines.push_back(TileCombined::create(rect._tiles));
+
+    return tileCombines;
+}
+
+void TileScheduler::dumpState(std::ostream& os) const
+{
+    std::size_t pending = 0;
+    for (const TileGroup& group : _groups)
+        pending += group._tiles.size();
+
+    os << "\n  TileScheduler:"
+       << "\n    window: " << _window
+       << "\n    pending tiles: " << pending << " in " << _groups.size() << " groups"
+       << "\n    pending requests: " << _pendingRequests
+       << "\n    requests: " << _requestCount
+       << "\n    tilecombines sent: " << _combineCount;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
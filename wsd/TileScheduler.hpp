@@ -0,0 +1,88 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "TileDesc.hpp"
+
+/// Batches the tiles that need rendering, requested by all the sessions
+/// of a document, over a short window and sends them to be rendered in as
+/// few tilecombine requests as possible.
+///
+/// Views sharing a CanonicalViewId request overlapping, but rarely
+/// identical, sets of tiles in their own order. Each request used to be a
+/// separate tilecombine, i.e. a separate paint in the Kit. Here the pending
+/// tiles with the same combine parameters are merged and split into
+/// maximal rectangles instead, since the Kit paints the bounding box of
+/// each tilecombine in one go. Each rectangle is rendered on its own, as
+/// rendering two together would paint the gap in their bounding box.
+/// The tiles of a single request, with nothing to merge them with, are
+/// rendered as requested: in one tilecombine per set of combine parameters.
+class TileScheduler final
+{
+public:
+    explicit TileScheduler(std::chrono::milliseconds window);
+
+    /// Queues the given tiles, which need rendering, from a single request.
+    void enqueue(const std::vector<TileDesc>& tiles, std::chrono::steady_clock::time_point now);
+
+    bool hasPending() const { return !_groups.empty(); }
+
+    /// True when the oldest pending tiles have waited for the full window.
+    bool isDue(std::chrono::steady_clock::time_point now) const
+    {
+        return hasPending() && now >= _firstEnqueueTime + _window;
+    }
+
+    /// Returns the time until the pending tiles are due, or @maxTimeout when there are none.
+    std::chrono::microseconds getTimeout(std::chrono::steady_clock::time_point now,
+                                         std::chrono::microseconds maxTimeout) const;
+
+    /// Returns the tilecombines to render all the pending tiles, and clears them.
+    std::vector<TileCombined> flush();
+
+    /// Merges the given tiles, with the same combine parameters, into
+    /// rectangles and returns a tilecombine for each.
+    static std::vector<TileCombined> combine(const std::vector<TileDesc>& tiles);
+
+    /// The number of requests that needed rendering, i.e. the number of
+    /// tilecombines that would have been sent without batching.
+    std::size_t getRequestCount() const { return _requestCount; }
+
+    /// The number of tilecombines actually sent to render.
+    std::size_t getCombineCount() const { return _combineCount; }
+
+    void dumpState(std::ostream& os) const;
+
+private:
+    /// The pending tiles with the same combine parameters.
+    struct TileGroup
+    {
+        std::vector<TileDesc> _tiles; ///< In the order first requested.
+        std::map<std::pair<int, int>, std::size_t> _index; ///< Into _tiles, by row then column.
+    };
+
+    std::chrono::milliseconds _window;
+    std::chrono::steady_clock::time_point _firstEnqueueTime;
+    std::vector<TileGroup> _groups;
+    std::size_t _pendingRequests; ///< The requests the pending tiles are from.
+    std::size_t _requestCount;
+    std::size_t _combineCount;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
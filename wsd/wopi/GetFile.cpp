@@ -0,0 +1,209 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <config.h>
+
+#include "GetFile.hpp"
+
+#include <COOLWSD.hpp>
+#include <common/FileUtil.hpp>
+#include <common/JailUtil.hpp>
+#include <common/SigUtil.hpp>
+#include <wopi/StorageConnectionManager.hpp>
+#include <Log.hpp>
+
+GetFile::GetFile(const std::shared_ptr<TerminatingPoll>& poll, const Poco::URI& uriPublic,
+                 std::string fileUrl, ProgressCallback onProgressCallback,
+                 std::function<void(GetFile&)> onFinishCallback)
+    : _auth(Authorization::create(uriPublic))
+    , _uriIndex(0)
+    , _profileZone("WopiStorage::downloadStorageFileToLocal",
+                   { { "url", fileUrl.empty() ? uriPublic.toString() : fileUrl } })
+    , _poll(poll)
+    , _onProgressCallback(std::move(onProgressCallback))
+    , _onFinishCallback(std::move(onFinishCallback))
+    , _duration(std::chrono::milliseconds::zero())
+    , _state(State::None)
+{
+    // First try the FileUrl, if provided.
+    if (!fileUrl.empty())
+        _uris.emplace_back(fileUrl);
+
+    // WOPI URI to download files ends in '/contents'.
+    Poco::URI uriObject(uriPublic);
+    uriObject.setPath(uriObject.getPath() + "/contents");
+    _auth.authorizeURI(uriObject);
+    _uris.push_back(std::move(uriObject));
+}
+
+GetFile::~GetFile()
+{
+    if (!_tmpDir.empty())
+        FileUtil::removeFile(_tmpDir, /*recursive=*/true);
+}
+
+void GetFile::getFile(int redirectionLimit)
+{
+    assert(_state == State::None && "GetFile can only be started once");
+    _startTime = std::chrono::steady_clock::now();
+
+    // The temporary directory is child-root/<CHILDROOT_TMP_INCOMING_PATH>,
+    // on the same file-system as the jails, to move the document there.
+    _tmpDir = FileUtil::createRandomTmpDir(COOLWSD::ChildRoot +
+                                           JailUtil::CHILDROOT_TMP_INCOMING_PATH);
+    if (_tmpDir.empty() || !FileUtil::checkDiskSpace(_tmpDir))
+    {
+        LOG_ERR("Low disk space or no temporary directory for WOPI::GetFile");
+        finish(State::Fail);
+        return;
+    }
+
+    _filePath = _tmpDir + "/document";
+
+    // We're in business.
+    _state = State::Active;
+    download(_uris[_uriIndex], redirectionLimit);
+}
+
+void GetFile::download(const Poco::URI& uri, int redirectionLimit)
+{
+    std::string uriAnonym = COOLWSD::anonymizeUrl(uri.toString());
+    LOG_INF("WOPI::GetFile asynchronously from [" << uriAnonym << ']');
+
+    _httpSession = StorageConnectionManager::getHttpSession(uri);
+    http::Request httpRequest = StorageConnectionManager::createHttpRequest(uri, _auth);
+
+    http::Session::FinishedCallback finishedCallback =
+        [selfWeak = weak_from_this(), this, uriAnonym = std::move(uriAnonym),
+         redirectionLimit](const std::shared_ptr<http::Session>& session)
+    {
+        std::shared_ptr<GetFile> selfLifecycle = selfWeak.lock();
+        if (!selfLifecycle)
+        {
+            session->asyncShutdown();
+            return;
+        }
+
+        _wopiCert = session->getSslCert(_subjectHash);
+        session->asyncShutdown();
+
+        if (SigUtil::getShutdownRequestFlag())
+        {
+            LOG_DBG("Shutdown flagged, giving up on in-flight requests");
+            finish(State::Fail);
+            return;
+        }
+
+        const std::shared_ptr<const http::Response> httpResponse = session->response();
+        const http::StatusCode statusCode = httpResponse->statusLine().statusCode();
+        if (httpResponse->state() == http::Response::State::Timeout)
+        {
+            LOG_ERR("WOPI::GetFile [" << uriAnonym << "] timed out");
+            finish(State::Timedout);
+            return;
+        }
+
+        if (statusCode == http::StatusCode::OK &&
+            httpResponse->state() == http::Response::State::Complete)
+        {
+            LOG_TRC("WOPI::GetFile response header for URI [" << uriAnonym << "]:\n"
+                                                              << httpResponse->header());
+            finish(State::Pass);
+            return;
+        }
+
+        if (statusCode == http::StatusCode::MovedPermanently ||
+            statusCode == http::StatusCode::Found ||
+            statusCode == http::StatusCode::TemporaryRedirect ||
+            statusCode == http::StatusCode::PermanentRedirect)
+        {
+            if (redirectionLimit > 0)
+            {
+                const std::string location = httpResponse->get("Location");
+                LOG_TRC("WOPI::GetFile redirect to URI [" << COOLWSD::anonymizeUrl(location)
+                                                          << ']');
+                download(Poco::URI(location), redirectionLimit - 1);
+                return;
+            }
+
+            LOG_ERR("WOPI::GetFile [" << uriAnonym << "] failed: redirected too many times");
+        }
+        else
+        {
+            LOG_ERR("WOPI::GetFile [" << uriAnonym << "] failed with Status Code: " << statusCode
+                                      << ", state: " << http::Response::name(httpResponse->state())
+                                      << ": " << httpResponse->getBody());
+        }
+
+        downloadNext(HTTP_REDIRECTION_LIMIT);
+    };
+
+    _httpSession->setFinishedHandler(std::move(finishedCallback));
+
+    http::Session::ConnectFailCallback connectFailCallback =
+        [selfWeak = weak_from_this(), this](const std::shared_ptr<http::Session>& /* httpSession */)
+    {
+        std::shared_ptr<GetFile> selfLifecycle = selfWeak.lock();
+        if (!selfLifecycle)
+            return;
+
+        LOG_ERR("Failed to start an async GetFile request");
+        downloadNext(HTTP_REDIRECTION_LIMIT);
+    };
+
+    _httpSession->setConnectFailHandler(std::move(connectFailCallback));
+
+    http::Response::ProgressCallback progressCallback =
+        [selfWeak = weak_from_this(), this](int64_t received, int64_t total)
+    {
+        std::shared_ptr<GetFile> selfLifecycle = selfWeak.lock();
+        if (selfLifecycle && _onProgressCallback)
+            _onProgressCallback(*this, received, total);
+    };
+
+    // Stream the document to disk on the WebServer Poll.
+    _httpSession->asyncDownload(httpRequest, _filePath, _poll, std::move(progressCallback));
+}
+
+void GetFile::downloadNext(int redirectionLimit)
+{
+    if (++_uriIndex < _uris.size())
+    {
+        LOG_INF("WOPI::GetFile will use the default URL");
+        download(_uris[_uriIndex], redirectionLimit);
+        return;
+    }
+
+    finish(State::Fail);
+}
+
+void GetFile::finish(State state)
+{
+    _profileZone.end(); // Finish profiling.
+
+    _duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - _startTime);
+    _state = state;
+
+    if (state == State::Pass)
+    {
+        const FileUtil::Stat fileStat(_filePath);
+        LOG_INF("WOPI::GetFile downloaded " << (fileStat.good() ? fileStat.size() : 0)
+                                            << " bytes in " << _duration);
+    }
+
+    if (_onFinishCallback)
+    {
+        _onFinishCallback(*this);
+    }
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,108 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 100 -*- */
+/*
+ * Copyright the Collabora Online contributors.
+ *
+ * SPDX-License-Identifier: MPL-2.0
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#pragma once
+
+#if MOBILEAPP
+#error This file should be excluded from Mobile App builds
+#endif // MOBILEAPP
+
+#include <Authorization.hpp>
+#include <HttpRequest.hpp>
+#include <Socket.hpp>
+#include <StateEnum.hpp>
+#include <TraceEvent.hpp>
+
+#include <Poco/URI.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// Downloads a document with WOPI::GetFile asynchronously, streaming
+/// it to a temporary file under the child-root, so that it can be
+/// overlapped with spawning the Kit, and later adopted by the storage
+/// (see WopiStorage::adoptDownloadedFile) without blocking DocBroker.
+class GetFile : public std::enable_shared_from_this<GetFile>
+{
+public:
+    /// The GetFile State.
+    STATE_ENUM(State, None, Active, Timedout, Fail, Pass);
+
+    /// Called as the document is received, with the bytes received
+    /// so far and the expected total, or -1 when unknown.
+    using ProgressCallback = std::function<void(GetFile&, int64_t received, int64_t total)>;
+
+    /// Create an instance to download the document at @uriPublic.
+    /// @fileUrl, when given, is tried first, as with the FileUrl in CheckFileInfo.
+    GetFile(const std::shared_ptr<TerminatingPoll>& poll, const Poco::URI& uriPublic,
+            std::string fileUrl, ProgressCallback onProgressCallback,
+            std::function<void(GetFile&)> onFinishCallback);
+
+    /// Removes the downloaded file, unless it was adopted.
+    ~GetFile();
+
+    /// Returns the state of the request.
+    State state() const { return _state; }
+
+    bool completed() const { return _state != State::None && _state != State::Active; }
+
+    /// The downloaded file, valid when the state is Pass.
+    const std::string& filePath() const { return _filePath; }
+
+    /// The time it took to download the document.
+    std::chrono::milliseconds duration() const { return _duration; }
+
+    /// The WOPI server certificate, if any, and its subject hash.
+    const std::string& wopiCert() const { return _wopiCert; }
+    const std::string& subjectHash() const { return _subjectHash; }
+
+    /// Start the actual request.
+    void getFile(int redirectionLimit);
+
+private:
+    inline void logPrefix(std::ostream& os) const
+    {
+        if (_httpSession)
+        {
+            os << '#' << _httpSession->getFD() << ": ";
+        }
+    }
+
+    /// Download from the given URI, following redirections.
+    void download(const Poco::URI& uri, int redirectionLimit);
+
+    /// Try the next URI, if any, or fail.
+    void downloadNext(int redirectionLimit);
+
+    /// Set the final state and notify.
+    void finish(State state);
+
+    const Authorization _auth; ///< From the public URI, for all requests.
+    std::vector<Poco::URI> _uris; ///< The URIs to try, in order.
+    std::size_t _uriIndex; ///< The URI currently being tried.
+    ProfileZone _profileZone;
+    std::shared_ptr<http::Session> _httpSession;
+    std::shared_ptr<TerminatingPoll> _poll;
+    ProgressCallback _onProgressCallback;
+    std::function<void(GetFile&)> _onFinishCallback;
+    std::string _tmpDir; ///< The temporary directory holding the download.
+    std::string _filePath; ///< The downloaded file.
+    std::string _wopiCert;
+    std::string _subjectHash;
+    std::chrono::steady_clock::time_point _startTime;
+    std::chrono::milliseconds _duration;
+    std::atomic<State> _state;
+};
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -16,6 +16,7 @@
 #include <Auth.hpp>
 #include <CommandControl.hpp>
 #include <Common.hpp>
+#include <DocumentCache.hpp>
 #include <Exceptions.hpp>
 #include <HostUtil.hpp>
 #include <HttpRequest.hpp>
@@ -47,6 +48,7 @@
 
 #include <cassert>
 #include <chrono>
+#include <cstdio>
 #include <memory>
 #include <string>
 
@@ -105,6 +107,7 @@ void WopiStorage::handleWOPIFileInfo(const WOPIFileInfo& wopiFileInfo, LockConte
 
     // If FileUrl is set, we use it for GetFile.
     _fileUrl = wopiFileInfo.getFileUrl();
+    _version = wopiFileInfo.getVersion();
 }
 
 WopiStorage::WOPIFileInfo::WOPIFileInfo(const FileInfo& fileInfo, Poco::JSON::Object::Ptr& object,
@@ -193,6 +196,7 @@ WopiStorage::WOPIFileInfo::WOPIFileInfo(const FileInfo& fileInfo, Poco::JSON::Ob
     JsonUtil::findJSONValue(object, "UserCanRename", _userCanRename);
     JsonUtil::findJSONValue(object, "BreadcrumbDocName", _breadcrumbDocName);
     JsonUtil::findJSONValue(object, "FileUrl", _fileUrl);
+    JsonUtil::findJSONValue(object, "Version", _version);
     JsonUtil::findJSONValue(object, "UserCanOnlyComment", _userCanOnlyComment);
 
     // check if user is admin on the integrator side
@@ -562,18 +566,7 @@ std::string WopiStorage::downloadDocument(const Poco::URI& uriObject, const std:
 
     http::Request httpRequest = StorageConnectionManager::createHttpRequest(uriObject, auth);
 
-    setRootFilePath(Poco::Path(getLocalRootPath(), getFileInfo().getFilename()).toString());
-    setRootFilePathAnonym(COOLWSD::anonymizeUrl(getRootFilePath()));
-
-    // Make sure the path is valid.
-    const Poco::Path downloadPath = Poco::Path(getRootFilePath()).parent();
-    Poco::File(downloadPath).createDirectories();
-
-    // Check for available space.
-    if (!FileUtil::checkDiskSpace(downloadPath.toString()))
-    {
-        throw StorageSpaceLowException("Low disk space for " + getRootFilePathAnonym());
-    }
+    prepareDownloadPath();
 
     LOG_TRC("Downloading from [" << uriAnonym << "] to [" << getRootFilePath()
                                  << "]: " << httpRequest.header());
@@ -634,6 +627,61 @@ std::string WopiStorage::downloadDocument(const Poco::URI& uriObject, const std:
     LOG_INF("WOPI::GetFile downloaded " << filesize << " bytes from [" << uriAnonym << "] -> "
                                         << getRootFilePathAnonym() << " in " << diff);
 
+    return completeDownload(wopiCert, subjectHash);
+}
+
+void WopiStorage::prepareDownloadPath()
+{
+    setRootFilePath(Poco::Path(getLocalRootPath(), getFileInfo().getFilename()).toString());
+    setRootFilePathAnonym(COOLWSD::anonymizeUrl(getRootFilePath()));
+
+    // Make sure the path is valid.
+    const Poco::Path downloadPath = Poco::Path(getRootFilePath()).parent();
+    Poco::File(downloadPath).createDirectories();
+
+    // Check for available space.
+    if (!FileUtil::checkDiskSpace(downloadPath.toString()))
+    {
+        throw StorageSpaceLowException("Low disk space for " + getRootFilePathAnonym());
+    }
+}
+
+std::string WopiStorage::adoptDownloadedFile(const std::string& filePath,
+                                             const std::string& wopiCert,
+                                             const std::string& subjectHash)
+{
+    prepareDownloadPath();
+
+    // The download directory is on the child-root, same as the jails,
+    // so this is normally a rename, rather than a copy.
+    if (::rename(filePath.c_str(), getRootFilePath().c_str()) != 0)
+    {
+        LOG_DBG("Failed to rename [" << COOLWSD::anonymizeUrl(filePath) << "] to ["
+                                     << getRootFilePathAnonym() << "], will copy instead");
+        if (!FileUtil::copy(filePath, getRootFilePath(), /*log=*/true, /*throw_on_error=*/false))
+            throw StorageConnectionException("WOPI::GetFile failed to move the downloaded "
+                                             "document into place");
+        FileUtil::removeFile(filePath);
+    }
+
+    LOG_INF("WOPI::GetFile adopted the downloaded document as " << getRootFilePathAnonym());
+    return completeDownload(wopiCert, subjectHash);
+}
+
+std::string WopiStorage::downloadFromCache(const std::string& cacheKey)
+{
+    prepareDownloadPath();
+
+    if (!DocumentCache::supplyDocument(cacheKey, getRootFilePath()))
+        return std::string();
+
+    // The certificate, if any, was supplied with the document.
+    return completeDownload(std::string(), std::string());
+}
+
+std::string WopiStorage::completeDownload(const std::string& wopiCert,
+                                          const std::string& subjectHash)
+{
     if (!wopiCert.empty() && !subjectHash.empty())
     {
         // Put the wopi server cert, which has been designated valid by 'online',
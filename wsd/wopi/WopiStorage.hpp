@@ -59,6 +59,7 @@ public:
         const std::string& getTemplateSource() const { return _templateSource; }
         const std::string& getBreadcrumbDocName() const { return _breadcrumbDocName; }
         const std::string& getFileUrl() const { return _fileUrl; }
+        const std::string& getVersion() const { return _version; }
         const std::string& getPostMessageOrigin() { return _postMessageOrigin; }
         const std::string& getHideUserList() { return _hideUserList; }
 
@@ -120,6 +121,8 @@ public:
         std::string _breadcrumbDocName;
         /// The optional FileUrl, used to download the document if provided.
         std::string _fileUrl;
+        /// The optional version of the document, which changes with its contents.
+        std::string _version;
         /// WOPI Post message property
         std::string _postMessageOrigin;
         /// If set to "true", user list on the status bar will be hidden
@@ -219,6 +222,20 @@ public:
     std::string downloadStorageFileToLocal(const Authorization& auth, LockContext& lockCtx,
                                            const std::string& templateUri) override;
 
+    /// Take over a document already downloaded by GetFile to @filePath,
+    /// moving it into the jail, instead of downloading it again.
+    /// Returns the jailed path, as downloadStorageFileToLocal does.
+    std::string adoptDownloadedFile(const std::string& filePath, const std::string& wopiCert,
+                                    const std::string& subjectHash);
+
+    /// Supply the document from the DocumentCache with the given key, if
+    /// cached, instead of downloading it. Returns the jailed path on a hit,
+    /// otherwise an empty string.
+    std::string downloadFromCache(const std::string& cacheKey);
+
+    /// The version of the document, as reported by CheckFileInfo, if any.
+    const std::string& getVersion() const { return _version; }
+
     std::size_t
     uploadLocalFileToStorageAsync(const Authorization& auth, LockContext& lockCtx,
                                   const std::string& saveAsPath, const std::string& saveAsFilename,
@@ -259,10 +276,20 @@ private:
     std::string downloadDocument(const Poco::URI& uriObject, const std::string& uriAnonym,
                                  const Authorization& auth, unsigned redirectLimit);
 
+    /// Set the local file path and make sure it is valid, with enough disk space.
+    void prepareDownloadPath();
+
+    /// Install the WOPI server certificate, if any, for the downloaded
+    /// document and mark it downloaded. Returns the jailed path.
+    std::string completeDownload(const std::string& wopiCert, const std::string& subjectHash);
+
 private:
     /// A URl provided by the WOPI host to use for GetFile.
     std::string _fileUrl;
 
+    /// The document version provided by the WOPI host, if any.
+    std::string _version;
+
     // Time spend in saving the file from storage
     std::chrono::milliseconds _wopiSaveDuration;
 